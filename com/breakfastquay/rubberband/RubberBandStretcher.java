@@ -102,6 +102,7 @@ public class RubberBandStretcher
     public static final int OptionThreadingAuto        = 0x00000000;
     public static final int OptionThreadingNever       = 0x00010000;
     public static final int OptionThreadingAlways      = 0x00020000;
+    public static final int OptionThreadingRealTime    = 0x00040000;
 
     public static final int OptionWindowStandard       = 0x00000000;
     public static final int OptionWindowShort          = 0x00100000;
@@ -62,6 +62,7 @@ namespace RubberBand
 			ThreadingAuto = 0x00000000,
 			ThreadingNever = 0x00010000,
 			ThreadingAlways = 0x00020000,
+			ThreadingRealTime = 0x00040000,
 
 			WindowStandard = 0x00000000,
 			WindowShort = 0x00100000,
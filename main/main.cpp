@@ -30,6 +30,8 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
+#include <memory>
 
 #include <fstream>
 
@@ -44,6 +46,19 @@
 #include <sys/time.h>
 #endif
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#endif
+
 #ifdef _WIN32
 using RubberBand::gettimeofday;
 #endif
@@ -82,7 +97,58 @@ double tempo_convert(const char *str)
     else return 1.0;
 }
 
-int main(int argc, char **argv)
+// Logger that sends stretcher log output to the stream of whichever
+// job is currently running, rather than always to cerr
+class JobLogger : public RubberBandStretcher::Logger
+{
+public:
+    JobLogger() : m_out(&cerr) { }
+
+    void setStream(std::ostream *out) {
+        m_out = (out ? out : &cerr);
+    }
+
+    void log(const char *message) override {
+        *m_out << "RubberBand: " << message << "\n";
+    }
+    void log(const char *message, double arg0) override {
+        auto prec = m_out->precision();
+        m_out->precision(10);
+        *m_out << "RubberBand: " << message << ": " << arg0 << "\n";
+        m_out->precision(prec);
+    }
+    void log(const char *message, double arg0, double arg1) override {
+        auto prec = m_out->precision();
+        m_out->precision(10);
+        *m_out << "RubberBand: " << message
+               << ": (" << arg0 << ", " << arg1 << ")" << "\n";
+        m_out->precision(prec);
+    }
+
+private:
+    std::ostream *m_out;
+};
+
+// State kept between jobs by a daemon (see runDaemon), so that each
+// job after the first finds its stretchers and FFT tuning ready
+struct Resident
+{
+    Resident() :
+        logger(std::make_shared<JobLogger>()),
+        pool(logger),
+        fftTuned(false) { }
+    
+    std::shared_ptr<JobLogger> logger;
+    RubberBandStretcher::Pool pool;
+    bool fftTuned;
+};
+
+// Process one file, as specified by the given command-line arguments,
+// writing diagnostic and progress output to err. This is the whole of
+// the program when run normally; a daemon calls it once per job, with
+// its resident state
+static int runJob(int argc, char **argv, std::ostream &err,
+                  Resident *resident)
 {
     double ratio = 1.0;
     double duration = 0.0;
@@ -115,6 +181,9 @@ int main(int argc, char **argv)
     std::string pitchMapFile;
     bool freqOrPitchMapSpecified = false;
 
+    std::string fftCacheFile;
+    std::string traceFile;
+
     enum {
         NoTransients,
         BandLimitedTransients,
@@ -138,6 +207,17 @@ int main(int argc, char **argv)
           myName.substr(myName.size() - 7, 7) == "-r3.exe") ||
          (myName.size() > 7 &&
           myName.substr(myName.size() - 7, 7) == "-R3.EXE"));
+
+    // A daemon parses a new argument list for each job, so getopt
+    // must start again from the beginning every time
+#ifdef __GLIBC__
+    optind = 0;
+#else
+    optind = 1;
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    optreset = 1;
+#endif
+#endif
     
     while (1) {
         int optionIndex = 0;
@@ -177,6 +257,8 @@ int main(int argc, char **argv)
             { "ignore-clipping", 0, 0, 'i' },
             { "fast",          0, 0, '2' },
             { "fine",          0, 0, '3' },
+            { "fft-cache",     1, 0, '&' },
+            { "trace",         1, 0, '!' },
             { 0, 0, 0, 0 }
         };
 
@@ -219,18 +301,20 @@ int main(int argc, char **argv)
         case 'i': ignoreClipping = true; break;
         case '2': faster = true; break;
         case '3': finer = true; break;
+        case '&': fftCacheFile = optarg; break;
+        case '!': traceFile = optarg; break;
         default:  help = true; break;
         }
     }
 
     if (version) {
-        cerr << RUBBERBAND_VERSION << endl;
+        err << RUBBERBAND_VERSION << endl;
         return 0;
     }
 
     if (freqOrPitchMapSpecified) {
         if (freqMapFile != "" && pitchMapFile != "") {
-            cerr << "ERROR: Please specify either pitch map or frequency map, not both" << endl;
+            err << "ERROR: Please specify either pitch map or frequency map, not both" << endl;
             return 1;
         }
         haveRatio = true;
@@ -238,143 +322,155 @@ int main(int argc, char **argv)
     }
     
     if (help || fullHelp || !haveRatio || optind + 2 != argc) {
-        cerr << endl;
-	cerr << "Rubber Band" << endl;
-        cerr << "An audio time-stretching and pitch-shifting library and utility program." << endl;
-	cerr << "Copyright 2007-2022 Particular Programs Ltd." << endl;
-        cerr << endl;
-	cerr << "   Usage: " << myName << " [options] <infile.wav> <outfile.wav>" << endl;
-        cerr << endl;
-        cerr << "You must specify at least one of the following time and pitch ratio options:" << endl;
-        cerr << endl;
-        cerr << "  -t<X>, --time <X>       Stretch to X times original duration, or" << endl;
-        cerr << "  -T<X>, --tempo <X>      Change tempo by multiple X (same as --time 1/X), or" << endl;
-        cerr << "  -T<X>, --tempo <X>:<Y>  Change tempo from X to Y (same as --time X/Y), or" << endl;
-        cerr << "  -D<X>, --duration <X>   Stretch or squash to make output file X seconds long" << endl;
-        cerr << endl;
-        cerr << "  -p<X>, --pitch <X>      Raise pitch by X semitones, or" << endl;
-        cerr << "  -f<X>, --frequency <X>  Change frequency by multiple X" << endl;
-        cerr << endl;
-        cerr << "The following options provide ways of making the time and frequency ratios" << endl;
-        cerr << "change during the audio:" << endl;
-        cerr << endl;
-        cerr << "  -M<F>, --timemap <F>    Use file F as the source for time map" << endl;
-        cerr << endl;
-        cerr << "  A time map (or key-frame map) file contains a series of lines, each with two" << endl;
-        cerr << "  sample frame numbers separated by a single space. These are source and" << endl;
-        cerr << "  target frames for fixed time points within the audio data, defining a varying" << endl;
-        cerr << "  stretch factor through the audio. When supplying a time map you must specify" << endl;
-        cerr << "  an overall stretch factor using -t, -T, or -D as well, to determine the" << endl;
-        cerr << "  total output duration." << endl;
-        cerr << endl;
-        cerr << "         --pitchmap <F>   Use file F as the source for pitch map" << endl;
-        cerr << endl;
-        cerr << "  A pitch map file contains a series of lines, each with two values: the input" << endl;
-        cerr << "  sample frame number and a pitch offset in semitones, separated by a single" << endl;
-        cerr << "  space. These specify a varying pitch factor through the audio. The offsets" << endl;
-        cerr << "  are all relative to an initial offset specified by the pitch or frequency" << endl;
-        cerr << "  option, or relative to no shift if neither was specified. Offsets are" << endl;
-        cerr << "  not cumulative. This option implies realtime mode (-R) and also enables a" << endl;
-        cerr << "  high-consistency pitch shifting mode, appropriate for dynamic pitch changes." << endl;
-        cerr << "  Because of the use of realtime mode, the overall duration will not be exact." << endl;
-        cerr << endl;
-        cerr << "         --freqmap <F>    Use file F as the source for frequency map" << endl;
-        cerr << endl;
-        cerr << "  A frequency map file is like a pitch map, except that its second column" << endl;
-        cerr << "  lists frequency multipliers rather than pitch offsets (like the difference" << endl;
-        cerr << "  between pitch and frequency options above)." << endl;
-        cerr << endl;
-        cerr << "The following options affect the sound manipulation and quality:" << endl;
-        cerr << endl;
-        cerr << "  -2,    --fast           Use the R2 (faster) engine" << endl;
-        cerr << endl;
-        cerr << "  This is the default (for backward compatibility) when this tool is invoked" << endl;
-        cerr << "  as \"rubberband\". It was the only engine available in versions prior to v3.0." << endl;
-        cerr << endl;
-        cerr << "  -3,    --fine           Use the R3 (finer) engine" << endl;
-        cerr << endl;
-        cerr << "  This is the default when this tool is invoked as \"rubberband-r3\". It almost" << endl;
-        cerr << "  always produces better results than the R2 engine, but with significantly" << endl;
-        cerr << "  higher CPU load." << endl;
-        cerr << endl;
-        cerr << "  -F,    --formant        Enable formant preservation when pitch shifting" << endl;
-        cerr << endl;
-        cerr << "  This option attempts to keep the formant envelope unchanged when changing" << endl;
-        cerr << "  the pitch, retaining the original timbre of vocals and instruments in a" << endl;
-        cerr << "  recognisable way." << endl;
-        cerr << endl;
+        err << endl;
+	err << "Rubber Band" << endl;
+        err << "An audio time-stretching and pitch-shifting library and utility program." << endl;
+	err << "Copyright 2007-2022 Particular Programs Ltd." << endl;
+        err << endl;
+	err << "   Usage: " << myName << " [options] <infile.wav> <outfile.wav>" << endl;
+        err << endl;
+        err << "You must specify at least one of the following time and pitch ratio options:" << endl;
+        err << endl;
+        err << "  -t<X>, --time <X>       Stretch to X times original duration, or" << endl;
+        err << "  -T<X>, --tempo <X>      Change tempo by multiple X (same as --time 1/X), or" << endl;
+        err << "  -T<X>, --tempo <X>:<Y>  Change tempo from X to Y (same as --time X/Y), or" << endl;
+        err << "  -D<X>, --duration <X>   Stretch or squash to make output file X seconds long" << endl;
+        err << endl;
+        err << "  -p<X>, --pitch <X>      Raise pitch by X semitones, or" << endl;
+        err << "  -f<X>, --frequency <X>  Change frequency by multiple X" << endl;
+        err << endl;
+        err << "The following options provide ways of making the time and frequency ratios" << endl;
+        err << "change during the audio:" << endl;
+        err << endl;
+        err << "  -M<F>, --timemap <F>    Use file F as the source for time map" << endl;
+        err << endl;
+        err << "  A time map (or key-frame map) file contains a series of lines, each with two" << endl;
+        err << "  sample frame numbers separated by a single space. These are source and" << endl;
+        err << "  target frames for fixed time points within the audio data, defining a varying" << endl;
+        err << "  stretch factor through the audio. When supplying a time map you must specify" << endl;
+        err << "  an overall stretch factor using -t, -T, or -D as well, to determine the" << endl;
+        err << "  total output duration." << endl;
+        err << endl;
+        err << "         --pitchmap <F>   Use file F as the source for pitch map" << endl;
+        err << endl;
+        err << "  A pitch map file contains a series of lines, each with two values: the input" << endl;
+        err << "  sample frame number and a pitch offset in semitones, separated by a single" << endl;
+        err << "  space. These specify a varying pitch factor through the audio. The offsets" << endl;
+        err << "  are all relative to an initial offset specified by the pitch or frequency" << endl;
+        err << "  option, or relative to no shift if neither was specified. Offsets are" << endl;
+        err << "  not cumulative. This option implies realtime mode (-R) and also enables a" << endl;
+        err << "  high-consistency pitch shifting mode, appropriate for dynamic pitch changes." << endl;
+        err << "  Because of the use of realtime mode, the overall duration will not be exact." << endl;
+        err << endl;
+        err << "         --freqmap <F>    Use file F as the source for frequency map" << endl;
+        err << endl;
+        err << "  A frequency map file is like a pitch map, except that its second column" << endl;
+        err << "  lists frequency multipliers rather than pitch offsets (like the difference" << endl;
+        err << "  between pitch and frequency options above)." << endl;
+        err << endl;
+        err << "The following options affect the sound manipulation and quality:" << endl;
+        err << endl;
+        err << "  -2,    --fast           Use the R2 (faster) engine" << endl;
+        err << endl;
+        err << "  This is the default (for backward compatibility) when this tool is invoked" << endl;
+        err << "  as \"rubberband\". It was the only engine available in versions prior to v3.0." << endl;
+        err << endl;
+        err << "  -3,    --fine           Use the R3 (finer) engine" << endl;
+        err << endl;
+        err << "  This is the default when this tool is invoked as \"rubberband-r3\". It almost" << endl;
+        err << "  always produces better results than the R2 engine, but with significantly" << endl;
+        err << "  higher CPU load." << endl;
+        err << endl;
+        err << "  -F,    --formant        Enable formant preservation when pitch shifting" << endl;
+        err << endl;
+        err << "  This option attempts to keep the formant envelope unchanged when changing" << endl;
+        err << "  the pitch, retaining the original timbre of vocals and instruments in a" << endl;
+        err << "  recognisable way." << endl;
+        err << endl;
         if (fullHelp || !isR3) {
-            cerr << "  -c<N>, --crisp <N>      Crispness (N = 0,1,2,3,4,5,6); default 5" << endl;
-            cerr << endl;
-            cerr << "  This option only has an effect when using the R2 (faster) engine. See below" << endl;
-            cerr << "  for details of the different levels." << endl;
-            cerr << endl;
+            err << "  -c<N>, --crisp <N>      Crispness (N = 0,1,2,3,4,5,6); default 5" << endl;
+            err << endl;
+            err << "  This option only has an effect when using the R2 (faster) engine. See below" << endl;
+            err << "  for details of the different levels." << endl;
+            err << endl;
         }
         if (fullHelp) {
-            cerr << "The remaining options fine-tune the processing mode and stretch algorithm." << endl;
-            cerr << "The default is to use none of these options." << endl;
-            cerr << "The options marked (2) currently only have an effect when using the R2 engine" << endl;
-            cerr << "(see -2, -3 options above)." << endl;
-            cerr << endl;
-            cerr << "  -R,    --realtime       Select realtime mode (implies --no-threads)." << endl;
-            cerr << "                          This utility does not do realtime stream processing;" << endl;
-            cerr << "                          the option merely selects realtime mode for the" << endl;
-            cerr << "                          stretcher it uses" << endl;
-            cerr << "(2)      --no-threads     No extra threads regardless of CPU and channel count" << endl;
-            cerr << "(2)      --threads        Assume multi-CPU even if only one CPU is identified" << endl;
-            cerr << "(2)      --no-transients  Disable phase resynchronisation at transients" << endl;
-            cerr << "(2)      --bl-transients  Band-limit phase resync to extreme frequencies" << endl;
-            cerr << "(2)      --no-lamination  Disable phase lamination" << endl;
-            cerr << "(2)      --window-long    Use longer processing window (actual size may vary)" << endl;
-            cerr << "(2)      --window-short   Use shorter processing window" << endl;
-            cerr << "(2)      --smoothing      Apply window presum and time-domain smoothing" << endl;
-            cerr << "(2)      --detector-perc  Use percussive transient detector (as in pre-1.5)" << endl;
-            cerr << "(2)      --detector-soft  Use soft transient detector" << endl;
-            cerr << "         --pitch-hq       In RT mode, use a slower, higher quality pitch shift" << endl;
-            cerr << "         --centre-focus   Preserve focus of centre material in stereo" << endl;
-            cerr << "                          (at a cost in width and individual channel quality)" << endl;
-            cerr << "         --ignore-clipping Ignore clipping at output; the default is to restart" << endl;
-            cerr << "                          with reduced gain if clipping occurs" << endl;
-            cerr << "  -L,    --loose          [Accepted for compatibility but ignored; always off]" << endl;
-            cerr << "  -P,    --precise        [Accepted for compatibility but ignored; always on]" << endl;
-            cerr << endl;
-            cerr << "  -d<N>, --debug <N>      Select debug level (N = 0,1,2,3); default 0, full 3" << endl;
-            cerr << "                          (N.B. debug level 3 includes audible ticks in output)" << endl;
-            cerr << endl;
-        }
-        cerr << "The following options are for output control and administration:" << endl;
-        cerr << endl;
-        cerr << "  -q,    --quiet          Suppress progress output" << endl;
-        cerr << "  -V,    --version        Show version number and exit" << endl;
-        cerr << "  -h,    --help           Show the normal help output" << endl;
-        cerr << "  -H,    --full-help      Show the full help output" << endl;
-        cerr << endl;
+            err << "The remaining options fine-tune the processing mode and stretch algorithm." << endl;
+            err << "The default is to use none of these options." << endl;
+            err << "The options marked (2) currently only have an effect when using the R2 engine" << endl;
+            err << "(see -2, -3 options above)." << endl;
+            err << endl;
+            err << "  -R,    --realtime       Select realtime mode (implies --no-threads)." << endl;
+            err << "                          This utility does not do realtime stream processing;" << endl;
+            err << "                          the option merely selects realtime mode for the" << endl;
+            err << "                          stretcher it uses" << endl;
+            err << "(2)      --no-threads     No extra threads regardless of CPU and channel count" << endl;
+            err << "(2)      --threads        Assume multi-CPU even if only one CPU is identified" << endl;
+            err << "(2)      --no-transients  Disable phase resynchronisation at transients" << endl;
+            err << "(2)      --bl-transients  Band-limit phase resync to extreme frequencies" << endl;
+            err << "(2)      --no-lamination  Disable phase lamination" << endl;
+            err << "(2)      --window-long    Use longer processing window (actual size may vary)" << endl;
+            err << "(2)      --window-short   Use shorter processing window" << endl;
+            err << "(2)      --smoothing      Apply window presum and time-domain smoothing" << endl;
+            err << "(2)      --detector-perc  Use percussive transient detector (as in pre-1.5)" << endl;
+            err << "(2)      --detector-soft  Use soft transient detector" << endl;
+            err << "         --pitch-hq       In RT mode, use a slower, higher quality pitch shift" << endl;
+            err << "         --centre-focus   Preserve focus of centre material in stereo" << endl;
+            err << "                          (at a cost in width and individual channel quality)" << endl;
+            err << "         --ignore-clipping Ignore clipping at output; the default is to restart" << endl;
+            err << "                          with reduced gain if clipping occurs" << endl;
+            err << "  -L,    --loose          [Accepted for compatibility but ignored; always off]" << endl;
+            err << "  -P,    --precise        [Accepted for compatibility but ignored; always on]" << endl;
+            err << endl;
+            err << "  -d<N>, --debug <N>      Select debug level (N = 0,1,2,3); default 0, full 3" << endl;
+            err << "                          (N.B. debug level 3 includes audible ticks in output)" << endl;
+            err << endl;
+        }
+        err << "The following options are for output control and administration:" << endl;
+        err << endl;
+        err << "  -q,    --quiet          Suppress progress output" << endl;
+        err << "         --fft-cache <F>  Use FFT implementation choices from file F, first" << endl;
+        err << "                          timing the available implementations and writing" << endl;
+        err << "                          F if it does not exist yet" << endl;
+        err << "         --trace <F>      Record the timing of each processing stage and" << endl;
+        err << "                          write it to F as Chrome trace-event JSON" << endl;
+        err << "         --daemon <S>     Stay resident, running the jobs passed through" << endl;
+        err << "                          Unix socket S by invocations using --client" << endl;
+        err << "         --daemon-workers <N>  With --daemon, run up to N jobs at once in" << endl;
+        err << "                          separate processes (default is one per CPU)" << endl;
+        err << "         --client <S>     Pass this job to the daemon listening on socket S" << endl;
+        err << "                          instead of processing it here. This saves the" << endl;
+        err << "                          start-up cost when processing many short files" << endl;
+        err << "  -V,    --version        Show version number and exit" << endl;
+        err << "  -h,    --help           Show the normal help output" << endl;
+        err << "  -H,    --full-help      Show the full help output" << endl;
+        err << endl;
         if (fullHelp) {
-            cerr << "\"Crispness\" levels: (2)" << endl;
-            cerr << "  -c 0   equivalent to --no-transients --no-lamination --window-long" << endl;
-            cerr << "  -c 1   equivalent to --detector-soft --no-lamination --window-long (for piano)" << endl;
-            cerr << "  -c 2   equivalent to --no-transients --no-lamination" << endl;
-            cerr << "  -c 3   equivalent to --no-transients" << endl;
-            cerr << "  -c 4   equivalent to --bl-transients" << endl;
-            cerr << "  -c 5   default processing options" << endl;
-            cerr << "  -c 6   equivalent to --no-lamination --window-short (may be good for drums)" << endl;
-            cerr << endl;
+            err << "\"Crispness\" levels: (2)" << endl;
+            err << "  -c 0   equivalent to --no-transients --no-lamination --window-long" << endl;
+            err << "  -c 1   equivalent to --detector-soft --no-lamination --window-long (for piano)" << endl;
+            err << "  -c 2   equivalent to --no-transients --no-lamination" << endl;
+            err << "  -c 3   equivalent to --no-transients" << endl;
+            err << "  -c 4   equivalent to --bl-transients" << endl;
+            err << "  -c 5   default processing options" << endl;
+            err << "  -c 6   equivalent to --no-lamination --window-short (may be good for drums)" << endl;
+            err << endl;
         } else {
-            cerr << "Numerous other options are available, mostly for tuning the behaviour of" << endl;
-            cerr << "the R2 engine. Run \"" << myName << " --full-help\" for details." << endl;
-            cerr << endl;
+            err << "Numerous other options are available, mostly for tuning the behaviour of" << endl;
+            err << "the R2 engine. Run \"" << myName << " --full-help\" for details." << endl;
+            err << endl;
         }            
         return 2;
     }
 
     if (ratio <= 0.0) {
-        cerr << "ERROR: Invalid time ratio " << ratio << endl;
+        err << "ERROR: Invalid time ratio " << ratio << endl;
         return 1;
     }
         
     if (faster && finer) {
-        cerr << "WARNING: Both fast (R2) and fine (R3) engines selected, will use default for" << endl;
-        cerr << "         this tool (" << (isR3 ? "fine" : "fast") << ")" << endl;
+        err << "WARNING: Both fast (R2) and fine (R3) engines selected, will use default for" << endl;
+        err << "         this tool (" << (isR3 ? "fine" : "fast") << ")" << endl;
         faster = false;
         finer = false;
     }
@@ -390,19 +486,19 @@ int main(int argc, char **argv)
     }
 
     if (crispness >= 0 && crispchanged) {
-        cerr << "WARNING: Both crispness option and transients, lamination or window options" << endl;
-        cerr << "         provided -- crispness will override these other options" << endl;
+        err << "WARNING: Both crispness option and transients, lamination or window options" << endl;
+        err << "         provided -- crispness will override these other options" << endl;
     }
 
     if (hqpitch && freqOrPitchMapSpecified) {
-        cerr << "WARNING: High-quality pitch mode selected, but frequency or pitch map file is" << endl;
-        cerr << "         provided -- pitch mode will be overridden by high-consistency mode" << endl;
+        err << "WARNING: High-quality pitch mode selected, but frequency or pitch map file is" << endl;
+        err << "         provided -- pitch mode will be overridden by high-consistency mode" << endl;
         hqpitch = false;
     }
 
     if (precisiongiven) {
-        cerr << "NOTE: The -L/--loose and -P/--precise options are both ignored -- precise" << endl;
-        cerr << "      became the default in v1.6 and loose was removed in v3.0" << endl;
+        err << "NOTE: The -L/--loose and -P/--precise options are both ignored -- precise" << endl;
+        err << "      became the default in v1.6 and loose was removed in v3.0" << endl;
     }
     
     switch (crispness) {
@@ -418,20 +514,20 @@ int main(int argc, char **argv)
 
     if (!quiet) {
         if (finer) {
-            cerr << "Using R3 (finer) engine" << endl;
+            err << "Using R3 (finer) engine" << endl;
         } else {
-            cerr << "Using R2 (faster) engine" << endl;
-            cerr << "Using crispness level: " << crispness << " (";
+            err << "Using R2 (faster) engine" << endl;
+            err << "Using crispness level: " << crispness << " (";
             switch (crispness) {
-            case 0: cerr << "Mushy"; break;
-            case 1: cerr << "Piano"; break;
-            case 2: cerr << "Smooth"; break;
-            case 3: cerr << "Balanced multitimbral mixture"; break;
-            case 4: cerr << "Unpitched percussion with stable notes"; break;
-            case 5: cerr << "Crisp monophonic instrumental"; break;
-            case 6: cerr << "Unpitched solo percussion"; break;
+            case 0: err << "Mushy"; break;
+            case 1: err << "Piano"; break;
+            case 2: err << "Smooth"; break;
+            case 3: err << "Balanced multitimbral mixture"; break;
+            case 4: err << "Unpitched percussion with stable notes"; break;
+            case 5: err << "Crisp monophonic instrumental"; break;
+            case 6: err << "Unpitched solo percussion"; break;
             }
-            cerr << ")" << endl;
+            err << ")" << endl;
         }
     }
 
@@ -439,8 +535,8 @@ int main(int argc, char **argv)
     if (timeMapFile != "") {
         std::ifstream ifile(timeMapFile.c_str());
         if (!ifile.is_open()) {
-            cerr << "ERROR: Failed to open time map file \""
-                 << timeMapFile << "\"" << endl;
+            err << "ERROR: Failed to open time map file \""
+                << timeMapFile << "\"" << endl;
             return 1;
         }
         std::string line;
@@ -456,8 +552,8 @@ int main(int argc, char **argv)
             }
             std::string::size_type i = line.find_first_of(" ");
             if (i == std::string::npos) {
-                cerr << "ERROR: Time map file \"" << timeMapFile
-                     << "\" is malformed at line " << lineno << endl;
+                err << "ERROR: Time map file \"" << timeMapFile
+                    << "\" is malformed at line " << lineno << endl;
                 return 1;
             }
             size_t source = atoi(line.substr(0, i).c_str());
@@ -465,14 +561,14 @@ int main(int argc, char **argv)
             size_t target = atoi(line.substr(i).c_str());
             timeMap[source] = target;
             if (debug > 0) {
-                cerr << "adding mapping from " << source << " to " << target << endl;
+                err << "adding mapping from " << source << " to " << target << endl;
             }
             ++lineno;
         }
         ifile.close();
 
         if (!quiet) {
-            cerr << "Read " << timeMap.size() << " line(s) from time map file" << endl;
+            err << "Read " << timeMap.size() << " line(s) from time map file" << endl;
         }
     }
 
@@ -487,7 +583,7 @@ int main(int argc, char **argv)
         }
         std::ifstream ifile(file.c_str());
         if (!ifile.is_open()) {
-            cerr << "ERROR: Failed to open map file \"" << file << "\"" << endl;
+            err << "ERROR: Failed to open map file \"" << file << "\"" << endl;
             return 1;
         }
         std::string line;
@@ -503,8 +599,8 @@ int main(int argc, char **argv)
             }
             std::string::size_type i = line.find_first_of(" ");
             if (i == std::string::npos) {
-                cerr << "ERROR: Map file \"" << file
-                     << "\" is malformed at line " << lineno << endl;
+                err << "ERROR: Map file \"" << file
+                    << "\" is malformed at line " << lineno << endl;
                 return 1;
             }
             size_t source = atoi(line.substr(0, i).c_str());
@@ -515,19 +611,21 @@ int main(int argc, char **argv)
             }
             freqMap[source] = freq;
             if (debug > 0) {
-                cerr << "adding mapping for source frame " << source << " of frequency multiplier " << freq << endl;
+                err << "adding mapping for source frame " << source << " of frequency multiplier " << freq << endl;
             }
             ++lineno;
         }
         ifile.close();
 
         if (!quiet) {
-            cerr << "Read " << freqMap.size() << " line(s) from frequency map file" << endl;
+            err << "Read " << freqMap.size() << " line(s) from frequency map file" << endl;
         }
     }
 
-    char *fileName = strdup(argv[optind++]);
-    char *fileNameOut = strdup(argv[optind++]);
+    // Held as strings, so that nothing needs freeing on the early
+    // returns below, which in daemon mode would otherwise leak
+    std::string fileName = argv[optind++];
+    std::string fileNameOut = argv[optind++];
 
     SNDFILE *sndfile;
     SNDFILE *sndfileOut;
@@ -536,21 +634,23 @@ int main(int argc, char **argv)
     memset(&sfinfo, 0, sizeof(SF_INFO));
     memset(&sfinfoOut, 0, sizeof(SF_INFO));
 
-    sndfile = sf_open(fileName, SFM_READ, &sfinfo);
+    sndfile = sf_open(fileName.c_str(), SFM_READ, &sfinfo);
     if (!sndfile) {
-        cerr << "ERROR: Failed to open input file \"" << fileName << "\": "
-             << sf_strerror(sndfile) << endl;
+        err << "ERROR: Failed to open input file \"" << fileName << "\": "
+            << sf_strerror(sndfile) << endl;
         return 1;
     }
 
     if (sfinfo.samplerate == 0) {
-        cerr << "ERROR: File lacks sample rate in header" << endl;
+        err << "ERROR: File lacks sample rate in header" << endl;
+        sf_close(sndfile);
         return 1;
     }
 
     if (duration != 0.0) {
         if (sfinfo.frames == 0) {
-            cerr << "ERROR: File lacks frame count in header, cannot use --duration" << endl;
+            err << "ERROR: File lacks frame count in header, cannot use --duration" << endl;
+            sf_close(sndfile);
             return 1;
         }
         double induration = double(sfinfo.frames) / double(sfinfo.samplerate);
@@ -564,10 +664,11 @@ int main(int argc, char **argv)
     sfinfoOut.sections = sfinfo.sections;
     sfinfoOut.seekable = sfinfo.seekable;
     
-    sndfileOut = sf_open(fileNameOut, SFM_WRITE, &sfinfoOut) ;
+    sndfileOut = sf_open(fileNameOut.c_str(), SFM_WRITE, &sfinfoOut) ;
     if (!sndfileOut) {
-        cerr << "ERROR: Failed to open output file \"" << fileNameOut << "\" for writing: "
-             << sf_strerror(sndfileOut) << endl;
+        err << "ERROR: Failed to open output file \"" << fileNameOut << "\" for writing: "
+            << sf_strerror(sndfileOut) << endl;
+        sf_close(sndfile);
         return 1;
     }
 
@@ -630,12 +731,12 @@ int main(int argc, char **argv)
         frequencyshift *= pow(2.0, pitchshift / 12.0);
     }
 
-    cerr << "Using time ratio " << ratio;
+    err << "Using time ratio " << ratio;
 
     if (!freqOrPitchMapSpecified) {
-        cerr << " and frequency ratio " << frequencyshift << endl;
+        err << " and frequency ratio " << frequencyshift << endl;
     } else {
-        cerr << " and initial frequency ratio " << frequencyshift << endl;
+        err << " and initial frequency ratio " << frequencyshift << endl;
     }
     
 #ifdef _WIN32
@@ -646,6 +747,23 @@ int main(int argc, char **argv)
     
     RubberBandStretcher::setDefaultDebugLevel(debug);
 
+    // The tuning is global, so a daemon need only load it once
+    if (fftCacheFile != "" && !(resident && resident->fftTuned)) {
+        if (!RubberBandStretcher::loadFFTTuning(fftCacheFile)) {
+            if (!quiet) {
+                err << "Timing FFT implementations..." << endl;
+            }
+            if (!RubberBandStretcher::tuneFFT(sfinfo.samplerate,
+                                              fftCacheFile)) {
+                err << "WARNING: Failed to write FFT cache file \""
+                    << fftCacheFile << "\"" << endl;
+            }
+        }
+        if (resident) {
+            resident->fftTuned = true;
+        }
+    }
+
     size_t countIn = 0, countOut = 0;
 
     float gain = 1.f;
@@ -660,14 +778,48 @@ int main(int argc, char **argv)
     }
     float *ibuf = new float[channels * bs];
 
+    auto deleteBuffers = [&]() {
+        delete[] ibuf;
+        for (size_t c = 0; c < channels; ++c) {
+            delete[] cbuf[c];
+        }
+        delete[] cbuf;
+    };
+
     int thisBlockSize;
 
     while (!successful) { // we may have to repeat with a modified
                           // gain, if clipping occurs
         successful = true;
 
-        RubberBandStretcher ts(sfinfo.samplerate, channels, options,
-                               ratio, frequencyshift);
+        if (traceFile != "") {
+            // Restarting discards any trace from a pass abandoned
+            // because of clipping
+            RubberBandStretcher::startTrace();
+        }
+
+        std::shared_ptr<RubberBandStretcher> stretcher;
+        
+        if (resident && debug == 0) {
+            // Reuse a stretcher from an earlier job with the same
+            // rate, channel count and options, if there is one. The
+            // pool's stretchers keep the debug level they were made
+            // with, so jobs wanting debug output get one of their
+            // own. Resetting after setting the ratios makes the
+            // result the same as for a stretcher constructed with them
+            stretcher = resident->pool.acquire(sfinfo.samplerate, channels,
+                                               options);
+            stretcher->setTimeRatio(ratio);
+            stretcher->setPitchScale(frequencyshift);
+            stretcher->reset();
+        } else {
+            stretcher = std::make_shared<RubberBandStretcher>
+                (sfinfo.samplerate, channels,
+                 resident ? resident->logger : nullptr,
+                 options, ratio, frequencyshift);
+        }
+        
+        RubberBandStretcher &ts = *stretcher;
         ts.setExpectedInputDuration(sfinfo.frames);
 
         int frame = 0;
@@ -676,7 +828,7 @@ int main(int argc, char **argv)
         if (!realtime) {
 
             if (!quiet) {
-                cerr << "Pass 1: Studying..." << endl;
+                err << "Pass 1: Studying..." << endl;
             }
 
             while (frame < sfinfo.frames) {
@@ -698,7 +850,7 @@ int main(int argc, char **argv)
                 if (p > percent || frame == 0) {
                     percent = p;
                     if (!quiet) {
-                        cerr << "\r" << percent << "% ";
+                        err << "\r" << percent << "% ";
                     }
                 }
 
@@ -706,7 +858,7 @@ int main(int argc, char **argv)
             }
 
             if (!quiet) {
-                cerr << "\rCalculating profile..." << endl;
+                err << "\rCalculating profile..." << endl;
             }
 
             sf_seek(sndfile, 0, SEEK_SET);
@@ -732,9 +884,9 @@ int main(int argc, char **argv)
         if (realtime) {
             int toPad = ts.getPreferredStartPad();
             if (debug > 0) {
-                cerr << "padding start with " << toPad
-                     << " samples in RT mode, will drop " << toDrop
-                     << " at output" << endl;
+                err << "padding start with " << toPad
+                    << " samples in RT mode, will drop " << toDrop
+                    << " at output" << endl;
             }
             if (toPad > 0) {
                 for (size_t c = 0; c < channels; ++c) {
@@ -760,10 +912,10 @@ int main(int argc, char **argv)
                 if (nextFreqFrame <= countIn) {
                     double s = frequencyshift * freqMapItr->second;
                     if (debug > 0) {
-                        cerr << "at frame " << countIn
-                             << " (requested at " << freqMapItr->first
-                             << " [NOT] plus latency " << ts.getLatency()
-                             << ") updating frequency ratio to " << s << endl;
+                        err << "at frame " << countIn
+                            << " (requested at " << freqMapItr->first
+                            << " [NOT] plus latency " << ts.getLatency()
+                            << ") updating frequency ratio to " << s << endl;
                     }
                     ts.setPitchScale(s);
                     ++freqMapItr;
@@ -791,7 +943,7 @@ int main(int argc, char **argv)
             bool final = (frame + thisBlockSize >= sfinfo.frames);
 
             if (debug > 2) {
-                cerr << "count = " << count << ", bs = " << thisBlockSize << ", frame = " << frame << ", frames = " << sfinfo.frames << ", final = " << final << endl;
+                err << "count = " << count << ", bs = " << thisBlockSize << ", frame = " << frame << ", frames = " << sfinfo.frames << ", final = " << final << endl;
             }
 
             ts.process(cbuf, count, final);
@@ -799,7 +951,7 @@ int main(int argc, char **argv)
             int avail;
             while ((avail = ts.available()) > 0) {
                 if (debug > 1) {
-                    cerr << "available = " << avail << endl;
+                    err << "available = " << avail << endl;
                 }
 
                 thisBlockSize = avail;
@@ -813,8 +965,8 @@ int main(int argc, char **argv)
                         dropHere = thisBlockSize;
                     }
                     if (debug > 1) {
-                        cerr << "toDrop = " << toDrop << ", dropping "
-                             << dropHere << " of " << avail << endl;
+                        err << "toDrop = " << toDrop << ", dropping "
+                            << dropHere << " of " << avail << endl;
                     }
                     ts.retrieve(cbuf, dropHere);
                     toDrop -= dropHere;
@@ -823,7 +975,7 @@ int main(int argc, char **argv)
                 }
                 
                 if (debug > 2) {
-                    cerr << "retrieving block of " << thisBlockSize << endl;
+                    err << "retrieving block of " << thisBlockSize << endl;
                 }
                 ts.retrieve(cbuf, thisBlockSize);
                 
@@ -831,15 +983,15 @@ int main(int argc, char **argv)
                     // (in offline mode the stretcher handles this itself)
                     size_t ideal = size_t(countIn * ratio);
                     if (debug > 2) {
-                        cerr << "at end, ideal = " << ideal
-                             << ", countOut = " << countOut
-                             << ", thisBlockSize = " << thisBlockSize << endl;
+                        err << "at end, ideal = " << ideal
+                            << ", countOut = " << countOut
+                            << ", thisBlockSize = " << thisBlockSize << endl;
                     }
                     if (countOut + thisBlockSize > ideal) {
                         thisBlockSize = ideal - countOut;
                         if (debug > 1) {
-                            cerr << "truncated final block to " << thisBlockSize
-                                 << endl;
+                            err << "truncated final block to " << thisBlockSize
+                                << endl;
                         }
                     }
                 }
@@ -867,18 +1019,18 @@ int main(int argc, char **argv)
             if (clipping) {
                 const float mingain = 0.75f;
                 if (gain < mingain) {
-                    cerr << "NOTE: Clipping detected at output sample "
-                         << countOut << ", but not reducing gain as it would "
-                         << "mean dropping below minimum " << mingain << endl;
+                    err << "NOTE: Clipping detected at output sample "
+                        << countOut << ", but not reducing gain as it would "
+                        << "mean dropping below minimum " << mingain << endl;
                     gain = mingain;
                     ignoreClipping = true;
                 } else {
                     if (!quiet) {
-                        cerr << "NOTE: Clipping detected at output sample "
-                             << countOut << ", restarting with "
-                             << "reduced gain of " << gain
-                             << " (supply --ignore-clipping to avoid this)"
-                             << endl;
+                        err << "NOTE: Clipping detected at output sample "
+                            << countOut << ", restarting with "
+                            << "reduced gain of " << gain
+                            << " (supply --ignore-clipping to avoid this)"
+                            << endl;
                     }
                 }
                 successful = false;
@@ -886,14 +1038,14 @@ int main(int argc, char **argv)
             }
             
             if (frame == 0 && !realtime && !quiet) {
-                cerr << "Pass 2: Processing..." << endl;
+                err << "Pass 2: Processing..." << endl;
             }
 
             int p = int((double(frame) * 100.0) / sfinfo.frames);
             if (p > percent || frame == 0) {
                 percent = p;
                 if (!quiet) {
-                    cerr << "\r" << percent << "% ";
+                    err << "\r" << percent << "% ";
                 }
             }
 
@@ -903,26 +1055,31 @@ int main(int argc, char **argv)
         if (!successful) {
             if (sf_seek(sndfile, 0, SEEK_SET) < 0) {
                 if (debug > 0) {
-                    cerr << "input file is not seekable: reopening" << endl;
+                    err << "input file is not seekable: reopening" << endl;
                 }
                 sf_close(sndfile);
-                sndfile = sf_open(fileName, SFM_READ, &sfinfo);
+                sndfile = sf_open(fileName.c_str(), SFM_READ, &sfinfo);
                 if (!sndfile) {
-                    cerr << "ERROR: Failed to reopen input file \""
-                         << fileName << "\": " << sf_strerror(sndfile) << endl;
+                    err << "ERROR: Failed to reopen input file \""
+                        << fileName << "\": " << sf_strerror(sndfile) << endl;
+                    sf_close(sndfileOut);
+                    deleteBuffers();
                     return 1;
                 }
             }
             if (sf_seek(sndfileOut, 0, SEEK_SET) < 0) {
                 if (debug > 0) {
-                    cerr << "output file is not seekable: reopening" << endl;
+                    err << "output file is not seekable: reopening" << endl;
                 }
                 sf_close(sndfileOut);
-                sndfileOut = sf_open(fileNameOut, SFM_WRITE, &sfinfoOut);
+                sndfileOut = sf_open(fileNameOut.c_str(), SFM_WRITE,
+                                     &sfinfoOut);
                 if (!sndfileOut) {
-                    cerr << "ERROR: Failed to reopen output file \""
-                         << fileNameOut << "\": "
-                         << sf_strerror(sndfileOut) << endl;
+                    err << "ERROR: Failed to reopen output file \""
+                        << fileNameOut << "\": "
+                        << sf_strerror(sndfileOut) << endl;
+                    sf_close(sndfile);
+                    deleteBuffers();
                     return 1;
                 }
             }
@@ -930,13 +1087,13 @@ int main(int argc, char **argv)
         }
     
         if (!quiet) {
-            cerr << "\r    " << endl;
+            err << "\r    " << endl;
         }
 
         int avail;
         while ((avail = ts.available()) >= 0) {
             if (debug > 1) {
-                cerr << "(completing) available = " << avail << endl;
+                err << "(completing) available = " << avail << endl;
             }
 
             if (avail == 0) {
@@ -970,26 +1127,23 @@ int main(int argc, char **argv)
         }
     }
 
-    delete[] ibuf;
-
-    for (size_t c = 0; c < channels; ++c) {
-        delete[] cbuf[c];
+    if (traceFile != "" && !RubberBandStretcher::stopTrace(traceFile)) {
+        err << "WARNING: Failed to write trace file \""
+            << traceFile << "\"" << endl;
     }
-    delete[] cbuf;
+
+    deleteBuffers();
 
     sf_close(sndfile);
     sf_close(sndfileOut);
 
-    free(fileName);
-    free(fileNameOut);
-
     if (!quiet) {
 
-        cerr << "in: " << countIn << ", out: " << countOut
-             << ", ratio: " << float(countOut)/float(countIn)
-             << ", ideal output: " << lrint(countIn * ratio)
-             << ", error: " << int(countOut) - lrint(countIn * ratio)
-             << endl;
+        err << "in: " << countIn << ", out: " << countOut
+            << ", ratio: " << float(countOut)/float(countIn)
+            << ", ideal output: " << lrint(countIn * ratio)
+            << ", error: " << int(countOut) - lrint(countIn * ratio)
+            << endl;
 
 #ifdef _WIN32
         RubberBand::
@@ -1005,9 +1159,9 @@ int main(int argc, char **argv)
         etv.tv_usec -= tv.tv_usec;
         
         double sec = double(etv.tv_sec) + (double(etv.tv_usec) / 1000000.0);
-        cerr << "elapsed time: " << sec << " sec, in frames/sec: "
-             << int64_t(countIn/sec) << ", out frames/sec: "
-             << int64_t(countOut/sec) << endl;
+        err << "elapsed time: " << sec << " sec, in frames/sec: "
+            << int64_t(countIn/sec) << ", out frames/sec: "
+            << int64_t(countOut/sec) << endl;
     }
 
     RubberBand::Profiler::dump();
@@ -1015,4 +1169,545 @@ int main(int argc, char **argv)
     return 0;
 }
 
+#ifndef _WIN32
+
+// A job is sent to a daemon as a series of NUL-terminated strings:
+// the client's working directory, the number of arguments, and the
+// arguments themselves starting with the program name. The daemon
+// replies with the job's diagnostic and progress output as it goes,
+// then a NUL and the job's exit status in decimal.
+//
+// The daemon runs jobs in a set of worker processes, each serving one
+// client at a time, so a worker gives up on any client that does not
+// send its whole request within requestTimeoutMs, or that stops
+// reading its output for writeTimeoutSec
+
+static const int requestTimeoutMs = 10000;
+static const int writeTimeoutSec = 30;
+
+static bool
+writeAll(int fd, const char *data, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, data, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += w;
+        n -= w;
+    }
+    return true;
+}
+
+// Unbuffered stream buffer writing to a socket, so that progress
+// reaches the client as soon as it is written. If a write fails or
+// times out, the connection is shut down, so the client sees it end
+// and the rest of the job's output is discarded
+class SocketStreamBuf : public std::streambuf
+{
+public:
+    SocketStreamBuf(int fd) : m_fd(fd), m_failed(false) { }
+
+protected:
+    int overflow(int c) override {
+        if (c == traits_type::eof()) return traits_type::not_eof(c);
+        char ch = char(c);
+        if (!writeOut(&ch, 1)) return traits_type::eof();
+        return c;
+    }
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        if (!writeOut(s, size_t(n))) return 0;
+        return n;
+    }
+
+private:
+    bool writeOut(const char *data, size_t n) {
+        if (m_failed) return false;
+        if (!writeAll(m_fd, data, n)) {
+            shutdown(m_fd, SHUT_RDWR);
+            m_failed = true;
+            return false;
+        }
+        return true;
+    }
+    
+    int m_fd;
+    bool m_failed;
+};
+
+static bool
+makeSocketAddress(const char *path, sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        cerr << "ERROR: Socket path \"" << path << "\" is too long" << endl;
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    return true;
+}
+
+static int
+connectToDaemon(const char *path)
+{
+    sockaddr_un addr;
+    if (!makeSocketAddress(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool
+readRequest(int fd, std::vector<std::string> &fields)
+{
+    const size_t maxRequestSize = 1048576;
+    const size_t maxArguments = 1000;
+
+    size_t expected = 2, total = 0;
+    std::string field;
+    char buf[4096];
 
+    auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(requestTimeoutMs);
+    
+    while (fields.size() < expected) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>
+            (deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) return false;
+        pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, int(remaining));
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return false;
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        total += n;
+        if (total > maxRequestSize) return false;
+        for (ssize_t i = 0; i < n && fields.size() < expected; ++i) {
+            if (buf[i] != '\0') {
+                field += buf[i];
+                continue;
+            }
+            fields.push_back(field);
+            field = "";
+            if (fields.size() == 2) {
+                int count = atoi(fields[1].c_str());
+                if (count < 1 || size_t(count) > maxArguments) return false;
+                expected += count;
+            }
+        }
+    }
+    
+    return true;
+}
+
+static void
+serveJob(int fd, Resident &resident)
+{
+    std::vector<std::string> fields;
+    if (!readRequest(fd, fields)) {
+        cerr << "WARNING: Ignoring malformed or incomplete job request"
+             << endl;
+        return;
+    }
+
+    SocketStreamBuf buf(fd);
+    std::ostream out(&buf);
+    int status = 1;
+
+    // Each worker process runs one job at a time, so we can simply
+    // run each in the client's working directory to resolve its
+    // relative paths
+    char here[PATH_MAX];
+    if (!getcwd(here, sizeof(here))) {
+        here[0] = '\0';
+    }
+    
+    if (chdir(fields[0].c_str()) != 0) {
+        out << "ERROR: Failed to change to working directory \""
+            << fields[0] << "\": " << strerror(errno) << endl;
+    } else {
+        std::vector<char *> args;
+        for (size_t i = 2; i < fields.size(); ++i) {
+            args.push_back(&fields[i][0]);
+        }
+        args.push_back(nullptr);
+        resident.logger->setStream(&out);
+        status = runJob(int(args.size()) - 1, args.data(), out, &resident);
+        resident.logger->setStream(nullptr);
+        if (here[0] && chdir(here) != 0) {
+            cerr << "WARNING: Failed to return to working directory \""
+                 << here << "\"" << endl;
+        }
+    }
+    
+    out << '\0' << status << std::flush;
+}
+
+// Only the user running the daemon may submit jobs to it. The socket
+// is created accessible to its owner alone, but where the platform
+// can tell us who is at the other end we check that as well
+static bool
+isPermittedPeer(int fd)
+{
+#if defined(__linux__)
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        return false;
+    }
+    return cred.uid == geteuid();
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) < 0) {
+        return false;
+    }
+    return uid == geteuid();
+#else
+    return true;
+#endif
+}
+
+// Accept and run jobs one at a time. This is the whole of the life of
+// a worker process, which has resident state of its own, and returns
+// only if the socket fails
+static void
+serveJobs(int fd)
+{
+    Resident resident;
+    
+    while (1) {
+        int client = accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            cerr << "ERROR: Failed to accept connection: "
+                 << strerror(errno) << endl;
+            return;
+        }
+        if (!isPermittedPeer(client)) {
+            cerr << "WARNING: Refusing connection from another user"
+                 << endl;
+            close(client);
+            continue;
+        }
+        timeval timeout;
+        timeout.tv_sec = writeTimeoutSec;
+        timeout.tv_usec = 0;
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO,
+                   &timeout, sizeof(timeout));
+        serveJob(client, resident);
+        close(client);
+    }
+}
+
+static volatile sig_atomic_t daemonStopping = 0;
+
+static void
+stopDaemon(int)
+{
+    daemonStopping = 1;
+}
+
+static void
+workerExited(int)
+{
+}
+
+// Fork a worker process to serve jobs on the socket. The caller has
+// the daemon's signals blocked, and the worker restores the default
+// handling for them along with the original signal mask
+static pid_t
+startWorker(int fd, const sigset_t &originalMask)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGHUP, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &originalMask, nullptr);
+        serveJobs(fd);
+        _exit(1);
+    }
+    if (pid < 0) {
+        cerr << "ERROR: Failed to start worker process: "
+             << strerror(errno) << endl;
+    }
+    return pid;
+}
+
+static int
+runDaemon(const char *path, int workerCount)
+{
+    sockaddr_un addr;
+    if (!makeSocketAddress(path, addr)) return 1;
+
+    // A socket left behind by a daemon that has gone away is
+    // replaced, but not one that still has a daemon listening, nor
+    // anything that is not a socket at all
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            cerr << "ERROR: \"" << path << "\" exists and is not a socket"
+                 << endl;
+            return 1;
+        }
+        int existing = connectToDaemon(path);
+        if (existing >= 0) {
+            close(existing);
+            cerr << "ERROR: A daemon is already listening on socket \""
+                 << path << "\"" << endl;
+            return 1;
+        }
+        unlink(path);
+    }
+
+    // Create the socket with owner-only permissions from the start,
+    // rather than changing them after it is already reachable
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t originalUmask = umask(0077);
+    bool bound = (fd >= 0 && bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+    umask(originalUmask);
+    if (!bound ||
+        chmod(path, S_IRUSR | S_IWUSR) < 0 ||
+        listen(fd, 64) < 0) {
+        cerr << "ERROR: Failed to listen on socket \"" << path << "\": "
+             << strerror(errno) << endl;
+        if (fd >= 0) close(fd);
+        if (bound) unlink(path);
+        return 1;
+    }
+
+    // A client that goes away mid-job should not take us with it
+    signal(SIGPIPE, SIG_IGN);
+
+    // The signals that stop the daemon, and the exit of a worker, are
+    // only delivered while we are waiting in sigsuspend below, so that
+    // none can arrive between our checking for them and waiting
+    sigset_t blocked, originalMask;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGHUP);
+    sigaddset(&blocked, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &blocked, &originalMask);
+    signal(SIGTERM, stopDaemon);
+    signal(SIGINT, stopDaemon);
+    signal(SIGHUP, stopDaemon);
+    signal(SIGCHLD, workerExited);
+
+    // Jobs run in separate processes rather than threads, because
+    // each changes to its client's working directory and may set
+    // library-wide state such as the default debug level
+    std::vector<pid_t> workers;
+    for (int i = 0; i < workerCount; ++i) {
+        pid_t pid = startWorker(fd, originalMask);
+        if (pid < 0) {
+            daemonStopping = 1;
+            break;
+        }
+        workers.push_back(pid);
+    }
+
+    if (!daemonStopping) {
+        cerr << "Listening for jobs on socket \"" << path << "\" with "
+             << workerCount << " worker process"
+             << (workerCount == 1 ? "" : "es") << endl;
+    }
+
+    int result = 0;
+    
+    while (!daemonStopping) {
+        int status = 0;
+        pid_t pid;
+        while (!daemonStopping &&
+               (pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (auto &w : workers) {
+                if (w != pid) continue;
+                if (WIFEXITED(status)) {
+                    // Its socket failed, so the others' will have too
+                    result = 1;
+                    daemonStopping = 1;
+                } else {
+                    // Killed, perhaps by a crash in a job: replace it
+                    cerr << "WARNING: Worker process " << pid
+                         << " was terminated, starting another" << endl;
+                    w = startWorker(fd, originalMask);
+                    if (w < 0) {
+                        result = 1;
+                        daemonStopping = 1;
+                    }
+                }
+            }
+        }
+        if (!daemonStopping) {
+            sigsuspend(&originalMask);
+        }
+    }
+
+    for (auto w : workers) {
+        if (w > 0) kill(w, SIGTERM);
+    }
+    for (auto w : workers) {
+        if (w > 0) waitpid(w, nullptr, 0);
+    }
+
+    close(fd);
+    unlink(path);
+    sigprocmask(SIG_SETMASK, &originalMask, nullptr);
+    return result;
+}
+
+static int
+runClient(const char *path, int argc, char **argv)
+{
+    int fd = connectToDaemon(path);
+    if (fd < 0) {
+        cerr << "ERROR: Failed to connect to daemon on socket \"" << path
+             << "\": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    
+    char here[PATH_MAX];
+    if (!getcwd(here, sizeof(here))) {
+        cerr << "ERROR: Failed to query working directory: "
+             << strerror(errno) << endl;
+        close(fd);
+        return 1;
+    }
+
+    std::string request(here);
+    request += '\0';
+    request += std::to_string(argc);
+    request += '\0';
+    for (int i = 0; i < argc; ++i) {
+        request += argv[i];
+        request += '\0';
+    }
+
+    if (!writeAll(fd, request.data(), request.size())) {
+        cerr << "ERROR: Failed to send job to daemon: "
+             << strerror(errno) << endl;
+        close(fd);
+        return 1;
+    }
+
+    bool haveStatus = false;
+    std::string status;
+    char buf[4096];
+
+    while (1) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        ssize_t i = 0;
+        if (!haveStatus) {
+            while (i < n && buf[i] != '\0') ++i;
+            cerr.write(buf, i);
+            cerr.flush();
+            if (i == n) continue;
+            haveStatus = true;
+            ++i;
+        }
+        status.append(buf + i, n - i);
+    }
+
+    close(fd);
+
+    if (!haveStatus || status == "") {
+        cerr << "ERROR: Lost connection to daemon before job completed"
+             << endl;
+        return 1;
+    }
+
+    return atoi(status.c_str());
+}
+
+#endif
+
+// Find and remove an option taking one argument, given either as
+// "--name value" or "--name=value", returning the value or null
+static const char *
+takeOption(int &argc, char **argv, const char *name)
+{
+    size_t len = strlen(name);
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--")) break;
+        if (strncmp(argv[i], name, len)) continue;
+        const char *value = nullptr;
+        int taken = 0;
+        if (argv[i][len] == '=') {
+            value = argv[i] + len + 1;
+            taken = 1;
+        } else if (argv[i][len] == '\0' && i + 1 < argc) {
+            value = argv[i + 1];
+            taken = 2;
+        } else {
+            continue;
+        }
+        for (int j = i; j + taken <= argc; ++j) {
+            argv[j] = argv[j + taken];
+        }
+        argc -= taken;
+        return value;
+    }
+    return nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    const char *daemonWorkers = takeOption(argc, argv, "--daemon-workers");
+    const char *daemonSocket = takeOption(argc, argv, "--daemon");
+    const char *clientSocket = takeOption(argc, argv, "--client");
+
+    if (daemonWorkers && !daemonSocket) {
+        cerr << "ERROR: --daemon-workers is only meaningful with --daemon" << endl;
+        return 1;
+    }
+
+    if (daemonSocket || clientSocket) {
+#ifdef _WIN32
+        cerr << "ERROR: Daemon and client modes are not supported on this platform" << endl;
+        return 1;
+#else
+        if (daemonSocket && clientSocket) {
+            cerr << "ERROR: Please specify either --daemon or --client, not both" << endl;
+            return 1;
+        }
+        if (daemonSocket) {
+            if (argc > 1) {
+                cerr << "ERROR: Options for processing are given to the client, not the daemon" << endl;
+                return 1;
+            }
+            int workers = 0;
+            if (daemonWorkers) {
+                workers = atoi(daemonWorkers);
+                if (workers < 1) {
+                    cerr << "ERROR: Invalid number of daemon workers \""
+                         << daemonWorkers << "\"" << endl;
+                    return 1;
+                }
+            } else {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                workers = (cpus > 1 ? int(cpus) : 1);
+            }
+            return runDaemon(daemonSocket, workers);
+        }
+        return runClient(clientSocket, argc, argv);
+#endif
+    }
+
+    return runJob(argc, argv, cerr, nullptr);
+}
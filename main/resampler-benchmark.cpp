@@ -0,0 +1,134 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "../src/common/Resampler.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace RubberBand;
+
+// Measure the throughput and aliasing of each resampler compiled
+// into the library, at the ratios and block sizes the stretchers
+// typically use, and report the fastest one that meets a given
+// quality bar. The result can be applied to a deployment through
+// the RUBBERBAND_RESAMPLER environment variable.
+
+static void
+usage(const char *name)
+{
+    cerr << endl;
+    cerr << "Usage: " << name << " [options]" << endl;
+    cerr << endl;
+    cerr << "Options:" << endl;
+    cerr << endl;
+    cerr << "  -q, --quality <Q>       Resampler quality: best, tolerable or fastest;" << endl;
+    cerr << "                          default best (as used by the stretchers offline" << endl;
+    cerr << "                          or with high-quality pitch shifting)" << endl;
+    cerr << "  -r, --rate <N>          Sample rate; default 44100" << endl;
+    cerr << "  -a, --max-aliasing <D>  Quality bar: highest acceptable level of unwanted" << endl;
+    cerr << "                          output in dB relative to signal; default -80" << endl;
+    cerr << "  -h, --help              Show this help" << endl;
+    cerr << endl;
+}
+
+int main(int argc, char **argv)
+{
+    Resampler::Parameters params;
+    params.quality = Resampler::Best;
+    double maxAliasing = -80.0;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool haveValue = (i + 1 < argc);
+        if ((arg == "-q" || arg == "--quality") && haveValue) {
+            string q = argv[++i];
+            if (q == "best") params.quality = Resampler::Best;
+            else if (q == "tolerable") params.quality = Resampler::FastestTolerable;
+            else if (q == "fastest") params.quality = Resampler::Fastest;
+            else {
+                cerr << "ERROR: Unknown quality \"" << q << "\"" << endl;
+                return 2;
+            }
+        } else if ((arg == "-r" || arg == "--rate") && haveValue) {
+            params.initialSampleRate = atof(argv[++i]);
+            if (params.initialSampleRate <= 0.0) {
+                cerr << "ERROR: Invalid sample rate" << endl;
+                return 2;
+            }
+        } else if ((arg == "-a" || arg == "--max-aliasing") && haveValue) {
+            maxAliasing = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return (arg == "-h" || arg == "--help") ? 0 : 2;
+        }
+    }
+
+    // Pitch shifts of up to an octave either way, including the
+    // semitone steps either side of unity where the filter transition
+    // band matters most, in blocks of the hop and increment sizes
+    // the stretchers resample with
+
+    vector<double> ratios {
+        0.5, 0.7937, 0.9439, 1.0595, 1.2599, 2.0
+    };
+    vector<int> blockSizes { 256, 512, 1024 };
+
+    cerr << "Measuring resamplers at sample rate "
+         << params.initialSampleRate << "..." << endl;
+
+    vector<Resampler::Measurement> measurements =
+        Resampler::measureImplementations(params, ratios, blockSizes);
+
+    cout << setw(14) << left << "implementation"
+         << setw(8) << right << "ratio"
+         << setw(8) << "block"
+         << setw(16) << "Mframes/sec"
+         << setw(14) << "aliasing dB" << endl;
+
+    for (const auto &m : measurements) {
+        cout << setw(14) << left << m.implementation
+             << setw(8) << right << fixed << setprecision(4) << m.ratio
+             << setw(8) << m.blockSize
+             << setw(16) << setprecision(2) << m.framesPerSecond / 1.0e6
+             << setw(14) << setprecision(1) << m.aliasing << endl;
+    }
+
+    string chosen = Resampler::chooseImplementation(measurements, maxAliasing);
+    cout << endl;
+    if (chosen == "") {
+        cout << "No implementation meets the quality bar of "
+             << maxAliasing << " dB" << endl;
+        return 1;
+    }
+
+    cout << "Fastest implementation meeting the quality bar of "
+         << maxAliasing << " dB: " << chosen << endl;
+    cout << "To use it, set RUBBERBAND_RESAMPLER=" << chosen << endl;
+    return 0;
+}
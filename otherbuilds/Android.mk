@@ -21,14 +21,21 @@ RUBBERBAND_SRC_FILES := \
 	$(RUBBERBAND_SRC_PATH)/faster/StretcherChannelData.cpp \
 	$(RUBBERBAND_SRC_PATH)/faster/StretcherImpl.cpp \
 	$(RUBBERBAND_SRC_PATH)/faster/StretcherProcess.cpp \
+	$(RUBBERBAND_SRC_PATH)/fastest/WsolaStretcher.cpp \
+	$(RUBBERBAND_SRC_PATH)/multi/MultiStreamStretcher.cpp \
 	$(RUBBERBAND_SRC_PATH)/common/BQResampler.cpp \
 	$(RUBBERBAND_SRC_PATH)/common/Profiler.cpp \
+	$(RUBBERBAND_SRC_PATH)/common/RealTimeCheck.cpp \
 	$(RUBBERBAND_SRC_PATH)/common/Resampler.cpp \
 	$(RUBBERBAND_SRC_PATH)/common/FFT.cpp \
+	$(RUBBERBAND_SRC_PATH)/common/LaneFFT.cpp \
 	$(RUBBERBAND_SRC_PATH)/common/Allocators.cpp \
+	$(RUBBERBAND_SRC_PATH)/common/BandLimitedFFT.cpp \
 	$(RUBBERBAND_SRC_PATH)/common/StretchCalculator.cpp \
 	$(RUBBERBAND_SRC_PATH)/common/sysutils.cpp \
 	$(RUBBERBAND_SRC_PATH)/common/Thread.cpp \
+	$(RUBBERBAND_SRC_PATH)/common/ThreadPool.cpp \
+	$(RUBBERBAND_SRC_PATH)/common/Tracer.cpp \
 	$(RUBBERBAND_SRC_PATH)/finer/R3StretcherImpl.cpp 
 
 LOCAL_SRC_FILES += \
@@ -39,6 +39,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <functional>
 #include <cstddef>
 
 namespace RubberBand
@@ -167,6 +168,17 @@ public:
      *   changes, and music with substantial bass content. However, it
      *   uses much more CPU power than the R2 engine.
      *
+     *   \li \c OptionEngineFastest - Use the time-domain (Fastest)
+     *   engine. Rather than a phase vocoder, this is an overlap-add
+     *   stretcher that aligns each frame with the waveform of the
+     *   previous one (WSOLA). It uses a small fraction of the CPU of
+     *   the R2 engine and is well suited to changing the playback
+     *   rate of speech, but it is not recommended for polyphonic
+     *   music. Most of the other options have no effect with this
+     *   engine. If both OptionEngineFiner and OptionEngineFastest
+     *   are given, OptionEngineFiner is used. This engine was added
+     *   in Rubber Band Library v3.0.
+     *
      *   Important note: Consider calling getEngineVersion() after
      *   construction to make sure the engine you requested is
      *   active. That's not because engine selection can fail, but
@@ -262,6 +274,30 @@ public:
      *   situation where \c OptionThreadingAuto would do so, except omit
      *   the check for multiple CPUs and instead assume it to be true.
      *
+     *   \li \c OptionThreadingRealTime - In real-time mode, share the
+     *   processing work with a helper thread. In the R3 engine, the
+     *   spectral analysis of each processing step is carried out on
+     *   the helper thread while the previous step is being
+     *   resynthesised. This requires one further step's worth of
+     *   input to be buffered before output is produced, which is
+     *   reflected in the value returned by getSamplesRequired(); the
+     *   output itself, and the values of getPreferredStartPad() and
+     *   getStartDelay(), are unchanged. In the R2 engine, with more
+     *   than one channel on a multiprocessor system (or with \c
+     *   OptionThreadingAlways also set, which omits the check for
+     *   multiple CPUs as for offline mode), the per-channel
+     *   work of each processing step is shared between the calling
+     *   thread and a set of worker threads, one fewer than the
+     *   number of channels. The workers sleep on a semaphore, which
+     *   the calling thread posts without blocking at each step. It
+     *   then works through the channels from the first, while the
+     *   workers take channels from the last, so any channel not yet
+     *   taken up by a worker is processed on the calling thread and
+     *   process() never waits for a worker to wake up. It does wait,
+     *   yielding rather than blocking, for a worker to finish any
+     *   channel it has already taken. This option has no effect in
+     *   offline mode. It was added in Rubber Band Library v3.0.
+     *
      * 7. Flags prefixed \c OptionWindow control the window size for
      * FFT processing in the R2 engine.  (The window size actually
      * used will depend on many factors, but it can be influenced.)
@@ -362,6 +398,78 @@ public:
      *   centre but relatively less stereo space and width and lower
      *   fidelity for individual channel content.
      *
+     * 12. Flags prefixed \c OptionHistory control the precision at
+     * which per-channel spectral history (values carried from one
+     * processing block to the next, such as the previous phases in
+     * the R2 engine and the classification filters in the R3 engine)
+     * is stored. Processing arithmetic is unaffected. These options
+     * may not be changed after construction, and are ignored by the
+     * time-domain engine.
+     *
+     *   \li \c OptionHistoryFull - Store history at the same
+     *   precision as the processing arithmetic (normally double
+     *   precision). This is the default.
+     *
+     *   \li \c OptionHistoryFloat - Store history in single
+     *   precision. This roughly halves the memory used for it, with
+     *   a very small effect on the output.
+     *
+     *   \li \c OptionHistoryHalf - Store history in half
+     *   precision. This reduces the memory used for it to a quarter,
+     *   and so also the amount of it that must be kept in cache, with
+     *   a small but measurable effect on the output.
+     *
+     * 13. Flags prefixed \c OptionClassify control how often the R3
+     * engine reclassifies the bins of each channel as harmonic,
+     * percussive or residual. These options may not be changed after
+     * construction, and are ignored by the R2 and time-domain engines.
+     *
+     *   \li \c OptionClassifyEveryHop - Classify every processing
+     *   block. This is the default.
+     *
+     *   \li \c OptionClassifyAdaptive - Reuse the previous
+     *   classification while the spectrum is nearly stationary, as in
+     *   sustained tonal passages, reclassifying at once whenever it
+     *   changes (for example at an onset) and at least every few
+     *   blocks regardless. This saves a substantial part of the
+     *   engine's analysis work on such material. The proportion of
+     *   blocks reused is reported at debug level 2.
+     *
+     * 14. Flags prefixed \c OptionHop control whether the R3 engine
+     * varies its processing block size through the material in
+     * offline mode. These options may not be changed after
+     * construction, and are ignored in real-time mode and by the R2
+     * and time-domain engines.
+     *
+     *   \li \c OptionHopFixed - Use a single block size throughout,
+     *   chosen from the time ratio and pitch scale. This is the
+     *   default.
+     *
+     *   \li \c OptionHopAdaptive - Use longer blocks where the input
+     *   is stationary, for example in sustained tones or silence, and
+     *   shorter ones around transients. This reduces the processing
+     *   cost on material with long stationary passages and can
+     *   sharpen onsets. The input is analysed for this during the
+     *   study pass, so it has no effect unless study() has been
+     *   called with the whole of the input first.
+     *
+     * 15. Flags prefixed \c OptionLog control when log output reaches
+     * the logger (or \c cerr). These options may not be changed after
+     * construction.
+     *
+     *   \li \c OptionLogImmediate - Deliver each message as soon as
+     *   it is logged, from whichever thread logged it. This is the
+     *   default. Delivery happens within process() and other calls,
+     *   so debug levels above 0 are not RT-safe unless the logger is.
+     *
+     *   \li \c OptionLogDeferred - Queue each message, without
+     *   locking or allocation, for delivery when drainLog() is
+     *   called. This makes logging RT-safe at any debug level, so
+     *   that diagnostics can be left enabled in real-time use, at the
+     *   cost of a fixed-size queue: messages logged while it is full
+     *   are dropped, and their number reported at the next drain.
+     *   See drainLog().
+     *
      * Finally, flags prefixed \c OptionStretch are obsolete flags
      * provided for backward compatibility only. They are ignored by
      * the stretcher.
@@ -384,10 +492,15 @@ public:
 
         OptionPhaseLaminar         = 0x00000000,
         OptionPhaseIndependent     = 0x00002000,
+
+        OptionHistoryFull          = 0x00000000,
+        OptionHistoryFloat         = 0x00004000,
+        OptionHistoryHalf          = 0x00008000,
     
         OptionThreadingAuto        = 0x00000000,
         OptionThreadingNever       = 0x00010000,
         OptionThreadingAlways      = 0x00020000,
+        OptionThreadingRealTime    = 0x00040000,
 
         OptionWindowStandard       = 0x00000000,
         OptionWindowShort          = 0x00100000,
@@ -403,11 +516,21 @@ public:
         OptionPitchHighQuality     = 0x02000000,
         OptionPitchHighConsistency = 0x04000000,
 
+        OptionClassifyEveryHop     = 0x00000000,
+        OptionClassifyAdaptive     = 0x08000000,
+
+        OptionHopFixed             = 0x00000000,
+        OptionHopAdaptive          = 0x00080000,
+
+        OptionLogImmediate         = 0x00000000,
+        OptionLogDeferred          = 0x00001000,
+
         OptionChannelsApart        = 0x00000000,
         OptionChannelsTogether     = 0x10000000,
 
         OptionEngineFaster         = 0x00000000,
-        OptionEngineFiner          = 0x20000000
+        OptionEngineFiner          = 0x20000000,
+        OptionEngineFastest        = 0x40000000
 
         // n.b. Options is int, so we must stop before 0x80000000
     };
@@ -453,6 +576,44 @@ public:
         
         virtual ~Logger() { }
     };
+
+    /**
+     * Interface for a task executor that may optionally be provided
+     * to the stretcher via setExecutor(), for use by processAsync().
+     *
+     * The stretcher calls execute() with a task that it wants to have
+     * run at some later point. The executor may run the task on any
+     * thread, but must eventually run every task it is given, exactly
+     * once. Tasks for a single stretcher are never handed to the
+     * executor in a way that requires them to run concurrently, so a
+     * single-threaded executor (such as one that runs tasks from an
+     * application's event loop when it is idle) is acceptable.
+     *
+     * This interface was added in Rubber Band Library v3.0.
+     *
+     * @see setExecutor
+     * @see processAsync
+     */
+    struct Executor {
+        /// Arrange for the given task to be run.
+        virtual void execute(std::function<void()> task) = 0;
+
+        virtual ~Executor() { }
+    };
+
+    /**
+     * Callback type for delivering output from processAsync(). The
+     * arguments are de-interleaved output data with one float array
+     * per channel, the number of sample frames in each array, and a
+     * flag indicating whether the processAsync() call that this
+     * output belongs to is now complete.
+     *
+     * The output arrays are owned by the stretcher and are valid
+     * only for the duration of the callback.
+     */
+    typedef std::function<void(const float *const *output,
+                               size_t samples,
+                               bool complete)> ProcessCallback;
     
     /**
      * Construct a time and pitch stretcher object to run at the given
@@ -510,6 +671,238 @@ public:
     
     ~RubberBandStretcher();
 
+    /**
+     * Construct and return a new stretcher with the same sample rate,
+     * channel count, construction options and logger as this one,
+     * and with its current time ratio, pitch scale, formant scale,
+     * output sample rate and debug level, but otherwise in the state
+     * of a newly constructed stretcher. Tables that never change
+     * during processing, such as the analysis and synthesis windows,
+     * are shared with this stretcher rather than recalculated, so
+     * this is much quicker than constructing a new stretcher in the
+     * usual way. The stretchers are otherwise independent and may be
+     * deleted in either order. The caller owns the returned object.
+     *
+     * This function is not RT-safe, and must not be called while
+     * another thread is calling a non-const function on this
+     * stretcher.
+     *
+     * This function was added in Rubber Band Library v3.0.
+     *
+     * @see Pool
+     */
+    RubberBandStretcher *clone() const;
+
+    /**
+     * A thread-safe pool of stretchers, for applications that create
+     * and discard stretchers often enough for the cost of
+     * construction to matter.
+     *
+     * acquire() returns a stretcher with the requested sample rate,
+     * channel count and options, at time ratio and pitch scale
+     * 1.0. This is either one returned to the pool earlier or a new
+     * one cloned (see clone()) from a prototype that the pool keeps
+     * for each distinct combination of rate, channel count and
+     * options. When the last reference to an acquired stretcher is
+     * released, the stretcher is reset and returned to the pool. A
+     * stretcher on which any of the set...Option() functions,
+     * setFrequencyCutoff(), setExecutor() or setDebugLevel() has been
+     * called is deleted instead of being returned.
+     *
+     * Acquired stretchers may outlive the pool, in which case they
+     * are simply deleted when released.
+     *
+     * This class was added in Rubber Band Library v3.0.
+     */
+    class RUBBERBAND_DLLEXPORT Pool
+    {
+    public:
+        /**
+         * Construct a pool whose stretchers will send log output to
+         * the given logger, or to \c cerr if it is null.
+         */
+        Pool(std::shared_ptr<Logger> logger = nullptr);
+        ~Pool();
+
+        /**
+         * Return a stretcher with the given sample rate, channel
+         * count and options, either reused or newly cloned.
+         */
+        std::shared_ptr<RubberBandStretcher> acquire(size_t sampleRate,
+                                                     size_t channels,
+                                                     Options options =
+                                                     DefaultOptions);
+
+        /**
+         * Ensure that at least count stretchers with the given
+         * sample rate, channel count and options are waiting in the
+         * pool, so that that many calls to acquire() can be satisfied
+         * without constructing anything.
+         */
+        void reserve(size_t sampleRate, size_t channels, Options options,
+                     size_t count);
+
+        /**
+         * Delete all stretchers and prototypes currently held by the
+         * pool. Stretchers that have been acquired are unaffected.
+         */
+        void clear();
+
+    protected:
+        class Impl;
+        std::shared_ptr<Impl> m_d;
+
+        Pool(const Pool &) =delete;
+        Pool &operator=(const Pool &) =delete;
+    };
+
+    /**
+     * A stretcher for many independent mono streams at once, each
+     * with its own time ratio and pitch scale, for applications such
+     * as game audio or voice processing that handle large numbers of
+     * concurrent streams at modest quality.
+     *
+     * Rather than running one stretcher per stream, the streams
+     * share a single set of tables and are processed getLaneCount()
+     * at a time: process() packs the streams that have enough input
+     * for their next hop into lanes, and carries out the windowing,
+     * FFTs and phase vocoder arithmetic for all the lanes together,
+     * in a form the compiler can vectorise. Each stream still has its
+     * own hop sizes, buffers and position, and may be supplied and
+     * retrieved independently of the others.
+     *
+     * The processing is a plain phase vocoder with phase reset at
+     * transients, in real-time mode only. It is considerably faster
+     * per stream than a RubberBandStretcher with either phase
+     * vocoder engine, but lacks the R2 engine's phase lamination and
+     * the refinements of the R3 engine, and has no formant
+     * preservation. Of the construction options, only \c
+     * OptionWindowShort, \c OptionWindowLong, \c
+     * OptionTransientsSmooth and \c OptionPitchHighQuality have any
+     * effect.
+     *
+     * The functions of this class must not be called concurrently
+     * from different threads. Apart from the first call to
+     * setPitchScale() for a stream, none of them allocates memory
+     * once the stretcher has been constructed.
+     *
+     * This class was added in Rubber Band Library v3.0.
+     */
+    class RUBBERBAND_DLLEXPORT MultiStream
+    {
+    public:
+        /**
+         * Construct a stretcher for the given number of mono streams
+         * at the given sample rate, each initially at time ratio and
+         * pitch scale 1.0. Log output is sent to the given logger,
+         * or to \c cerr if it is null.
+         */
+        MultiStream(size_t sampleRate,
+                    size_t streams,
+                    Options options = DefaultOptions,
+                    std::shared_ptr<Logger> logger = nullptr);
+        ~MultiStream();
+
+        /**
+         * Return the number of streams, as passed to the constructor.
+         */
+        size_t getStreamCount() const;
+
+        /**
+         * Return the number of streams that are processed together
+         * in each group. Throughput per stream is highest when at
+         * least this many streams are ready for processing at once.
+         */
+        static size_t getLaneCount();
+
+        /**
+         * Reset all streams, as if the stretcher had just been
+         * constructed but retaining their time ratios and pitch
+         * scales.
+         */
+        void reset();
+
+        /**
+         * Reset a single stream, leaving the others unaffected.
+         */
+        void reset(size_t stream);
+
+        /**
+         * Set the time ratio for a stream. This may be changed at
+         * any time, as for a real-time RubberBandStretcher.
+         */
+        void setTimeRatio(size_t stream, double ratio);
+
+        /**
+         * Set the pitch scale for a stream, in the range 0.125 to
+         * 8.0. This may be changed at any time. The first call with
+         * a scale other than 1.0 for a stream allocates a resampler
+         * for it, so is best made before processing begins.
+         */
+        void setPitchScale(size_t stream, double scale);
+
+        double getTimeRatio(size_t stream) const;
+        double getPitchScale(size_t stream) const;
+
+        /**
+         * Return the number of further input samples a stream needs
+         * before it can be processed, as for
+         * RubberBandStretcher::getSamplesRequired().
+         */
+        size_t getSamplesRequired(size_t stream) const;
+
+        /**
+         * Supply input for a stream, without processing it. Returns
+         * the number of samples accepted, which may be fewer than
+         * requested if the stream's input buffer is full, in which
+         * case process() and retrieve() should be called before
+         * supplying the remainder. Set final to true for the last
+         * block of a stream's input: this takes effect only if the
+         * whole block is accepted.
+         */
+        size_t supply(size_t stream, const float *input,
+                      size_t samples, bool final);
+
+        /**
+         * Process every hop that is due across all streams, for as
+         * long as any stream has both enough input and room for its
+         * output. Returns the number of hops processed.
+         */
+        size_t process();
+
+        /**
+         * Return the number of output samples available for a
+         * stream, or -1 if its final block has been processed and
+         * all output retrieved, as for RubberBandStretcher::available().
+         */
+        int available(size_t stream) const;
+
+        /**
+         * Retrieve up to the given number of output samples for a
+         * stream, returning the number obtained.
+         */
+        size_t retrieve(size_t stream, float *output, size_t samples);
+
+        /**
+         * Set the level of debug output, as for
+         * RubberBandStretcher::setDebugLevel().
+         */
+        void setDebugLevel(int level);
+
+        /**
+         * Deliver any queued log messages, if constructed with
+         * OptionLogDeferred, as for RubberBandStretcher::drainLog().
+         */
+        size_t drainLog();
+
+    protected:
+        class Impl;
+        std::shared_ptr<Impl> m_d;
+
+        MultiStream(const MultiStream &) =delete;
+        MultiStream &operator=(const MultiStream &) =delete;
+    };
+
     /**
      * Reset the stretcher's internal buffers.  The stretcher should
      * subsequently behave as if it had just been constructed
@@ -520,7 +913,8 @@ public:
     /**
      * Return the active internal engine version, according to the \c
      * OptionEngine flag supplied on construction. This will return 2
-     * for the R2 (Faster) engine or 3 for the R3 (Finer) engine.
+     * for the R2 (Faster) engine, 3 for the R3 (Finer) engine, or 1
+     * for the time-domain (Fastest) engine.
      *
      * This function was added in Rubber Band Library v3.0.
      */
@@ -605,6 +999,33 @@ public:
      * This function was added in Rubber Band Library v3.0.
      */
     void setFormantScale(double scale);
+
+    /**
+     * Set the sample rate at which the output is to be delivered, if
+     * it differs from the input sample rate supplied on
+     * construction. For example, to stretch audio from a 44.1kHz
+     * source for playback on a 48kHz device, construct the stretcher
+     * with a sample rate of 44100 and call setOutputSampleRate(48000).
+     *
+     * The sample rate conversion is carried out by the same resampler
+     * that is used for pitch shifting, with no additional processing
+     * pass. The time ratio and pitch scale retain their usual
+     * meanings in terms of duration and frequency, so the number of
+     * output samples per input sample is the time ratio multiplied by
+     * the ratio of output to input sample rates. Output sample
+     * positions given in a key frame map (see setKeyFrameMap) and the
+     * values returned by available() and getStartDelay() are also in
+     * terms of the output sample rate. Pass 0 to revert to the input
+     * sample rate.
+     *
+     * If the stretcher was constructed in Offline mode, this function
+     * may not be called after study() or process() has been called.
+     * In RealTime mode it may be called at any time, subject to the
+     * same threading constraints as setPitchScale().
+     *
+     * This function was added in Rubber Band Library v3.0.
+     */
+    void setOutputSampleRate(size_t rate);
     
     /**
      * Return the last time ratio value that was set (either on
@@ -887,6 +1308,41 @@ public:
      */
     void process(const float *const *input, size_t samples, bool final);
 
+    /**
+     * Provide a block of "samples" sample frames for processing, as
+     * with process(), but carry out no more than "maxHops" processing
+     * steps before returning, leaving any further work for later
+     * calls. Return the number of steps actually carried out. A step
+     * is one analysis and synthesis frame (for all channels) and
+     * typically corresponds to a few hundred input samples.
+     *
+     * This allows an application that runs several stretchers on the
+     * same thread to bound the work done in a single call, and to
+     * interleave the stretchers fairly.
+     *
+     * If the return value is equal to "maxHops", more work may be
+     * pending. Call processSome() again with no input ("samples" of
+     * zero, and the same value of "final" as before) to continue with
+     * it. If the return value is less than "maxHops", the stretcher
+     * can make no further progress until more input is supplied or
+     * more output is retrieved. This continuation is permitted even
+     * after a call with "final" set.
+     *
+     * The limit is exceeded only if the input supplied does not fit
+     * in the stretcher's buffers without processing some of what is
+     * already there: to avoid this, supply no more than
+     * getSamplesRequired() or the size set with setMaxProcessSize().
+     * In the R2 engine's multi-threaded offline mode, processing
+     * happens on separate threads and the limit has no effect.
+     *
+     * A "maxHops" value of zero means no limit, making this
+     * equivalent to process().
+     *
+     * This function was added in Rubber Band Library v3.0.
+     */
+    size_t processSome(const float *const *input, size_t samples, bool final,
+                       size_t maxHops);
+
     /**
      * Ask the stretcher how many audio sample frames of output data
      * are available for reading (via retrieve()).
@@ -926,6 +1382,53 @@ public:
      */
     size_t retrieve(float *const *output, size_t samples) const;
 
+    /**
+     * Provide a block of "samples" sample frames for processing in
+     * the background, receiving the output through a callback rather
+     * than through retrieve(). The input is copied, so the caller's
+     * buffers need not remain valid after this function returns. The
+     * arguments are as for process(), with the addition of the
+     * callback.
+     *
+     * The processing is carried out by the executor set using
+     * setExecutor(), or, if none has been set, by a small pool of
+     * threads shared between all stretchers in the library. Work
+     * submitted through successive processAsync() calls on the same
+     * stretcher is carried out in the order it was submitted, and
+     * never concurrently.
+     *
+     * The callback is called on the executor's thread, once for each
+     * block of output that becomes available while processing this
+     * input, and then once more with the "complete" flag set (and
+     * possibly no output) when all of this input has been
+     * processed. If "final" is true, the completing call is made only
+     * after all remaining output has been delivered.
+     *
+     * Do not mix processAsync() with process() or retrieve() on the
+     * same stretcher while asynchronous work is outstanding. In
+     * Offline mode, study() must still be called synchronously
+     * before the first processAsync() call. The stretcher's
+     * destructor and reset() wait for any outstanding asynchronous
+     * work to complete.
+     *
+     * This function is not RT-safe, as it allocates a copy of the
+     * input.
+     *
+     * This function was added in Rubber Band Library v3.0.
+     */
+    void processAsync(const float *const *input, size_t samples, bool final,
+                      ProcessCallback callback);
+
+    /**
+     * Set the executor to be used for subsequent processAsync()
+     * calls. Pass a null pointer to revert to the library's shared
+     * thread pool. If any asynchronous work is outstanding, this
+     * waits for it to complete before switching executor.
+     *
+     * This function was added in Rubber Band Library v3.0.
+     */
+    void setExecutor(std::shared_ptr<Executor> executor);
+
     /**
      * Return the value of internal frequency cutoff value n.
      *
@@ -1024,6 +1527,12 @@ public:
      * are not guaranteed to be RT-safe in any conditions as they may
      * construct messages by allocation.
      *
+     * A stretcher constructed with OptionLogDeferred queues its
+     * messages instead, and delivers them only from drainLog(). All
+     * debug levels are then RT-safe with any logger, although
+     * messages may be dropped at the higher levels if the log is not
+     * drained often enough.
+     *
      * @see Logger
      * @see setDefaultDebugLevel
      */
@@ -1037,10 +1546,100 @@ public:
      */
     static void setDefaultDebugLevel(int level);
 
+    /**
+     * Deliver to the logger (or \c cerr) any log messages queued
+     * since the last call, for a stretcher constructed with
+     * OptionLogDeferred, and return the number delivered. If any
+     * messages were dropped because the queue was full, a further
+     * message reports how many. Does nothing and returns 0 for a
+     * stretcher without OptionLogDeferred. Messages still queued
+     * when the stretcher is deleted are delivered then.
+     *
+     * This function is not RT-safe, as it calls the logger. It may be
+     * called from any thread, including while another thread is
+     * processing, for example from a timer on an application's
+     * non-real-time thread, but not from two threads at once.
+     *
+     * This function was added in Rubber Band Library v3.0.
+     *
+     * @see OptionLogDeferred
+     */
+    size_t drainLog();
+
+    /**
+     * Time each FFT implementation compiled into the library at each
+     * of the transform sizes the R2 and R3 engines use at the given
+     * sample rate, and record the fastest implementation for each
+     * size. Stretchers constructed subsequently will use the
+     * recorded choices. An implementation explicitly selected as the
+     * library-wide default still takes precedence over these.
+     *
+     * If cacheFilename is non-empty, all recorded choices are then
+     * written to that file so that they can be reused in later
+     * sessions through loadFFTTuning(), or by naming the file in the
+     * RUBBERBAND_FFT_CACHE environment variable, in which case it is
+     * loaded automatically before the first stretcher is
+     * constructed. Return false if the file could not be written.
+     *
+     * Tuning takes a fraction of a second or more and is not
+     * RT-safe. It is only worth doing where more than one FFT
+     * implementation has been compiled in.
+     *
+     * This function was added in Rubber Band Library v3.0.
+     *
+     * @see loadFFTTuning
+     */
+    static bool tuneFFT(size_t sampleRate, std::string cacheFilename = "");
+
+    /**
+     * Load per-size FFT implementation choices from a file written
+     * by tuneFFT(), for use by stretchers constructed
+     * subsequently. Return false if the file could not be read.
+     *
+     * This function was added in Rubber Band Library v3.0.
+     *
+     * @see tuneFFT
+     */
+    static bool loadFFTTuning(std::string cacheFilename);
+
+    /**
+     * Begin recording timing events for diagnostic purposes. While
+     * recording, every stretcher in the process notes the start and
+     * end of each stage of its per-hop processing (analysis, phase
+     * advance, synthesis, resampling, and so on) along with the
+     * thread it ran on and the hop number. Any events from an
+     * earlier recording are discarded.
+     *
+     * The memory for events is allocated here, so that recording
+     * itself does not allocate, but recording still affects
+     * processing time a little and should not be left running in
+     * production. When not recording, the cost is negligible.
+     *
+     * This function was added in Rubber Band Library v3.0.
+     *
+     * @see stopTrace
+     */
+    static void startTrace();
+
+    /**
+     * Stop recording timing events and, if filename is non-empty,
+     * write those recorded since startTrace() to that file in the
+     * Chrome trace-event JSON format, which can be viewed in
+     * chrome://tracing or the Perfetto UI. Return false if the file
+     * could not be written.
+     *
+     * This function was added in Rubber Band Library v3.0.
+     *
+     * @see startTrace
+     */
+    static bool stopTrace(std::string filename);
+
 protected:
     class Impl;
     Impl *m_d;
 
+    RubberBandStretcher(Impl *d);
+
     RubberBandStretcher(const RubberBandStretcher &) =delete;
     RubberBandStretcher &operator=(const RubberBandStretcher &) =delete;
 };
@@ -70,10 +70,15 @@ enum RubberBandOption {
 
     RubberBandOptionPhaseLaminar         = 0x00000000,
     RubberBandOptionPhaseIndependent     = 0x00002000,
+
+    RubberBandOptionHistoryFull          = 0x00000000,
+    RubberBandOptionHistoryFloat         = 0x00004000,
+    RubberBandOptionHistoryHalf          = 0x00008000,
     
     RubberBandOptionThreadingAuto        = 0x00000000,
     RubberBandOptionThreadingNever       = 0x00010000,
     RubberBandOptionThreadingAlways      = 0x00020000,
+    RubberBandOptionThreadingRealTime    = 0x00040000,
 
     RubberBandOptionWindowStandard       = 0x00000000,
     RubberBandOptionWindowShort          = 0x00100000,
@@ -89,11 +94,21 @@ enum RubberBandOption {
     RubberBandOptionPitchHighQuality     = 0x02000000,
     RubberBandOptionPitchHighConsistency = 0x04000000,
 
+    RubberBandOptionClassifyEveryHop     = 0x00000000,
+    RubberBandOptionClassifyAdaptive     = 0x08000000,
+
+    RubberBandOptionHopFixed             = 0x00000000,
+    RubberBandOptionHopAdaptive          = 0x00080000,
+
+    RubberBandOptionLogImmediate         = 0x00000000,
+    RubberBandOptionLogDeferred          = 0x00001000,
+
     RubberBandOptionChannelsApart        = 0x00000000,
     RubberBandOptionChannelsTogether     = 0x10000000,
 
     RubberBandOptionEngineFaster         = 0x00000000,
-    RubberBandOptionEngineFiner          = 0x20000000
+    RubberBandOptionEngineFiner          = 0x20000000,
+    RubberBandOptionEngineFastest        = 0x40000000
 };
 
 typedef int RubberBandOptions;
@@ -109,6 +124,11 @@ RB_EXTERN RubberBandState rubberband_new(unsigned int sampleRate,
 
 RB_EXTERN void rubberband_delete(RubberBandState);
 
+/** Return a new state holding a clone of the given one's stretcher
+ *  (see RubberBandStretcher::clone()). Delete it with
+ *  rubberband_delete() as usual. */
+RB_EXTERN RubberBandState rubberband_clone(const RubberBandState);
+
 RB_EXTERN void rubberband_reset(RubberBandState);
 
 RB_EXTERN int rubberband_get_engine_version(RubberBandState);
@@ -122,6 +142,8 @@ RB_EXTERN double rubberband_get_pitch_scale(const RubberBandState);
 RB_EXTERN void rubberband_set_formant_scale(RubberBandState, double scale);
 RB_EXTERN double rubberband_get_formant_scale(const RubberBandState);
 
+RB_EXTERN void rubberband_set_output_sample_rate(RubberBandState, unsigned int rate);
+
 RB_EXTERN unsigned int rubberband_get_preferred_start_pad(const RubberBandState);
 RB_EXTERN unsigned int rubberband_get_start_delay(const RubberBandState);
 RB_EXTERN unsigned int rubberband_get_latency(const RubberBandState);
@@ -141,6 +163,7 @@ RB_EXTERN void rubberband_set_key_frame_map(RubberBandState, unsigned int keyfra
 
 RB_EXTERN void rubberband_study(RubberBandState, const float *const *input, unsigned int samples, int final);
 RB_EXTERN void rubberband_process(RubberBandState, const float *const *input, unsigned int samples, int final);
+RB_EXTERN unsigned int rubberband_process_some(RubberBandState, const float *const *input, unsigned int samples, int final, unsigned int maxHops);
 
 RB_EXTERN int rubberband_available(const RubberBandState);
 RB_EXTERN unsigned int rubberband_retrieve(const RubberBandState, float *const *output, unsigned int samples);
@@ -151,6 +174,19 @@ RB_EXTERN void rubberband_calculate_stretch(RubberBandState);
 
 RB_EXTERN void rubberband_set_debug_level(RubberBandState, int level);
 RB_EXTERN void rubberband_set_default_debug_level(int level);
+RB_EXTERN unsigned int rubberband_drain_log(RubberBandState);
+
+/** Return non-zero on success, zero if the cache file could not be
+ *  written or read. The filename may be NULL for tuning without a
+ *  cache file. */
+RB_EXTERN int rubberband_tune_fft(unsigned int sampleRate, const char *cacheFilename);
+RB_EXTERN int rubberband_load_fft_tuning(const char *cacheFilename);
+
+RB_EXTERN void rubberband_start_trace(void);
+
+/** Return non-zero on success, zero if the trace file could not be
+ *  written. The filename may be NULL to discard the trace. */
+RB_EXTERN int rubberband_stop_trace(const char *filename);
 
 #ifdef __cplusplus
 }
@@ -63,16 +63,23 @@
 #include "../src/faster/PercussiveAudioCurve.cpp"
 #include "../src/common/Log.cpp"
 #include "../src/common/Profiler.cpp"
+#include "../src/common/RealTimeCheck.cpp"
 #include "../src/common/FFT.cpp"
+#include "../src/common/LaneFFT.cpp"
 #include "../src/common/Resampler.cpp"
 #include "../src/common/BQResampler.cpp"
 #include "../src/common/Allocators.cpp"
+#include "../src/common/BandLimitedFFT.cpp"
 #include "../src/common/StretchCalculator.cpp"
 #include "../src/common/sysutils.cpp"
 #include "../src/common/Thread.cpp"
+#include "../src/common/ThreadPool.cpp"
+#include "../src/common/Tracer.cpp"
 #include "../src/faster/StretcherChannelData.cpp"
 #include "../src/faster/R2Stretcher.cpp"
 #include "../src/faster/StretcherProcess.cpp"
+#include "../src/fastest/WsolaStretcher.cpp"
+#include "../src/multi/MultiStreamStretcher.cpp"
 #include "../src/finer/R3Stretcher.cpp"
 
 #include "../src/RubberBandStretcher.cpp"
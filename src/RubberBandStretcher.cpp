@@ -23,15 +23,71 @@
 
 #include "faster/R2Stretcher.h"
 #include "finer/R3Stretcher.h"
+#include "fastest/WsolaStretcher.h"
+#include "multi/MultiStreamStretcher.h"
+
+#include "common/Thread.h"
+#include "common/ThreadPool.h"
+#include "common/RealTimeCheck.h"
+#include "common/Tracer.h"
+#include "common/FloatGuards.h"
 
 #include <iostream>
+#include <deque>
+#include <tuple>
 
 namespace RubberBand {
 
 class RubberBandStretcher::Impl
 {
+    size_t m_sampleRate;
+    size_t m_channels;
+    Options m_options;
+    std::shared_ptr<RubberBandStretcher::Logger> m_logger;
+    Log m_log; // shares its queue with the engine's, if deferred
+    size_t m_outputSampleRate;
+    int m_debugLevel;
+
+    // False once any setting has been changed that reset() does not
+    // restore, so that a pool knows not to hand this out again
+    bool m_reusable;
+    
     R2Stretcher *m_r2;
     R3Stretcher *m_r3;
+    WsolaStretcher *m_wsola;
+
+    struct AsyncJob {
+        std::vector<std::vector<float>> input;
+        size_t samples;
+        bool final;
+        ProcessCallback callback;
+    };
+
+    std::shared_ptr<Executor> m_executor;
+    std::deque<AsyncJob> m_asyncJobs;
+    bool m_asyncScheduled;
+    Condition m_asyncCondition;
+    size_t m_asyncBlockSize;
+    std::vector<std::vector<float>> m_asyncOutput;
+
+    // Tasks handed to the executor hold only a weak reference to
+    // this, so that one still queued with an executor that has not
+    // yet run it does nothing once the stretcher has gone. This can
+    // only happen in a NO_THREADING build, where waitForAsync() runs
+    // the outstanding jobs itself rather than waiting for the task
+    std::shared_ptr<bool> m_asyncAlive;
+
+    // Input blocks containing NaN or infinite values are copied
+    // through here, a buffer's length at a time, with those values
+    // replaced by zero, so that nothing downstream has to check
+    std::vector<std::vector<float>> m_sanitised;
+    std::vector<const float *> m_sanitisedPtrs;
+
+    // Sanitised input that processSome() received but could not pass
+    // on within its hop limit, held for the calls that continue it
+    std::vector<std::vector<float>> m_pending;
+    size_t m_pendingCount;
+    bool m_pendingFinal;
 
     class CerrLogger : public RubberBandStretcher::Logger {
     public:
@@ -53,7 +109,12 @@ class RubberBandStretcher::Impl
         }
     };
 
-    Log makeRBLog(std::shared_ptr<RubberBandStretcher::Logger> logger) {
+public:
+    static Log makeRBLog(std::shared_ptr<RubberBandStretcher::Logger> logger,
+                         Options options = 0) {
+        if (options & OptionLogDeferred) {
+            return makeRBLog(logger).deferred();
+        }
         if (logger) {
             return Log(
                 [=](const char *message) {
@@ -72,40 +133,107 @@ class RubberBandStretcher::Impl
         }
     }
 
-public:
     Impl(size_t sampleRate, size_t channels, Options options,
          std::shared_ptr<RubberBandStretcher::Logger> logger,
-         double initialTimeRatio, double initialPitchScale) :
-        m_r2 (!(options & OptionEngineFiner) ?
+         double initialTimeRatio, double initialPitchScale,
+         const Impl *prototype = nullptr) :
+        m_sampleRate(sampleRate),
+        m_channels(channels),
+        m_options(options),
+        m_logger(logger),
+        m_log(makeRBLog(logger, options)),
+        m_outputSampleRate(0),
+        m_debugLevel(-1),
+        m_reusable(true),
+        m_r2 (!(options & (OptionEngineFiner | OptionEngineFastest)) ?
               new R2Stretcher(sampleRate, channels, options,
                               initialTimeRatio, initialPitchScale,
-                              makeRBLog(logger))
+                              m_log,
+                              prototype ? prototype->m_r2 : nullptr)
               : nullptr),
         m_r3 ((options & OptionEngineFiner) ?
               new R3Stretcher(R3Stretcher::Parameters
                               (double(sampleRate), channels, options),
                               initialTimeRatio, initialPitchScale,
-                              makeRBLog(logger))
-              : nullptr)
+                              m_log,
+                              prototype ? prototype->m_r3 : nullptr)
+              : nullptr),
+        m_wsola ((!(options & OptionEngineFiner) &&
+                  (options & OptionEngineFastest)) ?
+                 new WsolaStretcher(WsolaStretcher::Parameters
+                                    (double(sampleRate), channels, options),
+                                    initialTimeRatio, initialPitchScale,
+                                    m_log)
+                 : nullptr),
+        m_asyncScheduled(false),
+        m_asyncCondition("async"),
+        m_asyncBlockSize(1024),
+        m_asyncAlive(std::make_shared<bool>(true)),
+        m_sanitised(channels, std::vector<float>(1024, 0.f)),
+        m_sanitisedPtrs(channels, nullptr),
+        m_pending(channels, std::vector<float>(1024, 0.f)),
+        m_pendingCount(0),
+        m_pendingFinal(false)
     {
     }
 
     ~Impl()
     {
+        waitForAsync();
         delete m_r2;
         delete m_r3;
+        delete m_wsola;
+        m_log.drain();
+    }
+
+    Impl *clone() const
+    {
+        Impl *d = new Impl(m_sampleRate, m_channels, m_options, m_logger,
+                           getTimeRatio(), getPitchScale(), this);
+        if (m_r3) d->setFormantScale(getFormantScale());
+        if (m_outputSampleRate != 0) d->setOutputSampleRate(m_outputSampleRate);
+        if (m_debugLevel >= 0) d->setDebugLevel(m_debugLevel);
+        d->m_reusable = m_reusable;
+        for (auto &s : d->m_sanitised) s.resize(m_sanitised[0].size(), 0.f);
+        for (auto &p : d->m_pending) p.resize(m_pending[0].size(), 0.f);
+        return d;
+    }
+
+    bool isReusable() const
+    {
+        return m_reusable;
+    }
+
+    // Reset and return the ratios and other per-stream settings to
+    // their defaults, ready for reuse from a pool
+    void recycle()
+    {
+        reset();
+        setTimeRatio(1.0);
+        setPitchScale(1.0);
+        setFormantScale(0.0);
+        if (m_outputSampleRate != 0) setOutputSampleRate(0);
+        if (m_r2) m_r2->setExpectedInputDuration(0);
+        // Reset again, as the R3 engine takes its initial hop history
+        // from the ratios in effect at reset, so that the result is
+        // the same as a new stretcher constructed at default ratios
+        if (m_r3) m_r3->reset();
     }
 
     int getEngineVersion() const
     {
         if (m_r3) return 3;
+        else if (m_wsola) return 1;
         else return 2;
     }
     
     void reset()
     {
+        waitForAsync();
+        m_pendingCount = 0;
         if (m_r2) m_r2->reset();
-        else m_r3->reset();
+        else if (m_r3) m_r3->reset();
+        else m_wsola->reset();
     }
 
     RTENTRY__
@@ -113,7 +241,8 @@ public:
     setTimeRatio(double ratio)
     {
         if (m_r2) m_r2->setTimeRatio(ratio);
-        else m_r3->setTimeRatio(ratio);
+        else if (m_r3) m_r3->setTimeRatio(ratio);
+        else m_wsola->setTimeRatio(ratio);
     }
 
     RTENTRY__
@@ -121,7 +250,8 @@ public:
     setPitchScale(double scale)
     {
         if (m_r2) m_r2->setPitchScale(scale);
-        else m_r3->setPitchScale(scale);
+        else if (m_r3) m_r3->setPitchScale(scale);
+        else m_wsola->setPitchScale(scale);
     }
 
     RTENTRY__
@@ -132,12 +262,23 @@ public:
         if (m_r3) m_r3->setFormantScale(scale);
     }
 
+    RTENTRY__
+    void
+    setOutputSampleRate(size_t rate)
+    {
+        m_outputSampleRate = rate;
+        if (m_r2) m_r2->setOutputSampleRate(double(rate));
+        else if (m_r3) m_r3->setOutputSampleRate(double(rate));
+        else m_wsola->setOutputSampleRate(double(rate));
+    }
+
     RTENTRY__
     double
     getTimeRatio() const
     {
         if (m_r2) return m_r2->getTimeRatio();
-        else return m_r3->getTimeRatio();
+        else if (m_r3) return m_r3->getTimeRatio();
+        else return m_wsola->getTimeRatio();
     }
 
     RTENTRY__
@@ -145,7 +286,8 @@ public:
     getPitchScale() const
     {
         if (m_r2) return m_r2->getPitchScale();
-        else return m_r3->getPitchScale();
+        else if (m_r3) return m_r3->getPitchScale();
+        else return m_wsola->getPitchScale();
     }
 
     RTENTRY__
@@ -154,7 +296,8 @@ public:
     {
         //!!!
         if (m_r2) return 0.0;
-        else return m_r3->getFormantScale();
+        else if (m_r3) return m_r3->getFormantScale();
+        else return 0.0;
     }
 
     RTENTRY__
@@ -162,7 +305,8 @@ public:
     getPreferredStartPad() const
     {
         if (m_r2) return m_r2->getPreferredStartPad();
-        else return m_r3->getPreferredStartPad();
+        else if (m_r3) return m_r3->getPreferredStartPad();
+        else return m_wsola->getPreferredStartPad();
     }
 
     RTENTRY__
@@ -170,7 +314,8 @@ public:
     getStartDelay() const
     {
         if (m_r2) return m_r2->getStartDelay();
-        else return m_r3->getStartDelay();
+        else if (m_r3) return m_r3->getStartDelay();
+        else return m_wsola->getStartDelay();
     }
 
 //!!! review all these
@@ -179,6 +324,7 @@ public:
     void
     setTransientsOption(Options options) 
     {
+        m_reusable = false;
         if (m_r2) m_r2->setTransientsOption(options);
     }
 
@@ -186,6 +332,7 @@ public:
     void
     setDetectorOption(Options options) 
     {
+        m_reusable = false;
         if (m_r2) m_r2->setDetectorOption(options);
     }
 
@@ -193,6 +340,7 @@ public:
     void
     setPhaseOption(Options options) 
     {
+        m_reusable = false;
         if (m_r2) m_r2->setPhaseOption(options);
     }
 
@@ -200,6 +348,7 @@ public:
     void
     setFormantOption(Options options)
     {
+        m_reusable = false;
         if (m_r2) m_r2->setFormantOption(options);
         else if (m_r3) m_r3->setFormantOption(options);
     }
@@ -208,29 +357,41 @@ public:
     void
     setPitchOption(Options options)
     {
+        m_reusable = false;
         if (m_r2) m_r2->setPitchOption(options);
         else if (m_r3) m_r3->setPitchOption(options);
+        else m_wsola->setPitchOption(options);
     }
 
     void
     setExpectedInputDuration(size_t samples) 
     {
         if (m_r2) m_r2->setExpectedInputDuration(samples);
-        else m_r3->setExpectedInputDuration(samples);
+        else if (m_r3) m_r3->setExpectedInputDuration(samples);
+        else m_wsola->setExpectedInputDuration(samples);
     }
 
     void
     setMaxProcessSize(size_t samples)
     {
+        if (samples > 0) m_asyncBlockSize = samples;
+        if (samples > m_sanitised[0].size()) {
+            for (auto &s : m_sanitised) s.resize(samples, 0.f);
+        }
+        if (samples > m_pending[0].size()) {
+            for (auto &p : m_pending) p.resize(samples, 0.f);
+        }
         if (m_r2) m_r2->setMaxProcessSize(samples);
-        else m_r3->setMaxProcessSize(samples);
+        else if (m_r3) m_r3->setMaxProcessSize(samples);
+        else m_wsola->setMaxProcessSize(samples);
     }
 
     void
     setKeyFrameMap(const std::map<size_t, size_t> &mapping)
     {
         if (m_r2) m_r2->setKeyFrameMap(mapping);
-        else m_r3->setKeyFrameMap(mapping);
+        else if (m_r3) m_r3->setKeyFrameMap(mapping);
+        else m_wsola->setKeyFrameMap(mapping);
     }
 
     RTENTRY__
@@ -238,15 +399,41 @@ public:
     getSamplesRequired() const
     {
         if (m_r2) return m_r2->getSamplesRequired();
-        else return m_r3->getSamplesRequired();
+        else if (m_r3) return m_r3->getSamplesRequired();
+        else return m_wsola->getSamplesRequired();
     }
 
     void
     study(const float *const *input, size_t samples,
           bool final)
+    {
+        if (isFinite(input, samples)) {
+            studyUnchecked(input, samples, final);
+            return;
+        }
+
+        // Sanitised a buffer's length at a time, as for process()
+        size_t blockSize = m_sanitised[0].size();
+        size_t offset = 0;
+        do {
+            size_t n = std::min(samples - offset, blockSize);
+            for (size_t c = 0; c < m_channels; ++c) {
+                v_copy_finite(m_sanitised[c].data(), input[c] + offset, int(n));
+                m_sanitisedPtrs[c] = m_sanitised[c].data();
+            }
+            offset += n;
+            studyUnchecked(m_sanitisedPtrs.data(), n,
+                           final && offset == samples);
+        } while (offset < samples);
+    }
+
+    void
+    studyUnchecked(const float *const *input, size_t samples,
+                   bool final)
     {
         if (m_r2) m_r2->study(input, samples, final);
-        else m_r3->study(input, samples, final);
+        else if (m_r3) m_r3->study(input, samples, final);
+        else m_wsola->study(input, samples, final);
     }
 
     RTENTRY__
@@ -254,24 +441,314 @@ public:
     process(const float *const *input, size_t samples,
             bool final)
     {
-        if (m_r2) m_r2->process(input, samples, final);
-        else m_r3->process(input, samples, final);
+        RealTimeCheck::Section section(m_options & OptionProcessRealTime);
+        ScopedFlushToZero ftz;
+        if (m_pendingCount > 0) {
+            processPending(0);
+        }
+        if (isFinite(input, samples)) {
+            processUnchecked(input, samples, final, 0);
+        } else {
+            processSanitised(input, samples, final, 0);
+        }
+    }
+
+    RTENTRY__
+    size_t
+    processSome(const float *const *input, size_t samples,
+                bool final, size_t maxHops)
+    {
+        RealTimeCheck::Section section(m_options & OptionProcessRealTime);
+        ScopedFlushToZero ftz;
+
+        size_t hops = 0;
+
+        if (m_pendingCount > 0) {
+            // Input held back by an earlier call goes first. If the
+            // limit runs out again, any new input joins it
+            hops = processPending(maxHops);
+            if (m_pendingCount > 0 || (maxHops > 0 && hops >= maxHops)) {
+                if (samples > 0) {
+                    holdPending(input, 0, samples, final);
+                }
+                return hops;
+            }
+        }
+
+        size_t limit = (maxHops > 0 ? maxHops - hops : 0);
+        
+        if (isFinite(input, samples)) {
+            hops += processUnchecked(input, samples, final, limit);
+        } else {
+            hops += processSanitised(input, samples, final, limit);
+        }
+        
+        return hops;
+    }
+
+    bool
+    isFinite(const float *const *input, size_t samples) const
+    {
+        if (samples == 0) {
+            return true; // input may be null
+        }
+        for (size_t c = 0; c < m_channels; ++c) {
+            if (!v_all_finite(input[c], int(samples))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t
+    processUnchecked(const float *const *input, size_t samples,
+                     bool final, size_t maxHops)
+    {
+        if (m_r2) return m_r2->processSome(input, samples, final, maxHops);
+        else if (m_r3) return m_r3->processSome(input, samples, final, maxHops);
+        else return m_wsola->processSome(input, samples, final, maxHops);
+    }
+
+    size_t
+    processSanitised(const float *const *input, size_t samples,
+                     bool final, size_t maxHops)
+    {
+        // Each block takes whatever remains of the hop limit. If it
+        // runs out before the input does, the rest is held for the
+        // calls that continue this one
+        
+        size_t blockSize = m_sanitised[0].size();
+        size_t offset = 0;
+        size_t hops = 0;
+
+        do {
+            size_t n = std::min(samples - offset, blockSize);
+            for (size_t c = 0; c < m_channels; ++c) {
+                v_copy_finite(m_sanitised[c].data(), input[c] + offset, int(n));
+                m_sanitisedPtrs[c] = m_sanitised[c].data();
+            }
+            offset += n;
+            hops += processUnchecked(m_sanitisedPtrs.data(), n,
+                                     final && offset == samples,
+                                     maxHops > 0 ? maxHops - hops : 0);
+        } while (offset < samples && (maxHops == 0 || hops < maxHops));
+
+        if (offset < samples) {
+            holdPending(input, offset, samples - offset, final);
+        }
+        
+        return hops;
+    }
+
+    void
+    holdPending(const float *const *input, size_t offset, size_t samples,
+                bool final)
+    {
+        size_t required = m_pendingCount + samples;
+        if (required > m_pending[0].size()) {
+            // Only if called with more than the maximum process size
+            for (auto &p : m_pending) p.resize(required, 0.f);
+        }
+        for (size_t c = 0; c < m_channels; ++c) {
+            v_copy_finite(m_pending[c].data() + m_pendingCount,
+                          input[c] + offset, int(samples));
+        }
+        m_pendingCount = required;
+        m_pendingFinal = final;
+    }
+
+    size_t
+    processPending(size_t maxHops)
+    {
+        size_t blockSize = m_sanitised[0].size();
+        size_t offset = 0;
+        size_t hops = 0;
+
+        while (offset < m_pendingCount && (maxHops == 0 || hops < maxHops)) {
+            size_t n = std::min(m_pendingCount - offset, blockSize);
+            for (size_t c = 0; c < m_channels; ++c) {
+                m_sanitisedPtrs[c] = m_pending[c].data() + offset;
+            }
+            offset += n;
+            hops += processUnchecked(m_sanitisedPtrs.data(), n,
+                                     m_pendingFinal &&
+                                     offset == m_pendingCount,
+                                     maxHops > 0 ? maxHops - hops : 0);
+        }
+
+        m_pendingCount -= offset;
+        if (m_pendingCount > 0) {
+            for (size_t c = 0; c < m_channels; ++c) {
+                v_move(m_pending[c].data(), m_pending[c].data() + offset,
+                       int(m_pendingCount));
+            }
+        }
+        
+        return hops;
     }
 
     RTENTRY__
     int
     available() const
     {
+        RealTimeCheck::Section section(m_options & OptionProcessRealTime);
         if (m_r2) return m_r2->available();
-        else return m_r3->available();
+        else if (m_r3) return m_r3->available();
+        else return m_wsola->available();
     }
 
     RTENTRY__
     size_t
     retrieve(float *const *output, size_t samples) const
     {
+        RealTimeCheck::Section section(m_options & OptionProcessRealTime);
         if (m_r2) return m_r2->retrieve(output, samples);
-        else return m_r3->retrieve(output, samples);
+        else if (m_r3) return m_r3->retrieve(output, samples);
+        else return m_wsola->retrieve(output, samples);
+    }
+
+    void
+    processAsync(const float *const *input, size_t samples, bool final,
+                 ProcessCallback callback)
+    {
+        AsyncJob job;
+        size_t channels = getChannelCount();
+        job.input.resize(channels);
+        for (size_t c = 0; c < channels; ++c) {
+            job.input[c] = std::vector<float>(input[c], input[c] + samples);
+        }
+        job.samples = samples;
+        job.final = final;
+        job.callback = callback;
+
+        bool schedule = false;
+        
+        m_asyncCondition.lock();
+        m_asyncJobs.push_back(std::move(job));
+        if (!m_asyncScheduled) {
+            m_asyncScheduled = true;
+            schedule = true;
+        }
+        m_asyncCondition.unlock();
+
+        // Only one task per stretcher is ever outstanding with the
+        // executor: it runs jobs until the queue is empty, so work
+        // for a single stretcher is serialised without tying up a
+        // thread of its own
+        if (schedule) {
+            std::weak_ptr<bool> alive(m_asyncAlive);
+            auto task = [this, alive]() {
+                if (auto a = alive.lock()) runAsyncJobs();
+            };
+            if (m_executor) {
+                m_executor->execute(task);
+            } else {
+                ThreadPool::getSharedPool().post(task);
+            }
+        }
+    }
+
+    void
+    setExecutor(std::shared_ptr<Executor> executor)
+    {
+        m_reusable = false;
+        waitForAsync();
+        m_executor = executor;
+    }
+
+    void
+    waitForAsync()
+    {
+#ifndef NO_THREADING
+        m_asyncCondition.lock();
+        while (m_asyncScheduled) {
+            m_asyncCondition.wait();
+        }
+        m_asyncCondition.unlock();
+#else
+        // Nothing else can be running the jobs, and the executor may
+        // be holding the task until later, so run them now. If the
+        // task does run later, it finds no jobs waiting
+        if (m_asyncScheduled) {
+            runAsyncJobs();
+        }
+#endif
+    }
+
+    void
+    runAsyncJobs()
+    {
+        while (true) {
+            m_asyncCondition.lock();
+            if (m_asyncJobs.empty()) {
+                m_asyncScheduled = false;
+                m_asyncCondition.signal();
+                m_asyncCondition.unlock();
+                return;
+            }
+            AsyncJob job = std::move(m_asyncJobs.front());
+            m_asyncJobs.pop_front();
+            m_asyncCondition.unlock();
+            runAsyncJob(job);
+        }
+    }
+
+    void
+    runAsyncJob(AsyncJob &job)
+    {
+        size_t channels = getChannelCount();
+        std::vector<const float *> in(channels, nullptr);
+        size_t offset = 0;
+
+        do {
+            size_t n = std::min(job.samples - offset, m_asyncBlockSize);
+            bool last = (offset + n == job.samples);
+            for (size_t c = 0; c < channels; ++c) {
+                in[c] = job.input[c].data() + offset;
+            }
+            process(in.data(), n, job.final && last);
+            offset += n;
+            deliverAsyncOutput(job.callback);
+        } while (offset < job.samples);
+
+        if (job.final) {
+            int av = 0;
+            while ((av = available()) >= 0) {
+                if (av == 0) {
+                    // Only the R2 engine in threaded mode can report
+                    // nothing available before the end: its process
+                    // threads are still working, so wait for them
+                    if (m_r2) m_r2->waitForOutput();
+                } else {
+                    deliverAsyncOutput(job.callback);
+                }
+            }
+        }
+
+        job.callback(nullptr, 0, true);
+    }
+
+    void
+    deliverAsyncOutput(const ProcessCallback &callback)
+    {
+        size_t channels = getChannelCount();
+        if (m_asyncOutput.size() != channels) {
+            m_asyncOutput.resize(channels);
+        }
+        std::vector<float *> out(channels, nullptr);
+        int av = 0;
+        while ((av = available()) > 0) {
+            size_t n = size_t(av);
+            for (size_t c = 0; c < channels; ++c) {
+                if (m_asyncOutput[c].size() < n) {
+                    m_asyncOutput[c].resize(n);
+                }
+                out[c] = m_asyncOutput[c].data();
+            }
+            size_t got = retrieve(out.data(), n);
+            if (got == 0) break;
+            callback(out.data(), got, false);
+        }
     }
 
     float
@@ -284,6 +761,7 @@ public:
     void
     setFrequencyCutoff(int n, float f) 
     {
+        m_reusable = false;
         if (m_r2) m_r2->setFrequencyCutoff(n, f);
     }
 
@@ -320,7 +798,8 @@ public:
     getChannelCount() const
     {
         if (m_r2) return m_r2->getChannelCount();
-        else return m_r3->getChannelCount();
+        else if (m_r3) return m_r3->getChannelCount();
+        else return m_wsola->getChannelCount();
     }
 
     void
@@ -332,8 +811,11 @@ public:
     void
     setDebugLevel(int level)
     {
+        m_debugLevel = level;
+        m_reusable = false;
         if (m_r2) m_r2->setDebugLevel(level);
-        else m_r3->setDebugLevel(level);
+        else if (m_r3) m_r3->setDebugLevel(level);
+        else m_wsola->setDebugLevel(level);
     }
 
     static void
@@ -341,6 +823,32 @@ public:
     {
         Log::setDefaultDebugLevel(level);
     }
+
+    size_t
+    drainLog()
+    {
+        return size_t(m_log.drain());
+    }
+
+    static bool
+    tuneFFT(size_t sampleRate, std::string cacheFilename)
+    {
+        std::set<int> sizes = R2Stretcher::getFftSizes(sampleRate);
+        std::set<int> r3sizes =
+            R3Stretcher::getFftSizes(sampleRate, makeRBLog(nullptr));
+        sizes.insert(r3sizes.begin(), r3sizes.end());
+        FFT::tuneImplementations(std::vector<int>(sizes.begin(), sizes.end()));
+        if (cacheFilename == "") {
+            return true;
+        }
+        return FFT::saveTunedImplementations(cacheFilename);
+    }
+
+    static bool
+    loadFFTTuning(std::string cacheFilename)
+    {
+        return FFT::loadTunedImplementations(cacheFilename);
+    }
 };
 
 RubberBandStretcher::RubberBandStretcher(size_t sampleRate,
@@ -364,11 +872,278 @@ RubberBandStretcher::RubberBandStretcher(size_t sampleRate,
 {
 }
 
+RubberBandStretcher::RubberBandStretcher(Impl *d) :
+    m_d(d)
+{
+}
+
 RubberBandStretcher::~RubberBandStretcher()
 {
     delete m_d;
 }
 
+RubberBandStretcher *
+RubberBandStretcher::clone() const
+{
+    return new RubberBandStretcher(m_d->clone());
+}
+
+class RubberBandStretcher::Pool::Impl
+{
+public:
+    Impl(std::shared_ptr<Logger> logger) : m_logger(logger) { }
+
+    ~Impl()
+    {
+        clear();
+    }
+
+    typedef std::tuple<size_t, size_t, Options> Key;
+
+    // Return a prototype for the given key, creating it if necessary.
+    // Prototypes are shared so that cloning can take place without
+    // the mutex held, even if clear() is called meanwhile
+    std::shared_ptr<const RubberBandStretcher>
+    getPrototype(const Key &key)
+    {
+        MutexLocker locker(&m_mutex);
+        Entry &entry = m_entries[key];
+        if (!entry.prototype) {
+            entry.prototype = std::make_shared<const RubberBandStretcher>
+                (std::get<0>(key), std::get<1>(key), m_logger, std::get<2>(key));
+        }
+        return entry.prototype;
+    }
+
+    RubberBandStretcher *
+    take(const Key &key)
+    {
+        MutexLocker locker(&m_mutex);
+        Entry &entry = m_entries[key];
+        if (entry.available.empty()) {
+            return nullptr;
+        }
+        RubberBandStretcher *s = entry.available.back();
+        entry.available.pop_back();
+        return s;
+    }
+
+    void
+    give(const Key &key, RubberBandStretcher *s)
+    {
+        MutexLocker locker(&m_mutex);
+        m_entries[key].available.push_back(s);
+    }
+
+    size_t
+    countAvailable(const Key &key)
+    {
+        MutexLocker locker(&m_mutex);
+        return m_entries[key].available.size();
+    }
+    
+    void
+    clear()
+    {
+        std::vector<RubberBandStretcher *> toDelete;
+        {
+            MutexLocker locker(&m_mutex);
+            for (auto &e : m_entries) {
+                toDelete.insert(toDelete.end(),
+                                e.second.available.begin(),
+                                e.second.available.end());
+            }
+            m_entries.clear();
+        }
+        for (auto s : toDelete) {
+            delete s;
+        }
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const RubberBandStretcher> prototype;
+        std::vector<RubberBandStretcher *> available;
+    };
+    std::shared_ptr<Logger> m_logger;
+    std::map<Key, Entry> m_entries;
+    Mutex m_mutex;
+};
+
+RubberBandStretcher::Pool::Pool(std::shared_ptr<Logger> logger) :
+    m_d(std::make_shared<Impl>(logger))
+{
+}
+
+RubberBandStretcher::Pool::~Pool()
+{
+}
+
+std::shared_ptr<RubberBandStretcher>
+RubberBandStretcher::Pool::acquire(size_t sampleRate, size_t channels,
+                                   Options options)
+{
+    Impl::Key key(sampleRate, channels, options);
+
+    RubberBandStretcher *s = m_d->take(key);
+    if (!s) {
+        s = m_d->getPrototype(key)->clone();
+    }
+
+    std::weak_ptr<Impl> pool(m_d);
+
+    return std::shared_ptr<RubberBandStretcher>
+        (s, [pool, key](RubberBandStretcher *s) {
+            std::shared_ptr<Impl> p = pool.lock();
+            if (p && s->m_d->isReusable()) {
+                s->m_d->recycle();
+                p->give(key, s);
+            } else {
+                delete s;
+            }
+        });
+}
+
+void
+RubberBandStretcher::Pool::reserve(size_t sampleRate, size_t channels,
+                                   Options options, size_t count)
+{
+    Impl::Key key(sampleRate, channels, options);
+    auto prototype = m_d->getPrototype(key);
+    while (m_d->countAvailable(key) < count) {
+        m_d->give(key, prototype->clone());
+    }
+}
+
+void
+RubberBandStretcher::Pool::clear()
+{
+    m_d->clear();
+}
+
+class RubberBandStretcher::MultiStream::Impl : public MultiStreamStretcher
+{
+public:
+    Impl(size_t sampleRate, size_t streams, Options options,
+         std::shared_ptr<Logger> logger) :
+        MultiStreamStretcher(MultiStreamStretcher::Parameters
+                             (double(sampleRate), int(streams), options),
+                             RubberBandStretcher::Impl::makeRBLog
+                             (logger, options)) { }
+
+    ~Impl() {
+        m_log.drain();
+    }
+
+    size_t drainLog() {
+        return size_t(m_log.drain());
+    }
+};
+
+RubberBandStretcher::MultiStream::MultiStream(size_t sampleRate,
+                                              size_t streams,
+                                              Options options,
+                                              std::shared_ptr<Logger> logger) :
+    m_d(std::make_shared<Impl>(sampleRate, streams, options, logger))
+{
+}
+
+RubberBandStretcher::MultiStream::~MultiStream()
+{
+}
+
+size_t
+RubberBandStretcher::MultiStream::getStreamCount() const
+{
+    return m_d->getStreamCount();
+}
+
+size_t
+RubberBandStretcher::MultiStream::getLaneCount()
+{
+    return LaneFFT::lanes;
+}
+
+void
+RubberBandStretcher::MultiStream::reset()
+{
+    m_d->reset();
+}
+
+void
+RubberBandStretcher::MultiStream::reset(size_t stream)
+{
+    m_d->reset(int(stream));
+}
+
+void
+RubberBandStretcher::MultiStream::setTimeRatio(size_t stream, double ratio)
+{
+    m_d->setTimeRatio(int(stream), ratio);
+}
+
+void
+RubberBandStretcher::MultiStream::setPitchScale(size_t stream, double scale)
+{
+    m_d->setPitchScale(int(stream), scale);
+}
+
+double
+RubberBandStretcher::MultiStream::getTimeRatio(size_t stream) const
+{
+    return m_d->getTimeRatio(int(stream));
+}
+
+double
+RubberBandStretcher::MultiStream::getPitchScale(size_t stream) const
+{
+    return m_d->getPitchScale(int(stream));
+}
+
+size_t
+RubberBandStretcher::MultiStream::getSamplesRequired(size_t stream) const
+{
+    return m_d->getSamplesRequired(int(stream));
+}
+
+size_t
+RubberBandStretcher::MultiStream::supply(size_t stream, const float *input,
+                                         size_t samples, bool final)
+{
+    return m_d->supply(int(stream), input, samples, final);
+}
+
+size_t
+RubberBandStretcher::MultiStream::process()
+{
+    return m_d->process();
+}
+
+int
+RubberBandStretcher::MultiStream::available(size_t stream) const
+{
+    return m_d->available(int(stream));
+}
+
+size_t
+RubberBandStretcher::MultiStream::retrieve(size_t stream, float *output,
+                                           size_t samples)
+{
+    return m_d->retrieve(int(stream), output, samples);
+}
+
+void
+RubberBandStretcher::MultiStream::setDebugLevel(int level)
+{
+    m_d->setDebugLevel(level);
+}
+
+size_t
+RubberBandStretcher::MultiStream::drainLog()
+{
+    return m_d->drainLog();
+}
+
 void
 RubberBandStretcher::reset()
 {
@@ -402,6 +1177,13 @@ RubberBandStretcher::setFormantScale(double scale)
     m_d->setFormantScale(scale);
 }
 
+RTENTRY__
+void
+RubberBandStretcher::setOutputSampleRate(size_t rate)
+{
+    m_d->setOutputSampleRate(rate);
+}
+
 RTENTRY__
 double
 RubberBandStretcher::getTimeRatio() const
@@ -520,6 +1302,14 @@ RubberBandStretcher::process(const float *const *input, size_t samples,
     m_d->process(input, samples, final);
 }
 
+RTENTRY__
+size_t
+RubberBandStretcher::processSome(const float *const *input, size_t samples,
+                                 bool final, size_t maxHops)
+{
+    return m_d->processSome(input, samples, final, maxHops);
+}
+
 RTENTRY__
 int
 RubberBandStretcher::available() const
@@ -534,6 +1324,19 @@ RubberBandStretcher::retrieve(float *const *output, size_t samples) const
     return m_d->retrieve(output, samples);
 }
 
+void
+RubberBandStretcher::processAsync(const float *const *input, size_t samples,
+                                  bool final, ProcessCallback callback)
+{
+    m_d->processAsync(input, samples, final, callback);
+}
+
+void
+RubberBandStretcher::setExecutor(std::shared_ptr<Executor> executor)
+{
+    m_d->setExecutor(executor);
+}
+
 float
 RubberBandStretcher::getFrequencyCutoff(int n) const
 {
@@ -595,5 +1398,39 @@ RubberBandStretcher::setDefaultDebugLevel(int level)
     Impl::setDefaultDebugLevel(level);
 }
 
+size_t
+RubberBandStretcher::drainLog()
+{
+    return m_d->drainLog();
+}
+
+bool
+RubberBandStretcher::tuneFFT(size_t sampleRate, std::string cacheFilename)
+{
+    return Impl::tuneFFT(sampleRate, cacheFilename);
+}
+
+bool
+RubberBandStretcher::loadFFTTuning(std::string cacheFilename)
+{
+    return Impl::loadFFTTuning(cacheFilename);
+}
+
+void
+RubberBandStretcher::startTrace()
+{
+    Tracer::start();
+}
+
+bool
+RubberBandStretcher::stopTrace(std::string filename)
+{
+    Tracer::stop();
+    if (filename == "") {
+        return true;
+    }
+    return Tracer::writeChromeTrace(filename);
+}
+
 }
 
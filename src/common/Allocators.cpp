@@ -38,6 +38,7 @@ namespace RubberBand {
 template <>
 float *allocate(size_t count)
 {
+    RealTimeCheck::hit(RealTimeCheck::Allocation, "allocate");
     float *ptr = ippsMalloc_32f(count);
     if (!ptr) throw (std::bad_alloc());
     return ptr;
@@ -46,6 +47,7 @@ float *allocate(size_t count)
 template <>
 double *allocate(size_t count)
 {
+    RealTimeCheck::hit(RealTimeCheck::Allocation, "allocate");
     double *ptr = ippsMalloc_64f(count);
     if (!ptr) throw (std::bad_alloc());
     return ptr;
@@ -54,13 +56,17 @@ double *allocate(size_t count)
 template <>
 void deallocate(float *ptr)
 {
-    if (ptr) ippsFree((void *)ptr);
+    if (!ptr) return;
+    RealTimeCheck::hit(RealTimeCheck::Deallocation, "deallocate");
+    ippsFree((void *)ptr);
 }
 
 template <>
 void deallocate(double *ptr)
 {
-    if (ptr) ippsFree((void *)ptr);
+    if (!ptr) return;
+    RealTimeCheck::hit(RealTimeCheck::Deallocation, "deallocate");
+    ippsFree((void *)ptr);
 }
 
 #endif
@@ -25,6 +25,7 @@
 #define RUBBERBAND_ALLOCATORS_H
 
 #include "VectorOps.h"
+#include "RealTimeCheck.h"
 
 #include <new> // for std::bad_alloc
 #include <stdlib.h>
@@ -73,6 +74,8 @@ T *allocate(size_t count)
 {
     void *ptr = 0;
 
+    RealTimeCheck::hit(RealTimeCheck::Allocation, "allocate");
+
     // We'd like to check HAVE_IPP first and, if it's defined, call
     // ippsMalloc_8u(count * sizeof(T)). But that isn't a general
     // replacement for malloc() because it only takes an int
@@ -171,6 +174,8 @@ template <typename T>
 void deallocate(T *ptr)
 {
     if (!ptr) return;
+
+    RealTimeCheck::hit(RealTimeCheck::Deallocation, "deallocate");
     
 #ifdef MALLOC_IS_ALIGNED
     free((void *)ptr);
@@ -30,6 +30,9 @@
 
 #include "Allocators.h"
 #include "VectorOps.h"
+#include "Thread.h"
+
+#include <map>
 
 #define BQ_R__ R__
 
@@ -41,6 +44,9 @@ using std::max;
 
 namespace RubberBand {
 
+static std::map<int, std::shared_ptr<const vector<double>>> prototypeFilters;
+static Mutex prototypeFilterMutex;
+
 BQResampler::BQResampler(Parameters parameters, int channels) :
     m_qparams(parameters.quality),
     m_dynamism(parameters.dynamism),
@@ -65,8 +71,16 @@ BQResampler::BQResampler(Parameters parameters, int channels) :
             cerr << "BQResampler: creating prototype filter of length "
                  << m_proto_length << endl;
         }
-        m_prototype = make_filter(m_proto_length, m_qparams.proto_p);
-        m_prototype.push_back(0.0); // interpolate without fear
+        MutexLocker locker(&prototypeFilterMutex);
+        int key = int(parameters.quality);
+        if (prototypeFilters.find(key) == prototypeFilters.end()) {
+            vector<double> filter = make_filter(m_proto_length,
+                                                m_qparams.proto_p);
+            filter.push_back(0.0); // interpolate without fear
+            prototypeFilters[key] =
+                std::make_shared<const vector<double>>(filter);
+        }
+        m_prototype = prototypeFilters[key];
     }
 
     int phase_reserve = 2 * int(round(m_initial_rate));
@@ -563,7 +577,7 @@ BQResampler::state_for_ratio(BQResampler::state &target_state,
             target_state.buffer = prev_state.buffer;
             target_state.fill = prev_state.fill;
         } else {
-            target_state.buffer = floatbuf(buffer_length, 0.0);
+            target_state.buffer.assign(buffer_length, 0.f);
             for (int i = 0; i < prev_state.fill; ++i) {
                 int offset = i - prev_state.centre;
                 int new_ix = offset + target_state.centre;
@@ -582,7 +596,7 @@ BQResampler::state_for_ratio(BQResampler::state &target_state,
             target_state.current_phase = n_phases - 1;
         }
     } else {
-        target_state.buffer = floatbuf(buffer_length, 0.0);
+        target_state.buffer.assign(buffer_length, 0.f);
     }
 }
 
@@ -613,6 +627,7 @@ BQResampler::reconstruct_one(state *s) const
         }
     } else {
         double m = double(m_proto_length - 1) / double(s->filter_length - 1);
+        const double *const prototype = m_prototype->data();
         for (int i = 0; i < dot_length; ++i) {
             double sample =
                 s->buffer[s->left + i * m_channels + s->current_channel];
@@ -620,8 +635,8 @@ BQResampler::reconstruct_one(state *s) const
             double proto_index = m * filter_index;
             int iix = int(floor(proto_index));
             double remainder = proto_index - iix;
-            double filter_value = m_prototype[iix] * (1.0 - remainder);
-            filter_value += m_prototype[iix+1] * remainder;
+            double filter_value = prototype[iix] * (1.0 - remainder);
+            filter_value += prototype[iix+1] * remainder;
             result += filter_value * sample;
         }
     }
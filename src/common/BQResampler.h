@@ -25,6 +25,7 @@
 #define BQ_BQRESAMPLER_H
 
 #include <vector>
+#include <memory>
 
 #include "Allocators.h"
 #include "VectorOps.h"
@@ -126,7 +127,9 @@ private:
     
     int m_fade_count;
     
-    std::vector<double> m_prototype;
+    // The prototype filter depends only on the quality setting, so
+    // it is designed once and shared by all resamplers using it
+    std::shared_ptr<const std::vector<double>> m_prototype;
     int m_proto_length;
     bool m_initialised;
 
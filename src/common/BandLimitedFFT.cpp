@@ -0,0 +1,127 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "BandLimitedFFT.h"
+
+#include <cmath>
+
+namespace RubberBand {
+
+int
+BandLimitedFFT::getFactorFor(int size, int binCount)
+{
+    // A full transform of size n costs about n/2 log2(n) butterflies.
+    // With decimation by r we save the last log2(r) stages, but pay
+    // r complex multiply-adds for each wanted bin, which we count as
+    // two butterflies as they are less cache-friendly. Below 64 the
+    // per-call overhead of the sub-transforms dominates
+
+    int bestFactor = 1;
+    double bestSaving = 0.0;
+
+    for (int r = 2; size / r >= 64; r *= 2) {
+        double saving = (size / 2.0) * log2(double(r)) -
+            2.0 * double(binCount) * double(r);
+        if (saving > bestSaving) {
+            bestFactor = r;
+            bestSaving = saving;
+        }
+    }
+
+    return bestFactor;
+}
+
+BandLimitedFFT::BandLimitedFFT(int size, int binCount) :
+    m_size(size),
+    m_binCount(binCount),
+    m_factor(getFactorFor(size, binCount)),
+    m_subSize(size / m_factor),
+    m_fft(m_subSize),
+    m_sub(m_subSize, 0.0),
+    m_subReal((m_subSize/2 + 1) * m_factor, 0.0),
+    m_subImag((m_subSize/2 + 1) * m_factor, 0.0),
+    m_twiddleCos(binCount * m_factor, 0.0),
+    m_twiddleSin(binCount * m_factor, 0.0)
+{
+    // Subsequence q holds input samples q, q + r, q + 2r etc, and
+    // output bin k is the sum over q of its bin k (mod the subsize)
+    // multiplied by exp(-2 pi i q k / size)
+
+    for (int k = 0; k < m_binCount; ++k) {
+        for (int q = 0; q < m_factor; ++q) {
+            double phase = -2.0 * M_PI * double(q) * double(k) / double(m_size);
+            m_twiddleCos[k * m_factor + q] = process_t(cos(phase));
+            m_twiddleSin[k * m_factor + q] = process_t(sin(phase));
+        }
+    }
+}
+
+void
+BandLimitedFFT::forward(const process_t *const R__ realIn,
+                        process_t *const R__ realOut,
+                        process_t *const R__ imagOut)
+{
+    const int r = m_factor;
+    const int m = m_subSize;
+    const int hs = m / 2 + 1;
+    process_t *const R__ sub = m_sub.data();
+    process_t *const R__ sr = m_subReal.data();
+    process_t *const R__ si = m_subImag.data();
+
+    for (int q = 0; q < r; ++q) {
+        for (int i = 0; i < m; ++i) {
+            sub[i] = realIn[i * r + q];
+        }
+        m_fft.forward(sub, sr + q * hs, si + q * hs);
+    }
+
+    const process_t *const R__ tc = m_twiddleCos.data();
+    const process_t *const R__ ts = m_twiddleSin.data();
+
+    for (int k = 0; k < m_binCount; ++k) {
+
+        // The sub-transforms are of real sequences, so for bins in
+        // their upper halves we take conjugates from the lower
+
+        int j = k % m;
+        process_t sign = 1.0;
+        if (j >= hs) {
+            j = m - j;
+            sign = -1.0;
+        }
+
+        process_t re = 0.0, im = 0.0;
+        for (int q = 0; q < r; ++q) {
+            process_t a = sr[q * hs + j];
+            process_t b = sign * si[q * hs + j];
+            process_t c = tc[k * r + q];
+            process_t s = ts[k * r + q];
+            re += a * c - b * s;
+            im += a * s + b * c;
+        }
+        realOut[k] = re;
+        imagOut[k] = im;
+    }
+}
+
+}
@@ -0,0 +1,94 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_BAND_LIMITED_FFT_H
+#define RUBBERBAND_BAND_LIMITED_FFT_H
+
+#include "FFT.h"
+#include "FixedVector.h"
+#include "sysutils.h"
+
+namespace RubberBand {
+
+/**
+ * Forward real-complex FFT of a fixed power-of-two size, of which
+ * only the first few output bins are wanted. The input is decimated
+ * in time into a number of interleaved subsequences, each of which
+ * is transformed with an FFT of correspondingly smaller size, and
+ * only the wanted bins are then assembled from the results. This
+ * saves the last stages of the full transform, at a cost in
+ * assembly proportional to the number of bins wanted.
+ *
+ * The output is that of FFT::forward for the same input, to within
+ * rounding, with the same scaling. Bins from the bin count upwards
+ * are left untouched.
+ */
+class BandLimitedFFT
+{
+public:
+    /**
+     * Construct for the given transform size and count of wanted
+     * bins, starting from bin 0. The decimation factor is the one
+     * returned by getFactorFor.
+     */
+    BandLimitedFFT(int size, int binCount);
+
+    int getSize() const { return m_size; }
+    int getBinCount() const { return m_binCount; }
+    int getFactor() const { return m_factor; }
+
+    /**
+     * Transform size real input samples into binCount real and
+     * imaginary outputs.
+     */
+    void forward(const process_t *realIn, process_t *realOut,
+                 process_t *imagOut);
+
+    /**
+     * Return the decimation factor that minimises the estimated cost
+     * of the transform for the given size and bin count. This is 1
+     * if decimation is not estimated to save anything over the full
+     * transform, in which case there is no point in using this class
+     * at all.
+     */
+    static int getFactorFor(int size, int binCount);
+
+private:
+    const int m_size;
+    const int m_binCount;
+    const int m_factor;
+    const int m_subSize;
+    FFT m_fft;
+    FixedVector<process_t> m_sub;
+    FixedVector<process_t> m_subReal; // per subsequence, concatenated
+    FixedVector<process_t> m_subImag;
+    FixedVector<process_t> m_twiddleCos; // per bin, per subsequence
+    FixedVector<process_t> m_twiddleSin;
+
+    BandLimitedFFT(const BandLimitedFFT &) =delete;
+    BandLimitedFFT &operator=(const BandLimitedFFT &) =delete;
+};
+
+}
+
+#endif
@@ -75,6 +75,10 @@
 
 #include <cmath>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
 #include <map>
 #include <cstdio>
 #include <cstdlib>
@@ -2281,6 +2285,86 @@ getImplementationDetails()
     return impls;
 }
 
+typedef std::map<int, std::string> TunedMap;
+
+static TunedMap tunedImplementations;
+static bool tunedImplementationsInitialised = false;
+static Mutex tunedImplementationsMutex;
+
+static bool
+readTunedImplementations(std::string filename, TunedMap &into)
+{
+    std::ifstream in(filename.c_str());
+    if (!in) return false;
+
+    ImplMap impls = getImplementationDetails();
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ls(line);
+        int size = 0;
+        std::string impl;
+        if (!(ls >> size >> impl) || size < 2) {
+            std::cerr << "WARNING: bqfft: Ignoring malformed line \""
+                      << line << "\" in FFT cache file \""
+                      << filename << "\"" << std::endl;
+            continue;
+        }
+        if (impls.find(impl) == impls.end()) {
+            std::cerr << "WARNING: bqfft: Implementation \"" << impl
+                      << "\" named in FFT cache file for size " << size
+                      << " is not compiled in" << std::endl;
+            continue;
+        }
+        into[size] = impl;
+    }
+
+    return true;
+}
+
+// Call with tunedImplementationsMutex held
+static void
+initialiseTunedImplementations()
+{
+    if (tunedImplementationsInitialised) return;
+    tunedImplementationsInitialised = true;
+    const char *filename = getenv("RUBBERBAND_FFT_CACHE");
+    if (filename && *filename) {
+        readTunedImplementations(filename, tunedImplementations);
+    }
+}
+
+static std::string
+getTunedImplementation(int size)
+{
+    MutexLocker locker(&tunedImplementationsMutex);
+    initialiseTunedImplementations();
+    TunedMap::const_iterator itr = tunedImplementations.find(size);
+    if (itr == tunedImplementations.end()) return "";
+    return itr->second;
+}
+
+static bool
+supportsSize(SizeConstraint constraint, int size)
+{
+    bool isPowerOfTwo = !(size & (size-1));
+    bool isEven = !(size & 1);
+
+    // out of an abundance of caution we don't attempt to use
+    // power-of-two implementations with size 2 either, as they may
+    // involve a half-half complex-complex underneath (which would
+    // end up with size 0)
+    if ((constraint & SizeConstraintPowerOfTwo) &&
+        (!isPowerOfTwo || size < 4)) {
+        return false;
+    }
+    if ((constraint & SizeConstraintEven) && !isEven) {
+        return false;
+    }
+    return true;
+}
+
 static std::string
 pickImplementation(int size)
 {
@@ -2308,6 +2392,14 @@ pickImplementation(int size)
                       << std::endl;
         }
     } 
+
+    std::string tuned = getTunedImplementation(size);
+    if (tuned != "") {
+        ImplMap::const_iterator itr = impls.find(tuned);
+        if (itr != impls.end() && supportsSize(itr->second, size)) {
+            return tuned;
+        }
+    }
     
     std::string preference[] = {
         "ipp", "vdsp", "fftw", "builtin", "kissfft"
@@ -2315,19 +2407,7 @@ pickImplementation(int size)
 
     for (int i = 0; i < int(sizeof(preference)/sizeof(preference[0])); ++i) {
         ImplMap::const_iterator itr = impls.find(preference[i]);
-        if (itr != impls.end()) {
-            if ((itr->second & SizeConstraintPowerOfTwo) &&
-                // out of an abundance of caution we don't attempt to
-                // use power-of-two implementations with size 2
-                // either, as they may involve a half-half
-                // complex-complex underneath (which would end up with
-                // size 0)
-                (!isPowerOfTwo || size < 4)) {
-                continue;
-            }
-            if ((itr->second & SizeConstraintEven) && !isEven) {
-                continue;
-            }
+        if (itr != impls.end() && supportsSize(itr->second, size)) {
             return preference[i];
         }
     }
@@ -2373,16 +2453,11 @@ FFT::setDefaultImplementation(std::string i)
     }
 }
 
-FFT::FFT(int size, int debugLevel) :
-    d(0)
+static FFTImpl *
+createImplementation(std::string impl, int size)
 {
-    std::string impl = pickImplementation(size);
-
-    if (debugLevel > 0) {
-        std::cerr << "FFT::FFT(" << size << "): using implementation: "
-                  << impl << std::endl;
-    }
-
+    FFTImpl *d = 0;
+    
     if (impl == "ipp") {
 #ifdef HAVE_IPP
         d = new FFTs::D_IPP(size);
@@ -2407,6 +2482,159 @@ FFT::FFT(int size, int debugLevel) :
         d = new FFTs::D_DFT(size);
     }
 
+    return d;
+}
+
+std::string
+FFT::getImplementationForSize(int size)
+{
+    return pickImplementation(size);
+}
+
+static double
+timeImplementation(FFTImpl *d, int size)
+{
+    std::vector<double> din(size), dre(size/2 + 1), dim(size/2 + 1);
+    std::vector<float> fin(size), fre(size/2 + 1), fim(size/2 + 1);
+    std::vector<double> dout(size);
+    std::vector<float> fout(size);
+
+    for (int i = 0; i < size; ++i) {
+        din[i] = sin(i * 0.1) + cos(i * 0.37) * 0.5;
+        fin[i] = float(din[i]);
+    }
+
+    d->initDouble();
+    d->initFloat();
+
+    // Aim for a similar total amount of work at every size, and take
+    // the best of several runs to discount interruptions
+    int iterations = std::max(4, 131072 / size);
+    double best = 0.0;
+
+    for (int run = 0; run < 4; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            d->forward(din.data(), dre.data(), dim.data());
+            d->inverse(dre.data(), dim.data(), dout.data());
+            d->forward(fin.data(), fre.data(), fim.data());
+            d->inverse(fre.data(), fim.data(), fout.data());
+        }
+        auto end = std::chrono::steady_clock::now();
+        double t = std::chrono::duration<double>(end - start).count();
+        if (run == 0) {
+            continue; // warm-up
+        }
+        if (run == 1 || t < best) {
+            best = t;
+        }
+    }
+
+    return best;
+}
+
+std::map<int, std::string>
+FFT::tuneImplementations(const std::vector<int> &sizes)
+{
+    ImplMap impls = getImplementationDetails();
+    TunedMap choices;
+
+    for (int si = 0; si < int(sizes.size()); ++si) {
+
+        int size = sizes[si];
+        if (size < 2 || choices.find(size) != choices.end()) continue;
+
+        std::string best;
+        double bestTime = 0.0;
+
+        for (ImplMap::const_iterator itr = impls.begin();
+             itr != impls.end(); ++itr) {
+            if (itr->first == "dft" || !supportsSize(itr->second, size)) {
+                continue;
+            }
+            FFTImpl *d = createImplementation(itr->first, size);
+            if (!d) continue;
+            double t = timeImplementation(d, size);
+            delete d;
+            if (best == "" || t < bestTime) {
+                best = itr->first;
+                bestTime = t;
+            }
+        }
+
+        if (best != "") {
+            choices[size] = best;
+        }
+    }
+
+    MutexLocker locker(&tunedImplementationsMutex);
+    initialiseTunedImplementations();
+    for (TunedMap::const_iterator itr = choices.begin();
+         itr != choices.end(); ++itr) {
+        tunedImplementations[itr->first] = itr->second;
+    }
+
+    return choices;
+}
+
+std::map<int, std::string>
+FFT::getTunedImplementations()
+{
+    MutexLocker locker(&tunedImplementationsMutex);
+    initialiseTunedImplementations();
+    return tunedImplementations;
+}
+
+void
+FFT::clearTunedImplementations()
+{
+    MutexLocker locker(&tunedImplementationsMutex);
+    tunedImplementationsInitialised = true;
+    tunedImplementations.clear();
+}
+
+bool
+FFT::loadTunedImplementations(std::string filename)
+{
+    TunedMap loaded;
+    if (!readTunedImplementations(filename, loaded)) {
+        return false;
+    }
+    MutexLocker locker(&tunedImplementationsMutex);
+    initialiseTunedImplementations();
+    for (TunedMap::const_iterator itr = loaded.begin();
+         itr != loaded.end(); ++itr) {
+        tunedImplementations[itr->first] = itr->second;
+    }
+    return true;
+}
+
+bool
+FFT::saveTunedImplementations(std::string filename)
+{
+    TunedMap toSave = getTunedImplementations();
+    std::ofstream out(filename.c_str());
+    if (!out) return false;
+    out << "# bqfft implementation choices: size implementation" << std::endl;
+    for (TunedMap::const_iterator itr = toSave.begin();
+         itr != toSave.end(); ++itr) {
+        out << itr->first << " " << itr->second << std::endl;
+    }
+    return bool(out);
+}
+
+FFT::FFT(int size, int debugLevel) :
+    d(0)
+{
+    std::string impl = pickImplementation(size);
+
+    if (debugLevel > 0) {
+        std::cerr << "FFT::FFT(" << size << "): using implementation: "
+                  << impl << std::endl;
+    }
+
+    d = createImplementation(impl, size);
+
     if (!d) {
         std::cerr << "FFT::FFT(" << size << "): ERROR: implementation "
                   << impl << " is not compiled in" << std::endl;
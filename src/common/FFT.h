@@ -28,6 +28,8 @@
 
 #include <string>
 #include <set>
+#include <map>
+#include <vector>
 
 namespace RubberBand {
 
@@ -115,6 +117,55 @@ public:
     static std::string getDefaultImplementation();
     static void setDefaultImplementation(std::string);
 
+    /**
+     * Return the name of the implementation that would be used for
+     * an FFT of the given size constructed now. This is the default
+     * implementation if one has been set and supports that size,
+     * otherwise any tuned choice for the size, otherwise the first
+     * suitable implementation in the built-in preference order.
+     */
+    static std::string getImplementationForSize(int size);
+
+    /**
+     * Time every compiled-in implementation (except the slow DFT) at
+     * each of the given sizes and record the fastest for each size.
+     * Recorded choices are used by FFT objects constructed
+     * subsequently, unless an explicit default implementation has
+     * been set with setDefaultImplementation. Return the choices
+     * made. Not RT-safe; may take some time for large sizes.
+     */
+    static std::map<int, std::string> tuneImplementations
+    (const std::vector<int> &sizes);
+
+    /**
+     * Return all recorded per-size choices, whether tuned or loaded.
+     */
+    static std::map<int, std::string> getTunedImplementations();
+
+    /**
+     * Forget all recorded per-size choices.
+     */
+    static void clearTunedImplementations();
+
+    /**
+     * Read per-size choices from a file written by
+     * saveTunedImplementations, adding to (and replacing, where the
+     * sizes coincide) any already recorded. Entries naming
+     * implementations that are not compiled in are ignored. Return
+     * false if the file could not be read.
+     *
+     * If the environment variable RUBBERBAND_FFT_CACHE names a file
+     * when the first FFT is constructed, that file is loaded
+     * automatically.
+     */
+    static bool loadTunedImplementations(std::string filename);
+
+    /**
+     * Write all recorded per-size choices to the given file. Return
+     * false if the file could not be written.
+     */
+    static bool saveTunedImplementations(std::string filename);
+
 #ifdef FFT_MEASUREMENT
     static std::string tune();
 #endif
@@ -0,0 +1,167 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_FLOAT_GUARDS_H
+#define RUBBERBAND_FLOAT_GUARDS_H
+
+#include "sysutils.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RB_FLOAT_GUARDS_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RB_FLOAT_GUARDS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace RubberBand {
+
+/**
+ * Switch the calling thread's floating-point unit into
+ * flush-to-zero and denormals-are-zero mode for the lifetime of the
+ * object, restoring the previous mode on destruction. Processing
+ * denormal values can be many times slower than normal ones, and
+ * they arise routinely as filter and accumulator state decays into
+ * silence.
+ *
+ * This affects SSE arithmetic on x86 (the MXCSR FTZ and DAZ bits)
+ * and all floating-point arithmetic on 64-bit ARM (the FPCR FZ
+ * bit). Elsewhere it does nothing.
+ */
+class ScopedFlushToZero
+{
+public:
+    ScopedFlushToZero() {
+#if defined(RB_FLOAT_GUARDS_SSE2)
+        m_saved = _mm_getcsr();
+        unsigned int wanted = m_saved | 0x8040; // FTZ | DAZ
+        if (wanted != m_saved) _mm_setcsr(wanted);
+#elif defined(RB_FLOAT_GUARDS_NEON) && defined(__GNUC__)
+        uint64_t fpcr;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        m_saved = fpcr;
+        fpcr |= (uint64_t(1) << 24); // FZ
+        if (fpcr != m_saved) {
+            __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+        }
+#endif
+    }
+
+    ~ScopedFlushToZero() {
+#if defined(RB_FLOAT_GUARDS_SSE2)
+        if (_mm_getcsr() != m_saved) _mm_setcsr(m_saved);
+#elif defined(RB_FLOAT_GUARDS_NEON) && defined(__GNUC__)
+        uint64_t fpcr;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        if (fpcr != m_saved) {
+            __asm__ __volatile__("msr fpcr, %0" : : "r"(m_saved));
+        }
+#endif
+    }
+
+private:
+#if defined(RB_FLOAT_GUARDS_SSE2)
+    unsigned int m_saved;
+#elif defined(RB_FLOAT_GUARDS_NEON) && defined(__GNUC__)
+    uint64_t m_saved;
+#endif
+
+    ScopedFlushToZero(const ScopedFlushToZero &) =delete;
+    ScopedFlushToZero &operator=(const ScopedFlushToZero &) =delete;
+};
+
+// NaN and infinity are the values with all exponent bits set, so
+// these test the bit patterns directly. That works regardless of
+// compiler floating-point options and vectorises readily.
+
+/**
+ * Return true if none of the count values in src is NaN or infinite.
+ */
+inline bool v_all_finite(const float *const R__ src,
+                         const int count)
+{
+    int i = 0;
+#if defined(RB_FLOAT_GUARDS_SSE2)
+    const __m128i mask = _mm_set1_epi32(0x7f800000);
+    __m128i any = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i e = _mm_and_si128
+            (_mm_castps_si128(_mm_loadu_ps(src + i)), mask);
+        any = _mm_or_si128(any, _mm_cmpeq_epi32(e, mask));
+    }
+    if (_mm_movemask_epi8(any)) return false;
+#elif defined(RB_FLOAT_GUARDS_NEON)
+    const uint32x4_t mask = vdupq_n_u32(0x7f800000);
+    uint32x4_t any = vdupq_n_u32(0);
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t e = vandq_u32
+            (vreinterpretq_u32_f32(vld1q_f32(src + i)), mask);
+        any = vorrq_u32(any, vceqq_u32(e, mask));
+    }
+    if (vmaxvq_u32(any)) return false;
+#endif
+    for (; i < count; ++i) {
+        uint32_t bits;
+        memcpy(&bits, src + i, sizeof(bits));
+        if ((bits & 0x7f800000u) == 0x7f800000u) return false;
+    }
+    return true;
+}
+
+/**
+ * Copy count values from src to dst, replacing any that are NaN or
+ * infinite with zero.
+ */
+inline void v_copy_finite(float *const R__ dst,
+                          const float *const R__ src,
+                          const int count)
+{
+    int i = 0;
+#if defined(RB_FLOAT_GUARDS_SSE2)
+    const __m128i mask = _mm_set1_epi32(0x7f800000);
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_castps_si128(_mm_loadu_ps(src + i));
+        __m128i bad = _mm_cmpeq_epi32(_mm_and_si128(x, mask), mask);
+        _mm_storeu_ps(dst + i, _mm_castsi128_ps(_mm_andnot_si128(bad, x)));
+    }
+#elif defined(RB_FLOAT_GUARDS_NEON)
+    const uint32x4_t mask = vdupq_n_u32(0x7f800000);
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t x = vreinterpretq_u32_f32(vld1q_f32(src + i));
+        uint32x4_t bad = vceqq_u32(vandq_u32(x, mask), mask);
+        vst1q_f32(dst + i, vreinterpretq_f32_u32(vbicq_u32(x, bad)));
+    }
+#endif
+    for (; i < count; ++i) {
+        uint32_t bits;
+        memcpy(&bits, src + i, sizeof(bits));
+        dst[i] = ((bits & 0x7f800000u) == 0x7f800000u) ? 0.f : src[i];
+    }
+}
+
+}
+
+#endif
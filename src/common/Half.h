@@ -0,0 +1,203 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_HALF_H
+#define RUBBERBAND_HALF_H
+
+#include "VectorOps.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace RubberBand {
+
+/**
+ * An IEEE 754 half-precision value, for compact storage only. A Half
+ * converts implicitly to float, and from float with rounding to
+ * nearest, so it can be compared and used in arithmetic directly,
+ * but all arithmetic happens at float precision or above.
+ *
+ * Conversions use the F16C instructions on x86 or the FP16
+ * conversions on 64-bit ARM where the compiler is targeting them,
+ * and portable bit manipulation otherwise.
+ */
+class Half
+{
+public:
+    Half() : m_bits(0) { }
+    Half(float f) : m_bits(fromFloat(f)) { }
+
+    operator float() const { return toFloat(m_bits); }
+
+    static uint16_t fromFloat(float f) {
+#if defined(__F16C__)
+        return _cvtss_sh(f, 0);
+#elif defined(__aarch64__)
+        __fp16 h = f;
+        uint16_t bits;
+        memcpy(&bits, &h, sizeof(bits));
+        return bits;
+#else
+        uint32_t x;
+        memcpy(&x, &f, sizeof(x));
+        uint32_t sign = (x >> 16) & 0x8000;
+        uint32_t absx = x & 0x7fffffff;
+        if (absx >= 0x7f800000) { // infinity or NaN
+            return sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0);
+        }
+        if (absx >= 0x47800000) { // too large, round to infinity
+            return sign | 0x7c00;
+        }
+        if (absx < 0x33000000) { // too small, round to zero
+            return sign;
+        }
+        uint32_t h, rem, halfway;
+        if (absx < 0x38800000) { // subnormal in half precision
+            uint32_t m = (absx & 0x7fffff) | 0x800000;
+            int shift = 126 - int(absx >> 23);
+            h = m >> shift;
+            rem = m & ((1u << shift) - 1);
+            halfway = 1u << (shift - 1);
+        } else {
+            h = (((absx >> 23) - 112) << 10) | ((absx & 0x7fffff) >> 13);
+            rem = absx & 0x1fff;
+            halfway = 0x1000;
+        }
+        // Round to nearest even; a carry out of the mantissa
+        // correctly increments the exponent
+        if (rem > halfway || (rem == halfway && (h & 1))) {
+            ++h;
+        }
+        return uint16_t(sign | h);
+#endif
+    }
+
+    static float toFloat(uint16_t bits) {
+#if defined(__F16C__)
+        return _cvtsh_ss(bits);
+#elif defined(__aarch64__)
+        __fp16 h;
+        memcpy(&h, &bits, sizeof(h));
+        return h;
+#else
+        uint32_t sign = uint32_t(bits & 0x8000) << 16;
+        uint32_t e = (bits >> 10) & 0x1f;
+        uint32_t m = bits & 0x3ff;
+        uint32_t x;
+        if (e == 0) {
+            float f = float(m) * 5.9604644775390625e-8f; // 2^-24
+            return sign ? -f : f;
+        } else if (e == 31) {
+            x = sign | 0x7f800000 | (m << 13);
+        } else {
+            x = sign | ((e + 112) << 23) | (m << 13);
+        }
+        float f;
+        memcpy(&f, &x, sizeof(f));
+        return f;
+#endif
+    }
+
+private:
+    uint16_t m_bits;
+};
+
+inline void v_convert(Half *const R__ dst,
+                      const float *const R__ src,
+                      const int count)
+{
+    int i = 0;
+#if defined(__F16C__)
+    for (; i + 4 <= count; i += 4) {
+        __m128i h = _mm_cvtps_ph(_mm_loadu_ps(src + i), 0);
+        _mm_storel_epi64((__m128i *)(dst + i), h);
+    }
+#elif defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        float16x4_t h = vcvt_f16_f32(vld1q_f32(src + i));
+        vst1_u16((uint16_t *)(dst + i), vreinterpret_u16_f16(h));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = Half(src[i]);
+    }
+}
+
+inline void v_convert(float *const R__ dst,
+                      const Half *const R__ src,
+                      const int count)
+{
+    int i = 0;
+#if defined(__F16C__)
+    for (; i + 4 <= count; i += 4) {
+        __m128i h = _mm_loadl_epi64((const __m128i *)(src + i));
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(h));
+    }
+#elif defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        float16x4_t h = vreinterpret_f16_u16(vld1_u16((const uint16_t *)(src + i)));
+        vst1q_f32(dst + i, vcvt_f32_f16(h));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = float(src[i]);
+    }
+}
+
+inline void v_convert(Half *const R__ dst,
+                      const double *const R__ src,
+                      const int count)
+{
+    // Narrow to float a short block at a time, so as to use the
+    // vectorised conversions above
+    const int block = 64;
+    float tmp[block];
+    for (int i = 0; i < count; i += block) {
+        int n = (count - i < block ? count - i : block);
+        v_convert(tmp, src + i, n);
+        v_convert(dst + i, tmp, n);
+    }
+}
+
+inline void v_convert(double *const R__ dst,
+                      const Half *const R__ src,
+                      const int count)
+{
+    const int block = 64;
+    float tmp[block];
+    for (int i = 0; i < count; i += block) {
+        int n = (count - i < block ? count - i : block);
+        v_convert(tmp, src + i, n);
+        v_convert(dst + i, tmp, n);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,160 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_HISTORY_BUFFER_H
+#define RUBBERBAND_HISTORY_BUFFER_H
+
+#include "Allocators.h"
+#include "VectorOps.h"
+#include "Half.h"
+#include "sysutils.h"
+
+namespace RubberBand {
+
+/**
+ * Precision at which values carried from one processing block to
+ * the next are stored. Arithmetic on them is always at process_t
+ * precision.
+ */
+enum class HistoryPrecision {
+    Full,       // process_t
+    Single,     // float
+    HalfFloat   // IEEE half precision
+};
+
+/**
+ * A fixed-size array of process_t values held at a given
+ * HistoryPrecision. Values are read and written through conversion
+ * in blocks, so that the caller can work on them at full precision
+ * in a short scratch buffer while the history itself stays compact.
+ */
+class HistoryBuffer
+{
+public:
+    HistoryBuffer(HistoryPrecision precision, int size) :
+        m_precision(precision),
+        m_size(size),
+        m_full(nullptr),
+        m_single(nullptr),
+        m_half(nullptr) {
+        switch (m_precision) {
+        case HistoryPrecision::Full:
+            m_full = allocate_and_zero<process_t>(m_size);
+            break;
+        case HistoryPrecision::Single:
+            m_single = allocate_and_zero<float>(m_size);
+            break;
+        case HistoryPrecision::HalfFloat:
+            m_half = allocate_and_zero<Half>(m_size);
+            break;
+        }
+    }
+
+    ~HistoryBuffer() {
+        deallocate(m_full);
+        deallocate(m_single);
+        deallocate(m_half);
+    }
+
+    HistoryPrecision getPrecision() const {
+        return m_precision;
+    }
+
+    int getSize() const {
+        return m_size;
+    }
+
+    /** Return the number of bytes used for the values.
+     */
+    size_t getFootprint() const {
+        switch (m_precision) {
+        case HistoryPrecision::Full: return m_size * sizeof(process_t);
+        case HistoryPrecision::Single: return m_size * sizeof(float);
+        case HistoryPrecision::HalfFloat: return m_size * sizeof(Half);
+        }
+        return 0;
+    }
+
+    /** Reallocate to the given size. All values are reset to zero.
+     */
+    void resize(int size) {
+        switch (m_precision) {
+        case HistoryPrecision::Full:
+            m_full = reallocate_and_zero(m_full, m_size, size);
+            break;
+        case HistoryPrecision::Single:
+            m_single = reallocate_and_zero(m_single, m_size, size);
+            break;
+        case HistoryPrecision::HalfFloat:
+            m_half = reallocate_and_zero(m_half, m_size, size);
+            break;
+        }
+        m_size = size;
+    }
+
+    void zero() {
+        zero(0, m_size);
+    }
+
+    void zero(int from, int count) {
+        switch (m_precision) {
+        case HistoryPrecision::Full: v_zero(m_full + from, count); break;
+        case HistoryPrecision::Single: v_zero(m_single + from, count); break;
+        case HistoryPrecision::HalfFloat: v_zero(m_half + from, count); break;
+        }
+    }
+
+    /** Read count values starting at index from into the array to.
+     */
+    void read(process_t *const R__ to, int from, int count) const {
+        switch (m_precision) {
+        case HistoryPrecision::Full: v_copy(to, m_full + from, count); break;
+        case HistoryPrecision::Single: v_convert(to, m_single + from, count); break;
+        case HistoryPrecision::HalfFloat: v_convert(to, m_half + from, count); break;
+        }
+    }
+
+    /** Write count values from the array from, starting at index to.
+     */
+    void write(const process_t *const R__ from, int to, int count) {
+        switch (m_precision) {
+        case HistoryPrecision::Full: v_copy(m_full + to, from, count); break;
+        case HistoryPrecision::Single: v_convert(m_single + to, from, count); break;
+        case HistoryPrecision::HalfFloat: v_convert(m_half + to, from, count); break;
+        }
+    }
+
+private:
+    HistoryPrecision m_precision;
+    int m_size;
+    process_t *m_full;
+    float *m_single;
+    Half *m_half;
+
+    HistoryBuffer(const HistoryBuffer &) =delete;
+    HistoryBuffer &operator=(const HistoryBuffer &) =delete;
+};
+
+}
+
+#endif
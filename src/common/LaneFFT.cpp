@@ -0,0 +1,278 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "LaneFFT.h"
+
+#include "sysutils.h"
+
+#include <cmath>
+
+namespace RubberBand {
+
+// The per-lane loops are in functions of their own because the
+// compiler will vectorise them cheaply only when it knows from the
+// restrict-qualified arguments that the rows do not overlap
+
+static inline void
+lane_butterfly(float *const R__ rj, float *const R__ ij,
+               float *const R__ rk, float *const R__ ik,
+               const float ar, const float ai)
+{
+    for (int l = 0; l < LaneFFT::lanes; ++l) {
+        float tr = ar * rk[l] - ai * ik[l];
+        float ti = ar * ik[l] + ai * rk[l];
+        rk[l] = rj[l] - tr;
+        ik[l] = ij[l] - ti;
+        rj[l] += tr;
+        ij[l] += ti;
+    }
+}
+
+// Combine rows k and j = half - k of one complex spectrum into rows
+// k and j of another, for the real-complex unpacking (or packing) of
+// the half-size transform
+static inline void
+lane_unpack(const float *const R__ rk, const float *const R__ ik,
+            const float *const R__ rj, const float *const R__ ij,
+            float *const R__ ork, float *const R__ oik,
+            float *const R__ orj, float *const R__ oij,
+            const float s, const float c, const float scale)
+{
+    for (int l = 0; l < LaneFFT::lanes; ++l) {
+        float r0 = rk[l];
+        float i0 = ik[l];
+        float r1 = rj[l];
+        float i1 = -ij[l];
+        float tw_r = (r0 - r1) * c - (i0 - i1) * s;
+        float tw_i = (r0 - r1) * s + (i0 - i1) * c;
+        ork[l] = (r0 + r1 + tw_r) * scale;
+        orj[l] = (r0 + r1 - tw_r) * scale;
+        oik[l] = (i0 + i1 + tw_i) * scale;
+        oij[l] = (tw_i - i0 - i1) * scale;
+    }
+}
+
+// The same for the middle row, where k == j
+static inline void
+lane_unpack_middle(const float *const R__ rk, const float *const R__ ik,
+                   float *const R__ ork, float *const R__ oik,
+                   const float s, const float c, const float scale)
+{
+    for (int l = 0; l < LaneFFT::lanes; ++l) {
+        float r0 = rk[l];
+        float i0 = ik[l];
+        float tw_r = -(i0 + i0) * s;
+        float tw_i = (i0 + i0) * c;
+        ork[l] = (r0 + r0 - tw_r) * scale;
+        oik[l] = tw_i * scale;
+    }
+}
+
+LaneFFT::LaneFFT(int size) :
+    m_size(size),
+    m_half(size/2),
+    m_table(m_half, 0),
+    m_twiddleCos(m_half, 0.f),
+    m_twiddleSin(m_half, 0.f),
+    m_sincosR(m_half, 0.f),
+    m_a((m_half + 1) * lanes, 0.f),
+    m_b((m_half + 1) * lanes, 0.f),
+    m_vr(m_half * lanes, 0.f),
+    m_vi(m_half * lanes, 0.f)
+{
+    // As in the built-in FFT: bit-reversal table for the complex
+    // transform of half the size, then twiddles, then the sin and
+    // cos table for the real-complex unpacking
+
+    const int n = m_half;
+
+    int bits = 0;
+    while ((1 << bits) < n) ++bits;
+
+    for (int i = 0; i < n; ++i) {
+        int m = i, k = 0;
+        for (int j = 0; j < bits; ++j) {
+            k = (k << 1) | (m & 1);
+            m >>= 1;
+        }
+        m_table[i] = k;
+    }
+
+    // Each stage with block size b uses the b/2 twiddles exp(-2 pi i
+    // m / b), and the stages together use n - 1 of them
+
+    int ix = 0;
+    for (int blockSize = 2; blockSize <= n; blockSize <<= 1) {
+        int blockEnd = blockSize / 2;
+        for (int m = 0; m < blockEnd; ++m) {
+            double phase = 2.0 * M_PI * double(m) / double(blockSize);
+            m_twiddleCos[ix] = float(cos(phase));
+            m_twiddleSin[ix] = float(sin(phase));
+            ++ix;
+        }
+    }
+
+    ix = 0;
+    for (int i = 0; i < n/2; ++i) {
+        double phase = M_PI * (double(i + 1) / double(m_half) + 0.5);
+        m_sincosR[ix++] = float(sin(phase));
+        m_sincosR[ix++] = float(cos(phase));
+    }
+}
+
+void
+LaneFFT::forward(const float *const R__ ri,
+                 float *const R__ ro,
+                 float *const R__ io)
+{
+    const int L = lanes;
+    const int half = m_half;
+    const int halfhalf = half / 2;
+    float *const R__ a = m_a.data();
+    float *const R__ b = m_b.data();
+    float *const R__ vr = m_vr.data();
+    float *const R__ vi = m_vi.data();
+
+    for (int i = 0; i < half; ++i) {
+        for (int l = 0; l < L; ++l) {
+            a[i * L + l] = ri[(i * 2) * L + l];
+            b[i * L + l] = ri[(i * 2 + 1) * L + l];
+        }
+    }
+
+    transformComplex(a, b, vr, vi, false);
+
+    for (int l = 0; l < L; ++l) {
+        ro[l] = vr[l] + vi[l];
+        ro[half * L + l] = vr[l] - vi[l];
+        io[l] = 0.f;
+        io[half * L + l] = 0.f;
+    }
+
+    const float *const R__ sc = m_sincosR.data();
+
+    for (int i = 0; i + 1 < halfhalf; ++i) {
+        const float s = -sc[i * 2];
+        const float c = sc[i * 2 + 1];
+        const int k = (i + 1) * L;
+        const int j = (half - i - 1) * L;
+        lane_unpack(vr + k, vi + k, vr + j, vi + j,
+                    ro + k, io + k, ro + j, io + j, s, c, 0.5f);
+    }
+
+    if (halfhalf > 0) {
+        const int i = halfhalf - 1;
+        const int k = halfhalf * L;
+        lane_unpack_middle(vr + k, vi + k, ro + k, io + k,
+                           -sc[i * 2], sc[i * 2 + 1], 0.5f);
+    }
+}
+
+void
+LaneFFT::inverse(const float *const R__ ri,
+                 const float *const R__ ii,
+                 float *const R__ ro)
+{
+    const int L = lanes;
+    const int half = m_half;
+    const int halfhalf = half / 2;
+    float *const R__ a = m_a.data();
+    float *const R__ b = m_b.data();
+    float *const R__ vr = m_vr.data();
+    float *const R__ vi = m_vi.data();
+
+    for (int l = 0; l < L; ++l) {
+        vr[l] = ri[l] + ri[half * L + l];
+        vi[l] = ri[l] - ri[half * L + l];
+    }
+
+    const float *const R__ sc = m_sincosR.data();
+
+    for (int i = 0; i + 1 < halfhalf; ++i) {
+        const float s = sc[i * 2];
+        const float c = sc[i * 2 + 1];
+        const int k = (i + 1) * L;
+        const int j = (half - i - 1) * L;
+        lane_unpack(ri + k, ii + k, ri + j, ii + j,
+                    vr + k, vi + k, vr + j, vi + j, s, c, 1.f);
+    }
+
+    if (halfhalf > 0) {
+        const int i = halfhalf - 1;
+        const int k = halfhalf * L;
+        lane_unpack_middle(ri + k, ii + k, vr + k, vi + k,
+                           sc[i * 2], sc[i * 2 + 1], 1.f);
+    }
+
+    transformComplex(vr, vi, a, b, true);
+
+    for (int i = 0; i < half; ++i) {
+        for (int l = 0; l < L; ++l) {
+            ro[(i * 2) * L + l] = a[i * L + l];
+            ro[(i * 2 + 1) * L + l] = b[i * L + l];
+        }
+    }
+}
+
+void
+LaneFFT::transformComplex(const float *const R__ ri,
+                          const float *const R__ ii,
+                          float *const R__ ro,
+                          float *const R__ io,
+                          bool inverse)
+{
+    const int L = lanes;
+    const int n = m_half;
+
+    for (int i = 0; i < n; ++i) {
+        const int j = m_table[i];
+        for (int l = 0; l < L; ++l) {
+            ro[j * L + l] = ri[i * L + l];
+            io[j * L + l] = ii[i * L + l];
+        }
+    }
+
+    const float ifactor = (inverse ? 1.f : -1.f);
+    const float *twc = m_twiddleCos.data();
+    const float *tws = m_twiddleSin.data();
+
+    for (int blockSize = 2; blockSize <= n; blockSize <<= 1) {
+
+        const int blockEnd = blockSize / 2;
+
+        for (int i = 0; i < n; i += blockSize) {
+            for (int m = 0; m < blockEnd; ++m) {
+
+                const int j = (i + m) * L;
+                const int k = (i + m + blockEnd) * L;
+                lane_butterfly(ro + j, io + j, ro + k, io + k,
+                               twc[m], ifactor * tws[m]);
+            }
+        }
+
+        twc += blockEnd;
+        tws += blockEnd;
+    }
+}
+
+}
@@ -0,0 +1,87 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_LANE_FFT_H
+#define RUBBERBAND_LANE_FFT_H
+
+#include "FixedVector.h"
+
+namespace RubberBand {
+
+/**
+ * Real-complex FFT of a fixed power-of-two size, carried out on a
+ * number of independent signals ("lanes") at once. Data are
+ * lane-interleaved: sample or bin i of lane l is at index i * lanes
+ * + l. Every butterfly then operates on a contiguous run of lanes
+ * values sharing the same twiddle factor, which the compiler can
+ * vectorise across lanes however the transform itself is laid out.
+ *
+ * The algorithm and scaling are those of the built-in FFT
+ * implementation: a complex FFT of half the size, with the real
+ * transform unpacked from it, and no normalisation in either
+ * direction. Unlike FFT, this is single-precision only and has no
+ * alternative implementations.
+ */
+class LaneFFT
+{
+public:
+    static const int lanes = 8;
+
+    LaneFFT(int size);
+
+    int getSize() const { return m_size; }
+
+    /**
+     * Transform size * lanes real input samples into (size/2 + 1) *
+     * lanes real and imaginary outputs.
+     */
+    void forward(const float *realIn, float *realOut, float *imagOut);
+
+    /**
+     * Transform (size/2 + 1) * lanes real and imaginary inputs into
+     * size * lanes real output samples.
+     */
+    void inverse(const float *realIn, const float *imagIn, float *realOut);
+
+private:
+    const int m_size;
+    const int m_half;
+    FixedVector<int> m_table;
+    FixedVector<float> m_twiddleCos; // per butterfly stage, concatenated
+    FixedVector<float> m_twiddleSin;
+    FixedVector<float> m_sincosR;    // for real-complex unpacking
+    FixedVector<float> m_a;
+    FixedVector<float> m_b;
+    FixedVector<float> m_vr;
+    FixedVector<float> m_vi;
+
+    void transformComplex(const float *ri, const float *ii,
+                          float *ro, float *io, bool inverse);
+
+    LaneFFT(const LaneFFT &) =delete;
+    LaneFFT &operator=(const LaneFFT &) =delete;
+};
+
+}
+
+#endif
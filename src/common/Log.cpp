@@ -28,4 +28,30 @@ namespace RubberBand
 
 int Log::m_defaultDebugLevel = 0;
 
+int
+Log::drain() const
+{
+    if (!m_queue) return 0;
+
+    int count = 0;
+    LogQueue::Record record;
+
+    while (m_queue->pop(record)) {
+        switch (record.argCount) {
+        case 0: m_log0(record.message); break;
+        case 1: m_log1(record.message, record.arg0); break;
+        default: m_log2(record.message, record.arg0, record.arg1); break;
+        }
+        ++count;
+    }
+
+    int dropped = m_queue->takeDroppedCount();
+    if (dropped > 0) {
+        m_log1("Log::drain: WARNING: Messages dropped as the queue was full",
+               dropped);
+    }
+    
+    return count;
+}
+
 }
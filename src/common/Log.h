@@ -24,8 +24,11 @@
 #ifndef RUBBERBAND_LOG_H
 #define RUBBERBAND_LOG_H
 
+#include "LogQueue.h"
+
 #include <functional>
 #include <iostream>
+#include <memory>
 
 namespace RubberBand {
 
@@ -48,23 +51,70 @@ public:
     int getDebugLevel() const { return m_debugLevel; }
 
     static void setDefaultDebugLevel(int level) { m_defaultDebugLevel = level; }
+
+    static const int defaultQueueCapacity = 1024;
+
+    /**
+     * Return a copy of this log that, instead of calling its
+     * functions, queues each message for delivery by a later call to
+     * drain(). Copies of the returned log share its queue, so one
+     * drain() delivers the messages logged through all of them. A
+     * deferred log never blocks or allocates when logging, so it is
+     * RT-safe at any debug level, provided its messages are string
+     * constants (which a queued record only points to).
+     */
+    Log deferred(int capacity = defaultQueueCapacity) const {
+        Log log(*this);
+        log.m_queue = std::make_shared<LogQueue>(capacity);
+        return log;
+    }
+
+    bool isDeferred() const { return bool(m_queue); }
+
+    /**
+     * Deliver any queued messages to the log functions, followed by
+     * a note of how many were dropped because the queue was full, if
+     * any were. Return the number of queued messages delivered. Not
+     * RT-safe, and must not be called from two threads at once.
+     */
+    int drain() const;
     
     void log(int level, const char *message) const {
-        if (level <= m_debugLevel) m_log0(message);
+        if (level <= m_debugLevel) {
+            if (m_queue) enqueue(message, 0, 0.0, 0.0);
+            else m_log0(message);
+        }
     }
     void log(int level, const char *message, double arg0) const {
-        if (level <= m_debugLevel) m_log1(message, arg0);
+        if (level <= m_debugLevel) {
+            if (m_queue) enqueue(message, 1, arg0, 0.0);
+            else m_log1(message, arg0);
+        }
     }
     void log(int level, const char *message, double arg0, double arg1) const {
-        if (level <= m_debugLevel) m_log2(message, arg0, arg1);
+        if (level <= m_debugLevel) {
+            if (m_queue) enqueue(message, 2, arg0, arg1);
+            else m_log2(message, arg0, arg1);
+        }
     }
 
 private:
     std::function<void(const char *)> m_log0;
     std::function<void(const char *, double)> m_log1;
     std::function<void(const char *, double, double)> m_log2;
+    std::shared_ptr<LogQueue> m_queue;
     int m_debugLevel;
     static int m_defaultDebugLevel;
+
+    void enqueue(const char *message, int argCount,
+                 double arg0, double arg1) const {
+        LogQueue::Record record;
+        record.message = message;
+        record.argCount = argCount;
+        record.arg0 = arg0;
+        record.arg1 = arg1;
+        m_queue->push(record);
+    }
 };
 
 }
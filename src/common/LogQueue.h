@@ -0,0 +1,151 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+
+#ifndef RUBBERBAND_LOG_QUEUE_H
+#define RUBBERBAND_LOG_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+namespace RubberBand {
+
+/**
+ * Fixed-capacity queue of log records, for deferring the delivery of
+ * log messages from threads that must not block. Any number of
+ * threads may push at once, without locking or allocation; a single
+ * thread at a time may pop. This is the bounded queue described by
+ * Dmitry Vyukov, in which each cell carries a sequence number that
+ * tells a pushing or popping thread whether the cell is ready for
+ * it.
+ *
+ * A record holds only the message pointer, which must therefore
+ * remain valid until the record is popped. In practice messages are
+ * string constants. A push to a full queue fails, and is counted.
+ */
+class LogQueue
+{
+public:
+    struct Record {
+        const char *message;
+        int argCount;
+        double arg0;
+        double arg1;
+    };
+
+    /**
+     * Construct a queue with room for at least the given number of
+     * records, rounded up to a power of two.
+     */
+    LogQueue(int capacity) :
+        m_mask(roundUp(capacity) - 1),
+        m_cells(new Cell[m_mask + 1]),
+        m_pushPosition(0),
+        m_popPosition(0),
+        m_dropped(0) {
+        for (size_t i = 0; i <= m_mask; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    int getCapacity() const { return int(m_mask + 1); }
+
+    /**
+     * Add a record. Return false, and count the record as dropped, if
+     * the queue is full. RT-safe.
+     */
+    bool push(const Record &record) {
+        size_t position = m_pushPosition.load(std::memory_order_relaxed);
+        Cell *cell = nullptr;
+        while (true) {
+            cell = &m_cells[position & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            ptrdiff_t diff = ptrdiff_t(sequence) - ptrdiff_t(position);
+            if (diff == 0) {
+                if (m_pushPosition.compare_exchange_weak
+                    (position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = m_pushPosition.load(std::memory_order_relaxed);
+            }
+        }
+        cell->record = record;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest record into the argument. Return false if
+     * there is none. Must not be called from two threads at once.
+     */
+    bool pop(Record &record) {
+        size_t position = m_popPosition.load(std::memory_order_relaxed);
+        Cell &cell = m_cells[position & m_mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != position + 1) {
+            return false;
+        }
+        record = cell.record;
+        cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+        m_popPosition.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Return the number of records dropped since the last call, and
+     * reset the count.
+     */
+    int takeDroppedCount() {
+        return m_dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    std::atomic<size_t> m_pushPosition;
+    std::atomic<size_t> m_popPosition;
+    std::atomic<int> m_dropped;
+
+    static size_t roundUp(int capacity) {
+        size_t n = 2;
+        while (n < size_t(capacity)) n <<= 1;
+        return n;
+    }
+
+    LogQueue(const LogQueue &) =delete;
+    LogQueue &operator=(const LogQueue &) =delete;
+};
+
+}
+
+#endif
@@ -30,7 +30,6 @@
 #include "SingleThreadRingBuffer.h"
 
 #include <algorithm>
-#include <iostream>
 
 namespace RubberBand
 {
@@ -41,6 +40,10 @@ namespace RubberBand
  * can get() the median.  You can call drop() to drop the oldest value
  * without pushing a new one, for example to drain the filter at the
  * tail of the sequence.
+ *
+ * Values pushed must not be NaN, as they would corrupt the sort
+ * order. Audio input is sanitised once on entry to the stretcher
+ * (see FloatGuards.h) rather than checked here for every value.
  */
 template <typename T>
 class MovingMedian : public SampleFilter<T>
@@ -50,7 +53,7 @@ class MovingMedian : public SampleFilter<T>
 public:
     MovingMedian(int filterLength, float percentile = fifty) :
         m_buffer(filterLength),
-        m_sortspace(filterLength, {}),
+        m_sortspace(filterLength, T()),
         m_fill(0),
         m_percentile(percentile)
     { }
@@ -69,10 +72,6 @@ public:
     }
     
     void push(T value) {
-        if (value != value) {
-            std::cerr << "WARNING: MovingMedian: NaN encountered" << std::endl;
-            value = T();
-        }
         if (m_fill == getSize()) {
             T toDrop = m_buffer.readOne();
             dropAndPut(toDrop, value);
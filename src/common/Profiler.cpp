@@ -24,6 +24,7 @@
 #include "Profiler.h"
 
 #include "Thread.h"
+#include "Tracer.h"
 
 #include <algorithm>
 #include <set>
@@ -184,8 +185,10 @@ Profiler::getReport()
 
 Profiler::Profiler(const char* c) :
     m_c(c),
-    m_ended(false)
+    m_ended(false),
+    m_traced(Tracer::isRecording())
 {
+    if (m_traced) Tracer::begin(m_c);
 #ifdef PROFILE_CLOCKS
     m_start = clock();
 #else
@@ -220,6 +223,11 @@ Profiler::end()
 
     add(m_c, ms);
 
+    if (m_traced) {
+        Tracer::end(m_c);
+        m_traced = false;
+    }
+
     m_ended = true;
 }
  
@@ -227,9 +235,27 @@ Profiler::end()
 
 #ifndef NO_TIMING_COMPLETE_NOOP
 
-Profiler::Profiler(const char *) { }
-Profiler::~Profiler() { }
-void Profiler::end() { }
+Profiler::Profiler(const char *c) :
+    m_c(c),
+    m_traced(Tracer::isRecording())
+{
+    if (m_traced) Tracer::begin(m_c);
+}
+
+Profiler::~Profiler()
+{
+    end();
+}
+
+void
+Profiler::end()
+{
+    if (m_traced) {
+        Tracer::end(m_c);
+        m_traced = false;
+    }
+}
+
 void Profiler::dump() { }
 
 #endif
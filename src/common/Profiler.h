@@ -83,6 +83,7 @@ protected:
 #endif
     bool m_showOnDestruct;
     bool m_ended;
+    bool m_traced;
 
     typedef std::pair<int, float> TimePair;
     typedef std::map<const char *, TimePair> ProfileMap;
@@ -112,6 +113,9 @@ public:
 
 #else
 
+// Records nothing itself, but passes begin and end events through
+// to the Tracer when that is recording
+
 class Profiler
 {
 public:
@@ -120,6 +124,10 @@ public:
 
     void end();
     static void dump();
+
+protected:
+    const char *m_c;
+    bool m_traced;
 };
 
 #endif
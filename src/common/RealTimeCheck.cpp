@@ -0,0 +1,161 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "RealTimeCheck.h"
+
+#ifdef CHECK_RT_SAFETY
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+namespace RubberBand {
+
+// Nothing here may allocate or lock, as it is called from within
+// operator new and the Mutex implementation. The depth is a plain
+// thread-local int so as to need no dynamic initialisation.
+
+static thread_local int sectionDepth = 0;
+
+static std::atomic<int> violationCounts[RealTimeCheck::KindCount];
+static std::atomic<const char *> lastViolation(nullptr);
+
+RealTimeCheck::Section::Section(bool active) :
+    m_active(active)
+{
+    if (m_active) ++sectionDepth;
+}
+
+RealTimeCheck::Section::~Section()
+{
+    if (m_active) --sectionDepth;
+}
+
+void
+RealTimeCheck::hit(Kind kind, const char *where)
+{
+    if (sectionDepth > 0) {
+        ++violationCounts[kind];
+        lastViolation = where;
+    }
+}
+
+bool
+RealTimeCheck::inSection()
+{
+    return sectionDepth > 0;
+}
+
+int
+RealTimeCheck::getViolationCount(Kind kind)
+{
+    return violationCounts[kind];
+}
+
+int
+RealTimeCheck::getViolationCount()
+{
+    int total = 0;
+    for (int i = 0; i < KindCount; ++i) {
+        total += violationCounts[i];
+    }
+    return total;
+}
+
+const char *
+RealTimeCheck::getLastViolation()
+{
+    const char *where = lastViolation;
+    return where ? where : "";
+}
+
+void
+RealTimeCheck::resetViolations()
+{
+    for (int i = 0; i < KindCount; ++i) {
+        violationCounts[i] = 0;
+    }
+    lastViolation = nullptr;
+}
+
+}
+
+// Replacements for the global allocation functions, so that
+// std::vector growth, std::map insertion, new-expressions and the
+// like are caught as well as our own allocate() calls
+
+using RubberBand::RealTimeCheck;
+
+void *operator new(size_t size)
+{
+    RealTimeCheck::hit(RealTimeCheck::Allocation, "operator new");
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    RealTimeCheck::hit(RealTimeCheck::Allocation, "operator new[]");
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    RealTimeCheck::hit(RealTimeCheck::Allocation, "operator new");
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    RealTimeCheck::hit(RealTimeCheck::Allocation, "operator new[]");
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (!ptr) return;
+    RealTimeCheck::hit(RealTimeCheck::Deallocation, "operator delete");
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    if (!ptr) return;
+    RealTimeCheck::hit(RealTimeCheck::Deallocation, "operator delete[]");
+    free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    operator delete[](ptr);
+}
+
+#endif
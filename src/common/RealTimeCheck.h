@@ -0,0 +1,117 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_REAL_TIME_CHECK_H
+#define RUBBERBAND_REAL_TIME_CHECK_H
+
+// Define CHECK_RT_SAFETY to compile in the real-time safety checks
+// below. This is intended for test builds only: it replaces the
+// global operator new and delete, and adds a thread-local lookup to
+// every allocation and lock.
+
+//#define CHECK_RT_SAFETY 1
+
+namespace RubberBand {
+
+/**
+ * Instrumentation for verifying that nothing called from within a
+ * real-time processing call allocates memory or blocks.
+ *
+ * The public process and retrieve functions open a Section on the
+ * calling thread when the stretcher is in real-time mode. The
+ * Allocators.h functions, global operator new and delete, and the
+ * Mutex, Condition and Thread primitives report themselves through
+ * hit(); a hit on a thread that is within a Section is recorded as
+ * a violation. Calls from other threads, such as the R2 stretcher's
+ * own processing threads, are not affected.
+ *
+ * Without CHECK_RT_SAFETY everything here compiles to nothing and
+ * isEnabled() returns false.
+ */
+class RealTimeCheck
+{
+public:
+    enum Kind {
+        Allocation,
+        Deallocation,
+        Lock,
+        Wait,
+        ThreadControl,
+        KindCount
+    };
+
+#ifdef CHECK_RT_SAFETY
+
+    class Section {
+    public:
+        Section(bool active = true);
+        ~Section();
+    private:
+        bool m_active;
+        Section(const Section &) =delete;
+        Section &operator=(const Section &) =delete;
+    };
+
+    static bool isEnabled() { return true; }
+
+    /** Record a call of the given kind, if the calling thread is
+     *  within a Section. The where argument must be a string literal
+     *  or otherwise outlive the check.
+     */
+    static void hit(Kind kind, const char *where);
+
+    /** Return true if the calling thread is within a Section.
+     */
+    static bool inSection();
+
+    static int getViolationCount(Kind kind);
+    static int getViolationCount();
+
+    /** Return the where argument of the most recent violation, or
+     *  the empty string if there has been none since the last reset.
+     */
+    static const char *getLastViolation();
+
+    static void resetViolations();
+
+#else
+
+    class Section {
+    public:
+        Section(bool = true) { }
+    };
+
+    static bool isEnabled() { return false; }
+    static void hit(Kind, const char *) { }
+    static bool inSection() { return false; }
+    static int getViolationCount(Kind) { return 0; }
+    static int getViolationCount() { return 0; }
+    static const char *getLastViolation() { return ""; }
+    static void resetViolations() { }
+
+#endif
+};
+
+}
+
+#endif
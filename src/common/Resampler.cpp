@@ -25,12 +25,16 @@
 
 #include "Allocators.h"
 #include "VectorOps.h"
+#include "FFT.h"
+#include "Window.h"
 
 #include <cstdlib>
 #include <cmath>
 
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <map>
 
 #ifdef HAVE_IPP
 #include <ippversion.h>
@@ -1387,69 +1391,189 @@ D_Speex::reset()
 
 } /* end namespace Resamplers */
 
-Resampler::Resampler(Resampler::Parameters params, int channels)
+// Implementation names, indexed by method number
+
+static const char *const implementationNames[] = {
+    "ipp", "libsamplerate", "speex", "libresample", "builtin"
+};
+
+static const int implementationCount =
+    int(sizeof(implementationNames) / sizeof(implementationNames[0]));
+
+static bool
+isCompiledIn(int method)
+{
+    switch (method) {
+#ifdef HAVE_IPP
+    case 0: return true;
+#endif
+#ifdef HAVE_LIBSAMPLERATE
+    case 1: return true;
+#endif
+#ifdef USE_SPEEX
+    case 2: return true;
+#endif
+#ifdef HAVE_LIBRESAMPLE
+    case 3: return true;
+#endif
+#ifdef USE_BQRESAMPLER
+    case 4: return true;
+#endif
+    default: return false;
+    }
+}
+
+static int
+findMethod(std::string implementation)
+{
+    for (int i = 0; i < implementationCount; ++i) {
+        if (implementation == implementationNames[i]) {
+            return isCompiledIn(i) ? i : -1;
+        }
+    }
+    return -1;
+}
+
+static std::string defaultResamplerImplementation;
+
+static std::string
+getEnvironmentImplementation()
+{
+    // Read once, on first construction
+    static const std::string implementation = []() {
+        const char *name = getenv("RUBBERBAND_RESAMPLER");
+        if (!name || !*name) {
+            return std::string();
+        }
+        if (findMethod(name) < 0) {
+            cerr << "WARNING: Resampler: Implementation \"" << name
+                 << "\" named in RUBBERBAND_RESAMPLER is not compiled in"
+                 << endl;
+            return std::string();
+        }
+        return std::string(name);
+    }();
+    return implementation;
+}
+
+std::set<std::string>
+Resampler::getImplementations()
+{
+    std::set<std::string> names;
+    for (int i = 0; i < implementationCount; ++i) {
+        if (isCompiledIn(i)) {
+            names.insert(implementationNames[i]);
+        }
+    }
+    return names;
+}
+
+std::string
+Resampler::getDefaultImplementation()
+{
+    return defaultResamplerImplementation;
+}
+
+void
+Resampler::setDefaultImplementation(std::string implementation)
+{
+    if (implementation != "" && findMethod(implementation) < 0) {
+        cerr << "WARNING: Resampler: setDefaultImplementation: "
+             << "requested implementation \"" << implementation
+             << "\" is not compiled in" << endl;
+        return;
+    }
+    defaultResamplerImplementation = implementation;
+}
+
+std::string
+Resampler::getImplementation() const
+{
+    return implementationNames[m_method];
+}
+
+Resampler::Resampler(Resampler::Parameters params, int channels) :
+    Resampler(params, channels, "")
+{
+}
+
+Resampler::Resampler(Resampler::Parameters params, int channels,
+                     std::string implementation)
 {
     m_method = -1;
 
     if (params.initialSampleRate == 0) {
         params.initialSampleRate = 44100;
     }
+
+    if (implementation == "") {
+        implementation = defaultResamplerImplementation;
+    }
+    if (implementation == "") {
+        implementation = getEnvironmentImplementation();
+    }
+    if (implementation != "") {
+        m_method = findMethod(implementation);
+    }
     
-    switch (params.quality) {
+    if (m_method == -1) {
 
-    case Resampler::Best:
+        switch (params.quality) {
+
+        case Resampler::Best:
 #ifdef HAVE_IPP
-        m_method = 0;
+            m_method = 0;
 #endif
 #ifdef USE_SPEEX
-        m_method = 2;
+            m_method = 2;
 #endif
 #ifdef HAVE_LIBRESAMPLE
-        m_method = 3;
+            m_method = 3;
 #endif
 #ifdef USE_BQRESAMPLER
-        m_method = 4;
+            m_method = 4;
 #endif
 #ifdef HAVE_LIBSAMPLERATE
-        m_method = 1;
+            m_method = 1;
 #endif
-        break;
+            break;
 
-    case Resampler::FastestTolerable:
+        case Resampler::FastestTolerable:
 #ifdef HAVE_IPP
-        m_method = 0;
+            m_method = 0;
 #endif
 #ifdef HAVE_LIBRESAMPLE
-        m_method = 3;
+            m_method = 3;
 #endif
 #ifdef USE_SPEEX
-        m_method = 2;
+            m_method = 2;
 #endif
 #ifdef USE_BQRESAMPLER
-        m_method = 4;
+            m_method = 4;
 #endif
 #ifdef HAVE_LIBSAMPLERATE
-        m_method = 1;
+            m_method = 1;
 #endif
-        break;
+            break;
 
-    case Resampler::Fastest:
+        case Resampler::Fastest:
 #ifdef HAVE_IPP
-        m_method = 0;
+            m_method = 0;
 #endif
 #ifdef HAVE_LIBRESAMPLE
-        m_method = 3;
+            m_method = 3;
 #endif
 #ifdef USE_SPEEX
-        m_method = 2;
+            m_method = 2;
 #endif
 #ifdef USE_BQRESAMPLER
-        m_method = 4;
+            m_method = 4;
 #endif
 #ifdef HAVE_LIBSAMPLERATE
-        m_method = 1;
+            m_method = 1;
 #endif
-        break;
+            break;
+        }
     }
 
     if (m_method == -1) {
@@ -1568,4 +1692,154 @@ Resampler::reset()
     d->reset();
 }
 
+static Resampler::Measurement
+measure(std::string implementation, Resampler::Parameters params,
+        double ratio, int blockSize)
+{
+    Resampler::Measurement m;
+    m.implementation = implementation;
+    m.ratio = ratio;
+    m.blockSize = blockSize;
+    m.framesPerSecond = 0.0;
+    m.aliasing = 0.0;
+
+    double rate = params.initialSampleRate;
+    if (rate <= 0.0) rate = 44100.0;
+
+    // A tone well inside the passband, and when downsampling, a
+    // second one midway between the output and input Nyquist
+    // frequencies, which should be filtered out entirely
+    double passFreq = 0.2 * rate * std::min(ratio, 1.0);
+    double stopFreq = 0.25 * rate * (1.0 + ratio);
+    bool haveStop = (ratio < 1.0);
+    
+    int incount = int(rate * 2.0);
+    std::vector<float> in(incount);
+    for (int i = 0; i < incount; ++i) {
+        double t = double(i) / rate;
+        double v = 0.5 * sin(2.0 * M_PI * passFreq * t);
+        if (haveStop) v += 0.5 * sin(2.0 * M_PI * stopFreq * t);
+        in[i] = float(v);
+    }
+
+    int outspace = int(ceil(blockSize * ratio)) + 16;
+    std::vector<float> out(int(ceil(incount * ratio)) + outspace);
+    std::vector<float> block(outspace);
+    float *blockp = block.data();
+
+    params.dynamism = Resampler::RatioMostlyFixed;
+    params.maxBufferSize = blockSize;
+    params.debugLevel = 0;
+    Resampler resampler(params, 1, implementation);
+
+    // Take the best of several runs, the first of which also provides
+    // the output for analysis
+    double best = 0.0;
+    int outcount = 0;
+    
+    for (int run = 0; run < 3; ++run) {
+        resampler.reset();
+        int produced = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < incount; i += blockSize) {
+            const float *inp = in.data() + i;
+            int n = std::min(blockSize, incount - i);
+            int got = resampler.resample(&blockp, outspace, &inp, n, ratio,
+                                         i + n >= incount);
+            if (run == 0) {
+                got = std::min(got, int(out.size()) - produced);
+                v_copy(out.data() + produced, blockp, got);
+            }
+            produced += got;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double t = std::chrono::duration<double>(end - start).count();
+        if (run == 0) {
+            outcount = produced;
+        } else if (run == 1 || t < best) {
+            best = t;
+        }
+    }
+
+    if (best > 0.0) {
+        m.framesPerSecond = incount / best;
+    }
+
+    int size = 16384;
+    while (size > 1024 && size > outcount / 2) size /= 2;
+    if (outcount < size) {
+        return m;
+    }
+
+    std::vector<float> frame(size), mag(size/2 + 1);
+    v_copy(frame.data(), out.data() + (outcount - size) / 2, size);
+    Window<float>(BlackmanHarrisWindow, size).cut(frame.data());
+    FFT fft(size);
+    fft.forwardMagnitude(frame.data(), mag.data());
+
+    // Power within the window's main lobe around the tone is signal;
+    // everything else is unwanted
+    int toneBin = int(round(passFreq * size / (rate * ratio)));
+    int lobe = 6;
+    double signal = 0.0, unwanted = 0.0;
+    for (int i = 0; i <= size/2; ++i) {
+        double p = double(mag[i]) * double(mag[i]);
+        if (abs(i - toneBin) <= lobe) signal += p;
+        else unwanted += p;
+    }
+    if (signal > 0.0) {
+        m.aliasing = 10.0 * log10(std::max(unwanted / signal, 1.0e-20));
+    }
+
+    return m;
+}
+
+std::vector<Resampler::Measurement>
+Resampler::measureImplementations(Parameters params,
+                                  const std::vector<double> &ratios,
+                                  const std::vector<int> &blockSizes)
+{
+    std::vector<Measurement> measurements;
+    for (int i = 0; i < implementationCount; ++i) {
+        if (!isCompiledIn(i)) continue;
+        for (double ratio : ratios) {
+            if (ratio <= 0.0) continue;
+            for (int blockSize : blockSizes) {
+                if (blockSize <= 0) continue;
+                measurements.push_back(measure(implementationNames[i],
+                                               params, ratio, blockSize));
+            }
+        }
+    }
+    return measurements;
+}
+
+std::string
+Resampler::chooseImplementation(const std::vector<Measurement> &measurements,
+                                double maxAliasing)
+{
+    // Total time per frame across all the measured cases, for each
+    // implementation that meets the bar in every one of them
+    std::map<std::string, double> cost;
+    std::set<std::string> rejected;
+    for (const Measurement &m : measurements) {
+        if (m.aliasing > maxAliasing || m.framesPerSecond <= 0.0) {
+            rejected.insert(m.implementation);
+        } else {
+            cost[m.implementation] += 1.0 / m.framesPerSecond;
+        }
+    }
+
+    std::string best;
+    double bestCost = 0.0;
+    for (const auto &c : cost) {
+        if (rejected.find(c.first) != rejected.end()) continue;
+        if (best == "" || c.second < bestCost) {
+            best = c.first;
+            bestCost = c.second;
+        }
+    }
+    return best;
+}
+
 }
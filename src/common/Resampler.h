@@ -26,6 +26,10 @@
 
 #include "sysutils.h"
 
+#include <set>
+#include <string>
+#include <vector>
+
 namespace RubberBand {
 
 class Resampler
@@ -99,9 +103,89 @@ public:
      * parameters.
      */
     Resampler(Parameters parameters, int channels);
+
+    /**
+     * Construct a resampler as above, but using the named
+     * implementation (one of those returned by getImplementations())
+     * in place of the default. If the name is empty or the
+     * implementation is not compiled in, use the default.
+     */
+    Resampler(Parameters parameters, int channels,
+              std::string implementation);
     
     ~Resampler();
 
+    /**
+     * Return the names of all compiled-in implementations, from
+     * "ipp", "libsamplerate", "speex", "libresample" and "builtin".
+     */
+    static std::set<std::string> getImplementations();
+
+    /**
+     * Return the implementation set with setDefaultImplementation(),
+     * or an empty string if none has been set.
+     */
+    static std::string getDefaultImplementation();
+
+    /**
+     * Use the named implementation for all resamplers constructed
+     * subsequently, regardless of their quality setting, or restore
+     * the built-in choice by quality if the name is empty. A name
+     * that is not compiled in is ignored with a warning.
+     *
+     * If no default has been set, the environment variable
+     * RUBBERBAND_RESAMPLER is consulted instead when the first
+     * resampler is constructed.
+     */
+    static void setDefaultImplementation(std::string);
+
+    /**
+     * Return the name of the implementation in use by this resampler.
+     */
+    std::string getImplementation() const;
+
+    struct Measurement {
+        std::string implementation;
+        double ratio;
+        int blockSize;
+
+        /**
+         * Input frames resampled per second, for a single channel.
+         */
+        double framesPerSecond;
+
+        /**
+         * Power in the output other than at the frequency of a test
+         * tone within the passband, relative to the tone, in dB. When
+         * downsampling the input also has an equal tone above the
+         * output Nyquist frequency, so this includes aliasing as well
+         * as imaging and noise. The floor of the measurement is
+         * around -100dB.
+         */
+        double aliasing;
+    };
+
+    /**
+     * Time every compiled-in implementation, resampling a mono test
+     * signal at each of the given ratios in each of the given block
+     * sizes with the given parameters, and measure the unwanted
+     * content of the output. Not RT-safe; takes a fraction of a
+     * second per ratio and block size for each implementation.
+     */
+    static std::vector<Measurement> measureImplementations
+    (Parameters parameters,
+     const std::vector<double> &ratios,
+     const std::vector<int> &blockSizes);
+
+    /**
+     * Return the fastest implementation overall, among those whose
+     * aliasing measurement never exceeds maxAliasing dB, from the
+     * results of measureImplementations(). Return an empty string if
+     * none qualifies.
+     */
+    static std::string chooseImplementation
+    (const std::vector<Measurement> &measurements, double maxAliasing);
+
     /**
      * Resample the given multi-channel buffers, where incount is the
      * number of frames in the input buffers and outspace is the space
@@ -43,6 +43,11 @@ namespace RubberBand {
  *
  * RingBuffer is thread-safe provided only one thread writes and only
  * one thread reads.
+ *
+ * Functions asked to read or write more than there is data or space
+ * for do as much as they can and return the count. They report the
+ * shortfall to cerr only if DEBUG_RINGBUFFER is defined, as they are
+ * called from real-time threads where writing to cerr is not safe.
  */
 template <typename T>
 class RingBuffer
@@ -308,8 +313,10 @@ RingBuffer<T>::read(S *const R__ destination, int n)
 
     int available = readSpaceFor(w, r);
     if (n > available) {
+#ifdef DEBUG_RINGBUFFER
 	std::cerr << "WARNING: RingBuffer::read: " << n << " requested, only "
                   << available << " available" << std::endl;
+#endif
 	n = available;
     }
     if (n == 0) return n;
@@ -342,8 +349,10 @@ RingBuffer<T>::readAdding(S *const R__ destination, int n)
 
     int available = readSpaceFor(w, r);
     if (n > available) {
+#ifdef DEBUG_RINGBUFFER
 	std::cerr << "WARNING: RingBuffer::read: " << n << " requested, only "
                   << available << " available" << std::endl;
+#endif
 	n = available;
     }
     if (n == 0) return n;
@@ -374,8 +383,10 @@ RingBuffer<T>::readOne()
     int r = m_reader;
 
     if (w == r) {
+#ifdef DEBUG_RINGBUFFER
 	std::cerr << "WARNING: RingBuffer::readOne: no sample available"
 		  << std::endl;
+#endif
 	return T();
     }
 
@@ -397,8 +408,10 @@ RingBuffer<T>::peek(S *const R__ destination, int n) const
 
     int available = readSpaceFor(w, r);
     if (n > available) {
+#ifdef DEBUG_RINGBUFFER
 	std::cerr << "WARNING: RingBuffer::peek: " << n << " requested, only "
                   << available << " available" << std::endl;
+#endif
 	n = available;
     }
     if (n == 0) return n;
@@ -424,8 +437,10 @@ RingBuffer<T>::peekOne() const
     int r = m_reader;
 
     if (w == r) {
+#ifdef DEBUG_RINGBUFFER
 	std::cerr << "WARNING: RingBuffer::peekOne: no sample available"
 		  << std::endl;
+#endif
 	return 0;
     }
 
@@ -442,8 +457,10 @@ RingBuffer<T>::skip(int n)
 
     int available = readSpaceFor(w, r);
     if (n > available) {
+#ifdef DEBUG_RINGBUFFER
 	std::cerr << "WARNING: RingBuffer::skip: " << n << " requested, only "
                   << available << " available" << std::endl;
+#endif
 	n = available;
     }
     if (n == 0) return n;
@@ -466,8 +483,10 @@ RingBuffer<T>::write(const S *const R__ source, int n)
 
     int available = writeSpaceFor(w, r);
     if (n > available) {
+#ifdef DEBUG_RINGBUFFER
 	std::cerr << "WARNING: RingBuffer::write: " << n
                   << " requested, only room for " << available << std::endl;
+#endif
 	n = available;
     }
     if (n == 0) return n;
@@ -500,8 +519,10 @@ RingBuffer<T>::zero(int n)
 
     int available = writeSpaceFor(w, r);
     if (n > available) {
+#ifdef DEBUG_RINGBUFFER
 	std::cerr << "WARNING: RingBuffer::zero: " << n
                   << " requested, only room for " << available << std::endl;
+#endif
 	n = available;
     }
     if (n == 0) return n;
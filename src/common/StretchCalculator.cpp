@@ -26,12 +26,15 @@
 #include <math.h>
 #include <iostream>
 #include <deque>
-#include <set>
 #include <cassert>
 #include <algorithm>
-#include <sstream>
+#include <atomic>
+#include <functional>
+#include <memory>
 
 #include "sysutils.h"
+#include "Thread.h"
+#include "ThreadPool.h"
 
 namespace RubberBand
 {
@@ -52,7 +55,8 @@ StretchCalculator::StretchCalculator(size_t sampleRate,
     m_inFrameCounter(0),
     m_frameCheckpoint(0, 0),
     m_outFrameCounter(0),
-    m_log(log)
+    m_log(log),
+    m_segmentLength(65536)
 {
     m_log.log(2, "StretchCalculator: useHardPeaks", useHardPeaks);
 }    
@@ -64,16 +68,17 @@ StretchCalculator::~StretchCalculator()
 void
 StretchCalculator::setKeyFrameMap(const std::map<size_t, size_t> &mapping)
 {
-    m_keyFrameMap = mapping;
+    m_keyFrameMap.clear();
+    m_keyFrameMap.reserve(mapping.size() + 1);
 
     // Ensure we always have a 0 -> 0 mapping. If there's nothing in
     // the map at all, don't need to worry about this (empty map is
     // handled separately anyway)
-    if (!m_keyFrameMap.empty()) {
-        if (m_keyFrameMap.find(0) == m_keyFrameMap.end()) {
-            m_keyFrameMap[0] = 0;
-        }
+    if (!mapping.empty() && mapping.begin()->first != 0) {
+        m_keyFrameMap.push_back({ 0, 0 });
     }
+
+    m_keyFrameMap.insert(m_keyFrameMap.end(), mapping.begin(), mapping.end());
 }
 
 std::vector<int>
@@ -102,6 +107,7 @@ StretchCalculator::calculate(double ratio, size_t inputDuration,
     size_t totalInput = 0, totalOutput = 0;
 
     std::vector<int> increments;
+    increments.reserve(totalCount);
 
     for (size_t i = 0; i <= peaks.size(); ++i) {
         
@@ -206,6 +212,7 @@ StretchCalculator::mapPeaks(std::vector<Peak> &peaks,
         // "normal" behaviour -- fixed points are strictly in
         // proportion
         peaks = m_peaks;
+        targets.reserve(peaks.size());
         for (size_t i = 0; i < peaks.size(); ++i) {
             targets.push_back
                 (lrint((double(peaks[i].chunk) * outputDuration) / totalCount));
@@ -218,8 +225,11 @@ StretchCalculator::mapPeaks(std::vector<Peak> &peaks,
     // are followed exactly, and any fixed points that we calculated
     // ourselves are interpolated in linear proportion in between.
 
+    peaks.reserve(m_peaks.size() + m_keyFrameMap.size());
+    targets.reserve(m_peaks.size() + m_keyFrameMap.size());
+
     size_t peakidx = 0;
-    std::map<size_t, size_t>::const_iterator mi = m_keyFrameMap.begin();
+    auto mi = m_keyFrameMap.begin();
 
     // NB we know for certain we have a mapping from 0 -> 0 (or at
     // least, some mapping for source sample 0) because that is
@@ -387,26 +397,13 @@ StretchCalculator::calculateSingle(double timeRatio,
     m_prevRatio = ratio;
     m_prevTimeRatio = timeRatio;
 
-    if (m_log.getDebugLevel() > 2) {
-        std::ostringstream os;
-        os << "StretchCalculator::calculateSingle: timeRatio = "
-           << timeRatio << ", effectivePitchRatio = "
-           << effectivePitchRatio << " (that's 1.0 / "
-           << (1.0 / effectivePitchRatio)
-           << "), ratio = " << ratio << ", df = " << df
-           << ", inIncrement = " << inIncrement
-           << ", default outIncrement = " << outIncrement
-           << ", analysisWindowSize = " << analysisWindowSize
-           << ", synthesisWindowSize = " << synthesisWindowSize
-           << "\n";
-
-        os << "inFrameCounter = " << m_inFrameCounter
-           << ", outFrameCounter = " << m_outFrameCounter
-           << "\n";
-
-        os << "The next sample out is input sample " << m_inFrameCounter << "\n";
-        m_log.log(3, os.str().c_str());
-    }
+    // Messages are all constants with numeric arguments, as a
+    // deferred log keeps only a pointer to each
+    m_log.log(3, "StretchCalculator::calculateSingle: timeRatio and effectivePitchRatio", timeRatio, effectivePitchRatio);
+    m_log.log(3, "StretchCalculator::calculateSingle: ratio and df", ratio, df);
+    m_log.log(3, "StretchCalculator::calculateSingle: inIncrement and default outIncrement", inIncrement, outIncrement);
+    m_log.log(3, "StretchCalculator::calculateSingle: analysisWindowSize and synthesisWindowSize", analysisWindowSize, synthesisWindowSize);
+    m_log.log(3, "StretchCalculator::calculateSingle: inFrameCounter and outFrameCounter", m_inFrameCounter, m_outFrameCounter);
 
     int64_t intended, projected;
     if (alignFrameStarts) { // R3
@@ -528,96 +525,245 @@ StretchCalculator::reset()
     m_justReset = true;
 }
 
-std::vector<StretchCalculator::Peak>
-StretchCalculator::findPeaks(const std::vector<float> &rawDf)
+// The offline analysis of a long input is split into segments of the
+// detection function that are worked on in parallel. Each segment is
+// a job that either the calling thread or one of the workers of the
+// shared thread pool picks up, and the caller waits only for those
+// segments that another thread has already started. This avoids any
+// risk of deadlock when the caller is itself running on the shared
+// pool, as the offline stretchers' asynchronous jobs do.
+
+struct SCSegmentJob {
+    std::function<void(size_t)> fn;
+    size_t count;
+    std::atomic<size_t> next;
+    size_t done;
+    Condition condition;
+    SCSegmentJob(std::function<void(size_t)> _fn, size_t _count) :
+        fn(_fn), count(_count), next(0), done(0),
+        condition("StretchCalculator segments") { }
+};
+
+static void
+sc_runSegmentJob(std::shared_ptr<SCSegmentJob> job)
 {
-    std::vector<float> df = smoothDF(rawDf);
-
-    // We distinguish between "soft" and "hard" peaks.  A soft peak is
-    // simply the result of peak-picking on the smoothed onset
-    // detection function, and it represents any (strong-ish) onset.
-    // We aim to ensure always that soft peaks are placed at the
-    // correct position in time.  A hard peak is where there is a very
-    // rapid rise in detection function, and it presumably represents
-    // a more broadband, noisy transient.  For these we perform a
-    // phase reset (if in the appropriate mode), and we locate the
-    // reset at the first point where we notice enough of a rapid
-    // rise, rather than necessarily at the peak itself, in order to
-    // preserve the shape of the transient.
-            
-    std::set<size_t> hardPeakCandidates;
-    std::set<size_t> softPeakCandidates;
-
-    if (m_useHardPeaks) {
+    size_t segment;
+    while ((segment = job->next++) < job->count) {
+        job->fn(segment);
+        job->condition.lock();
+        ++job->done;
+        job->condition.signal();
+        job->condition.unlock();
+    }
+}
 
-        // 0.05 sec approx min between hard peaks
-        size_t hardPeakAmnesty = lrint(ceil(double(m_sampleRate) /
-                                            (20 * double(m_increment))));
-        size_t prevHardPeak = 0;
+static void
+sc_runSegments(size_t count, std::function<void(size_t)> fn)
+{
+    if (count < 2) {
+        if (count > 0) fn(0);
+        return;
+    }
 
-        m_log.log(2, "hardPeakAmnesty", hardPeakAmnesty);
+    std::shared_ptr<SCSegmentJob> job =
+        std::make_shared<SCSegmentJob>(fn, count);
 
-        for (size_t i = 1; i + 1 < df.size(); ++i) {
+    ThreadPool &pool = ThreadPool::getSharedPool();
+    size_t helpers = std::min(count - 1, size_t(pool.getThreadCount()));
+    for (size_t i = 0; i < helpers; ++i) {
+        pool.post([job]() { sc_runSegmentJob(job); });
+    }
 
-            if (df[i] < 0.1) continue;
-            if (df[i] <= df[i-1] * 1.1) continue;
-            if (df[i] < 0.22) continue;
+    sc_runSegmentJob(job);
 
-            if (!hardPeakCandidates.empty() &&
-                i < prevHardPeak + hardPeakAmnesty) {
-                continue;
-            }
+    job->condition.lock();
+    while (job->done < job->count) {
+        job->condition.wait();
+    }
+    job->condition.unlock();
+}
 
-            bool hard = (df[i] > 0.4);
+// A peak candidate found by one of the per-segment scans. For a hard
+// peak, reason identifies which test it passed and offset is 1 if it
+// is to be pushed forward to the following chunk. For a soft peak,
+// offset is the distance from the chunk to the maximum that follows
+// it in the median window, and value is the median window value it
+// was picked for.
+
+struct SCPeakCandidate {
+    size_t chunk;
+    int offset;
+    int reason;
+    float value;
+};
+
+static void
+sc_findHardPeakCandidates(const std::vector<float> &df,
+                          const std::vector<float> &rawDf,
+                          size_t from, size_t to,
+                          std::vector<SCPeakCandidate> &candidates)
+{
+    if (from < 1) from = 1;
+    if (to + 1 > df.size()) to = df.size() - 1;
+    
+    for (size_t i = from; i < to; ++i) {
+
+        if (df[i] < 0.1) continue;
+        if (df[i] <= df[i-1] * 1.1) continue;
+        if (df[i] < 0.22) continue;
+
+        int reason = 0;
+
+        if (df[i] > 0.4) {
+            reason = 1;
+        } else if (df[i] > df[i-1] * 1.4) {
+            reason = 2;
+        } else if (i > 1 &&
+                   df[i]   > df[i-1] * 1.2 &&
+                   df[i-1] > df[i-2] * 1.2) {
+            reason = 3;
+        } else if (i > 2 &&
+                   // have already established that df[i] > df[i-1] * 1.1
+                   df[i] > 0.3 &&
+                   df[i-1] > df[i-2] * 1.1 &&
+                   df[i-2] > df[i-3] * 1.1) {
+            reason = 4;
+        }
 
-            if (hard) {
-                m_log.log(2, "hard peak, df > absolute 0.4: chunk and df", i, df[i]);
-            }
+        if (reason == 0) continue;
 
-            if (!hard) {
-                hard = (df[i] > df[i-1] * 1.4);
+        SCPeakCandidate c;
+        c.chunk = i;
+        c.offset = 0;
+        c.reason = reason;
+        c.value = df[i];
 
-                if (hard) {
-                    m_log.log(2, "hard peak, single rise of 40%: chunk and df", i, df[i]);
-                }
-            }
+        if (i + 1 < rawDf.size() &&
+            rawDf[i + 1] > rawDf[i] * 1.4) {
+            c.offset = 1;
+        }
 
-            if (!hard && i > 1) {
-                hard = (df[i]   > df[i-1] * 1.2 &&
-                        df[i-1] > df[i-2] * 1.2);
+        candidates.push_back(c);
+    }
+}
 
-                if (hard) {
-                    m_log.log(2, "hard peak, two rises of 20%: chunk and df", i, df[i]);
-                }
-            }
+static void
+sc_findSoftPeakCandidates(const std::vector<float> &df,
+                          size_t medianmaxsize,
+                          size_t from, size_t to,
+                          std::vector<SCPeakCandidate> &candidates)
+{
+    // The median window holds medianmaxsize values of df centred on
+    // the current chunk, except near the start where it takes some
+    // time to fill up. A segment starting at chunk from > 0 begins
+    // with the window as it would be by then, which (provided from >
+    // medianmaxsize) is exactly the values around from. Alongside the
+    // window we keep a sorted copy of it, updated by removing and
+    // inserting one value per chunk rather than sorting afresh
+    
+    std::deque<float> medianwin;
+    std::vector<float> sorted;
+    sorted.reserve(medianmaxsize + 1);
 
-            if (!hard && i > 2) {
-                // have already established that df[i] > df[i-1] * 1.1
-                hard = (df[i] > 0.3 &&
-                        df[i-1] > df[i-2] * 1.1 &&
-                        df[i-2] > df[i-3] * 1.1);
+    const size_t half = medianmaxsize / 2;
+    
+    if (from == 0) {
+        for (size_t i = 0; i < half; ++i) {
+            medianwin.push_back(0);
+        }
+        for (size_t i = 0; i < half && i < df.size(); ++i) {
+            medianwin.push_back(df[i]);
+        }
+    } else {
+        for (size_t i = from - half; i < from - half + medianmaxsize; ++i) {
+            medianwin.push_back(i < df.size() ? df[i] : 0.f);
+        }
+    }
 
-                if (hard) {
-                    m_log.log(2, "hard peak, three rises of 10%: chunk and df", i, df[i]);
-                }
-            }
+    sorted.assign(medianwin.begin(), medianwin.end());
+    std::sort(sorted.begin(), sorted.end());
+    
+    for (size_t i = from; i < to; ++i) {
+        
+        size_t mediansize = medianmaxsize;
 
-            if (!hard) continue;
+        if (medianwin.size() < mediansize) {
+            mediansize = medianwin.size();
+        }
 
-            size_t peakLocation = i;
+        size_t middle = medianmaxsize / 2;
+        if (middle >= mediansize) middle = mediansize-1;
 
-            if (i + 1 < rawDf.size() &&
-                rawDf[i + 1] > rawDf[i] * 1.4) {
+        size_t nextDf = i + mediansize - middle;
 
-                ++peakLocation;
+        if (mediansize >= 2) {
+            
+            size_t n = 90; // percentile above which we pick peaks
+            size_t index = (sorted.size() * n) / 100;
+            if (index >= sorted.size()) index = sorted.size()-1;
+            if (index == sorted.size()-1 && index > 0) --index;
+            float thresh = sorted[index];
+
+            if (medianwin[middle] > thresh &&
+                medianwin[middle] > medianwin[middle-1] &&
+                medianwin[middle] > medianwin[middle+1]) {
+
+                size_t maxindex = middle;
+                float maxval = medianwin[middle];
+
+                for (size_t j = middle+1; j < mediansize; ++j) {
+                    if (medianwin[j] > maxval) {
+                        maxval = medianwin[j];
+                        maxindex = j;
+                    } else if (medianwin[j] < medianwin[middle]) {
+                        break;
+                    }
+                }
 
-                m_log.log(2, "big rise next, pushing hard peak forward to", peakLocation);
+                SCPeakCandidate c;
+                c.chunk = i;
+                c.offset = int(maxindex - middle);
+                c.reason = 0;
+                c.value = medianwin[middle];
+                candidates.push_back(c);
             }
+        }
 
-            hardPeakCandidates.insert(peakLocation);
-            prevHardPeak = peakLocation;
+        if (mediansize >= medianmaxsize) {
+            float v = medianwin.front();
+            medianwin.pop_front();
+            auto si = std::lower_bound(sorted.begin(), sorted.end(), v);
+            if (si == sorted.end()) --si;
+            sorted.erase(si);
         }
+
+        float v = (nextDf < df.size() ? df[nextDf] : 0.f);
+        medianwin.push_back(v);
+        sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), v), v);
     }
+}
+
+std::vector<StretchCalculator::Peak>
+StretchCalculator::findPeaks(const std::vector<float> &rawDf)
+{
+    std::vector<float> df = smoothDF(rawDf);
+
+    // We distinguish between "soft" and "hard" peaks.  A soft peak is
+    // simply the result of peak-picking on the smoothed onset
+    // detection function, and it represents any (strong-ish) onset.
+    // We aim to ensure always that soft peaks are placed at the
+    // correct position in time.  A hard peak is where there is a very
+    // rapid rise in detection function, and it presumably represents
+    // a more broadband, noisy transient.  For these we perform a
+    // phase reset (if in the appropriate mode), and we locate the
+    // reset at the first point where we notice enough of a rapid
+    // rise, rather than necessarily at the peak itself, in order to
+    // preserve the shape of the transient.
+
+    // The candidates are found for each segment independently, in
+    // parallel; then the amnesty rules, which depend on the peaks
+    // already accepted, are applied in a single pass through them
+    // in order.
 
     size_t medianmaxsize = lrint(ceil(double(m_sampleRate) /
                                  double(m_increment))); // 1 sec ish
@@ -628,112 +774,118 @@ StretchCalculator::findPeaks(const std::vector<float> &rawDf)
         m_log.log(2, "adjusted mediansize", medianmaxsize);
     }
 
-    int minspacing = lrint(ceil(double(m_sampleRate) /
-                                (20 * double(m_increment)))); // 0.05 sec ish
-    
-    std::deque<float> medianwin;
-    std::vector<float> sorted;
-    int softPeakAmnesty = 0;
-
-    for (size_t i = 0; i < medianmaxsize/2; ++i) {
-        medianwin.push_back(0);
-    }
-    for (size_t i = 0; i < medianmaxsize/2 && i < df.size(); ++i) {
-        medianwin.push_back(df[i]);
+    size_t segmentLength = m_segmentLength;
+    if (segmentLength <= medianmaxsize) {
+        segmentLength = medianmaxsize + 1;
     }
+    size_t segments = (df.size() + segmentLength - 1) / segmentLength;
 
-    size_t lastSoftPeak = 0;
+    std::vector<std::vector<SCPeakCandidate>> hardCandidates(segments);
+    std::vector<std::vector<SCPeakCandidate>> softCandidates(segments);
+    
+    sc_runSegments(segments, [&](size_t s) {
+        size_t from = s * segmentLength;
+        size_t to = std::min(from + segmentLength, df.size());
+        if (m_useHardPeaks) {
+            sc_findHardPeakCandidates(df, rawDf, from, to, hardCandidates[s]);
+        }
+        sc_findSoftPeakCandidates(df, medianmaxsize, from, to,
+                                  softCandidates[s]);
+    });
 
-    for (size_t i = 0; i < df.size(); ++i) {
-        
-        size_t mediansize = medianmaxsize;
+    // Both of these come out in ascending order without duplicates
+    std::vector<size_t> hardPeakCandidates;
+    std::vector<size_t> softPeakCandidates;
 
-        if (medianwin.size() < mediansize) {
-            mediansize = medianwin.size();
-        }
+    if (m_useHardPeaks) {
 
-        size_t middle = medianmaxsize / 2;
-        if (middle >= mediansize) middle = mediansize-1;
+        // 0.05 sec approx min between hard peaks
+        size_t hardPeakAmnesty = lrint(ceil(double(m_sampleRate) /
+                                            (20 * double(m_increment))));
+        size_t prevHardPeak = 0;
 
-        size_t nextDf = i + mediansize - middle;
+        m_log.log(2, "hardPeakAmnesty", hardPeakAmnesty);
 
-        if (mediansize < 2) {
-            if (mediansize > medianmaxsize) { // absurd, but never mind that
-                medianwin.pop_front();
-            }
-            if (nextDf < df.size()) {
-                medianwin.push_back(df[nextDf]);
-            } else {
-                medianwin.push_back(0);
-            }
-            continue;
-        }
+        for (const auto &candidates : hardCandidates) {
+            for (const auto &c : candidates) {
 
-        sorted.clear();
-        for (size_t j = 0; j < mediansize; ++j) {
-            sorted.push_back(medianwin[j]);
-        }
-        std::sort(sorted.begin(), sorted.end());
-
-        size_t n = 90; // percentile above which we pick peaks
-        size_t index = (sorted.size() * n) / 100;
-        if (index >= sorted.size()) index = sorted.size()-1;
-        if (index == sorted.size()-1 && index > 0) --index;
-        float thresh = sorted[index];
-
-        if (medianwin[middle] > thresh &&
-            medianwin[middle] > medianwin[middle-1] &&
-            medianwin[middle] > medianwin[middle+1] &&
-            softPeakAmnesty == 0) {
-
-            size_t maxindex = middle;
-            float maxval = medianwin[middle];
-
-            for (size_t j = middle+1; j < mediansize; ++j) {
-                if (medianwin[j] > maxval) {
-                    maxval = medianwin[j];
-                    maxindex = j;
-                } else if (medianwin[j] < medianwin[middle]) {
+                size_t i = c.chunk;
+                
+                if (!hardPeakCandidates.empty() &&
+                    i < prevHardPeak + hardPeakAmnesty) {
+                    continue;
+                }
+
+                switch (c.reason) {
+                case 1:
+                    m_log.log(2, "hard peak, df > absolute 0.4: chunk and df", i, c.value);
+                    break;
+                case 2:
+                    m_log.log(2, "hard peak, single rise of 40%: chunk and df", i, c.value);
+                    break;
+                case 3:
+                    m_log.log(2, "hard peak, two rises of 20%: chunk and df", i, c.value);
+                    break;
+                default:
+                    m_log.log(2, "hard peak, three rises of 10%: chunk and df", i, c.value);
                     break;
                 }
+                
+                size_t peakLocation = i + c.offset;
+
+                if (c.offset > 0) {
+                    m_log.log(2, "big rise next, pushing hard peak forward to", peakLocation);
+                }
+
+                hardPeakCandidates.push_back(peakLocation);
+                prevHardPeak = peakLocation;
             }
+        }
+    }
 
-            size_t peak = i + maxindex - middle;
+    int minspacing = lrint(ceil(double(m_sampleRate) /
+                                (20 * double(m_increment)))); // 0.05 sec ish
+
+    // A candidate is accepted unless it falls within the amnesty
+    // period following the last one accepted; this is the first
+    // chunk after that period
+    size_t softPeakAmnestyEnd = 0;
+    
+    for (const auto &candidates : softCandidates) {
+        for (const auto &c : candidates) {
+
+            if (c.chunk < softPeakAmnestyEnd) {
+                continue;
+            }
+            
+            size_t peak = c.chunk + c.offset;
 
-            if (softPeakCandidates.empty() || lastSoftPeak != peak) {
-                m_log.log(2, "soft peak: chunk and median df", peak, medianwin[middle]);
+            if (softPeakCandidates.empty() ||
+                softPeakCandidates[softPeakCandidates.size()-1] != peak) {
+                m_log.log(2, "soft peak: chunk and median df", peak, c.value);
                 if (peak >= df.size()) {
                     m_log.log(2, "peak is beyond end");
                 } else {
-                    softPeakCandidates.insert(peak);
-                    lastSoftPeak = peak;
+                    softPeakCandidates.push_back(peak);
                 }
             }
 
-            softPeakAmnesty = minspacing + maxindex - middle;
+            int softPeakAmnesty = minspacing + c.offset;
             m_log.log(3, "amnesty", softPeakAmnesty);
-
-        } else if (softPeakAmnesty > 0) --softPeakAmnesty;
-
-        if (mediansize >= medianmaxsize) {
-            medianwin.pop_front();
-        }
-        if (nextDf < df.size()) {
-            medianwin.push_back(df[nextDf]);
-        } else {
-            medianwin.push_back(0);
+            softPeakAmnestyEnd = c.chunk + softPeakAmnesty + 1;
         }
     }
 
     std::vector<Peak> peaks;
+    size_t hi = 0, si = 0;
 
-    while (!hardPeakCandidates.empty() || !softPeakCandidates.empty()) {
+    while (hi < hardPeakCandidates.size() || si < softPeakCandidates.size()) {
 
-        bool haveHardPeak = !hardPeakCandidates.empty();
-        bool haveSoftPeak = !softPeakCandidates.empty();
+        bool haveHardPeak = hi < hardPeakCandidates.size();
+        bool haveSoftPeak = si < softPeakCandidates.size();
 
-        size_t hardPeak = (haveHardPeak ? *hardPeakCandidates.begin() : 0);
-        size_t softPeak = (haveSoftPeak ? *softPeakCandidates.begin() : 0);
+        size_t hardPeak = (haveHardPeak ? hardPeakCandidates[hi] : 0);
+        size_t softPeak = (haveSoftPeak ? softPeakCandidates[si] : 0);
 
         Peak peak;
         peak.hard = false;
@@ -746,7 +898,7 @@ StretchCalculator::findPeaks(const std::vector<float> &rawDf)
             m_log.log(3, "hard peak", hardPeak);
             peak.hard = true;
             peak.chunk = hardPeak;
-            hardPeakCandidates.erase(hardPeakCandidates.begin());
+            ++hi;
         } else {
             m_log.log(3, "soft peak", softPeak);
             if (!peaks.empty() &&
@@ -758,7 +910,7 @@ StretchCalculator::findPeaks(const std::vector<float> &rawDf)
         }            
 
         if (haveSoftPeak && peak.chunk == softPeak) {
-            softPeakCandidates.erase(softPeakCandidates.begin());
+            ++si;
         }
 
         if (!ignore) {
@@ -772,20 +924,26 @@ StretchCalculator::findPeaks(const std::vector<float> &rawDf)
 std::vector<float>
 StretchCalculator::smoothDF(const std::vector<float> &df)
 {
-    std::vector<float> smoothedDF;
-    
-    for (size_t i = 0; i < df.size(); ++i) {
-        // three-value moving mean window for simple smoothing
-        float total = 0.f, count = 0;
-        if (i > 0) { total += df[i-1]; ++count; }
-        total += df[i]; ++count;
-        if (i+1 < df.size()) { total += df[i+1]; ++count; }
-        float mean = total / count;
-        smoothedDF.push_back(mean);
-    }
+    std::vector<float> smoothedDF(df.size(), 0.f);
+
+    size_t segmentLength = std::max(m_segmentLength, size_t(1));
+    size_t segments = (df.size() + segmentLength - 1) / segmentLength;
+
+    sc_runSegments(segments, [&](size_t s) {
+        size_t from = s * segmentLength;
+        size_t to = std::min(from + segmentLength, df.size());
+        for (size_t i = from; i < to; ++i) {
+            // three-value moving mean window for simple smoothing
+            float total = 0.f, count = 0;
+            if (i > 0) { total += df[i-1]; ++count; }
+            total += df[i]; ++count;
+            if (i+1 < df.size()) { total += df[i+1]; ++count; }
+            float mean = total / count;
+            smoothedDF[i] = mean;
+        }
+    });
 
     return smoothedDF;
 }
 
 }
-
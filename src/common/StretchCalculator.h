@@ -91,6 +91,11 @@ public:
     };
     std::vector<Peak> getLastCalculatedPeaks() const { return m_peaks; }
 
+    /**
+     * Return the detection function smoothed with a three-point
+     * moving mean. Long inputs are processed in segments on the
+     * shared thread pool.
+     */
     std::vector<float> smoothDF(const std::vector<float> &df);
 
 protected:
@@ -114,8 +119,14 @@ protected:
     double m_outFrameCounter;
     Log m_log;
 
-    std::map<size_t, size_t> m_keyFrameMap;
+    // Sorted by source frame, always starting at 0 when non-empty
+    std::vector<std::pair<size_t, size_t>> m_keyFrameMap;
     std::vector<Peak> m_peaks;
+
+    // Length in chunks of the segments of the detection function that
+    // the offline calculation divides among threads. Inputs no longer
+    // than this are analysed in one go on the calling thread.
+    size_t m_segmentLength;
 };
 
 }
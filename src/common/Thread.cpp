@@ -24,13 +24,17 @@
 #ifndef NO_THREADING
 
 #include "Thread.h"
+#include "RealTimeCheck.h"
 
 #include <iostream>
 #include <cstdlib>
+#include <cerrno>
+#include <climits>
 
 #ifdef USE_PTHREADS
 #include <sys/time.h>
 #include <time.h>
+#include <sched.h>
 #endif
 
 using std::cerr;
@@ -67,6 +71,7 @@ Thread::~Thread()
 void
 Thread::start()
 {
+    RealTimeCheck::hit(RealTimeCheck::ThreadControl, "Thread::start");
     m_id = CreateThread(NULL, 0, staticRun, this, 0, 0);
     if (!m_id) {
         cerr << "ERROR: thread creation failed" << endl;
@@ -82,6 +87,7 @@ Thread::start()
 void 
 Thread::wait()
 {
+    RealTimeCheck::hit(RealTimeCheck::ThreadControl, "Thread::wait");
     if (m_extant) {
 #ifdef DEBUG_THREAD
         cerr << "THREAD DEBUG: Waiting on thread " << m_id << " for thread object " << this << endl;
@@ -106,6 +112,12 @@ Thread::threadingAvailable()
     return true;
 }
 
+void
+Thread::yield()
+{
+    SwitchToThread();
+}
+
 DWORD
 Thread::staticRun(LPVOID arg)
 {
@@ -140,6 +152,7 @@ Mutex::~Mutex()
 void
 Mutex::lock()
 {
+    RealTimeCheck::hit(RealTimeCheck::Lock, "Mutex::lock");
 #ifndef NO_THREAD_CHECKS
     DWORD tid = GetCurrentThreadId();
     if (m_lockedBy == tid) {
@@ -230,6 +243,7 @@ Condition::~Condition()
 void
 Condition::lock()
 {
+    RealTimeCheck::hit(RealTimeCheck::Lock, "Condition::lock");
 #ifdef DEBUG_CONDITION
     cerr << "CONDITION DEBUG: " << (void *)GetCurrentThreadId() << ": Want to lock " << &m_condition << " \"" << m_name << "\"" << endl;
 #endif
@@ -259,6 +273,7 @@ Condition::unlock()
 void 
 Condition::wait(int us)
 {
+    RealTimeCheck::hit(RealTimeCheck::Wait, "Condition::wait");
     if (us == 0) {
 
 #ifdef DEBUG_CONDITION
@@ -294,6 +309,34 @@ Condition::signal()
     SetEvent(m_condition);
 }
 
+Semaphore::Semaphore() :
+    m_count(0)
+{
+    m_semaphore = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+}
+
+Semaphore::~Semaphore()
+{
+    CloseHandle(m_semaphore);
+}
+
+void
+Semaphore::post()
+{
+    if (m_count.fetch_add(1) < 0) {
+        ReleaseSemaphore(m_semaphore, 1, NULL);
+    }
+}
+
+void
+Semaphore::wait()
+{
+    RealTimeCheck::hit(RealTimeCheck::Wait, "Semaphore::wait");
+    if (m_count.fetch_sub(1) <= 0) {
+        WaitForSingleObject(m_semaphore, INFINITE);
+    }
+}
+
 #else /* !_WIN32 */
 
 #ifdef USE_PTHREADS
@@ -323,6 +366,7 @@ Thread::~Thread()
 void
 Thread::start()
 {
+    RealTimeCheck::hit(RealTimeCheck::ThreadControl, "Thread::start");
     if (pthread_create(&m_id, 0, staticRun, this)) {
         cerr << "ERROR: thread creation failed" << endl;
         exit(1);
@@ -337,6 +381,7 @@ Thread::start()
 void 
 Thread::wait()
 {
+    RealTimeCheck::hit(RealTimeCheck::ThreadControl, "Thread::wait");
     if (m_extant) {
 #ifdef DEBUG_THREAD
         cerr << "THREAD DEBUG: Waiting on thread " << m_id << " for thread object " << this << endl;
@@ -361,6 +406,12 @@ Thread::threadingAvailable()
     return true;
 }
 
+void
+Thread::yield()
+{
+    sched_yield();
+}
+
 void *
 Thread::staticRun(void *arg)
 {
@@ -396,6 +447,7 @@ Mutex::~Mutex()
 void
 Mutex::lock()
 {
+    RealTimeCheck::hit(RealTimeCheck::Lock, "Mutex::lock");
 #ifndef NO_THREAD_CHECKS
     pthread_t tid = pthread_self();
     if (m_locked && m_lockedBy == tid) {
@@ -490,6 +542,7 @@ Condition::~Condition()
 void
 Condition::lock()
 {
+    RealTimeCheck::hit(RealTimeCheck::Lock, "Condition::lock");
 #ifdef DEBUG_CONDITION
     cerr << "CONDITION DEBUG: " << (void *)pthread_self() << ": Want to lock " << &m_condition << " \"" << m_name << "\"" << endl;
 #endif
@@ -519,6 +572,7 @@ Condition::unlock()
 void 
 Condition::wait(int us)
 {
+    RealTimeCheck::hit(RealTimeCheck::Wait, "Condition::wait");
     if (us == 0) {
 
 #ifdef DEBUG_CONDITION
@@ -562,6 +616,50 @@ Condition::signal()
     pthread_cond_signal(&m_condition);
 }
 
+Semaphore::Semaphore() :
+    m_count(0)
+{
+#ifdef __APPLE__
+    m_semaphore = dispatch_semaphore_create(0);
+#else
+    sem_init(&m_semaphore, 0, 0);
+#endif
+}
+
+Semaphore::~Semaphore()
+{
+#ifdef __APPLE__
+    dispatch_release(m_semaphore);
+#else
+    sem_destroy(&m_semaphore);
+#endif
+}
+
+void
+Semaphore::post()
+{
+    if (m_count.fetch_add(1) < 0) {
+#ifdef __APPLE__
+        dispatch_semaphore_signal(m_semaphore);
+#else
+        sem_post(&m_semaphore);
+#endif
+    }
+}
+
+void
+Semaphore::wait()
+{
+    RealTimeCheck::hit(RealTimeCheck::Wait, "Semaphore::wait");
+    if (m_count.fetch_sub(1) <= 0) {
+#ifdef __APPLE__
+        dispatch_semaphore_wait(m_semaphore, DISPATCH_TIME_FOREVER);
+#else
+        while (sem_wait(&m_semaphore) != 0 && errno == EINTR) ;
+#endif
+    }
+}
+
 #else /* !USE_PTHREADS */
 
 Thread::Thread()
@@ -596,6 +694,11 @@ Thread::threadingAvailable()
     return false;
 }
 
+void
+Thread::yield()
+{
+}
+
 Mutex::Mutex()
 {
 }
@@ -648,6 +751,26 @@ Condition::signal()
     abort();
 }
 
+Semaphore::Semaphore()
+{
+}
+
+Semaphore::~Semaphore()
+{
+}
+
+void
+Semaphore::post()
+{
+    abort();
+}
+
+void
+Semaphore::wait()
+{
+    abort();
+}
+
 #endif /* !USE_PTHREADS */
 #endif /* !_WIN32 */
 
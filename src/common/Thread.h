@@ -28,11 +28,18 @@
 
 #ifndef NO_THREADING
 
+#include <atomic>
+
 #ifdef _WIN32
 #include <windows.h>
 #else /* !_WIN32 */
 #ifdef USE_PTHREADS
 #include <pthread.h>
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#else
+#include <semaphore.h>
+#endif
 #else /* !USE_PTHREADS */
 #error No thread implementation selected
 #endif /* !USE_PTHREADS */
@@ -66,6 +73,12 @@ public:
 
     static bool threadingAvailable();
 
+    /**
+     * Give up the rest of the calling thread's timeslice, for use
+     * in spin-waits.
+     */
+    static void yield();
+
 protected:
     virtual void run() = 0;
 
@@ -164,6 +177,49 @@ private:
 #endif
 };
 
+/**
+  The Semaphore class is a counting semaphore, for use where a thread
+  that must not block (such as the audio processing thread) needs to
+  wake one that is waiting for work.
+
+  post() increments the count, and never takes a lock: if no thread
+  is waiting it is a single atomic operation, and otherwise it makes
+  one call to post the system semaphore, which wakes the waiter
+  without any mutex on the posting side. wait() blocks until the
+  count is positive and then decrements it.
+
+  Each post() satisfies exactly one wait(), so a waiter that may be
+  posted more often than it waits should re-test whatever it is
+  waiting for when wait() returns.
+*/
+
+class Semaphore
+{
+public:
+    Semaphore();
+    ~Semaphore();
+
+    void post();
+    void wait();
+
+private:
+    std::atomic<int> m_count; // negative when threads are waiting
+#ifdef _WIN32
+    HANDLE m_semaphore;
+#else
+#ifdef USE_PTHREADS
+#ifdef __APPLE__
+    dispatch_semaphore_t m_semaphore;
+#else
+    sem_t m_semaphore;
+#endif
+#endif
+#endif
+
+    Semaphore(const Semaphore &) =delete;
+    Semaphore &operator=(const Semaphore &) =delete;
+};
+
 }
 
 #else
@@ -188,6 +244,8 @@ public:
 
     static bool threadingAvailable() { return false; }
 
+    static void yield() { }
+
 protected:
     virtual void run() = 0;
 
@@ -225,6 +283,16 @@ public:
     void signal() { }
 };
 
+class Semaphore
+{
+public:
+    Semaphore() { }
+    ~Semaphore() { }
+
+    void post() { }
+    void wait() { }
+};
+
 }
 
 #endif /* NO_THREADING */
@@ -0,0 +1,130 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "ThreadPool.h"
+
+#include "sysutils.h"
+
+namespace RubberBand
+{
+
+#ifndef NO_THREADING
+
+ThreadPool::ThreadPool(int threadCount) :
+    m_condition("ThreadPool"),
+    m_exiting(false),
+    m_threadCount(threadCount < 1 ? 1 : threadCount)
+{
+    for (int i = 0; i < m_threadCount; ++i) {
+        Worker *w = new Worker(this);
+        m_workers.push_back(w);
+        w->start();
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    m_condition.lock();
+    m_exiting = true;
+    for (int i = 0; i < m_threadCount; ++i) {
+        m_condition.signal();
+    }
+    m_condition.unlock();
+    
+    for (auto w : m_workers) {
+        w->wait();
+        delete w;
+    }
+}
+
+void
+ThreadPool::post(Task task)
+{
+    m_condition.lock();
+    m_tasks.push_back(task);
+    m_condition.signal();
+    m_condition.unlock();
+}
+
+void
+ThreadPool::Worker::run()
+{
+    ThreadPool *p = m_pool;
+    
+    p->m_condition.lock();
+
+    while (true) {
+
+        if (p->m_tasks.empty()) {
+            if (p->m_exiting) {
+                break;
+            }
+            p->m_condition.wait();
+            continue;
+        }
+
+        Task task = p->m_tasks.front();
+        p->m_tasks.pop_front();
+
+        p->m_condition.unlock();
+        task();
+        p->m_condition.lock();
+    }
+
+    p->m_condition.unlock();
+}
+
+#else
+
+ThreadPool::ThreadPool(int threadCount) :
+    m_threadCount(threadCount < 1 ? 1 : threadCount)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+}
+
+void
+ThreadPool::post(Task task)
+{
+    task();
+}
+
+#endif
+
+int
+ThreadPool::getThreadCount() const
+{
+    return m_threadCount;
+}
+
+ThreadPool &
+ThreadPool::getSharedPool()
+{
+    // Function-local static, so construction is thread-safe in C++11
+    static ThreadPool pool(system_is_multiprocessor() ? 2 : 1);
+    return pool;
+}
+
+}
@@ -0,0 +1,100 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_THREAD_POOL_H
+#define RUBBERBAND_THREAD_POOL_H
+
+#include "Thread.h"
+
+#include <functional>
+#include <deque>
+#include <vector>
+
+namespace RubberBand
+{
+
+/**
+ * A small fixed-size pool of worker threads that run queued tasks in
+ * submission order. Workers sleep on a condition while the queue is
+ * empty, so an idle pool costs nothing but its threads.
+ *
+ * A single shared pool is available through getSharedPool(), which
+ * is what the library uses when it needs to run work in the
+ * background and the application has not supplied an executor of
+ * its own. Tasks run on a pool may run concurrently with one
+ * another, so anything that needs to be serialised (such as the
+ * work for a single stretcher) must arrange that for itself.
+ *
+ * When built with NO_THREADING, post() simply runs the task
+ * immediately on the calling thread.
+ */
+class ThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    ThreadPool(int threadCount);
+
+    /**
+     * Run any tasks still queued, then stop and join the workers.
+     */
+    ~ThreadPool();
+
+    int getThreadCount() const;
+
+    /**
+     * Queue a task to be run on one of the workers. This allocates
+     * and locks, so it is not RT-safe.
+     */
+    void post(Task task);
+
+    /**
+     * Return the library-wide pool, creating it on first use.
+     */
+    static ThreadPool &getSharedPool();
+
+protected:
+#ifndef NO_THREADING
+    class Worker : public Thread
+    {
+    public:
+        Worker(ThreadPool *pool) : m_pool(pool) { }
+        void run() override;
+    private:
+        ThreadPool *m_pool;
+    };
+
+    std::vector<Worker *> m_workers;
+    std::deque<Task> m_tasks;
+    Condition m_condition;
+    bool m_exiting;
+#endif
+    int m_threadCount;
+
+    ThreadPool(const ThreadPool &) =delete;
+    ThreadPool &operator=(const ThreadPool &) =delete;
+};
+
+}
+
+#endif
@@ -0,0 +1,322 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "Tracer.h"
+
+#include <chrono>
+#include <fstream>
+#include <stdio.h>
+
+#ifdef _MSC_VER
+#define snprintf sprintf_s
+#endif
+
+namespace RubberBand {
+
+namespace {
+
+struct Event {
+    const char *name;
+    double time; // microseconds since start()
+    int64_t hop;
+    char phase;
+};
+
+static const int blockSize = 16384;
+
+struct Block {
+    Event events[blockSize];
+    std::atomic<Block *> next;
+    Block() : next(nullptr) { }
+};
+
+// A thread's buffer. Only the owning thread writes events and the
+// count; the reader loads the count with acquire ordering and reads
+// that many events. Buffers and their blocks are allocated by
+// start() and never freed. A buffer is claimed by a thread the first
+// time it records, and released when that thread exits, after which
+// it may be claimed by a thread in a later session.
+
+struct ThreadBuffer {
+    std::atomic<bool> inUse;
+    std::atomic<int> session;
+    std::atomic<int> count;
+    std::atomic<int> dropped;
+    int tid;
+    Block *first;
+    Block *current;
+    ThreadBuffer *next; // in list of all buffers, immutable once linked
+    ThreadBuffer(int t) :
+        inUse(false), session(0), count(0), dropped(0), tid(t),
+        first(new Block), current(first), next(nullptr) { }
+    void extend(int blocks) { // called from start() only
+        Block *last = first;
+        for (int i = 1; i < blocks; ++i) {
+            Block *next = last->next.load(std::memory_order_acquire);
+            if (!next) {
+                next = new Block;
+                last->next.store(next, std::memory_order_release);
+            }
+            last = next;
+        }
+    }
+};
+
+static std::atomic<ThreadBuffer *> buffers(nullptr);
+static std::atomic<int> nextTid(1);
+static std::atomic<int> session(0);
+static std::atomic<int> maxEvents(0);
+static std::atomic<int64_t> startTime(0); // steady_clock ns
+
+// Events from threads that found no free buffer, in the current session
+static std::atomic<int> unbufferedDropped(0);
+
+static thread_local int64_t currentHop = -1;
+
+struct BufferRelease {
+    ThreadBuffer *buffer;
+    BufferRelease() : buffer(nullptr) { }
+    ~BufferRelease() {
+        if (buffer) buffer->inUse.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local BufferRelease myBuffer;
+
+// Session in which the calling thread last failed to claim a buffer,
+// so that it need not search again for every event
+static thread_local int unbufferedSession = 0;
+
+static ThreadBuffer *
+claimBuffer(int currentSession)
+{
+    // Take a free buffer, either one not yet used or one left by a
+    // thread that has exited, so long as it holds nothing from the
+    // current session. This never allocates: if there is none, the
+    // calling thread records nothing
+    for (ThreadBuffer *b = buffers.load(std::memory_order_acquire);
+         b; b = b->next) {
+        if (b->session.load(std::memory_order_acquire) == currentSession) {
+            continue;
+        }
+        bool expected = false;
+        if (b->inUse.compare_exchange_strong(expected, true)) {
+            return b;
+        }
+    }
+    return nullptr;
+}
+
+}
+
+std::atomic<bool> Tracer::m_recording(false);
+
+void
+Tracer::start(int maxEventsPerThread, int maxThreads)
+{
+    m_recording = false;
+
+    // Allocate everything that recording will need, so that record()
+    // only has to claim it. Buffers are shared with earlier sessions,
+    // so we make sure every buffer, and not only new ones, can hold
+    // maxEventsPerThread events
+    
+    int blocks = (maxEventsPerThread + blockSize - 1) / blockSize;
+    if (blocks < 1) blocks = 1;
+    
+    int existing = 0;
+    for (ThreadBuffer *b = buffers.load(std::memory_order_acquire);
+         b; b = b->next) {
+        b->extend(blocks);
+        ++existing;
+    }
+    for (int i = existing; i < maxThreads; ++i) {
+        ThreadBuffer *b = new ThreadBuffer(nextTid++);
+        b->extend(blocks);
+        b->next = buffers.load(std::memory_order_relaxed);
+        buffers.store(b, std::memory_order_release);
+    }
+
+    maxEvents = maxEventsPerThread;
+    unbufferedDropped = 0;
+    startTime = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+    ++session;
+    m_recording = true;
+}
+
+void
+Tracer::stop()
+{
+    m_recording = false;
+}
+
+void
+Tracer::setHop(int64_t hop)
+{
+    currentHop = hop;
+}
+
+void
+Tracer::record(const char *name, char phase)
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+    double time = double(now - startTime.load(std::memory_order_relaxed))
+        / 1000.0;
+
+    int currentSession = session.load(std::memory_order_relaxed);
+
+    ThreadBuffer *b = myBuffer.buffer;
+    if (!b) {
+        if (unbufferedSession != currentSession) {
+            b = claimBuffer(currentSession);
+        }
+        if (!b) {
+            unbufferedSession = currentSession;
+            unbufferedDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        myBuffer.buffer = b;
+    }
+    if (b->session.load(std::memory_order_relaxed) != currentSession) {
+        b->count.store(0, std::memory_order_relaxed);
+        b->dropped.store(0, std::memory_order_relaxed);
+        b->current = b->first;
+        b->session.store(currentSession, std::memory_order_release);
+    }
+
+    int n = b->count.load(std::memory_order_relaxed);
+    if (n >= maxEvents.load(std::memory_order_relaxed)) {
+        b->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    int offset = n % blockSize;
+    if (offset == 0 && n > 0) {
+        Block *next = b->current->next.load(std::memory_order_acquire);
+        if (!next) {
+            // start() allocated enough for maxEvents, but be safe
+            b->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        b->current = next;
+    }
+
+    Event &e = b->current->events[offset];
+    e.name = name;
+    e.time = time;
+    e.hop = currentHop;
+    e.phase = phase;
+
+    b->count.store(n + 1, std::memory_order_release);
+}
+
+static void
+appendEscaped(std::string &s, const char *str)
+{
+    for (const char *p = str; *p; ++p) {
+        if (*p == '"' || *p == '\\') s += '\\';
+        s += *p;
+    }
+}
+
+std::string
+Tracer::getChromeTrace()
+{
+    static const int buflen = 128;
+    char buffer[buflen];
+
+    int currentSession = session.load(std::memory_order_acquire);
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool firstEvent = true;
+
+    for (ThreadBuffer *b = buffers.load(std::memory_order_acquire);
+         b; b = b->next) {
+
+        if (b->session.load(std::memory_order_acquire) != currentSession) {
+            continue;
+        }
+        int n = b->count.load(std::memory_order_acquire);
+        if (n == 0) {
+            continue;
+        }
+
+        snprintf(buffer, buflen,
+                 "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                 firstEvent ? "" : ",", b->tid, b->tid);
+        json += buffer;
+        firstEvent = false;
+
+        const Block *block = b->first;
+        for (int i = 0; i < n; ++i) {
+            if (i > 0 && i % blockSize == 0) {
+                block = block->next.load(std::memory_order_acquire);
+            }
+            const Event &e = block->events[i % blockSize];
+            json += ",\n{\"name\":\"";
+            appendEscaped(json, e.name);
+            snprintf(buffer, buflen,
+                     "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+                     e.phase, e.time, b->tid);
+            json += buffer;
+            if (e.hop >= 0) {
+                snprintf(buffer, buflen, ",\"args\":{\"hop\":%lld}",
+                         (long long)e.hop);
+                json += buffer;
+            }
+            json += "}";
+        }
+    }
+
+    json += "\n]}\n";
+    return json;
+}
+
+bool
+Tracer::writeChromeTrace(std::string filename)
+{
+    std::ofstream out(filename.c_str());
+    if (!out) {
+        return false;
+    }
+    out << getChromeTrace();
+    return bool(out);
+}
+
+int
+Tracer::getDroppedEventCount()
+{
+    int currentSession = session.load(std::memory_order_acquire);
+    int dropped = unbufferedDropped.load(std::memory_order_relaxed);
+    for (ThreadBuffer *b = buffers.load(std::memory_order_acquire);
+         b; b = b->next) {
+        if (b->session.load(std::memory_order_acquire) == currentSession) {
+            dropped += b->dropped.load(std::memory_order_relaxed);
+        }
+    }
+    return dropped;
+}
+
+}
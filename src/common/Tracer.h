@@ -0,0 +1,105 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_TRACER_H
+#define RUBBERBAND_TRACER_H
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+namespace RubberBand {
+
+/**
+ * Recorder for begin and end events at the Profiler probe points,
+ * for export as Chrome trace-event JSON (as read by chrome://tracing
+ * and Perfetto). Unlike the Profiler statistics, this is available
+ * in release builds: recording is switched on and off at runtime,
+ * and when it is off each probe costs one relaxed atomic load.
+ *
+ * Each thread appends to a buffer of its own, without locking.
+ * start() allocates the buffers, each with room for the per-thread
+ * limit it is given, and a thread claims one the first time it
+ * records anything, so recording itself does not allocate. Buffers
+ * are reused by later threads and sessions. Events beyond the
+ * per-thread limit, and all events from threads beyond the number
+ * of buffers, are dropped and counted.
+ */
+class Tracer
+{
+public:
+    /** Discard anything previously recorded and begin recording,
+     *  keeping at most maxEventsPerThread events for each of up to
+     *  maxThreads threads. The memory for these is allocated here
+     *  (though not touched until used) and retained for later
+     *  sessions.
+     */
+    static void start(int maxEventsPerThread = 1 << 18,
+                      int maxThreads = 16);
+
+    /** Stop recording. Events recorded so far are retained until the
+     *  next start().
+     */
+    static void stop();
+
+    static bool isRecording() {
+        return m_recording.load(std::memory_order_relaxed);
+    }
+
+    static void begin(const char *name) {
+        if (isRecording()) record(name, 'B');
+    }
+
+    static void end(const char *name) {
+        if (isRecording()) record(name, 'E');
+    }
+
+    /** Set the hop number recorded with subsequent events on the
+     *  calling thread, or -1 for none.
+     */
+    static void setHop(int64_t hop);
+
+    /** Return the events recorded in the most recent session as a
+     *  Chrome trace-event JSON document. Call this only once
+     *  recording has been stopped.
+     */
+    static std::string getChromeTrace();
+
+    /** Write the result of getChromeTrace() to the given file,
+     *  returning false if it could not be written.
+     */
+    static bool writeChromeTrace(std::string filename);
+
+    /** Return the number of events dropped in the most recent
+     *  session because a thread's buffer was full.
+     */
+    static int getDroppedEventCount();
+
+private:
+    static std::atomic<bool> m_recording;
+    static void record(const char *name, char phase);
+};
+
+}
+
+#endif
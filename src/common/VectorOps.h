@@ -840,6 +840,65 @@ inline void v_fftshift(T *const R__ ptr,
     }
 }
 
+// Multiply src by window and write the result to dst with its
+// halves exchanged, as by v_fftshift, converting to the type of dst
+// on the way. This is the whole of the preparation of an analysis
+// frame for a forward FFT, in one pass. The count must be even and
+// src and dst must not overlap.
+
+template<typename T, typename S, typename W>
+inline void v_multiply_and_fftshift(T *const R__ dst,
+                                    const S *const R__ src,
+                                    const W *const R__ window,
+                                    const int count)
+{
+    const int hs = count/2;
+    for (int i = 0; i < hs; ++i) {
+        dst[i] = T(src[i + hs] * window[i + hs]);
+    }
+    for (int i = 0; i < hs; ++i) {
+        dst[i + hs] = T(src[i] * window[i]);
+    }
+}
+
+template<typename T, typename W>
+inline void v_multiply_and_fftshift(T *const R__ ptr,
+                                    const W *const R__ window,
+                                    const int count)
+{
+    const int hs = count/2;
+    for (int i = 0; i < hs; ++i) {
+        T t = ptr[i] * window[i];
+        ptr[i] = ptr[i + hs] * window[i + hs];
+        ptr[i + hs] = t;
+    }
+}
+
+// The converse, for synthesis: add src into dst with its halves
+// exchanged and multiplied by window, converting to the type of dst,
+// and add window multiplied by gain into windowSum. This is the
+// whole of the overlap-add of a frame from the output of an inverse
+// FFT, in one pass. The count must be even.
+
+template<typename T, typename S>
+inline void v_fftshift_multiply_and_add(T *const R__ dst,
+                                        T *const R__ windowSum,
+                                        const S *const R__ src,
+                                        const T *const R__ window,
+                                        const T gain,
+                                        const int count)
+{
+    const int hs = count/2;
+    for (int i = 0; i < hs; ++i) {
+        dst[i] += T(src[i + hs]) * window[i];
+        windowSum[i] += window[i] * gain;
+    }
+    for (int i = 0; i < hs; ++i) {
+        dst[i + hs] += T(src[i]) * window[i + hs];
+        windowSum[i + hs] += window[i + hs] * gain;
+    }
+}
+
 template<typename T>
 inline T v_mean(const T *const R__ ptr, const int count)
 {
@@ -84,6 +84,33 @@ public:
     inline void cutAndAdd(const T *const R__ src, T *const R__ dst) const {
         v_multiply_and_add(dst, src, m_cache, m_size);
     }
+
+    /**
+     * Window src into dst with the two halves exchanged, ready for
+     * a forward FFT, converting sample type as needed. The size must
+     * be even and src and dst must not overlap.
+     */
+    template <typename S, typename D>
+    inline void cutAndShift(const S *const R__ src, D *const R__ dst) const {
+        v_multiply_and_fftshift(dst, src, m_cache, m_size);
+    }
+
+    inline void cutAndShift(T *const R__ block) const {
+        v_multiply_and_fftshift(block, m_cache, m_size);
+    }
+
+    /**
+     * Window src, with its two halves exchanged, and add it into
+     * dst, converting sample type as needed; and add the window
+     * itself, scaled by windowGain, into windowSum. The size must be
+     * even.
+     */
+    template <typename S>
+    inline void shiftCutAndAdd(const S *const R__ src, T *const R__ dst,
+                               T *const R__ windowSum, T windowGain) const {
+        v_fftshift_multiply_and_add(dst, windowSum, src, m_cache,
+                                    windowGain, m_size);
+    }
     
     inline void add(T *const R__ dst, T scale) const {
         v_add_with_gain(dst, m_cache, scale, m_size);
@@ -61,11 +61,13 @@ R2Stretcher::R2Stretcher(size_t sampleRate,
                          RubberBandStretcher::Options options,
                          double initialTimeRatio,
                          double initialPitchScale,
-                         Log log) :
+                         Log log,
+                         const R2Stretcher *prototype) :
     m_sampleRate(sampleRate),
     m_channels(channels),
     m_timeRatio(initialTimeRatio),
     m_pitchScale(initialPitchScale),
+    m_outputRateRatio(1.0),
     m_fftSize(m_defaultFftSize),
     m_aWindowSize(m_defaultFftSize),
     m_sWindowSize(m_defaultFftSize),
@@ -80,12 +82,17 @@ R2Stretcher::R2Stretcher(size_t sampleRate,
     m_options(options),
     m_log(log),
     m_mode(JustCreated),
+    m_channelTask(AnalyseTask),
+    m_taskPhaseIncrement(0),
+    m_taskShiftIncrement(0),
+    m_taskPhaseReset(false),
     m_awindow(0),
     m_afilter(0),
     m_swindow(0),
     m_studyFFT(0),
 #ifndef NO_THREADING
     m_spaceAvailable("space"),
+    m_channelTaskState(0),
 #endif
     m_inputDuration(0),
     m_detectorType(CompoundAudioCurve::CompoundDetector),
@@ -157,15 +164,50 @@ R2Stretcher::R2Stretcher(size_t sampleRate,
         if (m_threaded) {
             m_log.log(1, "Going multithreaded...");
         }
+
+        if (m_realtime &&
+            (m_options & RubberBandStretcher::OptionThreadingRealTime) &&
+            ((m_options & RubberBandStretcher::OptionThreadingAlways) ||
+             system_is_multiprocessor())) {
+            m_log.log(1, "Sharing real-time channel processing with workers",
+                      m_channels - 1);
+            m_channelTaskState = new std::atomic<int>[m_channels];
+            for (size_t c = 0; c < m_channels; ++c) {
+                m_channelTaskState[c] = TaskIdle;
+            }
+            m_channelTaskLast = std::vector<char>(m_channels, 0);
+            for (size_t i = 1; i < m_channels; ++i) {
+                ChannelWorker *worker = new ChannelWorker(this);
+                m_channelWorkers.push_back(worker);
+                worker->start();
+            }
+        }
     }
 #endif
 
+    if (prototype) {
+        m_windows = prototype->m_windows;
+        m_sincs = prototype->m_sincs;
+    }
+
     configure();
 }
 
 R2Stretcher::~R2Stretcher()
 {
 #ifndef NO_THREADING
+    for (size_t i = 0; i < m_channelWorkers.size(); ++i) {
+        m_channelWorkers[i]->abandon();
+    }
+    for (size_t i = 0; i < m_channelWorkers.size(); ++i) {
+        m_channelTasksAvailable.post();
+    }
+    for (size_t i = 0; i < m_channelWorkers.size(); ++i) {
+        m_channelWorkers[i]->wait();
+        delete m_channelWorkers[i];
+    }
+    delete[] m_channelTaskState;
+    
     if (m_threaded) {
         MutexLocker locker(&m_threadSetMutex);
         for (set<ProcessThread *>::iterator i = m_threadSet.begin();
@@ -181,20 +223,14 @@ R2Stretcher::~R2Stretcher()
     for (size_t c = 0; c < m_channels; ++c) {
         delete m_channelData[c];
     }
+    for (size_t i = 0; i < m_scratch.size(); ++i) {
+        delete m_scratch[i];
+    }
 
     delete m_phaseResetAudioCurve;
     delete m_silentAudioCurve;
     delete m_stretchCalculator;
     delete m_studyFFT;
-
-    for (map<size_t, Window<float> *>::iterator i = m_windows.begin();
-         i != m_windows.end(); ++i) {
-        delete i->second;
-    }
-    for (map<size_t, SincWindow<float> *>::iterator i = m_sincs.begin();
-         i != m_sincs.end(); ++i) {
-        delete i->second;
-    }
 }
 
 void
@@ -202,15 +238,15 @@ R2Stretcher::reset()
 {
 #ifndef NO_THREADING
     if (m_threaded) {
+        // Park rather than join the process threads: they are resumed
+        // on the next process() call, as reset is commonly used when
+        // reusing a stretcher for a series of short inputs
         m_threadSetMutex.lock();
         for (set<ProcessThread *>::iterator i = m_threadSet.begin();
              i != m_threadSet.end(); ++i) {
-            m_log.log(1, "RubberBandStretcher::~RubberBandStretcher: joining for channel", (*i)->channel());
-            (*i)->abandon();
-            (*i)->wait();
-            delete *i;
+            m_log.log(2, "R2Stretcher::reset: parking thread for channel", (*i)->channel());
+            (*i)->park();
         }
-        m_threadSet.clear();
     }
 #endif
 
@@ -219,6 +255,7 @@ R2Stretcher::reset()
     if (m_stretchCalculator) {
         m_stretchCalculator->reset();
     }
+    m_keyFrameMap.clear();
 
     for (size_t c = 0; c < m_channels; ++c) {
         m_channelData[c]->reset();
@@ -227,6 +264,9 @@ R2Stretcher::reset()
     m_mode = JustCreated;
     if (m_phaseResetAudioCurve) m_phaseResetAudioCurve->reset();
     if (m_silentAudioCurve) m_silentAudioCurve->reset();
+    m_phaseResetDf.clear();
+    m_silence.clear();
+    m_outputIncrements.clear();
     m_inputDuration = 0;
     m_silentHistory = 0;
 
@@ -234,7 +274,43 @@ R2Stretcher::reset()
     if (m_threaded) m_threadSetMutex.unlock();
 #endif
 
-    reconfigure();
+    if (m_realtime) {
+        reconfigure();
+        return;
+    }
+
+    // In offline mode, reconfigure() would rebuild the audio curves
+    // and stretch calculator, which we have just reset in place. We
+    // only need it if the sizes no longer match the current ratios,
+    // which should not normally happen as the ratio setters already
+    // reconfigure when they change anything.
+
+    size_t prevFftSize = m_fftSize;
+    size_t prevAWindowSize = m_aWindowSize;
+    size_t prevSWindowSize = m_sWindowSize;
+    size_t prevOutbufSize = m_outbufSize;
+    size_t prevIncrement = m_increment;
+
+    calculateSizes();
+
+    if (m_fftSize != prevFftSize ||
+        m_aWindowSize != prevAWindowSize ||
+        m_sWindowSize != prevSWindowSize ||
+        m_outbufSize != prevOutbufSize ||
+        m_increment != prevIncrement) {
+        m_fftSize = prevFftSize;
+        m_aWindowSize = prevAWindowSize;
+        m_sWindowSize = prevSWindowSize;
+        m_outbufSize = prevOutbufSize;
+        m_increment = prevIncrement;
+        reconfigure();
+        return;
+    }
+
+    // See note in configure() about the prefill
+    for (size_t c = 0; c < m_channels; ++c) {
+        m_channelData[c]->inbuf->zero(m_aWindowSize/2);
+    }
 }
 
 void
@@ -265,16 +341,49 @@ R2Stretcher::setPitchScale(double fs)
 
     if (fs == m_pitchScale) return;
     
-    bool was1 = (m_pitchScale == 1.f);
+    bool was1 = (getResampleRatio() == 1.0);
     bool rbs = resampleBeforeStretching();
 
     m_pitchScale = fs;
 
     reconfigure();
+    resetResamplersIfModeChanged(was1, rbs);
+}
 
+void
+R2Stretcher::setOutputSampleRate(double rate)
+{
+    if (!m_realtime) {
+        if (m_mode == Studying || m_mode == Processing) {
+            m_log.log(0, "R2Stretcher::setOutputSampleRate: Cannot set output sample rate while studying or processing in non-RT mode");
+            return;
+        }
+    }
+
+    double ratio = 1.0;
+    if (rate > 0.0) {
+        ratio = rate / double(m_sampleRate);
+    }
+    
+    if (ratio == m_outputRateRatio) return;
+
+    m_log.log(1, "R2Stretcher::setOutputSampleRate: rate and ratio", rate, ratio);
+    
+    bool was1 = (getResampleRatio() == 1.0);
+    bool rbs = resampleBeforeStretching();
+
+    m_outputRateRatio = ratio;
+
+    reconfigure();
+    resetResamplersIfModeChanged(was1, rbs);
+}
+
+void
+R2Stretcher::resetResamplersIfModeChanged(bool was1, bool rbs)
+{
     if (!(m_options & RubberBandStretcher::OptionPitchHighConsistency) &&
         (was1 || resampleBeforeStretching() != rbs) &&
-        m_pitchScale != 1.f) {
+        getResampleRatio() != 1.0) {
         
         // resampling mode has changed
         for (int c = 0; c < int(m_channels); ++c) {
@@ -328,6 +437,8 @@ R2Stretcher::setKeyFrameMap(const std::map<size_t, size_t> &
         return;
     }
 
+    m_keyFrameMap = mapping;
+
     if (m_stretchCalculator) {
         m_stretchCalculator->setKeyFrameMap(mapping);
     }
@@ -354,6 +465,18 @@ R2Stretcher::setFrequencyCutoff(int n, float f)
     }
 }
 
+HistoryPrecision
+R2Stretcher::getHistoryPrecision() const
+{
+    if (m_options & RubberBandStretcher::OptionHistoryHalf) {
+        return HistoryPrecision::HalfFloat;
+    } else if (m_options & RubberBandStretcher::OptionHistoryFloat) {
+        return HistoryPrecision::Single;
+    } else {
+        return HistoryPrecision::Full;
+    }
+}
+
 double
 R2Stretcher::getEffectiveRatio() const
 {
@@ -371,6 +494,16 @@ R2Stretcher::getEffectiveRatio() const
     return m_timeRatio * m_pitchScale;
 }
 
+double
+R2Stretcher::getResampleRatio() const
+{
+    // Returns the ratio applied by the resampler, either before or
+    // after stretching. This effects the pitch shift and any
+    // conversion to a different output sample rate in the same step.
+    
+    return m_outputRateRatio / m_pitchScale;
+}
+
 size_t
 R2Stretcher::roundUp(size_t value)
 {
@@ -381,6 +514,22 @@ R2Stretcher::roundUp(size_t value)
     return value;
 }
 
+std::set<int>
+R2Stretcher::getFftSizes(size_t sampleRate)
+{
+    // As in the constructor and calculateSizes: the base size follows
+    // the sample rate, is halved or doubled by the window options,
+    // and may be doubled again for large stretch ratios
+    float rateMultiple = float(sampleRate) / 48000.f;
+    size_t base = roundUp(int(m_defaultFftSize * rateMultiple));
+    std::set<int> sizes;
+    sizes.insert(int(base / 2));
+    sizes.insert(int(base));
+    sizes.insert(int(base * 2));
+    sizes.insert(int(base * 4));
+    return sizes;
+}
+
 void
 R2Stretcher::calculateSizes()
 {
@@ -407,7 +556,7 @@ R2Stretcher::calculateSizes()
 
         if (r < 1) {
             
-            bool rsb = (m_pitchScale < 1.0 && !resampleBeforeStretching());
+            bool rsb = (getResampleRatio() > 1.0 && !resampleBeforeStretching());
             float windowIncrRatio = 4.5;
             if (r == 1.0) windowIncrRatio = 4;
             else if (rsb) windowIncrRatio = 4.5;
@@ -429,7 +578,7 @@ R2Stretcher::calculateSizes()
 
         } else {
 
-            bool rsb = (m_pitchScale > 1.0 && resampleBeforeStretching());
+            bool rsb = (getResampleRatio() < 1.0 && resampleBeforeStretching());
             float windowIncrRatio = 4.5;
             if (r == 1.0) windowIncrRatio = 4;
             else if (rsb) windowIncrRatio = 4.5;
@@ -451,7 +600,7 @@ R2Stretcher::calculateSizes()
 
             if (rsb) {
                 size_t oldWindowSize = windowSize;
-                size_t newWindowSize = roundUp(lrint(windowSize / m_pitchScale));
+                size_t newWindowSize = roundUp(lrint(windowSize * getResampleRatio()));
                 if (newWindowSize < 512) newWindowSize = 512;
                 size_t div = windowSize / newWindowSize;
                 if (inputIncrement > div && outputIncrement > div) {
@@ -533,8 +682,9 @@ R2Stretcher::calculateSizes()
     m_outbufSize =
         size_t
         (ceil(max
-              (m_maxProcessSize / m_pitchScale,
-               m_maxProcessSize * 2 * (m_timeRatio > 1.f ? m_timeRatio : 1.f))));
+              (m_maxProcessSize * getResampleRatio(),
+               m_maxProcessSize * 2 * (m_timeRatio > 1.f ? m_timeRatio : 1.f) *
+               (m_outputRateRatio > 1.0 ? m_outputRateRatio : 1.0))));
 
     if (m_realtime) {
         // This headroom is so as to try to avoid reallocation when
@@ -570,7 +720,7 @@ R2Stretcher::configure()
     size_t prevAWindowSize = m_aWindowSize;
     size_t prevSWindowSize = m_sWindowSize;
     size_t prevOutbufSize = m_outbufSize;
-    if (m_windows.empty()) {
+    if (m_channelData.empty()) {
         prevFftSize = 0;
         prevAWindowSize = 0;
         prevSWindowSize = 0;
@@ -608,15 +758,16 @@ R2Stretcher::configure()
         for (set<size_t>::const_iterator i = windowSizes.begin();
              i != windowSizes.end(); ++i) {
             if (m_windows.find(*i) == m_windows.end()) {
-                m_windows[*i] = new Window<float>(HannWindow, *i);
+                m_windows[*i] = std::make_shared<Window<float>>
+                    (HannWindow, *i);
             }
             if (m_sincs.find(*i) == m_sincs.end()) {
-                m_sincs[*i] = new SincWindow<float>(*i, *i);
+                m_sincs[*i] = std::make_shared<SincWindow<float>>(*i, *i);
             }
         }
-        m_awindow = m_windows[m_aWindowSize];
-        m_afilter = m_sincs[m_aWindowSize];
-        m_swindow = m_windows[m_sWindowSize];
+        m_awindow = m_windows[m_aWindowSize].get();
+        m_afilter = m_sincs[m_aWindowSize].get();
+        m_swindow = m_windows[m_sWindowSize].get();
 
         m_log.log(1, "analysis and synthesis window areas",
                   m_awindow->getArea(), m_swindow->getArea());
@@ -634,7 +785,29 @@ R2Stretcher::configure()
                 (new ChannelData(windowSizes,
                                  std::max(m_aWindowSize, m_sWindowSize),
                                  m_fftSize,
-                                 m_outbufSize));
+                                 m_outbufSize,
+                                 getHistoryPrecision()));
+        }
+    }
+
+    if (windowSizeChanged || fftSizeChanged) {
+
+        for (size_t i = 0; i < m_scratch.size(); ++i) {
+            delete m_scratch[i];
+        }
+        m_scratch.clear();
+
+        size_t scratchSets = 1;
+#ifndef NO_THREADING
+        if (m_threaded || !m_channelWorkers.empty()) {
+            scratchSets = m_channels;
+        }
+#endif
+        for (size_t i = 0; i < scratchSets; ++i) {
+            m_scratch.push_back
+                (new ScratchData(windowSizes,
+                                 std::max(m_aWindowSize, m_sWindowSize),
+                                 m_fftSize));
         }
     }
 
@@ -644,7 +817,7 @@ R2Stretcher::configure()
         m_studyFFT->initFloat();
     }
 
-    if (m_pitchScale != 1.0 ||
+    if (getResampleRatio() != 1.0 ||
         (m_options & RubberBandStretcher::OptionPitchHighConsistency) ||
         m_realtime) {
 
@@ -674,7 +847,7 @@ R2Stretcher::configure()
             // for resampling; but allocate a sensible amount in case
             // the pitch scale changes during use
             size_t rbs = 
-                lrintf(ceil((m_increment * m_timeRatio * 2) / m_pitchScale));
+                lrintf(ceil((m_increment * m_timeRatio * 2) * getResampleRatio()));
             if (rbs < m_increment * 16) rbs = m_increment * 16;
             m_channelData[c]->setResampleBufSize(rbs);
         }
@@ -756,28 +929,32 @@ R2Stretcher::reconfigure()
 
         if (m_windows.find(m_aWindowSize) == m_windows.end()) {
             m_log.log(0, "WARNING: reconfigure(): window allocation required in realtime mode, size", m_aWindowSize);
-            m_windows[m_aWindowSize] = new Window<float>
+            m_windows[m_aWindowSize] = std::make_shared<Window<float>>
                 (HannWindow, m_aWindowSize);
-            m_sincs[m_aWindowSize] = new SincWindow<float>
+            m_sincs[m_aWindowSize] = std::make_shared<SincWindow<float>>
                 (m_aWindowSize, m_aWindowSize);
         }
 
         if (m_windows.find(m_sWindowSize) == m_windows.end()) {
             m_log.log(0, "WARNING: reconfigure(): window allocation required in realtime mode, size", m_sWindowSize);
-            m_windows[m_sWindowSize] = new Window<float>
+            m_windows[m_sWindowSize] = std::make_shared<Window<float>>
                 (HannWindow, m_sWindowSize);
-            m_sincs[m_sWindowSize] = new SincWindow<float>
+            m_sincs[m_sWindowSize] = std::make_shared<SincWindow<float>>
                 (m_sWindowSize, m_sWindowSize);
         }
 
-        m_awindow = m_windows[m_aWindowSize];
-        m_afilter = m_sincs[m_aWindowSize];
-        m_swindow = m_windows[m_sWindowSize];
+        m_awindow = m_windows[m_aWindowSize].get();
+        m_afilter = m_sincs[m_aWindowSize].get();
+        m_swindow = m_windows[m_sWindowSize].get();
 
         for (size_t c = 0; c < m_channels; ++c) {
             m_channelData[c]->setSizes(std::max(m_aWindowSize, m_sWindowSize),
                                        m_fftSize);
         }
+        for (size_t i = 0; i < m_scratch.size(); ++i) {
+            m_scratch[i]->setSizes(std::max(m_aWindowSize, m_sWindowSize),
+                                   m_fftSize);
+        }
 
         somethingChanged = true;
     }
@@ -789,7 +966,7 @@ R2Stretcher::reconfigure()
         somethingChanged = true;
     }
 
-    if (m_pitchScale != 1.0) {
+    if (getResampleRatio() != 1.0) {
         for (size_t c = 0; c < m_channels; ++c) {
 
             if (m_channelData[c]->resampler) continue;
@@ -807,7 +984,7 @@ R2Stretcher::reconfigure()
             m_channelData[c]->resampler = new Resampler(params, 1);
 
             size_t rbs = 
-                lrintf(ceil((m_increment * m_timeRatio * 2) / m_pitchScale));
+                lrintf(ceil((m_increment * m_timeRatio * 2) * getResampleRatio()));
             if (rbs < m_increment * 16) rbs = m_increment * 16;
             m_channelData[c]->setResampleBufSize(rbs);
 
@@ -839,7 +1016,7 @@ size_t
 R2Stretcher::getStartDelay() const
 {
     if (!m_realtime) return 0;
-    return lrint((m_aWindowSize/2) / m_pitchScale);
+    return lrint((m_aWindowSize/2) * getResampleRatio());
 }
 
 void
@@ -1131,6 +1308,17 @@ R2Stretcher::calculateStretch()
         }
     }
 
+    // Key frame output positions are in terms of the final output,
+    // but the stretch calculation precedes resampling
+    
+    if (!m_keyFrameMap.empty() && getResampleRatio() != 1.0) {
+        std::map<size_t, size_t> mapping;
+        for (auto kf : m_keyFrameMap) {
+            mapping[kf.first] = size_t(round(kf.second / getResampleRatio()));
+        }
+        m_stretchCalculator->setKeyFrameMap(mapping);
+    }
+
     std::vector<int> increments = m_stretchCalculator->calculate
         (getEffectiveRatio(),
          inputDuration,
@@ -1217,12 +1405,39 @@ R2Stretcher::getSamplesRequired() const
 
 void
 R2Stretcher::process(const float *const *input, size_t samples, bool final)
+{
+    processSome(input, samples, final, 0);
+}
+
+size_t
+R2Stretcher::processSome(const float *const *input, size_t samples,
+                         bool final, size_t maxHops)
 {
     Profiler profiler("R2Stretcher::process");
 
     if (m_mode == Finished) {
+        if (samples == 0 && maxHops > 0) {
+            // Continuing to drain after a bounded final call. This is
+            // the same work available() would otherwise do for us
+            size_t hops = 0;
+#ifndef NO_THREADING
+            if (!m_threaded) {
+#endif
+                for (size_t c = 0; c < m_channels; ++c) {
+                    if (m_channelData[c]->inbuf->getReadSpace() > 0 &&
+                        !m_channelData[c]->outputComplete) {
+                        bool any = false, last = false;
+                        hops = std::max
+                            (hops, processChunks(c, any, last, maxHops));
+                    }
+                }
+#ifndef NO_THREADING
+            }
+#endif
+            return hops;
+        }
         m_log.log(0, "R2Stretcher::process: Cannot process again after final chunk");
-        return;
+        return 0;
     }
 
     if (m_mode == JustCreated || m_mode == Studying) {
@@ -1246,13 +1461,20 @@ R2Stretcher::process(const float *const *input, size_t samples, bool final)
         if (m_threaded) {
             MutexLocker locker(&m_threadSetMutex);
 
-            for (size_t c = 0; c < m_channels; ++c) {
-                ProcessThread *thread = new ProcessThread(this, c);
-                m_threadSet.insert(thread);
-                thread->start();
+            if (m_threadSet.empty()) {
+                for (size_t c = 0; c < m_channels; ++c) {
+                    ProcessThread *thread = new ProcessThread(this, c);
+                    m_threadSet.insert(thread);
+                    thread->start();
+                }
+                m_log.log(1, "created threads", m_channels);
+            } else {
+                for (ThreadSet::iterator i = m_threadSet.begin();
+                     i != m_threadSet.end(); ++i) {
+                    (*i)->resume();
+                }
+                m_log.log(1, "resumed threads", m_channels);
             }
-
-            m_log.log(1, "created threads", m_channels);
         }
 #endif
         
@@ -1262,10 +1484,14 @@ R2Stretcher::process(const float *const *input, size_t samples, bool final)
     bool allConsumed = false;
 
     size_t *consumed = (size_t *)alloca(m_channels * sizeof(size_t));
+    size_t *chunks = (size_t *)alloca(m_channels * sizeof(size_t));
     for (size_t c = 0; c < m_channels; ++c) {
         consumed[c] = 0;
+        chunks[c] = 0;
     }
 
+    size_t hops = 0;
+
     while (!allConsumed) {
 
         // In a threaded mode, our "consumed" counters only indicate
@@ -1277,11 +1503,13 @@ R2Stretcher::process(const float *const *input, size_t samples, bool final)
         allConsumed = true;
 
         for (size_t c = 0; c < m_channels; ++c) {
-            consumed[c] += consumeChannel(c,
-                                          input,
-                                          consumed[c],
-                                          samples - consumed[c],
-                                          final);
+            if (input) {
+                consumed[c] += consumeChannel(c,
+                                              input,
+                                              consumed[c],
+                                              samples - consumed[c],
+                                              final);
+            }
             if (consumed[c] < samples) {
                 allConsumed = false;
             } else {
@@ -1294,8 +1522,21 @@ R2Stretcher::process(const float *const *input, size_t samples, bool final)
                 !m_threaded &&
 #endif
                 !m_realtime) {
-                bool any = false, last = false;
-                processChunks(c, any, last);
+                // With a hop limit, we only go over it if we have to
+                // in order to make room for the rest of the input
+                size_t limit = 0;
+                if (maxHops > 0) {
+                    if (chunks[c] < maxHops) {
+                        limit = maxHops - chunks[c];
+                    } else if (consumed[c] < samples) {
+                        limit = 1;
+                    }
+                }
+                if (maxHops == 0 || limit > 0) {
+                    bool any = false, last = false;
+                    chunks[c] += processChunks(c, any, last, limit);
+                }
+                hops = std::max(hops, chunks[c]);
             }
         }
 
@@ -1303,8 +1544,15 @@ R2Stretcher::process(const float *const *input, size_t samples, bool final)
             // When running in real time, we need to process both
             // channels in step because we will need to use the sum of
             // their frequency domain representations as the input to
-            // the realtime onset detector
-            processOneChunk();
+            // the realtime onset detector. Only chunks actually
+            // processed count towards the limit, so that a caller
+            // continuing for as long as we return maxHops will stop
+            // once the input runs out
+            if (maxHops == 0 || hops < maxHops || !allConsumed) {
+                if (processOneChunk()) {
+                    ++hops;
+                }
+            }
         }
 #ifndef NO_THREADING
         if (m_threaded) {
@@ -1323,9 +1571,19 @@ R2Stretcher::process(const float *const *input, size_t samples, bool final)
         m_log.log(2, "process looping");
     }
 
+    if (m_realtime && maxHops > 0) {
+        // With a hop limit, carry on through whatever the input
+        // already buffered allows, up to the limit
+        while (hops < maxHops && processOneChunk()) {
+            ++hops;
+        }
+    }
+
     m_log.log(2, "process returning");
 
     if (final) m_mode = Finished;
+
+    return hops;
 }
 
 
@@ -32,13 +32,17 @@
 #include "../common/Scavenger.h"
 #include "../common/Thread.h"
 #include "../common/Log.h"
+#include "../common/HistoryBuffer.h"
 #include "../common/sysutils.h"
 
 #include "SincWindow.h"
 #include "CompoundAudioCurve.h"
 
 #include <set>
+#include <map>
 #include <algorithm>
+#include <atomic>
+#include <memory>
 
 namespace RubberBand
 {
@@ -49,15 +53,22 @@ class StretchCalculator;
 class R2Stretcher
 {
 public:
+    /**
+     * If a prototype is given, it must have the same sample rate,
+     * channel count and options; its windows are then shared rather
+     * than recalculated. The prototype need not outlive this
+     * stretcher.
+     */
     R2Stretcher(size_t sampleRate, size_t channels,
                 RubberBandStretcher::Options options,
                 double initialTimeRatio, double initialPitchScale,
-                Log log);
+                Log log, const R2Stretcher *prototype = nullptr);
     ~R2Stretcher();
     
     void reset();
     void setTimeRatio(double ratio);
     void setPitchScale(double scale);
+    void setOutputSampleRate(double rate);
 
     double getTimeRatio() const;
     double getPitchScale() const;
@@ -79,10 +90,17 @@ public:
 
     void study(const float *const *input, size_t samples, bool final);
     void process(const float *const *input, size_t samples, bool final);
+    size_t processSome(const float *const *input, size_t samples, bool final,
+                       size_t maxHops);
 
     int available() const;
     size_t retrieve(float *const *output, size_t samples) const;
 
+    // In threaded mode, block until the process threads have written
+    // more output or finished, if available() would return 0.
+    // Otherwise return at once
+    void waitForOutput();
+
     float getFrequencyCutoff(int n) const;
     void setFrequencyCutoff(int n, float f);
 
@@ -102,6 +120,13 @@ public:
 
     void setDebugLevel(int level);
 
+    /**
+     * Return the FFT sizes that a stretcher at the given sample rate
+     * may use, across the window size options and the range of
+     * ratios, for FFT implementation tuning.
+     */
+    static std::set<int> getFftSizes(size_t sampleRate);
+
 protected:
     size_t m_sampleRate;
     size_t m_channels;
@@ -110,8 +135,16 @@ protected:
                           size_t offset, size_t samples, float *prepared);
     size_t consumeChannel(size_t channel, const float *const *inputs,
                           size_t offset, size_t samples, bool final);
-    void processChunks(size_t channel, bool &any, bool &last);
+    size_t processChunks(size_t channel, bool &any, bool &last,
+                         size_t maxChunks = 0);
     bool processOneChunk(); // across all channels, for real time use
+
+    enum ChannelTask {
+        AnalyseTask,
+        ProcessTask
+    };
+    bool runChannelTask(size_t channel, ChannelTask task);
+    bool runChannelTasks(ChannelTask task); // all channels, return last
     bool processChunkForChannel(size_t channel, size_t phaseIncrement,
                                 size_t shiftIncrement, bool phaseReset);
     bool testInbufReadSpace(size_t channel);
@@ -128,22 +161,22 @@ protected:
     void calculateSizes();
     void configure();
     void reconfigure();
+    void resetResamplersIfModeChanged(bool was1, bool rbs);
 
     double getEffectiveRatio() const;
+    double getResampleRatio() const;
     
-    size_t roundUp(size_t value); // to next power of two
+    static size_t roundUp(size_t value); // to next power of two
 
     template <typename T, typename S>
     void cutShiftAndFold(T *target, int targetSize,
-                         S *src, // destructive to src
+                         S *src, // destructive to src when folding
                          Window<float> *window) {
-        window->cut(src);
         const int windowSize = window->getSize();
-        const int hs = targetSize / 2;
         if (windowSize == targetSize) {
-            v_convert(target, src + hs, hs);
-            v_convert(target + hs, src, hs);
+            window->cutAndShift(src, target);
         } else {
+            window->cut(src);
             v_zero(target, targetSize);
             int j = targetSize - windowSize/2;
             while (j < 0) j += targetSize;
@@ -155,9 +188,12 @@ protected:
     }
 
     bool resampleBeforeStretching() const;
+
+    HistoryPrecision getHistoryPrecision() const;
     
     double m_timeRatio;
     double m_pitchScale;
+    double m_outputRateRatio;
 
     // n.b. either m_fftSize is an integer multiple of m_windowSize,
     // or vice versa
@@ -187,8 +223,15 @@ protected:
 
     ProcessMode m_mode;
 
-    std::map<size_t, Window<float> *> m_windows;
-    std::map<size_t, SincWindow<float> *> m_sincs;
+    ChannelTask m_channelTask;
+    size_t m_taskPhaseIncrement;
+    size_t m_taskShiftIncrement;
+    bool m_taskPhaseReset;
+
+    // Windows are never modified once created, so they may be
+    // shared with stretchers cloned from this one
+    std::map<size_t, std::shared_ptr<Window<float>>> m_windows;
+    std::map<size_t, std::shared_ptr<SincWindow<float>>> m_sincs;
     Window<float> *m_awindow;
     SincWindow<float> *m_afilter;
     Window<float> *m_swindow;
@@ -204,18 +247,58 @@ protected:
         void run();
         void signalDataAvailable();
         void abandon();
+        void park();
+        void resume();
         size_t channel() { return m_channel; }
     private:
+        void processInput();
         R2Stretcher *m_s;
         size_t m_channel;
         Condition m_dataAvailable;
-        bool m_abandoning;
+        Condition m_parked;
+        std::atomic<bool> m_abandoning;
+        std::atomic<bool> m_parking;
+        std::atomic<bool> m_active;
     };
 
     mutable Mutex m_threadSetMutex;
     typedef std::set<ProcessThread *> ThreadSet;
     ThreadSet m_threadSet;
 
+    // With OptionThreadingRealTime, the per-channel work of
+    // processOneChunk is shared between the calling thread and a set
+    // of workers. The calling thread takes the channels in order,
+    // while workers woken by a semaphore post steal from the end, so
+    // if the workers are late the calling thread simply does the
+    // work itself. Nothing on the calling thread blocks or locks.
+    
+    class ChannelWorker : public Thread
+    {
+    public:
+        ChannelWorker(R2Stretcher *s);
+        void run();
+        void abandon();
+    private:
+        R2Stretcher *m_s;
+        std::atomic<bool> m_abandoning;
+    };
+
+    enum ChannelTaskState {
+        TaskIdle,
+        TaskPending,
+        TaskClaimed,
+        TaskDone
+    };
+    
+    std::vector<ChannelWorker *> m_channelWorkers;
+    std::atomic<int> *m_channelTaskState;
+    std::vector<char> m_channelTaskLast;
+    Semaphore m_channelTasksAvailable;
+
+    bool claimChannelTask(size_t channel);
+    bool stealChannelTask(size_t &channel);
+    void performChannelTask(size_t channel);
+
 #if defined(HAVE_IPP) && !defined(NO_THREADING) && !defined(USE_BQRESAMPLER) && !defined(USE_SPEEX) && !defined(HAVE_LIBSAMPLERATE)
     // Exasperatingly, the IPP polyphase resampler does not appear to
     // be thread-safe as advertised -- a good reason to prefer any of
@@ -234,6 +317,16 @@ protected:
     class ChannelData; 
     std::vector<ChannelData *> m_channelData;
 
+    // Channels are processed concurrently only by the per-channel
+    // process threads or the real-time channel workers, and then
+    // there is one scratch set per channel; otherwise a single set is
+    // shared by all of them
+    class ScratchData;
+    std::vector<ScratchData *> m_scratch;
+    ScratchData &getScratch(size_t channel) {
+        return *m_scratch[m_scratch.size() > 1 ? channel : 0];
+    }
+
     std::vector<int> m_outputIncrements;
 
     mutable RingBuffer<int> m_lastProcessOutputIncrements;
@@ -243,6 +336,7 @@ protected:
     CompoundAudioCurve *m_phaseResetAudioCurve;
     AudioCurveCalculator *m_silentAudioCurve;
     StretchCalculator *m_stretchCalculator;
+    std::map<size_t, size_t> m_keyFrameMap;
 
     float m_freq0;
     float m_freq1;
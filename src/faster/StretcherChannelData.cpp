@@ -33,25 +33,29 @@ namespace RubberBand
       
 R2Stretcher::ChannelData::ChannelData(size_t windowSize,
                                       size_t fftSize,
-                                      size_t outbufSize)
+                                      size_t outbufSize,
+                                      HistoryPrecision historyPrecision)
 {
     std::set<size_t> s;
-    construct(s, windowSize, fftSize, outbufSize);
+    construct(s, windowSize, fftSize, outbufSize, historyPrecision);
 }
 
 R2Stretcher::ChannelData::ChannelData(const std::set<size_t> &sizes,
                                       size_t initialWindowSize,
                                       size_t initialFftSize,
-                                      size_t outbufSize)
+                                      size_t outbufSize,
+                                      HistoryPrecision historyPrecision)
 {
-    construct(sizes, initialWindowSize, initialFftSize, outbufSize);
+    construct(sizes, initialWindowSize, initialFftSize, outbufSize,
+              historyPrecision);
 }
 
 void
 R2Stretcher::ChannelData::construct(const std::set<size_t> &sizes,
                                     size_t initialWindowSize,
                                     size_t initialFftSize,
-                                    size_t outbufSize)
+                                    size_t outbufSize,
+                                    HistoryPrecision historyPrecision)
 {
     size_t maxSize = initialWindowSize * 2;
     if (initialFftSize > maxSize) maxSize = initialFftSize;
@@ -73,13 +77,11 @@ R2Stretcher::ChannelData::construct(const std::set<size_t> &sizes,
 
     mag = allocate_and_zero<process_t>(realSize);
     phase = allocate_and_zero<process_t>(realSize);
-    prevPhase = allocate_and_zero<process_t>(realSize);
-    prevError = allocate_and_zero<process_t>(realSize);
-    unwrappedPhase = allocate_and_zero<process_t>(realSize);
-    envelope = allocate_and_zero<process_t>(realSize);
+    prevPhase = new HistoryBuffer(historyPrecision, realSize);
+    prevError = new HistoryBuffer(historyPrecision, realSize);
+    unwrappedPhase = new HistoryBuffer(historyPrecision, realSize);
 
     fltbuf = allocate_and_zero<float>(maxSize);
-    dblbuf = allocate_and_zero<process_t>(maxSize);
 
     accumulator = allocate_and_zero<float>(maxSize);
     windowAccumulator = allocate_and_zero<float>(maxSize);
@@ -140,13 +142,12 @@ R2Stretcher::ChannelData::setSizes(size_t windowSize,
         fft = ffts[fftSize];
 
         v_zero(fltbuf, maxSize);
-        v_zero(dblbuf, maxSize);
 
         v_zero(mag, realSize);
         v_zero(phase, realSize);
-        v_zero(prevPhase, realSize);
-        v_zero(prevError, realSize);
-        v_zero(unwrappedPhase, realSize);
+        prevPhase->zero(0, realSize);
+        prevError->zero(0, realSize);
+        unwrappedPhase->zero(0, realSize);
 
         return;
     }
@@ -166,12 +167,10 @@ R2Stretcher::ChannelData::setSizes(size_t windowSize,
 
     mag = reallocate_and_zero(mag, oldReal, realSize);
     phase = reallocate_and_zero(phase, oldReal, realSize);
-    prevPhase = reallocate_and_zero(prevPhase, oldReal, realSize);
-    prevError = reallocate_and_zero(prevError, oldReal, realSize);
-    unwrappedPhase = reallocate_and_zero(unwrappedPhase, oldReal, realSize);
-    envelope = reallocate_and_zero(envelope, oldReal, realSize);
+    prevPhase->resize(realSize);
+    prevError->resize(realSize);
+    unwrappedPhase->resize(realSize);
     fltbuf = reallocate_and_zero(fltbuf, oldMax, maxSize);
-    dblbuf = reallocate_and_zero(dblbuf, oldMax, maxSize);
     ms = reallocate_and_zero(ms, oldMax, maxSize);
     interpolator = reallocate_and_zero(interpolator, oldMax, maxSize);
 
@@ -233,16 +232,14 @@ R2Stretcher::ChannelData::~ChannelData()
 
     deallocate(mag);
     deallocate(phase);
-    deallocate(prevPhase);
-    deallocate(prevError);
-    deallocate(unwrappedPhase);
-    deallocate(envelope);
+    delete prevPhase;
+    delete prevError;
+    delete unwrappedPhase;
     deallocate(interpolator);
     deallocate(ms);
     deallocate(accumulator);
     deallocate(windowAccumulator);
     deallocate(fltbuf);
-    deallocate(dblbuf);
 
     for (std::map<size_t, FFT *>::iterator i = ffts.begin();
          i != ffts.end(); ++i) {
@@ -280,4 +277,53 @@ R2Stretcher::ChannelData::reset()
     outputComplete = false;
 }
 
+R2Stretcher::ScratchData::ScratchData(const std::set<size_t> &sizes,
+                                      size_t initialWindowSize,
+                                      size_t initialFftSize) :
+    dblbuf(0),
+    envelope(0),
+    spare(0),
+    m_size(0)
+{
+    // Sized as for ChannelData::construct
+    size_t maxSize = initialWindowSize * 2;
+    if (initialFftSize > maxSize) maxSize = initialFftSize;
+
+    std::set<size_t>::const_iterator i = sizes.end();
+    if (i != sizes.begin()) {
+        --i;
+        if (*i > maxSize) maxSize = *i;
+    }
+
+    allocateFor(maxSize);
+}
+
+R2Stretcher::ScratchData::~ScratchData()
+{
+    deallocate(dblbuf);
+    deallocate(envelope);
+    deallocate(spare);
+}
+
+void
+R2Stretcher::ScratchData::setSizes(size_t windowSize, size_t fftSize)
+{
+    size_t maxSize = 2 * std::max(windowSize, fftSize);
+    if (maxSize > m_size) {
+        allocateFor(maxSize);
+    }
+}
+
+void
+R2Stretcher::ScratchData::allocateFor(size_t maxSize)
+{
+    // We don't want to preserve anything in these
+    size_t realSize = maxSize / 2 + 1;
+    size_t oldReal = m_size / 2 + 1;
+    dblbuf = reallocate_and_zero(dblbuf, m_size, maxSize);
+    envelope = reallocate_and_zero(envelope, oldReal, realSize);
+    spare = reallocate_and_zero(spare, oldReal, realSize);
+    m_size = maxSize;
+}
+
 }
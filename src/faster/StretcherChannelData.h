@@ -26,6 +26,9 @@
 
 #include "R2Stretcher.h"
 
+#include "../common/HistoryBuffer.h"
+
+
 #include <set>
 #include <atomic>
 
@@ -50,10 +53,14 @@ public:
      * The outbuf size depends on other factors as well, including
      * the pitch scale factor and any maximum processing block
      * size specified by the user of the code.
+     *
+     * The history precision is that used to store the phase
+     * history carried between processing chunks.
      */
     ChannelData(size_t windowSize,
                 size_t fftSize,
-                size_t outbufSize);
+                size_t outbufSize,
+                HistoryPrecision historyPrecision = HistoryPrecision::Full);
 
     /**
      * Construct a ChannelData structure that can process at different
@@ -69,7 +76,8 @@ public:
     ChannelData(const std::set<size_t> &sizes,
                 size_t initialWindowSize,
                 size_t initialFftSize,
-                size_t outbufSize);
+                size_t outbufSize,
+                HistoryPrecision historyPrecision = HistoryPrecision::Full);
     ~ChannelData();
 
     /**
@@ -103,9 +111,9 @@ public:
     process_t *mag;
     process_t *phase;
 
-    process_t *prevPhase;
-    process_t *prevError;
-    process_t *unwrappedPhase;
+    HistoryBuffer *prevPhase;
+    HistoryBuffer *prevError;
+    HistoryBuffer *unwrappedPhase;
 
     float *accumulator;
     size_t accumulatorFill;
@@ -114,9 +122,7 @@ public:
     float *interpolator; // only used when time-domain smoothing is on
     int interpolatorScale;
 
-    float *fltbuf;
-    process_t *dblbuf; // owned by FFT object, only used for time domain FFT i/o
-    process_t *envelope; // for cepstral formant shift
+    float *fltbuf; // analysis frame, carried through to synthesis
     bool unchanged;
 
     size_t prevIncrement; // only used in RT mode
@@ -139,9 +145,45 @@ public:
 private:
     void construct(const std::set<size_t> &sizes,
                    size_t initialWindowSize, size_t initialFftSize,
-                   size_t outbufSize);
+                   size_t outbufSize, HistoryPrecision historyPrecision);
 };        
 
+/**
+ * Buffers needed only while a single chunk of a single channel is
+ * being analysed, formant-shifted or resynthesised. Nothing is
+ * carried in them from one chunk to the next, so a single set can be
+ * shared by all channels that are processed serially.
+ */
+class R2Stretcher::ScratchData
+{
+public:
+    /**
+     * Construct a ScratchData structure large enough for any of the
+     * given window and FFT sizes, as for the ChannelData constructor.
+     */
+    ScratchData(const std::set<size_t> &sizes,
+                size_t initialWindowSize,
+                size_t initialFftSize);
+    ~ScratchData();
+
+    /**
+     * Ensure the buffers are large enough for the given window and
+     * FFT sizes, reallocating only if they are not already.
+     */
+    void setSizes(size_t windowSize, size_t fftSize);
+
+    process_t *dblbuf; // time domain FFT i/o
+    process_t *envelope; // for cepstral formant shift
+    process_t *spare; // unused imaginary output of the cepstral FFT
+
+private:
+    size_t m_size;
+    void allocateFor(size_t maxSize);
+
+    ScratchData(const ScratchData &) =delete;
+    ScratchData &operator=(const ScratchData &) =delete;
+};
+
 }
 
 #endif
@@ -27,6 +27,8 @@
 #include "../common/StretchCalculator.h"
 #include "../common/Resampler.h"
 #include "../common/Profiler.h"
+#include "../common/Tracer.h"
+#include "../common/FloatGuards.h"
 #include "../common/VectorOps.h"
 #include "../common/sysutils.h"
 #include "../common/mathmisc.h"
@@ -48,7 +50,10 @@ R2Stretcher::ProcessThread::ProcessThread(R2Stretcher *s, size_t c) :
     m_s(s),
     m_channel(c),
     m_dataAvailable(std::string("data ") + char('A' + c)),
-    m_abandoning(false)
+    m_parked(std::string("parked ") + char('A' + c)),
+    m_abandoning(false),
+    m_parking(false),
+    m_active(true)
 { }
 
 void
@@ -56,6 +61,40 @@ R2Stretcher::ProcessThread::run()
 {
     m_s->m_log.log(2, "thread getting going for channel", m_channel);
 
+    ScopedFlushToZero ftz;
+
+    // The thread outlives a single run of input: when that is done
+    // (or when reset() parks us part-way through) we wait here for
+    // resume() rather than exiting, so that reusing the stretcher
+    // does not have to create a new thread per channel each time.
+    
+    while (!m_abandoning) {
+
+        processInput();
+
+        m_parked.lock();
+        m_active = false;
+        m_parked.signal();
+        m_parked.unlock();
+
+        // resume() and abandon() both signal with m_dataAvailable
+        // locked, after setting the flag we test, so there is no
+        // need to wake up and look
+        m_dataAvailable.lock();
+        while (!m_active && !m_abandoning) {
+            m_dataAvailable.wait();
+        }
+        m_dataAvailable.unlock();
+    }
+
+    m_s->m_log.log(2, "thread abandoning for channel", m_channel);
+}
+
+void
+R2Stretcher::ProcessThread::processInput()
+{
+    Profiler profiler("R2Stretcher::ProcessThread::processInput");
+
     ChannelData &cd = *m_s->m_channelData[m_channel];
 
     while (cd.inputSize == -1 ||
@@ -73,13 +112,14 @@ R2Stretcher::ProcessThread::run()
         }
 
         m_dataAvailable.lock();
-        if (!m_s->testInbufReadSpace(m_channel) && !m_abandoning) {
+        if (!m_s->testInbufReadSpace(m_channel) &&
+            !m_abandoning && !m_parking) {
             m_dataAvailable.wait(50000); // bounded in case of abandonment
         }
         m_dataAvailable.unlock();
 
-        if (m_abandoning) {
-            m_s->m_log.log(2, "thread abandoning for channel", m_channel);
+        if (m_abandoning || m_parking) {
+            m_s->m_log.log(2, "thread stopping early for channel", m_channel);
             return;
         }
     }
@@ -105,6 +145,93 @@ void
 R2Stretcher::ProcessThread::abandon()
 {
     m_abandoning = true;
+    signalDataAvailable();
+}
+
+void
+R2Stretcher::ProcessThread::park()
+{
+    // Return only once the thread has stopped touching the channel
+    // data, so that the caller may reset it
+    m_parking = true;
+    signalDataAvailable();
+    m_parked.lock();
+    while (m_active) {
+        m_parked.wait();
+    }
+    m_parked.unlock();
+    m_parking = false;
+}
+
+void
+R2Stretcher::ProcessThread::resume()
+{
+    m_dataAvailable.lock();
+    m_active = true;
+    m_dataAvailable.signal();
+    m_dataAvailable.unlock();
+}
+
+R2Stretcher::ChannelWorker::ChannelWorker(R2Stretcher *s) :
+    m_s(s),
+    m_abandoning(false)
+{ }
+
+void
+R2Stretcher::ChannelWorker::run()
+{
+    // Sleep until the calling thread posts that there are channel
+    // tasks, then steal any it has not yet reached. The caller works
+    // from the first channel upwards, so we work from the last one
+    // downwards and only ever take what is left for it.
+    
+    ScopedFlushToZero ftz;
+
+    while (!m_abandoning) {
+        
+        m_s->m_channelTasksAvailable.wait();
+
+        // Posts are not matched one-to-one with task rounds, so we
+        // may wake with nothing left to do
+        size_t c;
+        while (!m_abandoning && m_s->stealChannelTask(c)) {
+            m_s->performChannelTask(c);
+        }
+    }
+}
+
+void
+R2Stretcher::ChannelWorker::abandon()
+{
+    m_abandoning = true;
+}
+
+bool
+R2Stretcher::claimChannelTask(size_t c)
+{
+    int expected = TaskPending;
+    return m_channelTaskState[c].compare_exchange_strong(expected,
+                                                         TaskClaimed);
+}
+
+bool
+R2Stretcher::stealChannelTask(size_t &c)
+{
+    for (size_t i = m_channels; i > 0; ) {
+        --i;
+        if (claimChannelTask(i)) {
+            c = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+R2Stretcher::performChannelTask(size_t c)
+{
+    m_channelTaskLast[c] = runChannelTask(c, m_channelTask);
+    m_channelTaskState[c] = TaskDone;
 }
 
 #endif
@@ -118,11 +245,11 @@ R2Stretcher::resampleBeforeStretching() const
     if (!m_realtime) return false;
 
     if (m_options & RubberBandStretcher::OptionPitchHighQuality) {
-        return (m_pitchScale < 1.0); // better sound
+        return (getResampleRatio() > 1.0); // better sound
     } else if (m_options & RubberBandStretcher::OptionPitchHighConsistency) {
         return false;
     } else {
-        return (m_pitchScale > 1.0); // better performance
+        return (getResampleRatio() < 1.0); // better performance
     }
 }
 
@@ -174,9 +301,9 @@ R2Stretcher::consumeChannel(size_t c,
 
         Profiler profiler2("R2Stretcher::resample");
         
-        toWrite = int(ceil(samples / m_pitchScale));
+        toWrite = int(ceil(samples * getResampleRatio()));
         if (writable < toWrite) {
-            samples = int(floor(writable * m_pitchScale));
+            samples = int(floor(writable / getResampleRatio()));
             if (samples == 0) return 0;
         }
 
@@ -189,7 +316,7 @@ R2Stretcher::consumeChannel(size_t c,
             }
         }
 
-        size_t reqSize = int(ceil(samples / m_pitchScale));
+        size_t reqSize = int(ceil(samples * getResampleRatio()));
         if (reqSize > cd.resamplebufSize) {
             m_log.log(0, "WARNING: R2Stretcher::consumeChannel: resizing resampler buffer from and to", cd.resamplebufSize, reqSize);
             cd.setResampleBufSize(reqSize);
@@ -212,7 +339,7 @@ R2Stretcher::consumeChannel(size_t c,
                                          cd.resamplebufSize,
                                          &input,
                                          samples,
-                                         1.0 / m_pitchScale,
+                                         getResampleRatio(),
                                          final);
 
 #if defined(STRETCHER_IMPL_RESAMPLER_MUTEX_REQUIRED)
@@ -250,14 +377,15 @@ R2Stretcher::consumeChannel(size_t c,
     }
 }
 
-void
-R2Stretcher::processChunks(size_t c, bool &any, bool &last)
+size_t
+R2Stretcher::processChunks(size_t c, bool &any, bool &last, size_t maxChunks)
 {
     Profiler profiler("R2Stretcher::processChunks");
 
     // Process as many chunks as there are available on the input
-    // buffer for channel c.  This requires that the increments have
-    // already been calculated.
+    // buffer for channel c, up to maxChunks if that is non-zero.
+    // This requires that the increments have already been
+    // calculated. Return the number of chunks processed.
 
     // This is the normal process method in offline mode.
 
@@ -267,9 +395,14 @@ R2Stretcher::processChunks(size_t c, bool &any, bool &last)
     any = false;
 
     float *tmp = 0;
+    size_t count = 0;
 
     while (!last) {
 
+        if (maxChunks > 0 && count >= maxChunks) {
+            break;
+        }
+
         if (!testInbufReadSpace(c)) {
             m_log.log(2, "processChunks: out of input");
             break;
@@ -281,6 +414,9 @@ R2Stretcher::processChunks(size_t c, bool &any, bool &last)
             size_t ready = cd.inbuf->getReadSpace();
             assert(ready >= m_aWindowSize || cd.inputSize >= 0);
             cd.inbuf->peek(cd.fltbuf, std::min(ready, m_aWindowSize));
+            if (ready < m_aWindowSize) {
+                v_zero(cd.fltbuf + ready, m_aWindowSize - ready);
+            }
             cd.inbuf->skip(m_increment);
         }
 
@@ -311,11 +447,14 @@ R2Stretcher::processChunks(size_t c, bool &any, bool &last)
         }
 
         cd.chunkCount++;
+        ++count;
         m_log.log(3, "channel/last", c, last);
         m_log.log(3, "channel/chunkCount", c, cd.chunkCount);
     }
 
     if (tmp) deallocate(tmp);
+
+    return count;
 }
 
 bool
@@ -324,38 +463,126 @@ R2Stretcher::processOneChunk()
     Profiler profiler("R2Stretcher::processOneChunk");
 
     // Process a single chunk for all channels, provided there is
-    // enough data on each channel for at least one chunk.  This is
-    // able to calculate increments as it goes along.
+    // enough data on each channel for at least one chunk, and return
+    // true if we did so.  This is able to calculate increments as it
+    // goes along.
 
     // This is the normal process method in RT mode.
 
+    bool complete = true;
+    for (size_t c = 0; c < m_channels; ++c) {
+        if (!m_channelData[c]->outputComplete) {
+            complete = false;
+            break;
+        }
+    }
+    if (complete) {
+        m_log.log(2, "processOneChunk: output already complete");
+        return false;
+    }
+    
     for (size_t c = 0; c < m_channels; ++c) {
         if (!testInbufReadSpace(c)) {
             m_log.log(2, "processOneChunk: out of input");
             return false;
         }
-        ChannelData &cd = *m_channelData[c];
+    }
+
+    runChannelTasks(AnalyseTask);
+    
+    bool phaseReset = false;
+    size_t phaseIncrement, shiftIncrement;
+    if (!getIncrements(0, phaseIncrement, shiftIncrement, phaseReset)) {
+        calculateIncrements(phaseIncrement, shiftIncrement, phaseReset);
+    }
+
+    m_taskPhaseIncrement = phaseIncrement;
+    m_taskShiftIncrement = shiftIncrement;
+    m_taskPhaseReset = phaseReset;
+
+    runChannelTasks(ProcessTask);
+    return true;
+}
+
+bool
+R2Stretcher::runChannelTask(size_t c, ChannelTask task)
+{
+    // One channel's share of processOneChunk. This may be called
+    // from a ChannelWorker thread, so it must touch nothing but the
+    // channel's own data
+
+    ChannelData &cd = *m_channelData[c];
+
+    if (task == AnalyseTask) {
         if (!cd.draining) {
             size_t ready = cd.inbuf->getReadSpace();
             assert(ready >= m_aWindowSize || cd.inputSize >= 0);
             cd.inbuf->peek(cd.fltbuf, std::min(ready, m_aWindowSize));
+            if (ready < m_aWindowSize) {
+                v_zero(cd.fltbuf + ready, m_aWindowSize - ready);
+            }
             cd.inbuf->skip(m_increment);
             analyseChunk(c);
         }
+        return false;
     }
-    
-    bool phaseReset = false;
-    size_t phaseIncrement, shiftIncrement;
-    if (!getIncrements(0, phaseIncrement, shiftIncrement, phaseReset)) {
-        calculateIncrements(phaseIncrement, shiftIncrement, phaseReset);
+
+    bool last = processChunkForChannel(c, m_taskPhaseIncrement,
+                                       m_taskShiftIncrement,
+                                       m_taskPhaseReset);
+    cd.chunkCount++;
+    return last;
+}
+
+bool
+R2Stretcher::runChannelTasks(ChannelTask task)
+{
+    m_channelTask = task;
+
+#ifndef NO_THREADING
+    if (!m_channelWorkers.empty()) {
+
+        for (size_t c = 0; c < m_channels; ++c) {
+            m_channelTaskState[c] = TaskPending;
+        }
+
+        // Wake the workers (post never blocks or locks), then work
+        // through the channels from the first, skipping any a worker
+        // has stolen from the other end. Each worker holds at most
+        // one task at a time, so once we run out the most we wait
+        // for is the remainder of the one task each is running
+        
+        for (size_t i = 0; i < m_channelWorkers.size(); ++i) {
+            m_channelTasksAvailable.post();
+        }
+        
+        size_t done = 0;
+        for (size_t c = 0; c < m_channels; ++c) {
+            if (claimChannelTask(c)) {
+                performChannelTask(c);
+                ++done;
+            }
+        }
+
+        if (done == m_channels) {
+            m_log.log(3, "runChannelTasks: workers did not wake in time, processed all channels serially");
+        }
+        
+        for (size_t c = 0; c < m_channels; ++c) {
+            while (m_channelTaskState[c] != TaskDone) {
+                Thread::yield();
+            }
+            m_channelTaskState[c] = TaskIdle;
+        }
+
+        return m_channelTaskLast[m_channels - 1];
     }
+#endif
 
     bool last = false;
     for (size_t c = 0; c < m_channels; ++c) {
-        last = processChunkForChannel(c, phaseIncrement, shiftIncrement, phaseReset);
-        m_channelData[c]->chunkCount++;
+        last = runChannelTask(c, task);
     }
-
     return last;
 }
 
@@ -409,6 +636,7 @@ R2Stretcher::processChunkForChannel(size_t c,
                                                   size_t shiftIncrement,
                                                   bool phaseReset)
 {
+    Tracer::setHop(int64_t(m_channelData[c]->chunkCount));
     Profiler profiler("R2Stretcher::processChunkForChannel");
 
     // Process a single chunk on a single channel.  This assumes
@@ -467,8 +695,8 @@ R2Stretcher::processChunkForChannel(size_t c,
         
     int required = shiftIncrement;
 
-    if (m_pitchScale != 1.0) {
-        required = int(required / m_pitchScale) + 1;
+    if (getResampleRatio() != 1.0) {
+        required = int(required * getResampleRatio()) + 1;
     }
 
     int ws = cd.outbuf->getWriteSpace();
@@ -574,13 +802,13 @@ R2Stretcher::calculateIncrements(size_t &phaseIncrementRtn,
         }
     }
 
-    double effectivePitchRatio = 1.0 / m_pitchScale;
+    double effectivePitchRatio = getResampleRatio();
     if (cd.resampler) {
         effectivePitchRatio = cd.resampler->getEffectiveRatio(effectivePitchRatio);
     }
     
     int incr = m_stretchCalculator->calculateSingle
-        (m_timeRatio, effectivePitchRatio, df, m_increment,
+        (m_timeRatio * m_outputRateRatio, effectivePitchRatio, df, m_increment,
          m_aWindowSize, m_sWindowSize, false);
 
     if (m_lastProcessPhaseResetDf.getWriteSpace() > 0) {
@@ -707,7 +935,7 @@ R2Stretcher::analyseChunk(size_t channel)
 
     ChannelData &cd = *m_channelData[channel];
 
-    process_t *const R__ dblbuf = cd.dblbuf;
+    process_t *const R__ dblbuf = getScratch(channel).dblbuf;
     float *const R__ fltbuf = cd.fltbuf;
 
     // cd.fltbuf is known to contain m_aWindowSize samples
@@ -773,83 +1001,115 @@ R2Stretcher::modifyChunk(size_t channel,
     process_t distance = 0.0;
     const process_t maxdist = 8.0;
 
-    const int lookback = 1;
-
     process_t distacc = 0.0;
 
-    for (int i = count; i >= 0; i -= lookback) {
+    // The phase history may be held at reduced precision, so we work
+    // on it in short blocks converted to and from process_t. The
+    // unwrapped phase grows without limit, which a reduced-precision
+    // store would not hold accurately, but only its value modulo 2pi
+    // is used, so in that case we store it wrapped.
 
-        bool resetThis = phaseReset;
+    const bool wrapUnwrapped =
+        (cd.unwrappedPhase->getPrecision() != HistoryPrecision::Full);
 
-        if (bandlimited) {
-            if (resetThis) {
-                if (i > bandlow && i < bandhigh) {
-                    resetThis = false;
-                    fullReset = false;
+    const int blockSize = 64;
+    process_t prevPhase[blockSize];
+    process_t prevError[blockSize];
+    process_t unwrappedPhase[blockSize];
+
+    // The advance applied to the bin above the current one (the one
+    // processed in the previous iteration), for phase inheritance
+    process_t aboveAdvance = 0.0;
+
+    for (int top = count; top >= 0; top -= blockSize) {
+
+        const int bottom = std::max(0, top - blockSize + 1);
+        const int n = top - bottom + 1;
+
+        cd.prevPhase->read(prevPhase, bottom, n);
+        cd.prevError->read(prevError, bottom, n);
+        cd.unwrappedPhase->read(unwrappedPhase, bottom, n);
+        
+        for (int i = top; i >= bottom; --i) {
+
+            const int j = i - bottom;
+            
+            bool resetThis = phaseReset;
+
+            if (bandlimited) {
+                if (resetThis) {
+                    if (i > bandlow && i < bandhigh) {
+                        resetThis = false;
+                        fullReset = false;
+                    }
                 }
             }
-        }
 
-        process_t p = cd.phase[i];
-        process_t perr = 0.0;
-        process_t outphase = p;
+            process_t p = cd.phase[i];
+            process_t perr = 0.0;
+            process_t outphase = p;
 
-        process_t mi = maxdist;
-        if (i <= limit0) mi = 0.0;
-        else if (i <= limit1) mi = 1.0;
-        else if (i <= limit2) mi = 3.0;
+            process_t mi = maxdist;
+            if (i <= limit0) mi = 0.0;
+            else if (i <= limit1) mi = 1.0;
+            else if (i <= limit2) mi = 3.0;
 
-        if (!resetThis) {
+            if (!resetThis) {
 
-            process_t omega = (2 * M_PI * m_increment * i) / (m_fftSize);
+                process_t omega = (2 * M_PI * m_increment * i) / (m_fftSize);
 
-            process_t pp = cd.prevPhase[i];
-            process_t ep = pp + omega;
-            perr = princarg(p - ep);
+                process_t pp = prevPhase[j];
+                process_t ep = pp + omega;
+                perr = princarg(p - ep);
 
-            process_t instability = fabs(perr - cd.prevError[i]);
-            bool direction = (perr > cd.prevError[i]);
+                process_t instability = fabs(perr - prevError[j]);
+                bool direction = (perr > prevError[j]);
 
-            bool inherit = false;
+                bool inherit = false;
 
-            if (laminar) {
-                if (distance >= mi || i == count) {
-                    inherit = false;
-                } else if (bandlimited && (i == bandhigh || i == bandlow)) {
-                    inherit = false;
-                } else if (instability > prevInstability &&
-                           direction == prevDirection) {
-                    inherit = true;
+                if (laminar) {
+                    if (distance >= mi || i == count) {
+                        inherit = false;
+                    } else if (bandlimited && (i == bandhigh || i == bandlow)) {
+                        inherit = false;
+                    } else if (instability > prevInstability &&
+                               direction == prevDirection) {
+                        inherit = true;
+                    }
                 }
-            }
 
-            process_t advance = outputIncrement * ((omega + perr) / m_increment);
-
-            if (inherit) {
-                process_t inherited =
-                    cd.unwrappedPhase[i + lookback] - cd.prevPhase[i + lookback];
-                advance = ((advance * distance) +
-                           (inherited * (maxdist - distance)))
-                    / maxdist;
-                outphase = p + advance;
-                distacc += distance;
-                distance += 1.0;
+                process_t advance = outputIncrement * ((omega + perr) / m_increment);
+
+                if (inherit) {
+                    process_t inherited = aboveAdvance;
+                    advance = ((advance * distance) +
+                               (inherited * (maxdist - distance)))
+                        / maxdist;
+                    outphase = p + advance;
+                    distacc += distance;
+                    distance += 1.0;
+                } else {
+                    outphase = unwrappedPhase[j] + advance;
+                    distance = 0.0;
+                }
+
+                prevInstability = instability;
+                prevDirection = direction;
+
             } else {
-                outphase = cd.unwrappedPhase[i] + advance;
                 distance = 0.0;
             }
 
-            prevInstability = instability;
-            prevDirection = direction;
-
-        } else {
-            distance = 0.0;
+            prevError[j] = perr;
+            prevPhase[j] = p;
+            cd.phase[i] = outphase;
+            unwrappedPhase[j] = (wrapUnwrapped ? princarg(outphase) : outphase);
+            aboveAdvance = outphase - p;
         }
 
-        cd.prevError[i] = perr;
-        cd.prevPhase[i] = p;
-        cd.phase[i] = outphase;
-        cd.unwrappedPhase[i] = outphase;
+        cd.prevPhase->write(prevPhase, bottom, n);
+        cd.prevError->write(prevError, bottom, n);
+        cd.unwrappedPhase->write(unwrappedPhase, bottom, n);
     }
 
     m_log.log(3, "mean inheritance distance", distacc / count);
@@ -869,10 +1129,11 @@ R2Stretcher::formantShiftChunk(size_t channel)
     Profiler profiler("R2Stretcher::formantShiftChunk");
 
     ChannelData &cd = *m_channelData[channel];
+    ScratchData &scratch = getScratch(channel);
 
     process_t *const R__ mag = cd.mag;
-    process_t *const R__ envelope = cd.envelope;
-    process_t *const R__ dblbuf = cd.dblbuf;
+    process_t *const R__ envelope = scratch.envelope;
+    process_t *const R__ dblbuf = scratch.dblbuf;
 
     const int sz = m_fftSize;
     const int hs = sz / 2;
@@ -891,8 +1152,7 @@ R2Stretcher::formantShiftChunk(size_t channel)
 
     v_scale(dblbuf, factor, cutoff);
 
-    process_t *spare = (process_t *)alloca((hs + 1) * sizeof(process_t));
-    cd.fft->forward(dblbuf, envelope, spare);
+    cd.fft->forward(dblbuf, envelope, scratch.spare);
 
     v_exp(envelope, hs + 1);
     v_divide(mag, envelope, hs + 1);
@@ -934,7 +1194,7 @@ R2Stretcher::synthesiseChunk(size_t channel,
 
     ChannelData &cd = *m_channelData[channel];
 
-    process_t *const R__ dblbuf = cd.dblbuf;
+    process_t *const R__ dblbuf = getScratch(channel).dblbuf;
     float *const R__ fltbuf = cd.fltbuf;
     float *const R__ accumulator = cd.accumulator;
     float *const R__ windowAccumulator = cd.windowAccumulator;
@@ -952,11 +1212,20 @@ R2Stretcher::synthesiseChunk(size_t channel,
         float factor = 1.f / fsz;
         v_scale(cd.mag, factor, hs + 1);
 
-        cd.fft->inversePolar(cd.mag, cd.phase, cd.dblbuf);
+        cd.fft->inversePolar(cd.mag, cd.phase, dblbuf);
 
         if (wsz == fsz) {
-            v_convert(fltbuf, dblbuf + hs, hs);
-            v_convert(fltbuf + hs, dblbuf, hs);
+
+            // The usual case: rotate, window and overlap-add straight
+            // from the inverse FFT output, accumulating the window
+            // sum as we go, without passing through fltbuf
+            
+            m_swindow->shiftCutAndAdd(dblbuf, accumulator,
+                                      windowAccumulator,
+                                      m_awindow->getArea() * 1.5f);
+            cd.accumulatorFill = std::max(cd.accumulatorFill, size_t(wsz));
+            return;
+            
         } else {
             v_zero(fltbuf, wsz);
             int j = fsz - wsz/2;
@@ -966,6 +1235,13 @@ R2Stretcher::synthesiseChunk(size_t channel,
                 if (++j == fsz) j = 0;
             }
         }
+
+    } else if (m_awindow->getSize() == fsz) {
+
+        // The unmodified analysis frame is still in fltbuf, but the
+        // analysis window was applied only on its way into the FFT
+        // input (see cutShiftAndFold), so apply it here too
+        m_awindow->cut(fltbuf);
     }
 
     if (wsz > fsz) {
@@ -977,8 +1253,7 @@ R2Stretcher::synthesiseChunk(size_t channel,
         v_multiply(fltbuf, cd.interpolator, wsz);
     }
 
-    m_swindow->cut(fltbuf);
-    v_add(accumulator, fltbuf, wsz);
+    m_swindow->cutAndAdd(fltbuf, accumulator);
     cd.accumulatorFill = std::max(cd.accumulatorFill, size_t(wsz));
 
     if (wsz > fsz) {
@@ -1017,19 +1292,19 @@ R2Stretcher::writeChunk(size_t channel, size_t shiftIncrement, bool last)
     // were running in RT mode)
     size_t theoreticalOut = 0;
     if (cd.inputSize >= 0) {
-        theoreticalOut = lrint(cd.inputSize * m_timeRatio);
+        theoreticalOut = lrint(cd.inputSize * m_timeRatio * m_outputRateRatio);
     }
 
     bool resampledAlready = resampleBeforeStretching();
 
     if (!resampledAlready &&
-        (m_pitchScale != 1.0 ||
+        (getResampleRatio() != 1.0 ||
          (m_options & RubberBandStretcher::OptionPitchHighConsistency)) &&
         cd.resampler) {
 
         Profiler profiler2("R2Stretcher::resample");
 
-        size_t reqSize = int(ceil(si / m_pitchScale));
+        size_t reqSize = int(ceil(si * getResampleRatio()));
         if (reqSize > cd.resamplebufSize) {
             // This shouldn't normally happen -- the buffer is
             // supposed to be initialised with enough space in the
@@ -1050,7 +1325,7 @@ R2Stretcher::writeChunk(size_t channel, size_t shiftIncrement, bool last)
                                                   cd.resamplebufSize,
                                                   &cd.accumulator,
                                                   si,
-                                                  1.0 / m_pitchScale,
+                                                  getResampleRatio(),
                                                   last);
 
 #if defined(STRETCHER_IMPL_RESAMPLER_MUTEX_REQUIRED)
@@ -1096,7 +1371,7 @@ R2Stretcher::writeOutput(RingBuffer<float> &to, float *from, size_t qty, size_t
 
     size_t startSkip = 0;
     if (!m_realtime) {
-        startSkip = lrintf((m_sWindowSize/2) / m_pitchScale);
+        startSkip = lrintf((m_sWindowSize/2) * getResampleRatio());
     }
 
     if (outCount > startSkip) {
@@ -1181,19 +1456,40 @@ R2Stretcher::available() const
     bool haveResamplers = false;
 
     for (size_t i = 0; i < m_channels; ++i) {
+        // Test for completion before looking at the output buffer: a
+        // process thread sets outputComplete only after writing its
+        // last output, so the other way around we could report the
+        // end of the stream while output was still pending
+        if (!m_channelData[i]->outputComplete) consumed = false;
         size_t availIn = m_channelData[i]->inbuf->getReadSpace();
         size_t availOut = m_channelData[i]->outbuf->getReadSpace();
         m_log.log(3, "available in and out", availIn, availOut);
         if (i == 0 || availOut < min) min = availOut;
-        if (!m_channelData[i]->outputComplete) consumed = false;
         if (m_channelData[i]->resampler) haveResamplers = true;
     }
 
     if (min == 0 && consumed) return -1;
-    if (m_pitchScale == 1.0) return min;
+    if (getResampleRatio() == 1.0) return min;
 
     if (haveResamplers) return min; // resampling has already happened
-    return int(floor(min / m_pitchScale));
+    return int(floor(min * getResampleRatio()));
+}
+
+void
+R2Stretcher::waitForOutput()
+{
+#ifndef NO_THREADING
+    if (!m_threaded) return;
+
+    // The process threads signal m_spaceAvailable with it locked
+    // after writing output and on finishing, so testing available()
+    // with it locked here means we cannot miss the signal
+    m_spaceAvailable.lock();
+    if (available() == 0) {
+        m_spaceAvailable.wait();
+    }
+    m_spaceAvailable.unlock();
+#endif
 }
 
 size_t
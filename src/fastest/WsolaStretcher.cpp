@@ -0,0 +1,789 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "WsolaStretcher.h"
+
+#include "../common/VectorOps.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace RubberBand {
+
+WsolaStretcher::WsolaStretcher(Parameters parameters,
+                               double initialTimeRatio,
+                               double initialPitchScale,
+                               Log log) :
+    m_parameters(parameters),
+    m_log(log),
+    m_timeRatio(initialTimeRatio),
+    m_pitchScale(initialPitchScale),
+    m_outputRateRatio(1.0),
+    m_frameSize(roundUp(int(ceil(parameters.sampleRate * 0.02)))),
+    m_hop(m_frameSize / 2),
+    m_tolerance((m_frameSize * 5) / 16),
+    m_decimation(std::max(1, m_frameSize / 128)),
+    m_regionSize(m_frameSize + m_tolerance * 2),
+    m_window(HannWindow, m_frameSize),
+    m_mix(m_regionSize, 0.f),
+    m_continuation(m_hop, 0.f),
+    m_mixDecimated(m_regionSize / m_decimation + 1, 0.f),
+    m_continuationDecimated(m_hop / m_decimation + 1, 0.f),
+    m_accumulators(m_parameters.channels, nullptr),
+    m_resampled(m_parameters.channels, nullptr),
+    m_inputPosition(0.0),
+    m_inbufPosition(0),
+    m_hopCount(0),
+    m_finishedProcessing(false),
+    m_startSkip(0),
+    m_studyInputDuration(0),
+    m_suppliedInputDuration(0),
+    m_totalTargetDuration(0),
+    m_totalInputDuration(0),
+    m_totalOutputDuration(0),
+    m_mode(ProcessMode::JustCreated)
+{
+    m_log.log(1, "WsolaStretcher::WsolaStretcher: rate, options",
+              m_parameters.sampleRate, m_parameters.options);
+    m_log.log(1, "WsolaStretcher::WsolaStretcher: initial time ratio and pitch scale",
+              m_timeRatio, m_pitchScale);
+    m_log.log(1, "WsolaStretcher::WsolaStretcher: frame size and tolerance",
+              m_frameSize, m_tolerance);
+
+    int prefill = m_tolerance + m_frameSize / 2;
+    int inRingBufferSize = m_regionSize * 2 + prefill;
+    int outRingBufferSize = m_frameSize * 64;
+
+    for (int c = 0; c < m_parameters.channels; ++c) {
+        m_channelData.push_back(std::make_shared<ChannelData>
+                                (m_regionSize,
+                                 m_frameSize,
+                                 inRingBufferSize,
+                                 outRingBufferSize));
+        m_channelData[c]->inbuf->zero(prefill);
+        m_accumulators[c] = m_channelData[c]->accumulator.data();
+        m_resampled[c] = m_channelData[c]->resampled.data();
+    }
+
+    if (isRealTime()) {
+        createResampler();
+        // As in R3, we don't create the resampler yet in offline
+        // mode, in case the pitch scale remains at 1.0
+    }
+
+    if (!m_timeRatio.is_lock_free()) {
+        m_log.log(0, "WARNING: std::atomic<double> is not lock-free");
+    }
+}
+
+void
+WsolaStretcher::setTimeRatio(double ratio)
+{
+    if (!isRealTime()) {
+        if (m_mode == ProcessMode::Studying ||
+            m_mode == ProcessMode::Processing) {
+            m_log.log(0, "WsolaStretcher::setTimeRatio: Cannot set time ratio while studying or processing in non-RT mode");
+            return;
+        }
+    }
+
+    m_timeRatio = ratio;
+}
+
+void
+WsolaStretcher::setPitchScale(double scale)
+{
+    if (!isRealTime()) {
+        if (m_mode == ProcessMode::Studying ||
+            m_mode == ProcessMode::Processing) {
+            m_log.log(0, "WsolaStretcher::setPitchScale: Cannot set pitch scale while studying or processing in non-RT mode");
+            return;
+        }
+    }
+
+    m_pitchScale = scale;
+}
+
+void
+WsolaStretcher::setOutputSampleRate(double rate)
+{
+    if (!isRealTime()) {
+        if (m_mode == ProcessMode::Studying ||
+            m_mode == ProcessMode::Processing) {
+            m_log.log(0, "WsolaStretcher::setOutputSampleRate: Cannot set output sample rate while studying or processing in non-RT mode");
+            return;
+        }
+    }
+
+    double ratio = 1.0;
+    if (rate > 0.0) {
+        ratio = rate / m_parameters.sampleRate;
+    }
+    m_log.log(1, "WsolaStretcher::setOutputSampleRate: rate and ratio", rate, ratio);
+    m_outputRateRatio = ratio;
+}
+
+void
+WsolaStretcher::setPitchOption(RubberBandStretcher::Options)
+{
+    m_log.log(0, "WsolaStretcher::setPitchOption: Option change after construction is not supported in time-domain engine");
+}
+
+void
+WsolaStretcher::setKeyFrameMap(const std::map<size_t, size_t> &mapping)
+{
+    if (isRealTime()) {
+        m_log.log(0, "WsolaStretcher::setKeyFrameMap: Cannot specify key frame map in RT mode");
+        return;
+    }
+    if (m_mode == ProcessMode::Processing || m_mode == ProcessMode::Finished) {
+        m_log.log(0, "WsolaStretcher::setKeyFrameMap: Cannot specify key frame map after process() has begun");
+        return;
+    }
+
+    m_keyFrameMap = mapping;
+}
+
+void
+WsolaStretcher::createResampler()
+{
+    Resampler::Parameters resamplerParameters;
+
+    if (m_parameters.options & RubberBandStretcher::OptionPitchHighQuality) {
+        resamplerParameters.quality = Resampler::Best;
+    } else {
+        resamplerParameters.quality = Resampler::FastestTolerable;
+    }
+    
+    resamplerParameters.initialSampleRate = m_parameters.sampleRate;
+    resamplerParameters.maxBufferSize = m_frameSize;
+
+    if (isRealTime()) {
+        if (m_parameters.options &
+            RubberBandStretcher::OptionPitchHighConsistency) {
+            resamplerParameters.dynamism = Resampler::RatioOftenChanging;
+            resamplerParameters.ratioChange = Resampler::SmoothRatioChange;
+        } else {
+            resamplerParameters.dynamism = Resampler::RatioMostlyFixed;
+            resamplerParameters.ratioChange = Resampler::SmoothRatioChange;
+        }
+    } else {
+        resamplerParameters.dynamism = Resampler::RatioMostlyFixed;
+        resamplerParameters.ratioChange = Resampler::SuddenRatioChange;
+    }
+    
+    m_resampler = std::unique_ptr<Resampler>
+        (new Resampler(resamplerParameters, m_parameters.channels));
+}
+
+void
+WsolaStretcher::prepareKeyFrames()
+{
+    // Flatten the key frame map into a list of (output, input)
+    // points, in the user-facing sample domain, bounded by the start
+    // and (if known) the end of the input. Positions between points
+    // are interpolated linearly, and positions beyond the last point
+    // follow the global time ratio
+
+    m_keyFrames.clear();
+    m_keyFrames.push_back({ 0.0, 0.0 });
+
+    size_t inputDuration = m_studyInputDuration;
+    if (inputDuration == 0) inputDuration = m_suppliedInputDuration;
+    
+    for (auto kf : m_keyFrameMap) {
+        if (inputDuration > 0 &&
+            (kf.first >= inputDuration || kf.second >= m_totalTargetDuration)) {
+            break;
+        }
+        if (kf.first <= m_keyFrames.rbegin()->second ||
+            kf.second <= m_keyFrames.rbegin()->first) {
+            m_log.log(0, "WsolaStretcher: ignoring non-monotonic key frame",
+                      kf.first, kf.second);
+            continue;
+        }
+        m_keyFrames.push_back({ double(kf.second), double(kf.first) });
+    }
+
+    if (inputDuration > 0 && m_totalTargetDuration > 0) {
+        m_keyFrames.push_back({ double(m_totalTargetDuration),
+                                double(inputDuration) });
+    }
+}
+
+double
+WsolaStretcher::getInputPositionForHop(size_t hop) const
+{
+    double output = double(hop) * m_hop * getResampleRatio();
+
+    auto i = std::upper_bound
+        (m_keyFrames.begin(), m_keyFrames.end(),
+         std::pair<double, double>(output, 0.0),
+         [](const std::pair<double, double> &a,
+            const std::pair<double, double> &b) {
+             return a.first < b.first;
+         });
+
+    if (i == m_keyFrames.end()) {
+        auto last = m_keyFrames.rbegin();
+        return last->second + (output - last->first) / getOutputRatio();
+    }
+
+    auto prev = i - 1;
+    double proportion = (output - prev->first) / (i->first - prev->first);
+    return prev->second + proportion * (i->second - prev->second);
+}
+
+double
+WsolaStretcher::getTimeRatio() const
+{
+    return m_timeRatio;
+}
+
+double
+WsolaStretcher::getPitchScale() const
+{
+    return m_pitchScale;
+}
+
+size_t
+WsolaStretcher::getPreferredStartPad() const
+{
+    // We always prefill internally, so no further padding is needed
+    return 0;
+}
+
+size_t
+WsolaStretcher::getStartDelay() const
+{
+    if (!isRealTime()) {
+        return 0;
+    } else {
+        return size_t(ceil(m_frameSize * 0.5 * getResampleRatio()));
+    }
+}
+
+size_t
+WsolaStretcher::getChannelCount() const
+{
+    return m_parameters.channels;
+}
+
+void
+WsolaStretcher::reset()
+{
+    if (m_resampler) {
+        m_resampler->reset();
+    }
+
+    int prefill = m_tolerance + m_frameSize / 2;
+    for (auto &cd : m_channelData) {
+        cd->reset();
+        cd->inbuf->zero(prefill);
+    }
+    v_zero(m_continuation.data(), m_continuation.size());
+    
+    m_inputPosition = 0.0;
+    m_inbufPosition = 0;
+    m_hopCount = 0;
+    m_finishedProcessing = false;
+    m_startSkip = 0;
+    m_studyInputDuration = 0;
+    m_suppliedInputDuration = 0;
+    m_totalTargetDuration = 0;
+    m_totalInputDuration = 0;
+    m_totalOutputDuration = 0;
+    m_keyFrameMap.clear();
+    m_keyFrames.clear();
+
+    m_mode = ProcessMode::JustCreated;
+}
+
+void
+WsolaStretcher::study(const float *const *, size_t samples, bool)
+{
+    if (isRealTime()) {
+        m_log.log(0, "WsolaStretcher::study: Not meaningful in realtime mode");
+        return;
+    }
+
+    if (m_mode == ProcessMode::Processing || m_mode == ProcessMode::Finished) {
+        m_log.log(0, "WsolaStretcher::study: Cannot study after processing");
+        return;
+    }
+    
+    if (m_mode == ProcessMode::JustCreated) {
+        m_studyInputDuration = 0;
+    }
+
+    m_mode = ProcessMode::Studying;
+    m_studyInputDuration += samples;
+}
+
+void
+WsolaStretcher::setExpectedInputDuration(size_t samples)
+{
+    m_suppliedInputDuration = samples;
+}
+
+size_t
+WsolaStretcher::getSamplesRequired() const
+{
+    if (available() != 0) return 0;
+    long required = long(round(m_inputPosition)) -
+        long(m_inbufPosition) + m_regionSize;
+    long rs = long(m_channelData[0]->inbuf->getReadSpace());
+    if (rs < required) {
+        return size_t(required - rs);
+    } else {
+        return 0;
+    }
+}
+
+void
+WsolaStretcher::setMaxProcessSize(size_t n)
+{
+    size_t oldSize = m_channelData[0]->inbuf->getSize();
+    size_t newSize = m_regionSize * 2 + n;
+
+    if (newSize > oldSize) {
+        m_log.log(1, "setMaxProcessSize: resizing from and to", oldSize, newSize);
+        for (int c = 0; c < m_parameters.channels; ++c) {
+            m_channelData[c]->inbuf = std::unique_ptr<RingBuffer<float>>
+                (m_channelData[c]->inbuf->resized(newSize));
+        }
+    } else {
+        m_log.log(1, "setMaxProcessSize: nothing to be done, newSize <= oldSize", newSize, oldSize);
+    }
+}
+
+void
+WsolaStretcher::process(const float *const *input, size_t samples, bool final)
+{
+    processSome(input, samples, final, 0);
+}
+
+size_t
+WsolaStretcher::processSome(const float *const *input, size_t samples,
+                            bool final, size_t maxHops)
+{
+    if (m_mode == ProcessMode::Finished) {
+        if (samples == 0) {
+            // Continuing to drain after a bounded final call, or
+            // after the output buffer filled up
+            return consume(maxHops);
+        }
+        m_log.log(0, "WsolaStretcher::process: Cannot process again after final chunk");
+        return 0;
+    }
+
+    if (!isRealTime()) {
+
+        if (m_mode == ProcessMode::Studying) {
+            m_totalTargetDuration =
+                size_t(round(m_studyInputDuration * getOutputRatio()));
+            m_log.log(1, "study duration and target duration",
+                      m_studyInputDuration, m_totalTargetDuration);
+        } else if (m_mode == ProcessMode::JustCreated) {
+            if (m_suppliedInputDuration != 0) {
+                m_totalTargetDuration =
+                    size_t(round(m_suppliedInputDuration * getOutputRatio()));
+                m_log.log(1, "supplied duration and target duration",
+                          m_suppliedInputDuration, m_totalTargetDuration);
+            }
+        }
+
+        if (m_mode == ProcessMode::JustCreated ||
+            m_mode == ProcessMode::Studying) {
+
+            if (getResampleRatio() != 1.0 && !m_resampler) {
+                createResampler();
+            }
+
+            prepareKeyFrames();
+
+            // The first frame is centred on the first input sample,
+            // and so is emitted half a frame early
+            m_startSkip = int(round(m_frameSize / 2 * getResampleRatio()));
+            m_log.log(1, "start skip is", m_startSkip);
+        }
+    }
+
+    if (final) {
+        m_mode = ProcessMode::Finished;
+    } else {
+        m_mode = ProcessMode::Processing;
+    }
+    
+    size_t ws = m_channelData[0]->inbuf->getWriteSpace();
+    if (samples > ws) {
+        m_log.log(0, "WsolaStretcher::process: WARNING: Forced to increase input buffer size. Either setMaxProcessSize was not properly called or process is being called repeatedly without retrieve. Write space and samples", ws, samples);
+        size_t newSize = m_channelData[0]->inbuf->getSize() - ws + samples;
+        for (int c = 0; c < m_parameters.channels; ++c) {
+            auto newBuf = m_channelData[c]->inbuf->resized(newSize);
+            m_channelData[c]->inbuf = std::unique_ptr<RingBuffer<float>>(newBuf);
+        }
+    }
+
+    if (samples > 0) {
+        for (int c = 0; c < m_parameters.channels; ++c) {
+            m_channelData[c]->inbuf->write(input[c], samples);
+        }
+        m_totalInputDuration += samples;
+    }
+
+    return consume(maxHops);
+}
+
+int
+WsolaStretcher::available() const
+{
+    int av = int(m_channelData[0]->outbuf->getReadSpace());
+    if (av == 0 && !isRealTime() &&
+        m_mode == ProcessMode::Finished && !m_finishedProcessing) {
+        // The final block produced more than the output buffer
+        // could hold: the caller has now drained it, so carry on
+        // from where consume() stopped
+        m_log.log(2, "WsolaStretcher::available: calling consume");
+        ((WsolaStretcher *)this)->consume(0);
+        av = int(m_channelData[0]->outbuf->getReadSpace());
+    }
+    if (av == 0 && m_finishedProcessing) {
+        return -1;
+    } else {
+        return av;
+    }
+}
+
+size_t
+WsolaStretcher::retrieve(float *const *output, size_t samples) const
+{
+    int got = samples;
+    
+    for (int c = 0; c < m_parameters.channels; ++c) {
+        int gotHere = m_channelData[c]->outbuf->read(output[c], got);
+        if (gotHere < got) {
+            if (c > 0) {
+                m_log.log(0, "WsolaStretcher::retrieve: WARNING: channel imbalance detected");
+            }
+            got = std::min(got, std::max(gotHere, 0));
+        }
+    }
+
+    return got;
+}
+
+size_t
+WsolaStretcher::consume(size_t maxHops)
+{
+    int channels = m_parameters.channels;
+    auto &cd0 = m_channelData.at(0);
+    size_t hops = 0;
+
+    bool resampling = isResampling();
+
+    // Leave room for the resampler to deliver more than its nominal
+    // ratio would suggest, as it may when flushing
+    int outspace = m_hop;
+    if (resampling) {
+        outspace = int(ceil(m_hop * getResampleRatio())) * 2;
+    }
+
+    // The input position and m_totalInputDuration both count
+    // user-supplied samples, excluding the prefill
+    double inputEnd = double(m_totalInputDuration);
+    
+    while (!m_finishedProcessing &&
+           int(cd0->outbuf->getWriteSpace()) >= outspace) {
+
+        if (maxHops > 0 && hops >= maxHops) {
+            break;
+        }
+
+        // Skip to the start of the search region for this frame
+
+        size_t regionStart = size_t(round(m_inputPosition));
+        if (regionStart < m_inbufPosition) {
+            regionStart = m_inbufPosition;
+        }
+        int toSkip = int(regionStart - m_inbufPosition);
+        int readSpace = cd0->inbuf->getReadSpace();
+        if (toSkip > 0) {
+            int skipping = std::min(toSkip, readSpace);
+            for (int c = 0; c < channels; ++c) {
+                m_channelData[c]->inbuf->skip(skipping);
+            }
+            m_inbufPosition += skipping;
+            readSpace -= skipping;
+            if (skipping < toSkip) {
+                if (m_mode == ProcessMode::Finished) {
+                    m_inbufPosition = regionStart;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        bool finished = (m_mode == ProcessMode::Finished);
+        if (readSpace < m_regionSize && !finished) {
+            // await more input
+            break;
+        }
+
+        bool last = (finished && m_inputPosition >= inputEnd);
+
+        // Read the search region and mix down for alignment
+        
+        int got = std::min(readSpace, m_regionSize);
+        for (int c = 0; c < channels; ++c) {
+            auto &cd = m_channelData.at(c);
+            cd->inbuf->peek(cd->region.data(), got);
+            if (got < m_regionSize) {
+                v_zero(cd->region.data() + got, m_regionSize - got);
+            }
+            if (c == 0) {
+                v_copy(m_mix.data(), cd->region.data(), m_regionSize);
+            } else {
+                v_add(m_mix.data(), cd->region.data(), m_regionSize);
+            }
+        }
+
+        // Once the input has run out, don't look ahead of the
+        // nominal position into the zero padding: a frame there can
+        // align well with the continuation over its first half, but
+        // would be silent after that
+        
+        int maxLag = m_tolerance;
+        if (got < m_regionSize) {
+            maxLag = std::max(0, std::min(maxLag,
+                                          got - m_tolerance - m_frameSize));
+        }
+        
+        int lag = findAlignment(maxLag);
+        m_log.log(2, "WsolaStretcher::consume: input position and lag",
+                  m_inputPosition, lag);
+        int offset = m_tolerance + lag;
+
+        // Overlap-add the chosen frame, and keep its natural
+        // continuation for aligning the next one
+
+        for (int c = 0; c < channels; ++c) {
+            auto &cd = m_channelData.at(c);
+            m_window.cutAndAdd(cd->region.data() + offset,
+                               cd->accumulator.data());
+        }
+        
+        v_copy(m_continuation.data(), m_mix.data() + offset + m_hop, m_hop);
+
+        emit(m_hop, last);
+
+        if (last) {
+            m_finishedProcessing = true;
+            m_log.log(1, "WsolaStretcher::consume: finished, output duration",
+                      m_totalOutputDuration);
+        }
+
+        ++hops;
+        ++m_hopCount;
+
+        if (isRealTime()) {
+            m_inputPosition += m_hop / getEffectiveRatio();
+        } else {
+            m_inputPosition = getInputPositionForHop(m_hopCount);
+        }
+    }
+
+    return hops;
+}
+
+int
+WsolaStretcher::findAlignment(int maxLag)
+{
+    // Return the lag, in the range -m_tolerance to maxLag (which must
+    // be non-negative), at which the frame taken from the current
+    // search region best matches the continuation of the previous
+    // frame. We search the whole range on a decimated signal first
+    // and then refine at full rate around the best coarse match.
+    //
+    // The match score is a normalised cross-correlation, less a small
+    // penalty for displacement from the nominal position. This breaks
+    // near-ties (as between the periods of a steady tone) in favour
+    // of the least timing error, and stops the frames running too
+    // far ahead of or behind the nominal position when stretching
+
+    if (m_hopCount == 0) {
+        return 0;
+    }
+
+    const float *cont = m_continuation.data();
+    int n = m_hop;
+
+    float contEnergy = 0.f;
+    for (int i = 0; i < n; ++i) {
+        contEnergy += cont[i] * cont[i];
+    }
+    if (contEnergy < 1e-9f) {
+        return 0;
+    }
+
+    const float penalty = 0.05f / float(m_tolerance);
+    int dec = m_decimation;
+    int best = 0;
+
+    if (dec > 1) {
+
+        int dn = n / dec;
+        int dregion = (m_tolerance * 2 + n) / dec;
+        float *dmix = m_mixDecimated.data();
+        float *dcont = m_continuationDecimated.data();
+
+        for (int i = 0; i < dregion; ++i) {
+            float sum = 0.f;
+            for (int j = 0; j < dec; ++j) {
+                sum += m_mix[i * dec + j];
+            }
+            dmix[i] = sum;
+        }
+        float dcontEnergy = 0.f;
+        for (int i = 0; i < dn; ++i) {
+            float sum = 0.f;
+            for (int j = 0; j < dec; ++j) {
+                sum += cont[i * dec + j];
+            }
+            dcont[i] = sum;
+            dcontEnergy += sum * sum;
+        }
+
+        int lags = (m_tolerance + maxLag) / dec;
+        float bestScore = 0.f;
+        for (int k = 0; k <= lags; ++k) {
+            float corr = 0.f, energy = 0.f;
+            for (int i = 0; i < dn; ++i) {
+                corr += dmix[k + i] * dcont[i];
+                energy += dmix[k + i] * dmix[k + i];
+            }
+            int d = k * dec - m_tolerance;
+            float score = corr /
+                sqrtf(std::max(energy * dcontEnergy, 1e-18f)) -
+                penalty * float(abs(d));
+            if (k == 0 || score > bestScore) {
+                bestScore = score;
+                best = d;
+            }
+        }
+    }
+
+    // Refine at full rate
+
+    int from = std::max(-m_tolerance, best - dec + 1);
+    int to = std::min(maxLag, best + dec - 1);
+    float bestScore = 0.f;
+    int bestLag = best;
+
+    for (int d = from; d <= to; ++d) {
+        const float *cand = m_mix.data() + m_tolerance + d;
+        float corr = 0.f, energy = 0.f;
+        for (int i = 0; i < n; ++i) {
+            corr += cand[i] * cont[i];
+            energy += cand[i] * cand[i];
+        }
+        float score = corr /
+            sqrtf(std::max(energy * contEnergy, 1e-18f)) -
+            penalty * float(abs(d));
+        if (d == from || score > bestScore) {
+            bestScore = score;
+            bestLag = d;
+        }
+    }
+
+    return bestLag;
+}
+
+void
+WsolaStretcher::emit(int count, bool final)
+{
+    int channels = m_parameters.channels;
+    
+    bool resampling = isResampling();
+
+    int writeCount = count;
+    if (resampling) {
+        writeCount = m_resampler->resample
+            (m_resampled.data(),
+             m_channelData[0]->resampled.size(),
+             m_accumulators.data(),
+             count,
+             getResampleRatio(),
+             final);
+    }
+
+    if (!isRealTime() && m_totalTargetDuration > 0) {
+        // We count the start skip as part of the output here, and
+        // remove it below
+        size_t target = m_totalTargetDuration + m_startSkip;
+        if (m_totalOutputDuration + writeCount > target) {
+            m_log.log(1, "writeCount would take output beyond target",
+                      m_totalOutputDuration, target);
+            writeCount = int(target - std::min(target, m_totalOutputDuration));
+        }
+    }
+
+    for (int c = 0; c < channels; ++c) {
+        auto &cd = m_channelData.at(c);
+        if (resampling) {
+            cd->outbuf->write(cd->resampled.data(), writeCount);
+        } else {
+            cd->outbuf->write(cd->accumulator.data(), writeCount);
+        }
+        float *acc = cd->accumulator.data();
+        v_move(acc, acc + count, m_frameSize - count);
+        v_zero(acc + m_frameSize - count, count);
+    }
+
+    m_totalOutputDuration += writeCount;
+
+    if (final && !isRealTime() && m_totalTargetDuration > 0) {
+        size_t target = m_totalTargetDuration + m_startSkip;
+        if (m_totalOutputDuration < target) {
+            int pad = int(target - m_totalOutputDuration);
+            m_log.log(1, "padding output to target", pad);
+            for (int c = 0; c < channels; ++c) {
+                m_channelData.at(c)->outbuf->zero(pad);
+            }
+            m_totalOutputDuration += pad;
+        }
+    }
+    
+    if (m_startSkip > 0) {
+        int rs = m_channelData[0]->outbuf->getReadSpace();
+        int toSkip = std::min(m_startSkip, rs);
+        for (int c = 0; c < channels; ++c) {
+            m_channelData.at(c)->outbuf->skip(toSkip);
+        }
+        m_startSkip -= toSkip;
+        m_totalOutputDuration -= toSkip;
+    }
+}
+
+}
@@ -0,0 +1,237 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_WSOLA_STRETCHER_H
+#define RUBBERBAND_WSOLA_STRETCHER_H
+
+#include "../common/Resampler.h"
+#include "../common/RingBuffer.h"
+#include "../common/FixedVector.h"
+#include "../common/Window.h"
+#include "../common/Log.h"
+#include "../common/VectorOps.h"
+
+#include "../../rubberband/RubberBandStretcher.h"
+
+#include <map>
+#include <memory>
+#include <atomic>
+#include <vector>
+
+namespace RubberBand
+{
+
+/**
+ * Time-domain (Fastest) engine. This is a WSOLA (waveform-similarity
+ * overlap-add) stretcher: fixed-length frames are overlap-added at a
+ * fixed output hop, and each frame is taken from the input at the
+ * position nominally dictated by the time ratio, adjusted within a
+ * tolerance so that it lines up with the natural continuation of the
+ * previous frame. The alignment search is carried out on a decimated
+ * mixdown first and then refined at full rate around the best
+ * candidate. Pitch shifting is by stretch and resample, as in the
+ * other engines.
+ *
+ * There is no frequency-domain processing at all, which makes this
+ * far cheaper than R2 or R3, and it works well for speech and other
+ * monophonic material at moderate ratios. It is less suitable for
+ * polyphonic music, which has no single periodicity to align with.
+ */
+class WsolaStretcher
+{
+public:
+    struct Parameters {
+        double sampleRate;
+        int channels;
+        RubberBandStretcher::Options options;
+        Parameters(double _sampleRate, int _channels,
+                   RubberBandStretcher::Options _options) :
+            sampleRate(_sampleRate), channels(_channels), options(_options) { }
+    };
+    
+    WsolaStretcher(Parameters parameters,
+                   double initialTimeRatio,
+                   double initialPitchScale,
+                   Log log);
+    ~WsolaStretcher() { }
+
+    void reset();
+    
+    void setTimeRatio(double ratio);
+    void setPitchScale(double scale);
+    void setOutputSampleRate(double rate);
+
+    double getTimeRatio() const;
+    double getPitchScale() const;
+
+    void setKeyFrameMap(const std::map<size_t, size_t> &);
+
+    void setPitchOption(RubberBandStretcher::Options);
+    
+    void study(const float *const *input, size_t samples, bool final);
+    size_t getSamplesRequired() const;
+    void process(const float *const *input, size_t samples, bool final);
+    size_t processSome(const float *const *input, size_t samples, bool final,
+                       size_t maxHops);
+    int available() const;
+    size_t retrieve(float *const *output, size_t samples) const;
+
+    size_t getPreferredStartPad() const;
+    size_t getStartDelay() const;
+    
+    size_t getChannelCount() const;
+
+    void setExpectedInputDuration(size_t samples);
+    void setMaxProcessSize(size_t samples);
+    
+    void setDebugLevel(int level) {
+        m_log.setDebugLevel(level);
+    }
+
+protected:
+    struct ChannelData {
+        std::unique_ptr<RingBuffer<float>> inbuf;
+        std::unique_ptr<RingBuffer<float>> outbuf;
+        FixedVector<float> region;      // search region, from inbuf
+        FixedVector<float> accumulator; // overlap-add output
+        FixedVector<float> resampled;
+        ChannelData(int regionSize,
+                    int frameSize,
+                    int inRingBufferSize,
+                    int outRingBufferSize) :
+            inbuf(new RingBuffer<float>(inRingBufferSize)),
+            outbuf(new RingBuffer<float>(outRingBufferSize)),
+            region(regionSize, 0.f),
+            accumulator(frameSize, 0.f),
+            resampled(outRingBufferSize, 0.f) { }
+        void reset() {
+            inbuf->reset();
+            outbuf->reset();
+            v_zero(region.data(), region.size());
+            v_zero(accumulator.data(), accumulator.size());
+        }
+    };
+
+    enum class ProcessMode {
+        JustCreated,
+        Studying,
+        Processing,
+        Finished
+    };
+    
+    Parameters m_parameters;
+    Log m_log;
+
+    std::atomic<double> m_timeRatio;
+    std::atomic<double> m_pitchScale;
+    std::atomic<double> m_outputRateRatio;
+
+    // Frame (window) length, output hop, alignment tolerance either
+    // side of the nominal position, and decimation factor for the
+    // coarse alignment search. The hop is always half the frame, and
+    // the search region is a frame plus the tolerance either side
+    int m_frameSize;
+    int m_hop;
+    int m_tolerance;
+    int m_decimation;
+    int m_regionSize;
+    
+    Window<float> m_window;
+    std::vector<std::shared_ptr<ChannelData>> m_channelData;
+    FixedVector<float> m_mix;           // mixdown of search region
+    FixedVector<float> m_continuation;  // of the previous frame
+    FixedVector<float> m_mixDecimated;
+    FixedVector<float> m_continuationDecimated;
+    FixedVector<float *> m_accumulators;
+    FixedVector<float *> m_resampled;
+    std::unique_ptr<Resampler> m_resampler;
+
+    std::map<size_t, size_t> m_keyFrameMap;
+    std::vector<std::pair<double, double>> m_keyFrames;
+
+    // Input position of the current frame. The input is prefilled
+    // with m_tolerance + m_frameSize/2 zeros, so this is both the
+    // user-supplied input sample aligned with the centre of the
+    // frame and the index in the prefilled input at which its
+    // search region begins
+    double m_inputPosition;
+    size_t m_inbufPosition;
+    size_t m_hopCount;
+    bool m_finishedProcessing;
+    
+    int m_startSkip;
+    size_t m_studyInputDuration;
+    size_t m_suppliedInputDuration;
+    size_t m_totalTargetDuration;
+    size_t m_totalInputDuration;
+    size_t m_totalOutputDuration;
+    ProcessMode m_mode;
+
+    size_t consume(size_t maxHops);
+    int findAlignment(int maxLag);
+    void emit(int count, bool final);
+    void createResampler();
+    void prepareKeyFrames();
+    double getInputPositionForHop(size_t hop) const;
+    
+    double getEffectiveRatio() const {
+        return m_timeRatio * m_pitchScale;
+    }
+
+    // Ratio of output to input sample count applied by the
+    // resampler, combining the pitch shift with any conversion to a
+    // different output sample rate
+    double getResampleRatio() const {
+        return m_outputRateRatio / m_pitchScale;
+    }
+
+    // Ratio of output to input sample count overall
+    double getOutputRatio() const {
+        return m_timeRatio * m_outputRateRatio;
+    }
+
+    bool isResampling() const {
+        return m_resampler &&
+            (getResampleRatio() != 1.0 ||
+             (m_parameters.options &
+              RubberBandStretcher::OptionPitchHighConsistency));
+    }
+
+    bool isRealTime() const {
+        return m_parameters.options &
+            RubberBandStretcher::OptionProcessRealTime;
+    }
+
+    int roundUp(int value) const {
+        if (value < 1) return 1;
+        if (!(value & (value - 1))) return value;
+        int bits = 0;
+        while (value) { ++bits; value >>= 1; }
+        value = 1 << bits;
+        return value;
+    }
+};
+
+}
+
+#endif
@@ -27,6 +27,7 @@
 #include "../common/Allocators.h"
 #include "../common/MovingMedian.h"
 #include "../common/RingBuffer.h"
+#include "../common/HistoryBuffer.h"
 
 #include <vector>
 #include <memory>
@@ -60,38 +61,38 @@ public:
             percussiveThreshold(_percussiveThreshold) { }
     };
     
-    BinClassifier(Parameters parameters) :
+    BinClassifier(Parameters parameters,
+                  HistoryPrecision precision = HistoryPrecision::Full) :
         m_parameters(parameters),
-        m_hFilters(new MovingMedianStack<process_t>(m_parameters.binCount,
-                                                    m_parameters.horizontalFilterLength)),
-        m_vFilter(new MovingMedian<process_t>(m_parameters.verticalFilterLength)),
-        m_vfQueue(parameters.horizontalFilterLag)
+        m_vFilter(new MovingMedian<process_t>(m_parameters.verticalFilterLength))
     {
         int n = m_parameters.binCount;
 
         m_hf = allocate_and_zero<process_t>(n);
         m_vf = allocate_and_zero<process_t>(n);
-        
-        for (int i = 0; i < m_parameters.horizontalFilterLag; ++i) {
-            process_t *entry = allocate_and_zero<process_t>(n);
-            m_vfQueue.write(&entry, 1);
+
+        switch (precision) {
+        case HistoryPrecision::Full:
+            m_history.reset(new History<process_t>(m_parameters));
+            break;
+        case HistoryPrecision::Single:
+            m_history.reset(new History<float>(m_parameters));
+            break;
+        case HistoryPrecision::HalfFloat:
+            m_history.reset(new History<Half>(m_parameters));
+            break;
         }
     }
 
     ~BinClassifier()
     {
-        while (m_vfQueue.getReadSpace() > 0) {
-            process_t *entry = m_vfQueue.readOne();
-            deallocate(entry);
-        }
-
         deallocate(m_hf);
         deallocate(m_vf);
     }
 
     void reset()
     {
-        m_hFilters->reset();
+        m_history->reset();
     }
     
     void classify(const process_t *const mag, // input, of at least binCount bins
@@ -99,19 +100,12 @@ public:
     {
         const int n = m_parameters.binCount;
 
-        for (int i = 0; i < n; ++i) {
-            m_hFilters->push(i, mag[i]);
-            m_hf[i] = m_hFilters->get(i);
-        }
+        m_history->filterHorizontal(mag, m_hf);
 
         v_copy(m_vf, mag, n);
         MovingMedian<process_t>::filter(*m_vFilter, m_vf, n);
 
-        if (m_parameters.horizontalFilterLag > 0) {
-            process_t *lagged = m_vfQueue.readOne();
-            m_vfQueue.write(&m_vf, 1);
-            m_vf = lagged;
-        }
+        m_history->exchangeLagged(m_vf);
 
         process_t eps = 1.0e-7;
             
@@ -131,14 +125,87 @@ public:
     }
 
 protected:
+    // The horizontal median filters and the queue of lagged
+    // vertically-filtered frames are the only state carried from one
+    // frame to the next, and they are large, so we hold them at the
+    // requested history precision. The filtering arithmetic is done
+    // at process_t.
+    
+    class HistoryBase
+    {
+    public:
+        virtual ~HistoryBase() { }
+        virtual void reset() = 0;
+        virtual void filterHorizontal(const process_t *const mag,
+                                      process_t *hf) = 0;
+        virtual void exchangeLagged(process_t *vf) = 0;
+    };
+
+    template <typename S>
+    class History : public HistoryBase
+    {
+    public:
+        History(const Parameters &parameters) :
+            m_n(parameters.binCount),
+            m_hFilters(parameters.binCount,
+                       parameters.horizontalFilterLength),
+            m_vfQueue(parameters.horizontalFilterLag)
+        {
+            for (int i = 0; i < parameters.horizontalFilterLag; ++i) {
+                S *entry = allocate_and_zero<S>(m_n);
+                m_vfQueue.write(&entry, 1);
+            }
+        }
+
+        ~History()
+        {
+            while (m_vfQueue.getReadSpace() > 0) {
+                S *entry = m_vfQueue.readOne();
+                deallocate(entry);
+            }
+        }
+
+        void reset() override
+        {
+            m_hFilters.reset();
+        }
+
+        void filterHorizontal(const process_t *const mag,
+                              process_t *hf) override
+        {
+            for (int i = 0; i < m_n; ++i) {
+                m_hFilters.push(i, S(mag[i]));
+                hf[i] = m_hFilters.get(i);
+            }
+        }
+
+        // Queue the frame vf and replace it with the one queued
+        // horizontalFilterLag frames ago
+        void exchangeLagged(process_t *vf) override
+        {
+            if (m_vfQueue.getReadSpace() == 0) {
+                return;
+            }
+            S *lagged = m_vfQueue.readOne();
+            for (int i = 0; i < m_n; ++i) {
+                process_t v = vf[i];
+                vf[i] = lagged[i];
+                lagged[i] = S(v);
+            }
+            m_vfQueue.write(&lagged, 1);
+        }
+
+    private:
+        int m_n;
+        MovingMedianStack<S> m_hFilters;
+        RingBuffer<S *> m_vfQueue;
+    };
+    
     Parameters m_parameters;
-    std::unique_ptr<MovingMedianStack<process_t>> m_hFilters;
+    std::unique_ptr<HistoryBase> m_history;
     std::unique_ptr<MovingMedian<process_t>> m_vFilter;
-    // We manage the queued frames through pointer swapping, hence
-    // bare pointers here
     process_t *m_hf;
     process_t *m_vf;
-    RingBuffer<process_t *> m_vfQueue;
 
     BinClassifier(const BinClassifier &) =delete;
     BinClassifier &operator=(const BinClassifier &) =delete;
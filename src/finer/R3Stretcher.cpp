@@ -24,6 +24,9 @@
 #include "R3Stretcher.h"
 
 #include "../common/VectorOpsComplex.h"
+#include "../common/Profiler.h"
+#include "../common/Tracer.h"
+#include "../common/FloatGuards.h"
 
 #include <array>
 
@@ -32,12 +35,14 @@ namespace RubberBand {
 R3Stretcher::R3Stretcher(Parameters parameters,
                          double initialTimeRatio,
                          double initialPitchScale,
-                         Log log) :
+                         Log log,
+                         const R3Stretcher *prototype) :
     m_parameters(parameters),
     m_log(log),
     m_timeRatio(initialTimeRatio),
     m_pitchScale(initialPitchScale),
     m_formantScale(0.0),
+    m_outputRateRatio(1.0),
     m_guide(Guide::Parameters(m_parameters.sampleRate), m_log),
     m_guideConfiguration(m_guide.getConfiguration()),
     m_channelAssembly(m_parameters.channels),
@@ -46,13 +51,26 @@ R3Stretcher::R3Stretcher(Parameters parameters,
     m_prevOuthop(1),
     m_unityCount(0),
     m_startSkip(0),
+    m_classificationHops(0),
+    m_classificationReuses(0),
     m_studyInputDuration(0),
     m_suppliedInputDuration(0),
     m_totalTargetDuration(0),
     m_consumedInputDuration(0),
     m_lastKeyFrameSurpassed(0),
     m_totalOutputDuration(0),
-    m_mode(ProcessMode::JustCreated)
+    m_idealOutputPosition(0.0),
+    m_mode(ProcessMode::JustCreated),
+    m_pipelined(false),
+    m_pipelineState(PipelineState::Idle),
+    m_pipelineInhop(0),
+    m_pipelineHop(0),
+    m_hopCount(0),
+    m_pipelineHops(0),
+    m_pipelineAdoptions(0)
+#ifndef NO_THREADING
+    , m_pipelineWaiting(false)
+#endif
 {
     m_log.log(1, "R3Stretcher::R3Stretcher: rate, options",
               m_parameters.sampleRate, m_parameters.options);
@@ -74,13 +92,27 @@ R3Stretcher::R3Stretcher(Parameters parameters,
     BinClassifier::Parameters classifierParameters
         (classificationBins, 9, 1, 10, 2.0, 2.0);
 
+#ifndef NO_THREADING
+    if (isRealTime() &&
+        (m_parameters.options & RubberBandStretcher::OptionThreadingRealTime) &&
+        Thread::threadingAvailable()) {
+        m_pipelined = true;
+    }
+#endif
+
+    // In pipelined mode we hold back one further hop of input, so
+    // that the following frame is available for the analysis thread
     int inRingBufferSize = m_guideConfiguration.longestFftSize * 2;
+    if (m_pipelined) {
+        inRingBufferSize += maxInhop;
+    }
     int outRingBufferSize = m_guideConfiguration.longestFftSize * 16;
 
     for (int c = 0; c < m_parameters.channels; ++c) {
         m_channelData.push_back(std::make_shared<ChannelData>
                                 (segmenterParameters,
                                  classifierParameters,
+                                 getHistoryPrecision(),
                                  m_guideConfiguration.longestFftSize,
                                  inRingBufferSize,
                                  outRingBufferSize));
@@ -91,13 +123,68 @@ R3Stretcher::R3Stretcher(Parameters parameters,
                 (fftSize, m_guideConfiguration.longestFftSize);
         }
     }
+
+    m_scratch = std::unique_ptr<ScratchData>
+        (new ScratchData(m_guideConfiguration.longestFftSize));
     
     for (auto band: m_guideConfiguration.fftBandLimits) {
         int fftSize = band.fftSize;
         GuidedPhaseAdvance::Parameters guidedParameters
             (fftSize, m_parameters.sampleRate, m_parameters.channels);
+        const ScaleData *prototypeScale = nullptr;
+        if (prototype) {
+            prototypeScale = prototype->m_scaleData.at(fftSize).get();
+        }
         m_scaleData[fftSize] = std::make_shared<ScaleData>
-            (guidedParameters, m_log);
+            (guidedParameters, m_log, prototypeScale);
+
+        // Only the band up to b1max of each scale is ever used, and
+        // apart from the classification scale, which needs the full
+        // range of magnitudes, we need not analyse any further. For
+        // the longest scale this is a narrow band, cheaper to
+        // calculate without the full FFT
+        int bins = band.b1max + 1;
+        if (fftSize != m_guideConfiguration.classificationFftSize &&
+            BandLimitedFFT::getFactorFor(fftSize, bins) > 1) {
+            m_scaleData[fftSize]->bandFft =
+                std::make_shared<BandLimitedFFT>(fftSize, bins);
+            m_log.log(1, "R3Stretcher::R3Stretcher: band-limited analysis for FFT size, with bins", fftSize, bins);
+        }
+    }
+
+    if (m_pipelined) {
+        int longest = m_guideConfiguration.longestFftSize;
+        int classify = m_guideConfiguration.classificationFftSize;
+        for (int c = 0; c < m_parameters.channels; ++c) {
+            auto pcd = std::make_shared<PipelineChannelData>
+                (longest + maxInhop, classify);
+            for (auto band: m_guideConfiguration.fftBandLimits) {
+                pcd->scales[band.fftSize] =
+                    std::make_shared<PipelineScaleData>(band.fftSize);
+            }
+            m_pipelineChannelData.push_back(pcd);
+        }
+        // The analysis thread has FFT objects of its own, as the
+        // ones in m_scaleData are in use for resynthesis at the same
+        // time
+        for (auto band: m_guideConfiguration.fftBandLimits) {
+            m_pipelineFfts[band.fftSize] =
+                std::make_shared<FFT>(band.fftSize);
+            const auto &bandFft = m_scaleData.at(band.fftSize)->bandFft;
+            if (bandFft) {
+                m_pipelineBandFfts[band.fftSize] =
+                    std::make_shared<BandLimitedFFT>
+                    (band.fftSize, bandFft->getBinCount());
+            }
+        }
+        m_pipelineScratch = std::unique_ptr<ScratchData>
+            (new ScratchData(longest));
+#ifndef NO_THREADING
+        m_analysisThread = std::unique_ptr<AnalysisThread>
+            (new AnalysisThread(this));
+        m_analysisThread->start();
+#endif
+        m_log.log(1, "R3Stretcher::R3Stretcher: pipelined analysis enabled");
     }
 
     m_calculator = std::unique_ptr<StretchCalculator>
@@ -126,6 +213,65 @@ R3Stretcher::R3Stretcher(Parameters parameters,
     }
 }
 
+R3Stretcher::~R3Stretcher()
+{
+    reportPipeline();
+    
+#ifndef NO_THREADING
+    if (m_analysisThread) {
+        m_analysisThread->abandon();
+        m_analysisThread->signalDataAvailable();
+        m_analysisThread->wait();
+    }
+#endif
+}
+
+#ifndef NO_THREADING
+
+R3Stretcher::AnalysisThread::AnalysisThread(R3Stretcher *s) :
+    m_s(s),
+    m_abandoning(false)
+{ }
+
+void
+R3Stretcher::AnalysisThread::run()
+{
+    ScopedFlushToZero ftz;
+
+    while (!m_abandoning) {
+
+        if (m_s->m_pipelineState == PipelineState::Requested) {
+            m_s->analysePipelined();
+            m_s->m_pipelineState = PipelineState::Ready;
+            // Only post if someone is waiting (see waitForPipeline),
+            // as nothing else would take the post back
+            if (m_s->m_pipelineWaiting) {
+                m_s->m_pipelineDone.post();
+            }
+            continue;
+        }
+
+        // Each request or abandonment posts once, so we may wake
+        // for a request we have already seen: the loop re-tests
+        m_dataAvailable.wait();
+    }
+}
+
+void
+R3Stretcher::AnalysisThread::signalDataAvailable()
+{
+    // Called from the processing thread, so must not lock
+    m_dataAvailable.post();
+}
+
+void
+R3Stretcher::AnalysisThread::abandon()
+{
+    m_abandoning = true;
+}
+
+#endif
+
 WindowType
 R3Stretcher::ScaleData::analysisWindowShape(int fftSize)
 {
@@ -199,6 +345,25 @@ R3Stretcher::setFormantScale(double scale)
     m_formantScale = scale;
 }
 
+void
+R3Stretcher::setOutputSampleRate(double rate)
+{
+    if (!isRealTime()) {
+        if (m_mode == ProcessMode::Studying ||
+            m_mode == ProcessMode::Processing) {
+            m_log.log(0, "R3Stretcher::setOutputSampleRate: Cannot set output sample rate while studying or processing in non-RT mode");
+            return;
+        }
+    }
+
+    double ratio = 1.0;
+    if (rate > 0.0) {
+        ratio = rate / m_parameters.sampleRate;
+    }
+    m_log.log(1, "R3Stretcher::setOutputSampleRate: rate and ratio", rate, ratio);
+    m_outputRateRatio = ratio;
+}
+
 void
 R3Stretcher::setFormantOption(RubberBandStretcher::Options options)
 {
@@ -245,6 +410,11 @@ R3Stretcher::createResampler()
     resamplerParameters.maxBufferSize = m_guideConfiguration.longestFftSize;
 
     if (isRealTime()) {
+        // We offer the resampler the whole of the resampled buffer
+        // as output space, so size its interleaving buffers for that
+        // here rather than have it reallocate on the first process
+        resamplerParameters.maxBufferSize =
+            int(m_channelData[0]->resampled.size()) / 2;
         if (m_parameters.options &
             RubberBandStretcher::OptionPitchHighConsistency) {
             resamplerParameters.dynamism = Resampler::RatioOftenChanging;
@@ -309,9 +479,12 @@ R3Stretcher::updateRatioFromMap()
 {
     if (m_keyFrameMap.empty()) return;
 
+    // Key frame output positions are at the output sample rate, so
+    // the ratios between them include the rate conversion
+    
     if (m_consumedInputDuration == 0) {
         m_timeRatio = double(m_keyFrameMap.begin()->second) /
-            double(m_keyFrameMap.begin()->first);
+            (double(m_keyFrameMap.begin()->first) * m_outputRateRatio);
 
         m_log.log(1, "initial key-frame map entry ",
                    double(m_keyFrameMap.begin()->first),
@@ -378,7 +551,7 @@ R3Stretcher::updateRatioFromMap()
         
         m_log.log(1, "new ratio", ratio);
     
-        m_timeRatio = ratio;
+        m_timeRatio = ratio / m_outputRateRatio;
         calculateHop();
 
         m_lastKeyFrameSurpassed = i0->first;
@@ -419,7 +592,7 @@ R3Stretcher::getStartDelay() const
     if (!isRealTime()) {
         return 0;
     } else {
-        double factor = 0.5 / m_pitchScale;
+        double factor = 0.5 * getResampleRatio();
         return size_t(ceil(m_guideConfiguration.longestFftSize * factor));
     }
 }
@@ -430,9 +603,36 @@ R3Stretcher::getChannelCount() const
     return m_parameters.channels;
 }
 
+std::set<int>
+R3Stretcher::getFftSizes(size_t sampleRate, Log log)
+{
+    Guide guide(Guide::Parameters(double(sampleRate)), log);
+    const Guide::Configuration &configuration = guide.getConfiguration();
+    std::set<int> sizes;
+    for (int b = 0; b < 3; ++b) {
+        const auto &band = configuration.fftBandLimits[b];
+        sizes.insert(band.fftSize);
+        // See the constructor - a band-limited analysis uses FFTs of
+        // a smaller size as well
+        if (band.fftSize != configuration.classificationFftSize) {
+            int factor = BandLimitedFFT::getFactorFor(band.fftSize,
+                                                      band.b1max + 1);
+            if (factor > 1) {
+                sizes.insert(band.fftSize / factor);
+            }
+        }
+    }
+    return sizes;
+}
+
 void
 R3Stretcher::reset()
 {
+    waitForPipeline();
+    reportPipeline();
+    m_pipelineState = PipelineState::Idle;
+    m_hopCount = 0;
+
     m_calculator->reset();
     if (m_resampler) {
         m_resampler->reset();
@@ -440,12 +640,16 @@ R3Stretcher::reset()
 
     for (auto &it : m_scaleData) {
         it.second->guided.reset();
+        it.second->dormant = false;
     }
 
     for (auto &cd : m_channelData) {
         cd->reset();
     }
 
+    m_classificationHops = 0;
+    m_classificationReuses = 0;
+
     m_prevInhop = m_inhop;
     m_prevOuthop = int(round(m_inhop * getEffectiveRatio()));
 
@@ -457,11 +661,17 @@ R3Stretcher::reset()
     m_totalOutputDuration = 0;
     m_keyFrameMap.clear();
 
+    m_studyMixdown.clear();
+    m_studyPrevMag.clear();
+    m_studyFlux.clear();
+    m_hopScales.clear();
+    m_idealOutputPosition = 0.0;
+
     m_mode = ProcessMode::JustCreated;
 }
 
 void
-R3Stretcher::study(const float *const *, size_t samples, bool)
+R3Stretcher::study(const float *const *input, size_t samples, bool final)
 {
     if (isRealTime()) {
         m_log.log(0, "R3Stretcher::study: Not meaningful in realtime mode");
@@ -475,10 +685,163 @@ R3Stretcher::study(const float *const *, size_t samples, bool)
     
     if (m_mode == ProcessMode::JustCreated) {
         m_studyInputDuration = 0;
+        if (isHopAdaptive()) {
+            // Centre the first frame on the start of the input
+            m_studyMixdown.assign
+                (m_guideConfiguration.classificationFftSize / 2, 0.0);
+        }
     }
 
     m_mode = ProcessMode::Studying;
     m_studyInputDuration += samples;
+
+    if (isHopAdaptive()) {
+        studyStationarity(input, samples, final);
+    }
+}
+
+void
+R3Stretcher::studyStationarity(const float *const *input, size_t samples,
+                               bool final)
+{
+    // Analyse the mixdown of the study input at the classification
+    // FFT size, with one frame centred on each boundary between hop
+    // regions, and record the normalised spectral flux between each
+    // frame and the previous one. That is, the flux across each
+    // region in turn
+
+    int classify = m_guideConfiguration.classificationFftSize;
+    int channels = m_parameters.channels;
+    int bins = classify/2 + 1;
+
+    size_t have = m_studyMixdown.size();
+    m_studyMixdown.resize(have + samples, 0.0);
+    for (int c = 0; c < channels; ++c) {
+        for (size_t i = 0; i < samples; ++i) {
+            m_studyMixdown[have + i] += input[c][i] / channels;
+        }
+    }
+
+    if (final) {
+        // Pad so as to analyse a frame centred beyond the end
+        m_studyMixdown.resize
+            (m_studyMixdown.size() + classify/2 + hopRegionSize, 0.0);
+    }
+
+    auto &scaleData = m_scaleData.at(classify);
+    ScratchData &scratch = *m_scratch;
+    process_t *mag = scratch.real.data();
+    
+    size_t offset = 0;
+    while (offset + classify <= m_studyMixdown.size()) {
+
+        scaleData->analysisWindow->cutAndShift(m_studyMixdown.data() + offset,
+                                               scratch.timeDomain.data());
+        scaleData->fft.forward(scratch.timeDomain.data(),
+                               scratch.real.data(),
+                               scratch.imag.data());
+        v_cartesian_to_magnitudes(mag, scratch.real.data(),
+                                  scratch.imag.data(), bins);
+
+        if (!m_studyPrevMag.empty()) {
+            process_t diff = 0.0, total = 0.0;
+            for (int i = 0; i < bins; ++i) {
+                diff += fabs(mag[i] - m_studyPrevMag[i]);
+                total += mag[i] + m_studyPrevMag[i];
+            }
+            // Silence counts as stationary
+            if (total > 1.0e-6 * bins) {
+                m_studyFlux.push_back(float(diff / total));
+            } else {
+                m_studyFlux.push_back(0.f);
+            }
+        }
+
+        m_studyPrevMag.assign(mag, mag + bins);
+        offset += hopRegionSize;
+    }
+
+    m_studyMixdown.erase(m_studyMixdown.begin(),
+                         m_studyMixdown.begin() + offset);
+}
+
+void
+R3Stretcher::calculateHopScales()
+{
+    // A region gets half the usual hop if the spectrum changes
+    // sharply within it or either of its neighbours, as its frames
+    // overlap those of its neighbours, and twice the usual hop if it
+    // barely changes within two regions either side. The thresholds
+    // are for flux normalised to the range 0 to 1, and a steady
+    // noise comes out between them
+
+    const float transientFlux = 0.45f;
+    const float stationaryFlux = 0.1f;
+    
+    int regions = int(m_studyFlux.size());
+    m_hopScales = std::vector<float>(regions, 1.f);
+
+    int stationary = 0, transient = 0;
+    
+    for (int k = 0; k < regions; ++k) {
+        float nearMax = 0.f, wideMax = 0.f;
+        for (int j = std::max(k - 2, 0); j <= std::min(k + 2, regions - 1); ++j) {
+            if (j >= k - 1 && j <= k + 1) {
+                nearMax = std::max(nearMax, m_studyFlux[j]);
+            }
+            wideMax = std::max(wideMax, m_studyFlux[j]);
+        }
+        if (nearMax > transientFlux) {
+            m_hopScales[k] = 0.5f;
+            ++transient;
+        } else if (wideMax < stationaryFlux) {
+            m_hopScales[k] = 2.f;
+            ++stationary;
+        }
+    }
+
+    m_log.log(1, "R3Stretcher::calculateHopScales: hop regions", regions);
+    m_log.log(1, "R3Stretcher::calculateHopScales: stationary and transient regions", stationary, transient);
+
+    m_studyMixdown = std::vector<process_t>();
+    m_studyPrevMag = std::vector<process_t>();
+    m_studyFlux = std::vector<float>();
+}
+
+int
+R3Stretcher::chooseAdaptiveHop(int &inhop, double hopRatio) const
+{
+    // The frame about to be processed is centred on input sample
+    // m_consumedInputDuration, as the offline prefill pads by half a
+    // frame. Scale the fixed inhop for the region it falls in, but
+    // keep the outhop in the range calculateHop uses and the
+    // classification readahead within the frame; then take the
+    // outhop as the distance between rounded ideal output positions,
+    // so that the total output duration does not drift however the
+    // hop varies
+
+    int longest = m_guideConfiguration.longestFftSize;
+    int classify = m_guideConfiguration.classificationFftSize;
+    
+    inhop = m_inhop;
+
+    size_t region = m_consumedInputDuration / hopRegionSize;
+    if (region < m_hopScales.size() && m_hopScales[region] != 1.f) {
+        double ratio = getEffectiveRatio();
+        double lower = std::min(double(inhop), ceil(128.0 / ratio));
+        double upper = std::min(floor(512.0 / ratio),
+                                double(std::min(int(maxInhop),
+                                                (longest - classify) / 2)));
+        upper = std::max(upper, double(inhop));
+        double proposed = round(inhop * m_hopScales[region]);
+        if (proposed < lower) proposed = lower;
+        if (proposed > upper) proposed = upper;
+        if (proposed < 1.0) proposed = 1.0;
+        inhop = int(proposed);
+    }
+
+    return int(round(m_idealOutputPosition + inhop * hopRatio) -
+               round(m_idealOutputPosition));
 }
 
 void
@@ -492,6 +855,9 @@ R3Stretcher::getSamplesRequired() const
 {
     if (available() != 0) return 0;
     int longest = m_guideConfiguration.longestFftSize;
+    if (m_pipelined) {
+        longest += m_inhop;
+    }
     int rs = m_channelData[0]->inbuf->getReadSpace();
     if (rs < longest) {
         return longest - rs;
@@ -505,6 +871,9 @@ R3Stretcher::setMaxProcessSize(size_t n)
 {
     size_t oldSize = m_channelData[0]->inbuf->getSize();
     size_t newSize = m_guideConfiguration.longestFftSize + n;
+    if (m_pipelined) {
+        newSize += maxInhop;
+    }
 
     if (newSize > oldSize) {
         m_log.log(1, "setMaxProcessSize: resizing from and to", oldSize, newSize);
@@ -519,23 +888,37 @@ R3Stretcher::setMaxProcessSize(size_t n)
 
 void
 R3Stretcher::process(const float *const *input, size_t samples, bool final)
+{
+    processSome(input, samples, final, 0);
+}
+
+size_t
+R3Stretcher::processSome(const float *const *input, size_t samples,
+                         bool final, size_t maxHops)
 {
     if (m_mode == ProcessMode::Finished) {
+        if (samples == 0 && maxHops > 0) {
+            // Continuing to drain after a bounded final call
+            return consume(maxHops);
+        }
         m_log.log(0, "R3Stretcher::process: Cannot process again after final chunk");
-        return;
+        return 0;
     }
 
     if (!isRealTime()) {
 
         if (m_mode == ProcessMode::Studying) {
             m_totalTargetDuration =
-                size_t(round(m_studyInputDuration * m_timeRatio));
+                size_t(round(m_studyInputDuration * getOutputRatio()));
             m_log.log(1, "study duration and target duration",
                       m_studyInputDuration, m_totalTargetDuration);
+            if (isHopAdaptive()) {
+                calculateHopScales();
+            }
         } else if (m_mode == ProcessMode::JustCreated) {
             if (m_suppliedInputDuration != 0) {
                 m_totalTargetDuration =
-                    size_t(round(m_suppliedInputDuration * m_timeRatio));
+                    size_t(round(m_suppliedInputDuration * getOutputRatio()));
                 m_log.log(1, "supplied duration and target duration",
                           m_suppliedInputDuration, m_totalTargetDuration);
             }
@@ -553,7 +936,7 @@ R3Stretcher::process(const float *const *input, size_t samples, bool final)
         if (m_mode == ProcessMode::JustCreated ||
             m_mode == ProcessMode::Studying) {
 
-            if (m_pitchScale != 1.0 && !m_resampler) {
+            if (getResampleRatio() != 1.0 && !m_resampler) {
                 createResampler();
             }
 
@@ -569,7 +952,7 @@ R3Stretcher::process(const float *const *input, size_t samples, bool final)
 
             // NB by the time we skip this later we may have resampled
             // as well as stretched
-            m_startSkip = int(round(pad / m_pitchScale));
+            m_startSkip = int(round(pad * getResampleRatio()));
             m_log.log(1, "start skip is", m_startSkip);
         }
     }
@@ -594,11 +977,13 @@ R3Stretcher::process(const float *const *input, size_t samples, bool final)
         }
     }
 
-    for (int c = 0; c < m_parameters.channels; ++c) {
-        m_channelData[c]->inbuf->write(input[c], samples);
+    if (samples > 0) {
+        for (int c = 0; c < m_parameters.channels; ++c) {
+            m_channelData[c]->inbuf->write(input[c], samples);
+        }
     }
 
-    consume();
+    return consume(maxHops);
 }
 
 int
@@ -630,26 +1015,41 @@ R3Stretcher::retrieve(float *const *output, size_t samples) const
     return got;
 }
 
-void
-R3Stretcher::consume()
+size_t
+R3Stretcher::consume(size_t maxHops)
 {
+    Tracer::setHop(int64_t(m_hopCount));
+    Profiler profiler("R3Stretcher::consume");
+
     int longest = m_guideConfiguration.longestFftSize;
+    int classify = m_guideConfiguration.classificationFftSize;
     int channels = m_parameters.channels;
     int inhop = m_inhop;
 
-    double effectivePitchRatio = 1.0 / m_pitchScale;
+    double effectivePitchRatio = getResampleRatio();
     if (m_resampler) {
         effectivePitchRatio =
             m_resampler->getEffectiveRatio(effectivePitchRatio);
     }
     
-    int outhop = m_calculator->calculateSingle(m_timeRatio,
+    // With an adaptive hop, both hops are chosen afresh for each
+    // frame rather than once per call, and the calculator is not used
+    
+    bool adaptive = !m_hopScales.empty();
+    double hopRatio = getOutputRatio() / effectivePitchRatio;
+    
+    int outhop;
+    if (adaptive) {
+        outhop = chooseAdaptiveHop(inhop, hopRatio);
+    } else {
+        outhop = m_calculator->calculateSingle(getOutputRatio(),
                                                effectivePitchRatio,
                                                1.f,
                                                inhop,
                                                longest,
                                                longest,
                                                true);
+    }
 
     if (outhop < 1) {
         m_log.log(0, "R3Stretcher::consume: WARNING: outhop calculated as", outhop);
@@ -677,9 +1077,14 @@ R3Stretcher::consume()
     }
 
     auto &cd0 = m_channelData.at(0);
+    size_t hops = 0;
     
     while (cd0->outbuf->getWriteSpace() >= outhop) {
 
+        if (maxHops > 0 && hops >= maxHops) {
+            break;
+        }
+
         // NB our ChannelData, ScaleData, and ChannelScaleData maps
         // contain shared_ptrs; whenever we retain one of them in a
         // variable, we do so by reference to avoid copying the
@@ -687,7 +1092,11 @@ R3Stretcher::consume()
         // the map iterators
 
         int readSpace = cd0->inbuf->getReadSpace();
-        if (readSpace < longest) {
+        int required = longest;
+        if (m_pipelined) {
+            required += inhop;
+        }
+        if (readSpace < required) {
             if (m_mode == ProcessMode::Finished) {
                 if (readSpace == 0) {
                     int fill = cd0->scales.at(longest)->accumulatorFill;
@@ -703,16 +1112,88 @@ R3Stretcher::consume()
             }
         }
 
-        // Analysis
+        Tracer::setHop(int64_t(m_hopCount));
+
+        // Analysis. The guidance depends on the overlap between
+        // frames, which with an adaptive hop may differ either side
+        // of this one, so it must allow for the wider of the two
+
+        int guideOuthop = m_prevOuthop;
+        if (adaptive) {
+            guideOuthop = std::max(m_prevOuthop, outhop);
+        }
         
-        for (int c = 0; c < channels; ++c) {
-            analyseChannel(c, inhop, m_prevInhop, m_prevOuthop);
+        bool adopted = (m_pipelined && adoptPipelinedAnalysis(inhop));
+
+        if (m_pipelined) {
+            if (adopted) ++m_pipelineAdoptions;
+            if (++m_pipelineHops == 1000) {
+                reportPipeline();
+            }
+        }
+        
+        if (adopted) {
+            for (int c = 0; c < channels; ++c) {
+                guideChannel(c, guideOuthop);
+            }
+        } else {
+            for (int c = 0; c < channels; ++c) {
+                analyseChannel(c, inhop, m_prevInhop, guideOuthop);
+            }
+        }
+
+        // The classification scale has been analysed and the guidance
+        // updated; now analyse the other scales, skipping any that
+        // the guidance does not use for this frame. The map is
+        // ordered by FFT size, so the longest comes last as
+        // analyseScale requires. (Pipelined analysis has already
+        // done them all, but formant adjustment is still to do)
+        
+        for (auto &it : m_scaleData) {
+            int fftSize = it.first;
+            if (fftSize == classify || !isScaleInUse(fftSize)) {
+                continue;
+            }
+            for (int c = 0; c < channels; ++c) {
+                if (!adopted) {
+                    analyseScale(c, fftSize);
+                }
+                if (m_parameters.options &
+                    RubberBandStretcher::OptionFormantPreserved) {
+                    adjustFormant(c, fftSize);
+                }
+            }
         }
 
-        // Phase update. This is synchronised across all channels
+        // In pipelined mode, hand the following frame to the
+        // analysis thread so it can work on it while we resynthesise
+        // this one. We need the whole of the following frame, so this
+        // is not possible when draining
+        
+        if (m_pipelined && readSpace >= longest + inhop) {
+            requestPipelinedAnalysis(inhop);
+        }
+
+        // Phase update. This is synchronised across all channels.
+        // Scales that were not analysed for this frame are skipped
+        // too, and marked dormant. When a dormant scale comes back
+        // into use, its phase history is stale, so for that frame we
+        // phase-reset it across the whole range: it has been
+        // contributing nothing to the output, so the frame's own
+        // phases are the right ones to continue from
+
+        Profiler advanceProfiler("R3Stretcher::advancePhase");
         
         for (auto &it : m_channelData[0]->scales) {
             int fftSize = it.first;
+            auto &scaleData = m_scaleData.at(fftSize);
+            if (fftSize != classify && !isScaleInUse(fftSize)) {
+                if (!scaleData->dormant) {
+                    m_log.log(2, "scale going dormant", fftSize);
+                    scaleData->dormant = true;
+                }
+                continue;
+            }
             for (int c = 0; c < channels; ++c) {
                 auto &cd = m_channelData.at(c);
                 auto &scale = cd->scales.at(fftSize);
@@ -721,8 +1202,18 @@ R3Stretcher::consume()
                 m_channelAssembly.prevMag[c] = scale->prevMag.data();
                 m_channelAssembly.guidance[c] = &cd->guidance;
                 m_channelAssembly.outPhase[c] = scale->advancedPhase.data();
+                if (scaleData->dormant) {
+                    cd->reawakeningGuidance = cd->guidance;
+                    cd->reawakeningGuidance.phaseReset =
+                        Guide::Range(true, 0.0, m_parameters.sampleRate / 2.0);
+                    m_channelAssembly.guidance[c] = &cd->reawakeningGuidance;
+                }
+            }
+            if (scaleData->dormant) {
+                m_log.log(2, "scale reawakening", fftSize);
+                scaleData->dormant = false;
             }
-            m_scaleData.at(fftSize)->guided.advance
+            scaleData->guided.advance
                 (m_channelAssembly.outPhase.data(),
                  m_channelAssembly.mag.data(),
                  m_channelAssembly.phase.data(),
@@ -736,18 +1227,27 @@ R3Stretcher::consume()
         for (int c = 0; c < channels; ++c) {
             adjustPreKick(c);
         }
+
+        advanceProfiler.end();
+        
+        // Resynthesis. Each frame is weighted by the output duration
+        // it stands for, which when the hop varies is the mean of the
+        // outhops either side of it
         
-        // Resynthesis
+        double meanOuthop = outhop;
+        if (adaptive) {
+            meanOuthop = (m_prevOuthop + outhop) / 2.0;
+        }
         
         for (int c = 0; c < channels; ++c) {
-            synthesiseChannel(c, outhop, readSpace == 0);
+            synthesiseChannel(c, outhop, meanOuthop, readSpace == 0);
         }
         
         // Resample
 
         bool resampling = false;
         if (m_resampler) {
-            if (m_pitchScale != 1.0 ||
+            if (getResampleRatio() != 1.0 ||
                 (m_parameters.options &
                  RubberBandStretcher::OptionPitchHighConsistency)) {
                 resampling = true;
@@ -756,6 +1256,7 @@ R3Stretcher::consume()
         
         int resampledCount = 0;
         if (resampling) {
+            Profiler resampleProfiler("R3Stretcher::resample");
             for (int c = 0; c < channels; ++c) {
                 auto &cd = m_channelData.at(c);
                 m_channelAssembly.mixdown[c] = cd->mixdown.data();
@@ -766,7 +1267,7 @@ R3Stretcher::consume()
                  m_channelData[0]->resampled.size(),
                  m_channelAssembly.mixdown.data(),
                  outhop,
-                 1.0 / m_pitchScale,
+                 getResampleRatio(),
                  m_mode == ProcessMode::Finished && readSpace < inhop);
         }
 
@@ -821,17 +1322,30 @@ R3Stretcher::consume()
         
         m_prevInhop = inhop;
         m_prevOuthop = outhop;
+
+        if (adaptive) {
+            m_idealOutputPosition += inhop * hopRatio;
+            outhop = chooseAdaptiveHop(inhop, hopRatio);
+            if (outhop < 1) outhop = 1;
+        }
+
+        ++hops;
+        ++m_hopCount;
     }
+
+    return hops;
 }
 
 void
 R3Stretcher::analyseChannel(int c, int inhop, int prevInhop, int prevOuthop)
 {
+    Profiler profiler("R3Stretcher::analyseChannel");
+
     int longest = m_guideConfiguration.longestFftSize;
     int classify = m_guideConfiguration.classificationFftSize;
 
     auto &cd = m_channelData.at(c);
-    process_t *buf = cd->scales.at(longest)->timeDomain.data();
+    process_t *buf = cd->frame.data();
 
     int readSpace = cd->inbuf->getReadSpace();
     if (readSpace < longest) {
@@ -842,55 +1356,39 @@ R3Stretcher::analyseChannel(int c, int inhop, int prevInhop, int prevOuthop)
     }
     
     // We have a single unwindowed frame at the longest FFT size
-    // ("scale"). Populate the shorter FFT sizes from the centre of
-    // it, windowing as we copy. The classification scale is handled
-    // separately because it has readahead, so skip it here as well as
-    // the longest. (In practice this means we are probably only
-    // populating one scale)
-
-    for (auto &it: cd->scales) {
-        int fftSize = it.first;
-        if (fftSize == classify || fftSize == longest) continue;
-        int offset = (longest - fftSize) / 2;
-        m_scaleData.at(fftSize)->analysisWindow.cut
-            (buf + offset, it.second->timeDomain.data());
-    }
+    // ("scale"). Here we analyse only the classification scale, which
+    // is always needed as it drives the guidance. The others are
+    // populated from the same frame by analyseScale, once the
+    // guidance has shown whether they will be used at all.
 
     // The classification scale has a one-hop readahead, so populate
     // the readahead from further down the long unwindowed frame.
 
     auto &classifyScale = cd->scales.at(classify);
     ClassificationReadaheadData &readahead = cd->readahead;
+    ScratchData &scratch = *m_scratch;
 
-    m_scaleData.at(classify)->analysisWindow.cut
+    m_scaleData.at(classify)->analysisWindow->cutAndShift
         (buf + (longest - classify) / 2 + inhop,
-         readahead.timeDomain.data());
-
-    // If inhop has changed since the previous frame, we'll have to
-    // populate the classification scale (but for analysis/resynthesis
-    // rather than classification) anew rather than reuse the previous
-    // readahead. Pity...
+         scratch.timeDomain.data());
 
-    bool haveValidReadahead = cd->haveReadahead;
-    if (inhop != prevInhop) haveValidReadahead = false;
+    // The previous frame's readahead was taken from one hop further
+    // along, so it is this frame's classification scale (for
+    // analysis/resynthesis rather than classification) if that is
+    // the hop we have since advanced by - whether or not the hop is
+    // changing now. If not, we'll have to populate it anew
 
-    if (!haveValidReadahead) {
-        m_scaleData.at(classify)->analysisWindow.cut
-            (buf + (longest - classify) / 2,
-             classifyScale->timeDomain.data());
-    }
+    bool haveValidReadahead =
+        (cd->haveReadahead && cd->readaheadInhop == prevInhop);
             
-    // Finally window the longest scale
-    m_scaleData.at(longest)->analysisWindow.cut(buf);
-
-    // FFT shift, forward FFT, and carry out cartesian-polar
-    // conversion for each FFT size.
+    // Forward FFT (the frames were shifted as they were windowed),
+    // and carry out cartesian-polar conversion.
 
     // For the classification scale we need magnitudes for the full
     // range (polar only in a subset) and we operate in the readahead,
     // pulling current values from the existing readahead (except
-    // where the inhop has changed as above, in which case we need to
-    // do both readahead and current)
+    // where it is not valid as above, in which case we need to do
+    // both readahead and current)
 
     if (haveValidReadahead) {
         v_copy(classifyScale->mag.data(),
@@ -901,10 +1399,9 @@ R3Stretcher::analyseChannel(int c, int inhop, int prevInhop, int prevOuthop)
                classifyScale->bufSize);
     }
 
-    v_fftshift(readahead.timeDomain.data(), classify);
-    m_scaleData.at(classify)->fft.forward(readahead.timeDomain.data(),
-                                          classifyScale->real.data(),
-                                          classifyScale->imag.data());
+    m_scaleData.at(classify)->fft.forward(scratch.timeDomain.data(),
+                                          scratch.real.data(),
+                                          scratch.imag.data());
 
     for (const auto &b : m_guideConfiguration.fftBandLimits) {
         if (b.fftSize == classify) {
@@ -916,8 +1413,8 @@ R3Stretcher::analyseChannel(int c, int inhop, int prevInhop, int prevOuthop)
             spec.polarBinCount = b.b1max - b.b0min + 1;
             convertToPolar(readahead.mag.data(),
                            readahead.phase.data(),
-                           classifyScale->real.data(),
-                           classifyScale->imag.data(),
+                           scratch.real.data(),
+                           scratch.imag.data(),
                            spec);
                     
             v_scale(classifyScale->mag.data(),
@@ -928,81 +1425,168 @@ R3Stretcher::analyseChannel(int c, int inhop, int prevInhop, int prevOuthop)
     }
 
     cd->haveReadahead = true;
+    cd->readaheadInhop = inhop;
 
-    // For the others (and the classify as well, if the inhop has
-    // changed or we haven't filled the readahead yet) we operate
-    // directly in the scale data and restrict the range for
-    // cartesian-polar conversion
-            
-    for (auto &it: cd->scales) {
-        int fftSize = it.first;
-        if (fftSize == classify && haveValidReadahead) {
-            continue;
-        }
-        
-        auto &scale = it.second;
+    // If the readahead was not valid or we haven't filled it yet,
+    // analyse the current frame for the classification scale
+    // as well. We always want the full range of magnitudes here (but
+    // not necessarily of phases), as all of them are potentially
+    // relevant to classification and formant analysis
+
+    if (!haveValidReadahead) {
 
-        v_fftshift(scale->timeDomain.data(), fftSize);
+        m_scaleData.at(classify)->analysisWindow->cutAndShift
+            (buf + (longest - classify) / 2,
+             scratch.timeDomain.data());
 
-        m_scaleData.at(fftSize)->fft.forward(scale->timeDomain.data(),
-                                             scale->real.data(),
-                                             scale->imag.data());
+        m_scaleData.at(classify)->fft.forward(scratch.timeDomain.data(),
+                                              scratch.real.data(),
+                                              scratch.imag.data());
 
         for (const auto &b : m_guideConfiguration.fftBandLimits) {
-            if (b.fftSize == fftSize) {
+            if (b.fftSize == classify) {
 
                 ToPolarSpec spec;
-
-                // For the classify scale we always want the full
-                // range, as all the magnitudes (though not
-                // necessarily all phases) are potentially relevant to
-                // classification and formant analysis. But this case
-                // here only happens if we don't haveValidReadahead -
-                // the normal case is above and just copies from the
-                // previous readahead.
-                if (fftSize == classify) {
-                    spec.magFromBin = 0;
-                    spec.magBinCount = classify/2 + 1;
-                    spec.polarFromBin = b.b0min;
-                    spec.polarBinCount = b.b1max - b.b0min + 1;
-                } else {
-                    spec.magFromBin = b.b0min;
-                    spec.magBinCount = b.b1max - b.b0min + 1;
-                    spec.polarFromBin = spec.magFromBin;
-                    spec.polarBinCount = spec.magBinCount;
-                }
-
-                convertToPolar(scale->mag.data(),
-                               scale->phase.data(),
-                               scale->real.data(),
-                               scale->imag.data(),
+                spec.magFromBin = 0;
+                spec.magBinCount = classify/2 + 1;
+                spec.polarFromBin = b.b0min;
+                spec.polarBinCount = b.b1max - b.b0min + 1;
+
+                convertToPolar(classifyScale->mag.data(),
+                               classifyScale->phase.data(),
+                               scratch.real.data(),
+                               scratch.imag.data(),
                                spec);
 
-                v_scale(scale->mag.data() + spec.magFromBin,
-                        1.0 / double(fftSize),
+                v_scale(classifyScale->mag.data(),
+                        1.0 / double(classify),
                         spec.magBinCount);
-                
                 break;
             }
         }
     }
 
+    guideChannel(c, prevOuthop);
+}
+
+void
+R3Stretcher::analyseScale(int c, int fftSize)
+{
+    // Analyse a scale other than the classification one, from the
+    // unwindowed frame left in the channel's frame buffer by
+    // analyseChannel.
+
+    Profiler profiler("R3Stretcher::analyseScale");
+    
+    int longest = m_guideConfiguration.longestFftSize;
+
+    auto &cd = m_channelData.at(c);
+    auto &scale = cd->scales.at(fftSize);
+    auto &scaleData = m_scaleData.at(fftSize);
+    ScratchData &scratch = *m_scratch;
+
+    scaleData->analysisWindow->cutAndShift
+        (cd->frame.data() + (longest - fftSize) / 2,
+         scratch.timeDomain.data());
+
+    if (scaleData->bandFft) {
+        scaleData->bandFft->forward(scratch.timeDomain.data(),
+                                    scratch.real.data(),
+                                    scratch.imag.data());
+    } else {
+        scaleData->fft.forward(scratch.timeDomain.data(),
+                               scratch.real.data(),
+                               scratch.imag.data());
+    }
+
+    for (const auto &b : m_guideConfiguration.fftBandLimits) {
+        if (b.fftSize == fftSize) {
+
+            ToPolarSpec spec;
+            spec.magFromBin = b.b0min;
+            spec.magBinCount = b.b1max - b.b0min + 1;
+            spec.polarFromBin = spec.magFromBin;
+            spec.polarBinCount = spec.magBinCount;
+
+            convertToPolar(scale->mag.data(),
+                           scale->phase.data(),
+                           scratch.real.data(),
+                           scratch.imag.data(),
+                           spec);
+
+            v_scale(scale->mag.data() + spec.magFromBin,
+                    1.0 / double(fftSize),
+                    spec.magBinCount);
+                
+            break;
+        }
+    }
+}
+
+bool
+R3Stretcher::isScaleInUse(int fftSize) const
+{
+    // A scale is in use for this frame if any channel's guidance has
+    // a non-empty frequency band for it. Bands are empty for silent
+    // frames, for unity ratio in offline mode, and for the shortest
+    // scale when the output hop is long
+    
+    for (const auto &cd : m_channelData) {
+        for (const auto &band : cd->guidance.fftBands) {
+            if (band.fftSize == fftSize && band.f1 > band.f0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void
+R3Stretcher::guideChannel(int c, int prevOuthop)
+{
+    int classify = m_guideConfiguration.classificationFftSize;
+
+    auto &cd = m_channelData.at(c);
+    auto &classifyScale = cd->scales.at(classify);
+    ClassificationReadaheadData &readahead = cd->readahead;
+    
     if (m_parameters.options & RubberBandStretcher::OptionFormantPreserved) {
         analyseFormant(c);
-        adjustFormant(c);
+        adjustFormant(c, classify);
     }
         
     // Use the classification scale to get a bin segmentation and
-    // calculate the adaptive frequency guide for this channel
+    // calculate the adaptive frequency guide for this channel. If the
+    // readahead has barely changed since it was last classified, we
+    // may take its classification to be unchanged as well
 
     v_copy(cd->classification.data(), cd->nextClassification.data(),
            cd->classification.size());
-    cd->classifier->classify(readahead.mag.data(),
-                             cd->nextClassification.data());
 
     cd->prevSegmentation = cd->segmentation;
     cd->segmentation = cd->nextSegmentation;
-    cd->nextSegmentation = cd->segmenter->segment(cd->nextClassification.data());
+
+    if (canReuseClassification(c)) {
+        ++cd->classificationReuseCount;
+        ++m_classificationReuses;
+    } else {
+        cd->classifier->classify(readahead.mag.data(),
+                                 cd->nextClassification.data());
+        cd->nextSegmentation =
+            cd->segmenter->segment(cd->nextClassification.data());
+        v_copy(cd->classifiedMag.data(), readahead.mag.data(),
+               cd->classifiedMag.size());
+        cd->classificationReuseCount = 0;
+    }
+
+    if (++m_classificationHops == 1000) {
+        if (m_parameters.options &
+            RubberBandStretcher::OptionClassifyAdaptive) {
+            m_log.log(2, "R3Stretcher::guideChannel: classification reused for channel-hops (reused, of)", m_classificationReuses, m_classificationHops);
+        }
+        m_classificationHops = 0;
+        m_classificationReuses = 0;
+    }
 /*
     if (c == 0) {
         double pb = cd->nextSegmentation.percussiveBelow;
@@ -1064,6 +1648,280 @@ R3Stretcher::analyseChannel(int c, int inhop, int prevInhop, int prevOuthop)
 */
 }
 
+bool
+R3Stretcher::canReuseClassification(int c)
+{
+    if (!(m_parameters.options &
+          RubberBandStretcher::OptionClassifyAdaptive)) {
+        return false;
+    }
+    
+    auto &cd = m_channelData.at(c);
+    if (cd->classificationReuseCount >= maxClassificationReuse) {
+        return false;
+    }
+
+    // Compare the readahead against the magnitudes that were last
+    // classified, in two ways. The spectral flux, normalised by their
+    // total, catches broad changes in level or balance. But a quiet
+    // onset over loud sustained tones barely moves that total, so we
+    // also count the bins that have risen by more than 3dB, as R2's
+    // percussive curve does, ignoring bins too far below the mean to
+    // matter. An onset anywhere in the spectrum raises many bins at
+    // once, so percussive frames (and the frames before them, for the
+    // pre-kick) are always classified
+
+    const process_t fluxThreshold = 0.05;
+    const process_t riseRatio = 1.41; // 3dB in power
+    const process_t floorRatio = 0.01;
+    
+    const process_t *const R__ mag = cd->readahead.mag.data();
+    const process_t *const R__ ref = cd->classifiedMag.data();
+    const int n = int(cd->classifiedMag.size());
+
+    process_t flux = 0.0, total = 0.0;
+    for (int i = 0; i < n; ++i) {
+        flux += fabs(mag[i] - ref[i]);
+        total += mag[i] + ref[i];
+    }
+
+    const process_t floor = floorRatio * total / (2 * n);
+    int rising = 0;
+    for (int i = 0; i < n; ++i) {
+        if (mag[i] > floor && mag[i] > ref[i] * riseRatio) {
+            ++rising;
+        }
+    }
+
+    if (flux > fluxThreshold * total || rising * 8 > n) {
+        m_log.log(3, "R3Stretcher::canReuseClassification: reclassifying at input sample (sample, rising bins)",
+                  double(m_consumedInputDuration), double(rising));
+        return false;
+    }
+
+    return true;
+}
+
+void
+R3Stretcher::requestPipelinedAnalysis(int inhop)
+{
+    // Called from consume() on the processing thread, with the
+    // current hop still at the start of the input buffers. Copy the
+    // current and following frames for the analysis thread and ask it
+    // to analyse the following one.
+    
+    if (m_pipelineState != PipelineState::Idle) {
+        return;
+    }
+
+    int longest = m_guideConfiguration.longestFftSize;
+    
+    for (int c = 0; c < m_parameters.channels; ++c) {
+        auto &cd = m_channelData.at(c);
+        auto &pcd = m_pipelineChannelData.at(c);
+        cd->inbuf->peek(pcd->frame.data(), longest + inhop);
+    }
+
+    m_pipelineInhop = inhop;
+    m_pipelineHop = m_hopCount + 1;
+    m_pipelineState = PipelineState::Requested;
+
+#ifndef NO_THREADING
+    m_analysisThread->signalDataAvailable();
+#endif
+}
+
+void
+R3Stretcher::analysePipelined()
+{
+    // Called on the analysis thread. This is the equivalent of
+    // analyseChannel() for the hop following the one being
+    // resynthesised, and it writes only to the pipeline data.
+
+    Tracer::setHop(int64_t(m_pipelineHop));
+    Profiler profiler("R3Stretcher::analysePipelined");
+    
+    int longest = m_guideConfiguration.longestFftSize;
+    int classify = m_guideConfiguration.classificationFftSize;
+    int inhop = m_pipelineInhop;
+    ScratchData &scratch = *m_pipelineScratch;
+
+    for (int c = 0; c < m_parameters.channels; ++c) {
+
+        auto &pcd = m_pipelineChannelData.at(c);
+        const process_t *frame = pcd->frame.data() + inhop;
+
+        // Classification readahead, one hop beyond the frame
+
+        m_scaleData.at(classify)->analysisWindow->cutAndShift
+            (frame + (longest - classify) / 2 + inhop,
+             scratch.timeDomain.data());
+
+        m_pipelineFfts.at(classify)->forward(scratch.timeDomain.data(),
+                                             scratch.real.data(),
+                                             scratch.imag.data());
+
+        for (const auto &b : m_guideConfiguration.fftBandLimits) {
+            if (b.fftSize == classify) {
+                ToPolarSpec spec;
+                spec.magFromBin = 0;
+                spec.magBinCount = classify/2 + 1;
+                spec.polarFromBin = b.b0min;
+                spec.polarBinCount = b.b1max - b.b0min + 1;
+                convertToPolar(pcd->readahead.mag.data(),
+                               pcd->readahead.phase.data(),
+                               scratch.real.data(),
+                               scratch.imag.data(),
+                               spec);
+                break;
+            }
+        }
+
+        // Then the other scales, from the centre of the frame. The
+        // classification scale itself will be taken from the
+        // existing readahead when this result is adopted
+        
+        for (const auto &b : m_guideConfiguration.fftBandLimits) {
+            int fftSize = b.fftSize;
+            if (fftSize == classify) continue;
+
+            auto &scale = pcd->scales.at(fftSize);
+            
+            m_scaleData.at(fftSize)->analysisWindow->cutAndShift
+                (frame + (longest - fftSize) / 2, scratch.timeDomain.data());
+
+            auto bit = m_pipelineBandFfts.find(fftSize);
+            if (bit != m_pipelineBandFfts.end()) {
+                bit->second->forward(scratch.timeDomain.data(),
+                                     scratch.real.data(),
+                                     scratch.imag.data());
+            } else {
+                m_pipelineFfts.at(fftSize)->forward(scratch.timeDomain.data(),
+                                                    scratch.real.data(),
+                                                    scratch.imag.data());
+            }
+
+            ToPolarSpec spec;
+            spec.magFromBin = b.b0min;
+            spec.magBinCount = b.b1max - b.b0min + 1;
+            spec.polarFromBin = spec.magFromBin;
+            spec.polarBinCount = spec.magBinCount;
+            
+            convertToPolar(scale->mag.data(),
+                           scale->phase.data(),
+                           scratch.real.data(),
+                           scratch.imag.data(),
+                           spec);
+            
+            v_scale(scale->mag.data() + spec.magFromBin,
+                    1.0 / double(fftSize),
+                    spec.magBinCount);
+        }
+    }
+}
+
+bool
+R3Stretcher::adoptPipelinedAnalysis(int inhop)
+{
+    // Called from consume() in place of analyseChannel(). If the
+    // analysis thread has finished with the current hop, copy its
+    // results into the channel data and return true; otherwise
+    // return false and the caller analyses synchronously. We never
+    // wait here, as that would defeat the purpose.
+    
+    if (m_pipelineState != PipelineState::Ready) {
+        return false;
+    }
+
+    bool valid = (m_pipelineHop == m_hopCount &&
+                  m_pipelineInhop == inhop);
+    
+    for (int c = 0; c < m_parameters.channels; ++c) {
+        auto &cd = m_channelData.at(c);
+        if (!cd->haveReadahead || cd->readaheadInhop != m_prevInhop) {
+            valid = false;
+        }
+    }
+
+    if (!valid) {
+        m_log.log(2, "R3Stretcher::adoptPipelinedAnalysis: discarding stale result for hop", double(m_pipelineHop));
+        m_pipelineState = PipelineState::Idle;
+        return false;
+    }
+    
+    int classify = m_guideConfiguration.classificationFftSize;
+
+    for (int c = 0; c < m_parameters.channels; ++c) {
+
+        auto &cd = m_channelData.at(c);
+        auto &pcd = m_pipelineChannelData.at(c);
+        
+        for (const auto &b : m_guideConfiguration.fftBandLimits) {
+
+            int fftSize = b.fftSize;
+            auto &scale = cd->scales.at(fftSize);
+            int polarCount = b.b1max - b.b0min + 1;
+            
+            if (fftSize == classify) {
+                v_copy(scale->mag.data(),
+                       cd->readahead.mag.data(),
+                       scale->bufSize);
+                v_copy(scale->phase.data(),
+                       cd->readahead.phase.data(),
+                       scale->bufSize);
+                v_copy(cd->readahead.mag.data(),
+                       pcd->readahead.mag.data(),
+                       scale->bufSize);
+                v_copy(cd->readahead.phase.data() + b.b0min,
+                       pcd->readahead.phase.data() + b.b0min,
+                       polarCount);
+                v_scale(scale->mag.data(),
+                        1.0 / double(classify),
+                        scale->mag.size());
+                cd->readaheadInhop = inhop;
+            } else {
+                auto &pending = pcd->scales.at(fftSize);
+                v_copy(scale->mag.data() + b.b0min,
+                       pending->mag.data() + b.b0min,
+                       polarCount);
+                v_copy(scale->phase.data() + b.b0min,
+                       pending->phase.data() + b.b0min,
+                       polarCount);
+            }
+        }
+    }
+
+    m_pipelineState = PipelineState::Idle;
+    return true;
+}
+
+void
+R3Stretcher::waitForPipeline()
+{
+#ifndef NO_THREADING
+    if (!m_analysisThread) return;
+    // Setting m_pipelineWaiting before testing the state, where the
+    // analysis thread sets the state before testing m_pipelineWaiting,
+    // ensures it posts if we go on to wait. It may also post when we
+    // don't, and that stale post is absorbed by the loop next time
+    m_pipelineWaiting = true;
+    while (m_pipelineState == PipelineState::Requested) {
+        m_pipelineDone.wait();
+    }
+    m_pipelineWaiting = false;
+#endif
+}
+
+void
+R3Stretcher::reportPipeline()
+{
+    if (m_pipelined && m_pipelineHops > 0) {
+        m_log.log(2, "R3Stretcher: pipelined analysis adopted for hops (adopted, of)", m_pipelineAdoptions, m_pipelineHops);
+    }
+    m_pipelineHops = 0;
+    m_pipelineAdoptions = 0;
+}
+
 void
 R3Stretcher::analyseFormant(int c)
 {
@@ -1088,7 +1946,9 @@ R3Stretcher::analyseFormant(int c)
     }
     v_scale(f.cepstra.data(), 1.0 / double(fftSize), cutoff);
 
-    scaleData->fft.forward(f.cepstra.data(), f.envelope.data(), f.spare.data());
+    // The imaginary output is all but zero, and not needed
+    scaleData->fft.forward(f.cepstra.data(), f.envelope.data(),
+                           m_scratch->imag.data());
 
     v_exp(f.envelope.data(), binCount);
     v_square(f.envelope.data(), binCount);
@@ -1099,34 +1959,29 @@ R3Stretcher::analyseFormant(int c)
 }
 
 void
-R3Stretcher::adjustFormant(int c)
+R3Stretcher::adjustFormant(int c, int fftSize)
 {
     auto &cd = m_channelData.at(c);
+    auto &scale = cd->scales.at(fftSize);
         
-    for (auto &it : cd->scales) {
-        
-        int fftSize = it.first;
-        auto &scale = it.second;
-
-        int highBin = int(floor(fftSize * 10000.0 / m_parameters.sampleRate));
-        process_t targetFactor = process_t(cd->formant->fftSize) / process_t(fftSize);
-        process_t formantScale = m_formantScale;
-        if (formantScale == 0.0) formantScale = 1.0 / m_pitchScale;
-        process_t sourceFactor = targetFactor / formantScale;
-        process_t maxRatio = 60.0;
-        process_t minRatio = 1.0 / maxRatio;
+    int highBin = int(floor(fftSize * 10000.0 / m_parameters.sampleRate));
+    process_t targetFactor = process_t(cd->formant->fftSize) / process_t(fftSize);
+    process_t formantScale = m_formantScale;
+    if (formantScale == 0.0) formantScale = 1.0 / m_pitchScale;
+    process_t sourceFactor = targetFactor / formantScale;
+    process_t maxRatio = 60.0;
+    process_t minRatio = 1.0 / maxRatio;
 
-        for (const auto &b : m_guideConfiguration.fftBandLimits) {
-            if (b.fftSize != fftSize) continue;
-            for (int i = b.b0min; i < b.b1max && i < highBin; ++i) {
-                process_t source = cd->formant->envelopeAt(i * sourceFactor);
-                process_t target = cd->formant->envelopeAt(i * targetFactor);
-                if (target > 0.0) {
-                    process_t ratio = source / target;
-                    if (ratio < minRatio) ratio = minRatio;
-                    if (ratio > maxRatio) ratio = maxRatio;
-                    scale->mag[i] *= ratio;
-                }
+    for (const auto &b : m_guideConfiguration.fftBandLimits) {
+        if (b.fftSize != fftSize) continue;
+        for (int i = b.b0min; i < b.b1max && i < highBin; ++i) {
+            process_t source = cd->formant->envelopeAt(i * sourceFactor);
+            process_t target = cd->formant->envelopeAt(i * targetFactor);
+            if (target > 0.0) {
+                process_t ratio = source / target;
+                if (ratio < minRatio) ratio = minRatio;
+                if (ratio > maxRatio) ratio = maxRatio;
+                scale->mag[i] *= ratio;
             }
         }
     }
@@ -1164,11 +2019,15 @@ R3Stretcher::adjustPreKick(int c)
 }
 
 void
-R3Stretcher::synthesiseChannel(int c, int outhop, bool draining)
+R3Stretcher::synthesiseChannel(int c, int outhop, double meanOuthop,
+                               bool draining)
 {
+    Profiler profiler("R3Stretcher::synthesiseChannel");
+
     int longest = m_guideConfiguration.longestFftSize;
 
     auto &cd = m_channelData.at(c);
+    ScratchData &scratch = *m_scratch;
         
     for (const auto &band : cd->guidance.fftBands) {
         int fftSize = band.fftSize;
@@ -1180,7 +2039,7 @@ R3Stretcher::synthesiseChannel(int c, int outhop, bool draining)
                scale->mag.data(),
                scale->bufSize);
 
-        process_t winscale = process_t(outhop) / scaleData->windowScaleFactor;
+        process_t winscale = process_t(meanOuthop) / scaleData->windowScaleFactor;
 
         // The frequency filter is applied naively in the frequency
         // domain. Aliasing is reduced by the shorter resynthesis
@@ -1192,29 +2051,33 @@ R3Stretcher::synthesiseChannel(int c, int outhop, bool draining)
         int highBin = binForFrequency(band.f1, fftSize, m_parameters.sampleRate);
         if (highBin % 2 == 0 && highBin > 0) --highBin;
 
+        // An empty band would resynthesise to silence, and the scale
+        // has not been analysed for this frame anyway
+        if (highBin <= lowBin) continue;
+        
         if (lowBin > 0) {
-            v_zero(scale->real.data(), lowBin);
-            v_zero(scale->imag.data(), lowBin);
+            v_zero(scratch.real.data(), lowBin);
+            v_zero(scratch.imag.data(), lowBin);
         }
 
         v_scale(scale->mag.data() + lowBin, winscale, highBin - lowBin);
 
-        v_polar_to_cartesian(scale->real.data() + lowBin,
-                             scale->imag.data() + lowBin,
+        v_polar_to_cartesian(scratch.real.data() + lowBin,
+                             scratch.imag.data() + lowBin,
                              scale->mag.data() + lowBin,
                              scale->advancedPhase.data() + lowBin,
                              highBin - lowBin);
         
         if (highBin < scale->bufSize) {
-            v_zero(scale->real.data() + highBin, scale->bufSize - highBin);
-            v_zero(scale->imag.data() + highBin, scale->bufSize - highBin);
+            v_zero(scratch.real.data() + highBin, scale->bufSize - highBin);
+            v_zero(scratch.imag.data() + highBin, scale->bufSize - highBin);
         }
 
-        scaleData->fft.inverse(scale->real.data(),
-                               scale->imag.data(),
-                               scale->timeDomain.data());
+        scaleData->fft.inverse(scratch.real.data(),
+                               scratch.imag.data(),
+                               scratch.timeDomain.data());
         
-        v_fftshift(scale->timeDomain.data(), fftSize);
+        v_fftshift(scratch.timeDomain.data(), fftSize);
 
         // Synthesis window may be shorter than analysis window, so
         // copy and cut only from the middle of the time-domain frame;
@@ -1222,12 +2085,12 @@ R3Stretcher::synthesiseChannel(int c, int outhop, bool draining)
         // size, so as to make mixing straightforward, so there is an
         // additional offset needed for the target
                 
-        int synthesisWindowSize = scaleData->synthesisWindow.getSize();
+        int synthesisWindowSize = scaleData->synthesisWindow->getSize();
         int fromOffset = (fftSize - synthesisWindowSize) / 2;
         int toOffset = (longest - synthesisWindowSize) / 2;
 
-        scaleData->synthesisWindow.cutAndAdd
-            (scale->timeDomain.data() + fromOffset,
+        scaleData->synthesisWindow->cutAndAdd
+            (scratch.timeDomain.data() + fromOffset,
              scale->accumulator.data() + toOffset);
     }
 
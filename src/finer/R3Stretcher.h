@@ -32,16 +32,20 @@
 #include "../common/StretchCalculator.h"
 #include "../common/Resampler.h"
 #include "../common/FFT.h"
+#include "../common/BandLimitedFFT.h"
 #include "../common/FixedVector.h"
 #include "../common/Allocators.h"
 #include "../common/Window.h"
 #include "../common/VectorOpsComplex.h"
 #include "../common/Log.h"
+#include "../common/Thread.h"
 
 #include "../../rubberband/RubberBandStretcher.h"
 
 #include <map>
+#include <set>
 #include <memory>
+#include <atomic>
 
 namespace RubberBand
 {
@@ -58,17 +62,24 @@ public:
             sampleRate(_sampleRate), channels(_channels), options(_options) { }
     };
     
+    /**
+     * If a prototype is given, it must have the same parameters; its
+     * analysis and synthesis windows are then shared rather than
+     * recalculated. The prototype need not outlive this stretcher.
+     */
     R3Stretcher(Parameters parameters,
                 double initialTimeRatio,
                 double initialPitchScale,
-                Log log);
-    ~R3Stretcher() { }
+                Log log,
+                const R3Stretcher *prototype = nullptr);
+    ~R3Stretcher();
 
     void reset();
     
     void setTimeRatio(double ratio);
     void setPitchScale(double scale);
     void setFormantScale(double scale);
+    void setOutputSampleRate(double rate);
 
     double getTimeRatio() const;
     double getPitchScale() const;
@@ -82,6 +93,8 @@ public:
     void study(const float *const *input, size_t samples, bool final);
     size_t getSamplesRequired() const;
     void process(const float *const *input, size_t samples, bool final);
+    size_t processSome(const float *const *input, size_t samples, bool final,
+                       size_t maxHops);
     int available() const;
     size_t retrieve(float *const *output, size_t samples) const;
 
@@ -102,13 +115,37 @@ public:
         m_calculator->setDebugLevel(level);
     }
 
+    /**
+     * Return the FFT sizes used by the guide's scales at the given
+     * sample rate, for FFT implementation tuning.
+     */
+    static std::set<int> getFftSizes(size_t sampleRate, Log log);
+
 protected:
-    struct ClassificationReadaheadData {
+    struct ScratchData {
+        // Transient buffers for a forward or inverse FFT and the
+        // polar conversion either side of it. Nothing here outlives
+        // the analysis or resynthesis of a single scale for a single
+        // channel, so one set, sized for the longest FFT, is shared
+        // by all channels and scales processed on the same thread
         FixedVector<process_t> timeDomain;
+        FixedVector<process_t> real;
+        FixedVector<process_t> imag;
+        ScratchData(int longestFftSize) :
+            timeDomain(longestFftSize, 0.f),
+            real(longestFftSize/2 + 1, 0.f),
+            imag(longestFftSize/2 + 1, 0.f)
+        { }
+
+    private:
+        ScratchData(const ScratchData &) =delete;
+        ScratchData &operator=(const ScratchData &) =delete;
+    };
+
+    struct ClassificationReadaheadData {
         FixedVector<process_t> mag;
         FixedVector<process_t> phase;
         ClassificationReadaheadData(int _fftSize) :
-            timeDomain(_fftSize, 0.f),
             mag(_fftSize/2 + 1, 0.f),
             phase(_fftSize/2 + 1, 0.f)
         { }
@@ -121,9 +158,6 @@ protected:
     struct ChannelScaleData {
         int fftSize;
         int bufSize; // size of every freq-domain array here: fftSize/2 + 1
-        FixedVector<process_t> timeDomain;
-        FixedVector<process_t> real;
-        FixedVector<process_t> imag;
         FixedVector<process_t> mag;
         FixedVector<process_t> phase;
         FixedVector<process_t> advancedPhase;
@@ -135,9 +169,6 @@ protected:
         ChannelScaleData(int _fftSize, int _longestFftSize) :
             fftSize(_fftSize),
             bufSize(fftSize/2 + 1),
-            timeDomain(fftSize, 0.f),
-            real(bufSize, 0.f),
-            imag(bufSize, 0.f),
             mag(bufSize, 0.f),
             phase(bufSize, 0.f),
             advancedPhase(bufSize, 0.f),
@@ -162,13 +193,11 @@ protected:
         int fftSize;
         FixedVector<process_t> cepstra;
         FixedVector<process_t> envelope;
-        FixedVector<process_t> spare;
 
         FormantData(int _fftSize) :
             fftSize(_fftSize),
             cepstra(_fftSize, 0.0),
-            envelope(_fftSize/2 + 1, 0.0),
-            spare(_fftSize/2 + 1, 0.0) { }
+            envelope(_fftSize/2 + 1, 0.0) { }
 
         process_t envelopeAt(process_t bin) const {
             int b0 = int(floor(bin)), b1 = int(ceil(bin));
@@ -185,8 +214,10 @@ protected:
 
     struct ChannelData {
         std::map<int, std::shared_ptr<ChannelScaleData>> scales;
+        FixedVector<process_t> frame; // unwindowed, longest FFT size
         ClassificationReadaheadData readahead;
         bool haveReadahead;
+        int readaheadInhop; // offset of readahead from its frame
         std::unique_ptr<BinClassifier> classifier;
         FixedVector<BinClassifier::Classification> classification;
         FixedVector<BinClassifier::Classification> nextClassification;
@@ -194,7 +225,10 @@ protected:
         BinSegmenter::Segmentation segmentation;
         BinSegmenter::Segmentation prevSegmentation;
         BinSegmenter::Segmentation nextSegmentation;
+        FixedVector<process_t> classifiedMag; // readahead at last classify
+        int classificationReuseCount;
         Guide::Guidance guidance;
+        Guide::Guidance reawakeningGuidance; // see consume()
         FixedVector<float> mixdown;
         FixedVector<float> resampled;
         std::unique_ptr<RingBuffer<float>> inbuf;
@@ -202,19 +236,25 @@ protected:
         std::unique_ptr<FormantData> formant;
         ChannelData(BinSegmenter::Parameters segmenterParameters,
                     BinClassifier::Parameters classifierParameters,
+                    HistoryPrecision historyPrecision,
                     int longestFftSize,
                     int inRingBufferSize,
                     int outRingBufferSize) :
             scales(),
+            frame(longestFftSize, 0.f),
             readahead(segmenterParameters.fftSize),
             haveReadahead(false),
-            classifier(new BinClassifier(classifierParameters)),
+            readaheadInhop(0),
+            classifier(new BinClassifier(classifierParameters,
+                                         historyPrecision)),
             classification(classifierParameters.binCount,
                            BinClassifier::Classification::Residual),
             nextClassification(classifierParameters.binCount,
                                BinClassifier::Classification::Residual),
             segmenter(new BinSegmenter(segmenterParameters)),
             segmentation(), prevSegmentation(), nextSegmentation(),
+            classifiedMag(classifierParameters.binCount, 0.f),
+            classificationReuseCount(maxClassificationReuse),
             mixdown(longestFftSize, 0.f), // though it could be shorter
             resampled(outRingBufferSize, 0.f),
             inbuf(new RingBuffer<float>(inRingBufferSize)),
@@ -226,6 +266,8 @@ protected:
             segmentation = BinSegmenter::Segmentation();
             prevSegmentation = BinSegmenter::Segmentation();
             nextSegmentation = BinSegmenter::Segmentation();
+            v_zero(classifiedMag.data(), classifiedMag.size());
+            classificationReuseCount = maxClassificationReuse;
             inbuf->reset();
             outbuf->reset();
             for (auto &s : scales) {
@@ -234,6 +276,63 @@ protected:
         }
     };
 
+    struct PipelineScaleData {
+        // Analysis results for the following hop, prepared on the
+        // analysis thread in OptionThreadingRealTime mode
+        FixedVector<process_t> mag;
+        FixedVector<process_t> phase;
+        PipelineScaleData(int fftSize) :
+            mag(fftSize/2 + 1, 0.f),
+            phase(fftSize/2 + 1, 0.f) { }
+
+    private:
+        PipelineScaleData(const PipelineScaleData &) =delete;
+        PipelineScaleData &operator=(const PipelineScaleData &) =delete;
+    };
+
+    struct PipelineChannelData {
+        FixedVector<process_t> frame; // unwindowed, this hop and next
+        std::map<int, std::shared_ptr<PipelineScaleData>> scales;
+        ClassificationReadaheadData readahead;
+        PipelineChannelData(int frameSize, int classificationFftSize) :
+            frame(frameSize, 0.f),
+            scales(),
+            readahead(classificationFftSize) { }
+    };
+
+    // Upper limit for the input hop, imposed in calculateHop
+    static const int maxInhop = 1024;
+
+    // With OptionClassifyAdaptive, the most hops in a row for
+    // which a channel may reuse its previous classification
+    static const int maxClassificationReuse = 8;
+
+    // With OptionHopAdaptive, the input duration over which a single
+    // hop size is chosen, and so the spacing of the frames analysed
+    // for it in the study pass
+    static const int hopRegionSize = 1024;
+
+    enum class PipelineState {
+        Idle,      // nothing prepared, analysis thread not busy
+        Requested, // analysis thread owns the pipeline data
+        Ready      // pipeline data ready for adoption by consume()
+    };
+
+#ifndef NO_THREADING
+    class AnalysisThread : public Thread
+    {
+    public:
+        AnalysisThread(R3Stretcher *s);
+        void run() override;
+        void signalDataAvailable();
+        void abandon();
+    private:
+        R3Stretcher *m_s;
+        Semaphore m_dataAvailable;
+        std::atomic<bool> m_abandoning;
+    };
+#endif
+    
     struct ChannelAssembly {
         // Vectors of bare pointers, used to package container data
         // from different channels into arguments for PhaseAdvance
@@ -254,26 +353,36 @@ protected:
     struct ScaleData {
         int fftSize;
         FFT fft;
-        Window<process_t> analysisWindow;
-        Window<process_t> synthesisWindow;
+        std::shared_ptr<BandLimitedFFT> bandFft; // analysis, if narrow band
+        std::shared_ptr<const Window<process_t>> analysisWindow;
+        std::shared_ptr<const Window<process_t>> synthesisWindow;
         process_t windowScaleFactor;
         GuidedPhaseAdvance guided;
+        bool dormant; // not analysed or phase-advanced in last frame
         ScaleData(GuidedPhaseAdvance::Parameters guidedParameters,
-                  Log log) :
+                  Log log,
+                  const ScaleData *prototype) :
             fftSize(guidedParameters.fftSize),
             fft(fftSize),
-            analysisWindow(analysisWindowShape(fftSize),
-                           analysisWindowLength(fftSize)),
-            synthesisWindow(synthesisWindowShape(fftSize),
-                            synthesisWindowLength(fftSize)),
             windowScaleFactor(0.0),
-            guided(guidedParameters, log)
+            guided(guidedParameters, log),
+            dormant(false)
         {
-            int asz = analysisWindow.getSize(), ssz = synthesisWindow.getSize();
+            if (prototype) {
+                analysisWindow = prototype->analysisWindow;
+                synthesisWindow = prototype->synthesisWindow;
+                windowScaleFactor = prototype->windowScaleFactor;
+                return;
+            }
+            analysisWindow = std::make_shared<Window<process_t>>
+                (analysisWindowShape(fftSize), analysisWindowLength(fftSize));
+            synthesisWindow = std::make_shared<Window<process_t>>
+                (synthesisWindowShape(fftSize), synthesisWindowLength(fftSize));
+            int asz = analysisWindow->getSize(), ssz = synthesisWindow->getSize();
             int off = (asz - ssz) / 2;
             for (int i = 0; i < ssz; ++i) {
-                windowScaleFactor += analysisWindow.getValue(i + off) *
-                    synthesisWindow.getValue(i);
+                windowScaleFactor += analysisWindow->getValue(i + off) *
+                    synthesisWindow->getValue(i);
             }
         }
 
@@ -289,8 +398,10 @@ protected:
     std::atomic<double> m_timeRatio;
     std::atomic<double> m_pitchScale;
     std::atomic<double> m_formantScale;
+    std::atomic<double> m_outputRateRatio;
     
     std::vector<std::shared_ptr<ChannelData>> m_channelData;
+    std::unique_ptr<ScratchData> m_scratch;
     std::map<int, std::shared_ptr<ScaleData>> m_scaleData;
     Guide m_guide;
     Guide::Configuration m_guideConfiguration;
@@ -302,6 +413,8 @@ protected:
     int m_prevOuthop;
     uint32_t m_unityCount;
     int m_startSkip;
+    int m_classificationHops;  // channel-hops since the last report
+    int m_classificationReuses;
 
     size_t m_studyInputDuration;
     size_t m_suppliedInputDuration;
@@ -310,6 +423,16 @@ protected:
     size_t m_lastKeyFrameSurpassed;
     size_t m_totalOutputDuration;
     std::map<size_t, size_t> m_keyFrameMap;
+
+    // With OptionHopAdaptive, the study input mixed down and not yet
+    // analysed, the previous frame's magnitudes, the spectral flux
+    // across each hop region, the hop scale factors derived from it,
+    // and the unrounded output position of the current frame
+    std::vector<process_t> m_studyMixdown;
+    std::vector<process_t> m_studyPrevMag;
+    std::vector<float> m_studyFlux;
+    std::vector<float> m_hopScales;
+    double m_idealOutputPosition;
     
     enum class ProcessMode {
         JustCreated,
@@ -319,15 +442,46 @@ protected:
     };
     ProcessMode m_mode;
 
-    void consume();
+    bool m_pipelined;
+    std::vector<std::shared_ptr<PipelineChannelData>> m_pipelineChannelData;
+    std::map<int, std::shared_ptr<FFT>> m_pipelineFfts;
+    std::map<int, std::shared_ptr<BandLimitedFFT>> m_pipelineBandFfts;
+    std::unique_ptr<ScratchData> m_pipelineScratch;
+    std::atomic<PipelineState> m_pipelineState;
+    int m_pipelineInhop;
+    size_t m_pipelineHop;
+    size_t m_hopCount;
+    int m_pipelineHops;      // hops since the last report
+    int m_pipelineAdoptions;
+#ifndef NO_THREADING
+    std::unique_ptr<AnalysisThread> m_analysisThread;
+    std::atomic<bool> m_pipelineWaiting;
+    Semaphore m_pipelineDone;
+#endif
+
+    size_t consume(size_t maxHops);
     void createResampler();
     void calculateHop();
+    void studyStationarity(const float *const *input, size_t samples,
+                           bool final);
+    void calculateHopScales();
+    int chooseAdaptiveHop(int &inhop, double hopRatio) const;
     void updateRatioFromMap();
     void analyseChannel(int channel, int inhop, int prevInhop, int prevOuthop);
+    void analyseScale(int channel, int fftSize);
+    bool isScaleInUse(int fftSize) const;
+    void guideChannel(int channel, int prevOuthop);
+    bool canReuseClassification(int channel);
+    void requestPipelinedAnalysis(int inhop);
+    void analysePipelined();
+    bool adoptPipelinedAnalysis(int inhop);
+    void waitForPipeline();
+    void reportPipeline();
     void analyseFormant(int channel);
-    void adjustFormant(int channel);
+    void adjustFormant(int channel, int fftSize);
     void adjustPreKick(int channel);
-    void synthesiseChannel(int channel, int outhop, bool draining);
+    void synthesiseChannel(int channel, int outhop, double meanOuthop,
+                           bool draining);
 
     struct ToPolarSpec {
         int magFromBin;
@@ -363,10 +517,38 @@ protected:
         return m_timeRatio * m_pitchScale;
     }
 
+    // Ratio of output to input sample count applied by the
+    // resampler, combining the pitch shift with any conversion to a
+    // different output sample rate
+    double getResampleRatio() const {
+        return m_outputRateRatio / m_pitchScale;
+    }
+
+    // Ratio of output to input sample count overall
+    double getOutputRatio() const {
+        return m_timeRatio * m_outputRateRatio;
+    }
+
     bool isRealTime() const {
         return m_parameters.options &
             RubberBandStretcher::OptionProcessRealTime;
     }
+
+    bool isHopAdaptive() const {
+        return !isRealTime() &&
+            (m_parameters.options & RubberBandStretcher::OptionHopAdaptive);
+    }
+
+    HistoryPrecision getHistoryPrecision() const {
+        if (m_parameters.options & RubberBandStretcher::OptionHistoryHalf) {
+            return HistoryPrecision::HalfFloat;
+        } else if (m_parameters.options &
+                   RubberBandStretcher::OptionHistoryFloat) {
+            return HistoryPrecision::Single;
+        } else {
+            return HistoryPrecision::Full;
+        }
+    }
 };
 
 }
@@ -0,0 +1,688 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#include "MultiStreamStretcher.h"
+
+#include "../common/VectorOps.h"
+#include "../common/FloatGuards.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace RubberBand {
+
+// The per-bin kernels below are written as loops over the lanes of a
+// group with no data-dependent branches or conditional expressions,
+// so that the compiler can vectorise them across lanes at the default
+// optimisation level. Selections are made by multiplying by 0 or 1
+// instead. These are the transcendental functions the kernels need,
+// in forms that vectorise: accurate to around 1e-5 rad for the phase
+// and 1e-6 for sin and cos, which is far below anything audible in a
+// phase vocoder.
+
+static inline float
+ms_princarg(float a)
+{
+    const float twoPi = 2.f * float(M_PI);
+    const float r = a * (1.f / twoPi);
+    return a - twoPi * float(int(r + copysignf(0.5f, r)));
+}
+
+static inline float
+ms_atan2(float y, float x)
+{
+    // Polynomial approximation to atan on [0, 1] (Abramowitz and
+    // Stegun 4.4.49), extended to the other octants by reflection
+    const float ax = fabsf(x), ay = fabsf(y);
+    const float d = ax - ay;
+    const float mx = 0.5f * (ax + ay + fabsf(d));
+    const float mn = 0.5f * (ax + ay - fabsf(d));
+    const float a = mn / (mx + 1.0e-30f);
+    const float s = a * a;
+    float r = a * (0.9998660f + s * (-0.3302995f + s * (0.1801410f +
+              s * (-0.0851330f + s * 0.0208351f))));
+    r = float(M_PI_4) - copysignf(float(M_PI_4) - r, d);
+    r = float(M_PI_2) - copysignf(float(M_PI_2) - r, x);
+    return copysignf(r, y);
+}
+
+// Argument in [-pi, pi]
+static inline void
+ms_sincos(float x, float &sn, float &cs)
+{
+    // Reflect into [-pi/2, pi/2], where cos changes sign
+    const float hpi = float(M_PI_2);
+    const float sign = copysignf(1.f, hpi - fabsf(x));
+    x = copysignf(hpi - fabsf(hpi - fabsf(x)), x);
+    const float s = x * x;
+    sn = x * (1.f + s * (-1.f/6.f + s * (1.f/120.f + s * (-1.f/5040.f +
+         s * (1.f/362880.f + s * (-1.f/39916800.f))))));
+    cs = sign * (1.f + s * (-0.5f + s * (1.f/24.f + s * (-1.f/720.f +
+         s * (1.f/40320.f + s * (-1.f/3628800.f))))));
+}
+
+// One bin of every lane, as in the functions below, is a row of
+// LaneFFT::lanes values. The lane loops are in functions of their own
+// because the compiler will vectorise them cheaply only when it knows
+// from the restrict-qualified arguments that the rows do not overlap.
+
+// Power and phase of a bin, and its contribution to the onset
+// measure. Power rather than magnitude, as sqrt does not vectorise
+// without relaxed floating-point options.
+static inline void
+ms_analyseBin(const float *const R__ real,
+              const float *const R__ imag,
+              float *const R__ prevPower,
+              float *const R__ phase,
+              float *const R__ count,
+              float *const R__ nonZero,
+              const float threshold,
+              const float zeroThresh)
+{
+    for (int l = 0; l < LaneFFT::lanes; ++l) {
+        const float re = real[l], im = imag[l];
+        const float p = re * re + im * im;
+        const float pp = prevPower[l];
+        phase[l] = ms_atan2(im, re);
+        count[l] += float(p >= std::max(threshold * pp, zeroThresh));
+        nonZero[l] += float(p > zeroThresh);
+        prevPower[l] = p;
+    }
+}
+
+// Phase advance of a bin with bin frequency omega, updating the
+// previous-frame phases. The bin is then rotated from its analysis
+// phase to its output phase, which leaves its magnitude unchanged
+// without having to calculate it.
+static inline void
+ms_synthesiseBin(const float *const R__ phase,
+                 float *const R__ prevPhase,
+                 float *const R__ prevOutPhase,
+                 const float *const R__ inhop,
+                 const float *const R__ outhop,
+                 const float *const R__ reset,
+                 const float omega,
+                 const float scale,
+                 float *const R__ real,
+                 float *const R__ imag)
+{
+    for (int l = 0; l < LaneFFT::lanes; ++l) {
+        const float ph = phase[l];
+        const float dphi = ms_princarg
+            (ph - prevPhase[l] - ms_princarg(omega * inhop[l]));
+        const float freq = omega + dphi / inhop[l];
+        float outPhase = ms_princarg(prevOutPhase[l] + freq * outhop[l]);
+        outPhase += reset[l] * (ph - outPhase);
+        prevPhase[l] = ph;
+        prevOutPhase[l] = outPhase;
+        float sn, cs;
+        ms_sincos(ms_princarg(outPhase - ph), sn, cs);
+        const float re = real[l] * scale, im = imag[l] * scale;
+        real[l] = re * cs - im * sn;
+        imag[l] = re * sn + im * cs;
+    }
+}
+
+MultiStreamStretcher::MultiStreamStretcher(Parameters parameters,
+                                           Log log) :
+    m_parameters(parameters),
+    m_log(log),
+    m_fftSize(roundUp(int(ceil(parameters.sampleRate * 2048.0 / 48000.0)))),
+    m_binCount(0),
+    m_defaultInhop(0),
+    m_phaseReset(!(parameters.options &
+                   RubberBandStretcher::OptionTransientsSmooth)),
+    m_window(HannWindow, adjustFftSize(m_fftSize, parameters.options)),
+    m_windowSquared(m_window.getSize(), 0.f),
+    m_fft(m_window.getSize()),
+    m_frame(m_window.getSize() * LaneFFT::lanes, 0.f),
+    m_real((m_window.getSize() / 2 + 1) * LaneFFT::lanes, 0.f),
+    m_imag((m_window.getSize() / 2 + 1) * LaneFFT::lanes, 0.f),
+    m_phase((m_window.getSize() / 2 + 1) * LaneFFT::lanes, 0.f),
+    m_prevPower((m_window.getSize() / 2 + 1) * LaneFFT::lanes, 0.f),
+    m_prevPhase((m_window.getSize() / 2 + 1) * LaneFFT::lanes, 0.f),
+    m_prevOutPhase((m_window.getSize() / 2 + 1) * LaneFFT::lanes, 0.f),
+    m_laneInhop(LaneFFT::lanes, 0.f),
+    m_laneOuthop(LaneFFT::lanes, 0.f),
+    m_laneReset(LaneFFT::lanes, 0.f),
+    m_peek(m_window.getSize(), 0.f)
+{
+    m_fftSize = m_window.getSize();
+    m_binCount = m_fftSize / 2 + 1;
+    m_defaultInhop = m_fftSize / 8;
+
+    m_log.log(1, "MultiStreamStretcher::MultiStreamStretcher: rate, options",
+              m_parameters.sampleRate, m_parameters.options);
+    m_log.log(1, "MultiStreamStretcher::MultiStreamStretcher: streams, lanes",
+              m_parameters.streams, LaneFFT::lanes);
+    m_log.log(1, "MultiStreamStretcher::MultiStreamStretcher: fft size",
+              m_fftSize);
+
+    for (int i = 0; i < m_fftSize; ++i) {
+        float w = m_window.getValue(i);
+        m_windowSquared[i] = w * w;
+    }
+
+    m_group.reserve(LaneFFT::lanes);
+
+    int prefill = m_fftSize / 2;
+    int inRingBufferSize = m_fftSize * 4 + prefill;
+    int outRingBufferSize = m_fftSize * 16;
+
+    for (int s = 0; s < m_parameters.streams; ++s) {
+        m_streams.push_back(std::make_shared<StreamData>
+                            (m_fftSize, inRingBufferSize, outRingBufferSize));
+        resetStream(*m_streams[s]);
+    }
+}
+
+bool
+MultiStreamStretcher::validStream(int stream) const
+{
+    if (stream < 0 || stream >= m_parameters.streams) {
+        m_log.log(0, "MultiStreamStretcher: stream index out of range", stream);
+        return false;
+    }
+    return true;
+}
+
+void
+MultiStreamStretcher::reset()
+{
+    for (auto &sd : m_streams) {
+        resetStream(*sd);
+    }
+}
+
+void
+MultiStreamStretcher::reset(int stream)
+{
+    if (!validStream(stream)) return;
+    resetStream(*m_streams[stream]);
+}
+
+void
+MultiStreamStretcher::resetStream(StreamData &sd)
+{
+    sd.inbuf->reset();
+    sd.outbuf->reset();
+    sd.inbuf->zero(m_fftSize / 2);
+
+    v_zero(sd.prevPower.data(), m_binCount);
+    v_zero(sd.prevPhase.data(), m_binCount);
+    v_zero(sd.prevOutPhase.data(), m_binCount);
+    v_zero(sd.accumulator.data(), m_fftSize);
+    v_zero(sd.windowAccumulator.data(), m_fftSize);
+
+    if (sd.resampler) {
+        sd.resampler->reset();
+    }
+
+    sd.prevDf = 0.f;
+    sd.inputSupplied = 0;
+    sd.inputConsumed = 0;
+    sd.outputPosition = 0.0;
+    sd.outputEmitted = 0;
+    sd.skip = m_fftSize / 2;
+    sd.hopCount = 0;
+    sd.final = false;
+    sd.finished = false;
+    sd.inhop = 0;
+    sd.outhop = 0;
+}
+
+void
+MultiStreamStretcher::setTimeRatio(int stream, double ratio)
+{
+    if (!validStream(stream)) return;
+    if (!(ratio > 0.0)) {
+        m_log.log(0, "MultiStreamStretcher::setTimeRatio: Invalid ratio", ratio);
+        return;
+    }
+    m_streams[stream]->timeRatio = ratio;
+}
+
+void
+MultiStreamStretcher::setPitchScale(int stream, double scale)
+{
+    if (!validStream(stream)) return;
+    if (!(scale > 0.0)) {
+        m_log.log(0, "MultiStreamStretcher::setPitchScale: Invalid scale", scale);
+        return;
+    }
+    if (scale < 0.125 || scale > 8.0) {
+        m_log.log(0, "MultiStreamStretcher::setPitchScale: Scale out of range, clamping", scale);
+        scale = std::max(0.125, std::min(8.0, scale));
+    }
+
+    StreamData &sd = *m_streams[stream];
+    sd.pitchScale = scale;
+
+    // Created on first use rather than for every stream up front,
+    // but here rather than in process() which should not allocate
+    if (scale != 1.0 && !sd.resampler) {
+        createResampler(sd);
+    }
+}
+
+double
+MultiStreamStretcher::getTimeRatio(int stream) const
+{
+    if (!validStream(stream)) return 1.0;
+    return m_streams[stream]->timeRatio;
+}
+
+double
+MultiStreamStretcher::getPitchScale(int stream) const
+{
+    if (!validStream(stream)) return 1.0;
+    return m_streams[stream]->pitchScale;
+}
+
+void
+MultiStreamStretcher::createResampler(StreamData &sd)
+{
+    Resampler::Parameters resamplerParameters;
+
+    if (m_parameters.options & RubberBandStretcher::OptionPitchHighQuality) {
+        resamplerParameters.quality = Resampler::Best;
+    } else {
+        resamplerParameters.quality = Resampler::FastestTolerable;
+    }
+
+    resamplerParameters.initialSampleRate = m_parameters.sampleRate;
+    resamplerParameters.maxBufferSize = m_fftSize;
+    resamplerParameters.dynamism = Resampler::RatioOftenChanging;
+    resamplerParameters.ratioChange = Resampler::SmoothRatioChange;
+
+    sd.resampler = std::unique_ptr<Resampler>
+        (new Resampler(resamplerParameters, 1));
+}
+
+size_t
+MultiStreamStretcher::getSamplesRequired(int stream) const
+{
+    if (!validStream(stream)) return 0;
+    const StreamData &sd = *m_streams[stream];
+    if (sd.final) return 0;
+    int rs = sd.inbuf->getReadSpace();
+    if (rs < m_fftSize) return m_fftSize - rs;
+    return 0;
+}
+
+size_t
+MultiStreamStretcher::supply(int stream, const float *input,
+                             size_t samples, bool final)
+{
+    if (!validStream(stream)) return 0;
+    StreamData &sd = *m_streams[stream];
+
+    if (sd.final) {
+        m_log.log(0, "MultiStreamStretcher::supply: Cannot supply input after final block", stream);
+        return 0;
+    }
+
+    int n = std::min(int(samples), sd.inbuf->getWriteSpace());
+
+    if (v_all_finite(input, n)) {
+        sd.inbuf->write(input, n);
+    } else {
+        m_log.log(0, "MultiStreamStretcher::supply: Replacing non-finite input values with zero in stream", stream);
+        for (int i = 0; i < n; i += m_fftSize) {
+            int chunk = std::min(n - i, m_fftSize);
+            v_copy_finite(m_peek.data(), input + i, chunk);
+            sd.inbuf->write(m_peek.data(), chunk);
+        }
+    }
+
+    sd.inputSupplied += n;
+
+    if (final && size_t(n) == samples) {
+        sd.final = true;
+    }
+
+    return n;
+}
+
+int
+MultiStreamStretcher::available(int stream) const
+{
+    if (!validStream(stream)) return 0;
+    const StreamData &sd = *m_streams[stream];
+    int rs = sd.outbuf->getReadSpace();
+    if (rs == 0 && sd.finished) return -1;
+    return rs;
+}
+
+size_t
+MultiStreamStretcher::retrieve(int stream, float *output, size_t samples)
+{
+    if (!validStream(stream)) return 0;
+    return m_streams[stream]->outbuf->read(output, int(samples));
+}
+
+int
+MultiStreamStretcher::getOutputSpaceRequired(const StreamData &sd) const
+{
+    // Enough for the longest emit, which is the drain at the end, of
+    // up to a whole frame before resampling
+    return int(ceil(m_fftSize / sd.pitchScale)) + 64;
+}
+
+bool
+MultiStreamStretcher::isDrained(const StreamData &sd) const
+{
+    return sd.final && sd.inputConsumed >= sd.inputSupplied;
+}
+
+bool
+MultiStreamStretcher::isReady(const StreamData &sd) const
+{
+    if (sd.finished || isDrained(sd)) return false;
+    if (sd.inbuf->getReadSpace() < m_fftSize && !sd.final) return false;
+    return sd.outbuf->getWriteSpace() >= getOutputSpaceRequired(sd);
+}
+
+void
+MultiStreamStretcher::prepareHop(StreamData &sd)
+{
+    // The phase vocoder stretches by the time ratio multiplied by the
+    // pitch scale and the resampler then undoes the pitch scale. Keep
+    // the output hop to at most half the frame by shortening the
+    // input hop at high ratios. The output hop is rounded from the
+    // running ideal output position, so that rounding errors do not
+    // accumulate in the output duration.
+
+    double r = sd.timeRatio * sd.pitchScale;
+    int inhop = m_defaultInhop;
+    if (inhop * r > m_fftSize / 2) {
+        inhop = std::max(1, int(floor((m_fftSize / 2) / r)));
+    }
+
+    sd.outputPosition += inhop * r;
+
+    sd.inhop = inhop;
+    sd.outhop = int(lrint(sd.outputPosition)) - int(sd.outputEmitted);
+    if (sd.outhop < 0) sd.outhop = 0;
+}
+
+size_t
+MultiStreamStretcher::process()
+{
+    ScopedFlushToZero ftz;
+
+    const int L = LaneFFT::lanes;
+    size_t hops = 0;
+
+    while (true) {
+
+        // Each pass takes one hop from every stream that is ready
+        // for one, packing them into groups of lanes as it goes. A
+        // stream may be ready again on the next pass if it has
+        // plenty of input buffered.
+
+        bool any = false;
+
+        for (int s = 0; s < m_parameters.streams; ++s) {
+
+            StreamData &sd = *m_streams[s];
+
+            if (!sd.finished && isDrained(sd)) {
+                if (sd.outbuf->getWriteSpace() >= getOutputSpaceRequired(sd)) {
+                    finishStream(sd);
+                }
+                continue;
+            }
+
+            if (!isReady(sd)) continue;
+
+            prepareHop(sd);
+            m_group.push_back(s);
+            any = true;
+
+            if (int(m_group.size()) == L) {
+                processGroup();
+                hops += L;
+                m_group.clear();
+            }
+        }
+
+        if (!m_group.empty()) {
+            processGroup();
+            hops += m_group.size();
+            m_group.clear();
+        }
+
+        if (!any) break;
+    }
+
+    return hops;
+}
+
+void
+MultiStreamStretcher::processGroup()
+{
+    const int L = LaneFFT::lanes;
+    const int n = m_fftSize;
+    const int half = n / 2;
+    const int bins = m_binCount;
+    const int g = int(m_group.size());
+
+    float *const R__ frame = m_frame.data();
+    float *const R__ real = m_real.data();
+    float *const R__ imag = m_imag.data();
+    float *const R__ phase = m_phase.data();
+    float *const R__ prevPower = m_prevPower.data();
+    float *const R__ prevPhase = m_prevPhase.data();
+    float *const R__ prevOutPhase = m_prevOutPhase.data();
+    float *const R__ peek = m_peek.data();
+    const float *const R__ laneInhop = m_laneInhop.data();
+    const float *const R__ laneOuthop = m_laneOuthop.data();
+    const float *const R__ laneReset = m_laneReset.data();
+
+    // Gather: each stream's frame, windowed and fftshifted, and its
+    // phase vocoder state into its lane. Lanes beyond the group are
+    // left silent.
+
+    for (int l = 0; l < L; ++l) {
+
+        if (l >= g) {
+            for (int i = 0; i < n; ++i) frame[i * L + l] = 0.f;
+            for (int k = 0; k < bins; ++k) {
+                prevPower[k * L + l] = 0.f;
+                prevPhase[k * L + l] = 0.f;
+                prevOutPhase[k * L + l] = 0.f;
+            }
+            m_laneInhop[l] = float(m_defaultInhop);
+            m_laneOuthop[l] = 0.f;
+            continue;
+        }
+
+        StreamData &sd = *m_streams[m_group[l]];
+
+        int rs = sd.inbuf->getReadSpace();
+        int got = sd.inbuf->peek(peek, std::min(rs, n));
+        if (got < n) v_zero(peek + got, n - got);
+        sd.inbuf->skip(std::min(got, sd.inhop));
+        sd.inputConsumed += sd.inhop;
+
+        for (int i = 0; i < half; ++i) {
+            frame[i * L + l] = peek[i + half] * m_window.getValue(i + half);
+            frame[(i + half) * L + l] = peek[i] * m_window.getValue(i);
+        }
+
+        for (int k = 0; k < bins; ++k) {
+            prevPower[k * L + l] = sd.prevPower[k];
+            prevPhase[k * L + l] = sd.prevPhase[k];
+            prevOutPhase[k * L + l] = sd.prevOutPhase[k];
+        }
+
+        m_laneInhop[l] = float(sd.inhop);
+        m_laneOuthop[l] = float(sd.outhop);
+    }
+
+    m_fft.forward(frame, real, imag);
+
+    // Phase, and the percussive onset measure of the R2 engine: the
+    // proportion of bins rising by 3dB or more in power. The
+    // threshold below which a bin counts as empty is much higher than
+    // R2's, which works in double precision: here the rounding noise
+    // of the single-precision FFT would otherwise make the empty bins
+    // of a steady tone look like a continuous onset.
+
+    const float threshold = 1.9952623f; // 10^0.3
+    const float zeroThresh = 1.0e-10f * float(n) * float(n); // -100dB
+
+    float count[L], nonZero[L];
+    for (int l = 0; l < L; ++l) {
+        count[l] = 0.f;
+        nonZero[l] = 0.f;
+    }
+
+    for (int k = 0; k < bins; ++k) {
+        const int ix = k * L;
+        ms_analyseBin(real + ix, imag + ix, prevPower + ix,
+                      phase + ix, count, nonZero,
+                      threshold, zeroThresh);
+    }
+
+    for (int l = 0; l < g; ++l) {
+        StreamData &sd = *m_streams[m_group[l]];
+        float df = (nonZero[l] > 0.f ? count[l] / nonZero[l] : 0.f);
+        bool reset = (sd.hopCount == 0);
+        if (m_phaseReset && df > 0.35f && df > sd.prevDf * 1.1f) {
+            m_log.log(2, "MultiStreamStretcher::processGroup: transient in stream, df", m_group[l], df);
+            reset = true;
+        }
+        sd.prevDf = df;
+        m_laneReset[l] = (reset ? 1.f : 0.f);
+    }
+    for (int l = g; l < L; ++l) {
+        m_laneReset[l] = 1.f;
+    }
+
+    // Phase advance, and back to cartesian, scaled for the inverse
+
+    const float scale = 1.f / float(n);
+    const float binFreq = 2.f * float(M_PI) / float(n);
+
+    for (int k = 0; k < bins; ++k) {
+        const int ix = k * L;
+        ms_synthesiseBin(phase + ix, prevPhase + ix, prevOutPhase + ix,
+                         laneInhop, laneOuthop, laneReset,
+                         binFreq * float(k), scale,
+                         real + ix, imag + ix);
+    }
+
+    m_fft.inverse(real, imag, frame);
+
+    // Scatter: state back to each stream, and its output frame
+    // un-shifted and windowed into its accumulator
+
+    for (int l = 0; l < g; ++l) {
+
+        StreamData &sd = *m_streams[m_group[l]];
+
+        for (int k = 0; k < bins; ++k) {
+            sd.prevPower[k] = prevPower[k * L + l];
+            sd.prevPhase[k] = prevPhase[k * L + l];
+            sd.prevOutPhase[k] = prevOutPhase[k * L + l];
+        }
+
+        float *const R__ acc = sd.accumulator.data();
+        float *const R__ wacc = sd.windowAccumulator.data();
+
+        for (int i = 0; i < half; ++i) {
+            acc[i] += frame[(i + half) * L + l] * m_window.getValue(i);
+            acc[i + half] += frame[i * L + l] * m_window.getValue(i + half);
+        }
+        v_add(wacc, m_windowSquared.data(), n);
+
+        emit(sd, sd.outhop, false);
+        ++sd.hopCount;
+    }
+}
+
+void
+MultiStreamStretcher::emit(StreamData &sd, int count, bool final)
+{
+    const int n = m_fftSize;
+    float *const R__ acc = sd.accumulator.data();
+    float *const R__ wacc = sd.windowAccumulator.data();
+
+    if (count > n) count = n;
+
+    for (int i = 0; i < count; ++i) {
+        if (wacc[i] > 0.f) acc[i] /= wacc[i];
+    }
+
+    int skipped = std::min(sd.skip, count);
+    sd.skip -= skipped;
+
+    float *from = acc + skipped;
+    int remaining = count - skipped;
+
+    if (sd.resampler) {
+        // Once created, the resampler stays in the output path even
+        // if the pitch scale returns to 1, as it has latency
+        float *to = sd.resampled.data();
+        int space = std::min(int(sd.resampled.size()),
+                             sd.outbuf->getWriteSpace());
+        int got = sd.resampler->resample(&to, space,
+                                         &from, remaining,
+                                         1.0 / sd.pitchScale,
+                                         final);
+        sd.outbuf->write(to, got);
+    } else {
+        sd.outbuf->write(from, remaining);
+    }
+
+    v_move(acc, acc + count, n - count);
+    v_zero(acc + n - count, count);
+    v_move(wacc, wacc + count, n - count);
+    v_zero(wacc + n - count, count);
+
+    sd.outputEmitted += count;
+}
+
+void
+MultiStreamStretcher::finishStream(StreamData &sd)
+{
+    // Emit what remains up to the target duration: the ideal output
+    // position less whatever the last hops ran beyond the end of the
+    // input, plus the skip at the start
+
+    double r = sd.timeRatio * sd.pitchScale;
+    double beyond = double(sd.inputConsumed) - double(sd.inputSupplied);
+    long target = long(m_fftSize / 2) + lrint(sd.outputPosition - beyond * r);
+    long remaining = target - long(sd.outputEmitted);
+    if (remaining < 0) remaining = 0;
+
+    m_log.log(2, "MultiStreamStretcher::finishStream: emitted, remaining",
+              double(sd.outputEmitted), double(remaining));
+
+    emit(sd, int(remaining), true);
+    sd.finished = true;
+}
+
+}
@@ -0,0 +1,198 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef RUBBERBAND_MULTI_STREAM_STRETCHER_H
+#define RUBBERBAND_MULTI_STREAM_STRETCHER_H
+
+#include "../common/LaneFFT.h"
+#include "../common/Resampler.h"
+#include "../common/RingBuffer.h"
+#include "../common/FixedVector.h"
+#include "../common/Window.h"
+#include "../common/Log.h"
+
+#include "../../rubberband/RubberBandStretcher.h"
+
+#include <memory>
+#include <vector>
+
+namespace RubberBand
+{
+
+/**
+ * Phase vocoder for many independent mono streams, each with its own
+ * time ratio and pitch scale, that processes the streams a group of
+ * LaneFFT::lanes at a time. Input is supplied to each stream
+ * separately, and process() then runs every hop that is due across
+ * all of them, packing the streams whose next hop is ready into the
+ * lanes of a group. The windowing, FFTs, phase advance and inverse
+ * are carried out across the lanes of a group together, while each
+ * stream keeps its own input and output hop sizes and its own
+ * position, so the streams need not be supplied in step with one
+ * another.
+ *
+ * The processing is that of a plain phase vocoder with phase reset
+ * at transients, close to the R2 engine without its phase
+ * lamination, frequency-dependent hop or formant handling. Pitch
+ * shifting is by stretch and resample, as in the other engines.
+ * There is no offline mode: the output is aligned with the input
+ * and its total duration is the input duration multiplied by the
+ * time ratio, and there is no study pass.
+ *
+ * No two functions may be called at once, from different threads.
+ */
+class MultiStreamStretcher
+{
+public:
+    struct Parameters {
+        double sampleRate;
+        int streams;
+        RubberBandStretcher::Options options;
+        Parameters(double _sampleRate, int _streams,
+                   RubberBandStretcher::Options _options) :
+            sampleRate(_sampleRate), streams(_streams), options(_options) { }
+    };
+
+    MultiStreamStretcher(Parameters parameters, Log log);
+    ~MultiStreamStretcher() { }
+
+    int getStreamCount() const { return m_parameters.streams; }
+
+    void reset();
+    void reset(int stream);
+
+    void setTimeRatio(int stream, double ratio);
+    void setPitchScale(int stream, double scale);
+    double getTimeRatio(int stream) const;
+    double getPitchScale(int stream) const;
+
+    size_t getSamplesRequired(int stream) const;
+    size_t supply(int stream, const float *input, size_t samples, bool final);
+    size_t process();
+    int available(int stream) const;
+    size_t retrieve(int stream, float *output, size_t samples);
+
+    void setDebugLevel(int level) {
+        m_log.setDebugLevel(level);
+    }
+
+protected:
+    struct StreamData {
+        double timeRatio;
+        double pitchScale;
+        std::unique_ptr<RingBuffer<float>> inbuf;
+        std::unique_ptr<RingBuffer<float>> outbuf;
+        FixedVector<float> prevPower;
+        FixedVector<float> prevPhase;
+        FixedVector<float> prevOutPhase;
+        FixedVector<float> accumulator;
+        FixedVector<float> windowAccumulator;
+        FixedVector<float> resampled;
+        std::unique_ptr<Resampler> resampler;
+        float prevDf;
+        size_t inputSupplied;   // excluding the prefill
+        size_t inputConsumed;   // input hops taken, i.e. frame centre
+        double outputPosition;  // ideal output duration so far
+        size_t outputEmitted;   // from accumulator, including the skip
+        int skip;               // still to discard from the start
+        int hopCount;
+        bool final;
+        bool finished;
+        int inhop;              // for the hop in progress
+        int outhop;
+        StreamData(int fftSize, int inRingBufferSize, int outRingBufferSize) :
+            timeRatio(1.0),
+            pitchScale(1.0),
+            inbuf(new RingBuffer<float>(inRingBufferSize)),
+            outbuf(new RingBuffer<float>(outRingBufferSize)),
+            prevPower(fftSize/2 + 1, 0.f),
+            prevPhase(fftSize/2 + 1, 0.f),
+            prevOutPhase(fftSize/2 + 1, 0.f),
+            accumulator(fftSize, 0.f),
+            windowAccumulator(fftSize, 0.f),
+            resampled(outRingBufferSize, 0.f) { }
+    private:
+        StreamData(const StreamData &) =delete;
+        StreamData &operator=(const StreamData &) =delete;
+    };
+
+    Parameters m_parameters;
+    Log m_log;
+
+    int m_fftSize;
+    int m_binCount;
+    int m_defaultInhop;
+    bool m_phaseReset;
+    Window<float> m_window;
+
+    // Window products accumulated for each synthesis frame, for
+    // normalisation of the overlap-add at varying output hops
+    FixedVector<float> m_windowSquared;
+
+    std::vector<std::shared_ptr<StreamData>> m_streams;
+
+    // Lane-interleaved working data for one group
+    LaneFFT m_fft;
+    FixedVector<float> m_frame;
+    FixedVector<float> m_real;
+    FixedVector<float> m_imag;
+    FixedVector<float> m_phase;
+    FixedVector<float> m_prevPower;
+    FixedVector<float> m_prevPhase;
+    FixedVector<float> m_prevOutPhase;
+    FixedVector<float> m_laneInhop;
+    FixedVector<float> m_laneOuthop;
+    FixedVector<float> m_laneReset;
+    FixedVector<float> m_peek;
+    std::vector<int> m_group;
+
+    bool validStream(int stream) const;
+    void resetStream(StreamData &sd);
+    int getOutputSpaceRequired(const StreamData &sd) const;
+    bool isReady(const StreamData &sd) const;
+    bool isDrained(const StreamData &sd) const;
+    void prepareHop(StreamData &sd);
+    void processGroup();
+    void emit(StreamData &sd, int count, bool final);
+    void finishStream(StreamData &sd);
+    void createResampler(StreamData &sd);
+
+    static int adjustFftSize(int size, RubberBandStretcher::Options options) {
+        if (options & RubberBandStretcher::OptionWindowShort) return size / 2;
+        if (options & RubberBandStretcher::OptionWindowLong) return size * 2;
+        return size;
+    }
+
+    int roundUp(int value) const {
+        if (value < 1) return 1;
+        if (!(value & (value - 1))) return value;
+        int bits = 0;
+        while (value) { ++bits; value >>= 1; }
+        value = 1 << bits;
+        return value;
+    }
+};
+
+}
+
+#endif
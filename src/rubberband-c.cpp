@@ -48,6 +48,13 @@ void rubberband_delete(RubberBandState state)
     delete state;
 }
 
+RubberBandState rubberband_clone(const RubberBandState state)
+{
+    RubberBandState_ *clone = new RubberBandState_();
+    clone->m_s = state->m_s->clone();
+    return clone;
+}
+
 void rubberband_reset(RubberBandState state)
 {
     state->m_s->reset();
@@ -88,6 +95,11 @@ double rubberband_get_formant_scale(const RubberBandState state)
     return state->m_s->getFormantScale();
 }
 
+void rubberband_set_output_sample_rate(RubberBandState state, unsigned int rate)
+{
+    state->m_s->setOutputSampleRate(rate);
+}
+
 unsigned int rubberband_get_preferred_start_pad(const RubberBandState state) 
 {
     return state->m_s->getPreferredStartPad();
@@ -162,6 +174,11 @@ void rubberband_process(RubberBandState state, const float *const *input, unsign
     state->m_s->process(input, samples, final != 0);
 }
 
+unsigned int rubberband_process_some(RubberBandState state, const float *const *input, unsigned int samples, int final, unsigned int maxHops)
+{
+    return state->m_s->processSome(input, samples, final != 0, maxHops);
+}
+
 int rubberband_available(const RubberBandState state)
 {
     return state->m_s->available();
@@ -192,3 +209,31 @@ void rubberband_set_default_debug_level(int level)
     RubberBand::RubberBandStretcher::setDefaultDebugLevel(level);
 }
 
+unsigned int rubberband_drain_log(RubberBandState state)
+{
+    return (unsigned int)state->m_s->drainLog();
+}
+
+int rubberband_tune_fft(unsigned int sampleRate, const char *cacheFilename)
+{
+    return RubberBand::RubberBandStretcher::tuneFFT
+        (sampleRate, cacheFilename ? cacheFilename : "") ? 1 : 0;
+}
+
+int rubberband_load_fft_tuning(const char *cacheFilename)
+{
+    if (!cacheFilename) return 0;
+    return RubberBand::RubberBandStretcher::loadFFTTuning(cacheFilename) ? 1 : 0;
+}
+
+void rubberband_start_trace(void)
+{
+    RubberBand::RubberBandStretcher::startTrace();
+}
+
+int rubberband_stop_trace(const char *filename)
+{
+    return RubberBand::RubberBandStretcher::stopTrace
+        (filename ? filename : "") ? 1 : 0;
+}
+
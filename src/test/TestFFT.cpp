@@ -27,11 +27,14 @@
 #include <boost/test/unit_test.hpp>
 
 #include "../common/FFT.h"
+#include "../common/LaneFFT.h"
+#include "../common/BandLimitedFFT.h"
 
 #include <iostream>
 
 #include <cstdio>
 #include <cmath>
+#include <vector>
 
 using namespace RubberBand;
 
@@ -722,4 +725,145 @@ ALL_IMPL_AUTO_TEST_CASE(random)
     delete[] in;
 }
 
+BOOST_AUTO_TEST_CASE(tuned)
+{
+    std::vector<int> sizes;
+    sizes.push_back(256);
+    sizes.push_back(2048);
+    FFT::clearTunedImplementations();
+    std::map<int, std::string> choices = FFT::tuneImplementations(sizes);
+    std::set<std::string> impls = FFT::getImplementations();
+    BOOST_CHECK_EQUAL(choices.size(), sizes.size());
+    for (auto c : choices) {
+        BOOST_CHECK(impls.find(c.second) != impls.end());
+        BOOST_CHECK_NE(c.second, "dft");
+        BOOST_CHECK_EQUAL(FFT::getImplementationForSize(c.first), c.second);
+    }
+
+    // A tuned choice is used for its size only, and an explicitly
+    // set default overrides it
+
+    const char *filename = "fft-tuning-test.txt";
+    FILE *f = fopen(filename, "w");
+    BOOST_REQUIRE(f);
+    fprintf(f, "# comment\n512 dft\nnonsense\n1024 nonexistent\n");
+    fclose(f);
+    
+    FFT::clearTunedImplementations();
+    BOOST_CHECK(FFT::loadTunedImplementations(filename));
+    std::map<int, std::string> loaded = FFT::getTunedImplementations();
+    BOOST_CHECK_EQUAL(loaded.size(), 1);
+    BOOST_CHECK_EQUAL(FFT::getImplementationForSize(512), "dft");
+    BOOST_CHECK_NE(FFT::getImplementationForSize(1024), "dft");
+    
+    std::string other = FFT::getImplementationForSize(1024);
+    FFT::setDefaultImplementation(other);
+    BOOST_CHECK_EQUAL(FFT::getImplementationForSize(512), other);
+    FFT::setDefaultImplementation("");
+    BOOST_CHECK_EQUAL(FFT::getImplementationForSize(512), "dft");
+
+    // Round trip through save and load
+
+    FFT::clearTunedImplementations();
+    FFT::tuneImplementations(sizes);
+    BOOST_CHECK(FFT::saveTunedImplementations(filename));
+    FFT::clearTunedImplementations();
+    BOOST_CHECK(FFT::getTunedImplementations().empty());
+    BOOST_CHECK(FFT::loadTunedImplementations(filename));
+    BOOST_CHECK(FFT::getTunedImplementations() == choices);
+    
+    FFT::clearTunedImplementations();
+    remove(filename);
+
+    BOOST_CHECK(!FFT::loadTunedImplementations("nonexistent-fft-tuning.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(lanes)
+{
+    // Each lane of a LaneFFT should match a double-precision FFT of
+    // that lane alone, in both directions
+
+    const int n = 512;
+    const int hs = n/2 + 1;
+    const int L = LaneFFT::lanes;
+
+    LaneFFT lfft(n);
+    FFT fft(n);
+    fft.initDouble();
+
+    std::vector<float> in(n * L), re(hs * L), im(hs * L), out(n * L);
+    for (int i = 0; i < n; ++i) {
+        for (int l = 0; l < L; ++l) {
+            in[i * L + l] = float(sin(i * 0.1 * (l + 1)) +
+                                  ((i * 7 + l * 3) % 11) / 11.0 - 0.5);
+        }
+    }
+
+    lfft.forward(in.data(), re.data(), im.data());
+    lfft.inverse(re.data(), im.data(), out.data());
+
+    std::vector<double> din(n), dre(hs), dim(hs), dout(n);
+    for (int l = 0; l < L; ++l) {
+        for (int i = 0; i < n; ++i) din[i] = in[i * L + l];
+        fft.forward(din.data(), dre.data(), dim.data());
+        for (int i = 0; i < hs; ++i) {
+            BOOST_CHECK_SMALL(re[i * L + l] - dre[i], 1e-3);
+            BOOST_CHECK_SMALL(im[i * L + l] - dim[i], 1e-3);
+        }
+        fft.inverse(dre.data(), dim.data(), dout.data());
+        for (int i = 0; i < n; ++i) {
+            BOOST_CHECK_SMALL(out[i * L + l] / n - dout[i] / n, 1e-5);
+            BOOST_CHECK_SMALL(double(out[i * L + l]) / n - din[i], 1e-5);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bandLimited)
+{
+    // The wanted bins of a BandLimitedFFT should match those of a
+    // full FFT of the same input, for the low band of the longest R3
+    // analysis scale at 44.1 and 96 kHz, and for a band too wide to
+    // be worth decimating
+
+    struct Case { int size; int bins; int factor; };
+    std::vector<Case> cases {
+        { 4096, 104, 16 }, { 8192, 95, 32 }, { 1024, 513, 1 }
+    };
+
+    for (const auto &c : cases) {
+
+        BOOST_TEST(BandLimitedFFT::getFactorFor(c.size, c.bins) == c.factor);
+
+        BandLimitedFFT bfft(c.size, c.bins);
+        BOOST_TEST(bfft.getFactor() == c.factor);
+
+        FFT fft(c.size);
+        int hs = c.size/2 + 1;
+        std::vector<process_t> in(c.size), re(hs), im(hs), bre(hs), bim(hs);
+        for (int i = 0; i < c.size; ++i) {
+            in[i] = process_t(sin(i * 0.1) + 0.5 * cos(i * 0.0371) +
+                              ((i * 7) % 13) / 13.0 - 0.5);
+        }
+
+        fft.forward(in.data(), re.data(), im.data());
+        bfft.forward(in.data(), bre.data(), bim.data());
+
+        double signal = 0.0, error = 0.0;
+        for (int i = 0; i < c.bins; ++i) {
+            signal += re[i] * re[i] + im[i] * im[i];
+            error += (re[i] - bre[i]) * (re[i] - bre[i]) +
+                (im[i] - bim[i]) * (im[i] - bim[i]);
+        }
+        double snr = 10.0 * log10(signal / std::max(error, 1e-300));
+        BOOST_TEST_MESSAGE("band-limited FFT of size " << c.size << ", "
+                           << c.bins << " bins, factor " << c.factor
+                           << ": SNR against full FFT " << snr << " dB");
+        if (sizeof(process_t) == sizeof(double)) {
+            BOOST_TEST(snr > 200.0);
+        } else {
+            BOOST_TEST(snr > 100.0);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
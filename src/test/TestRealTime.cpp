@@ -0,0 +1,360 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rubber Band Library
+    An audio time-stretching and pitch-shifting library.
+    Copyright 2007-2022 Particular Programs Ltd.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+
+    Alternatively, if you have a valid commercial licence for the
+    Rubber Band Library obtained by agreement with the copyright
+    holders, you may redistribute and/or modify it under the terms
+    described in that licence.
+
+    If you wish to distribute code using the Rubber Band Library
+    under terms other than those of the GNU General Public License,
+    you must obtain a valid commercial licence before doing so.
+*/
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+#include <boost/test/unit_test.hpp>
+
+#include "../../rubberband/RubberBandStretcher.h"
+
+#include "../common/RealTimeCheck.h"
+#include "../common/Allocators.h"
+#include "../common/Thread.h"
+#include "../common/Log.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace RubberBand;
+using namespace std;
+
+// These tests are only meaningful in a build with CHECK_RT_SAFETY
+// defined (meson option rt_checks). In other builds they still run
+// the stretchers through the same changes, but nothing is counted.
+
+BOOST_AUTO_TEST_SUITE(TestRealTime)
+
+static void
+report_violations(const char *name)
+{
+    static const char *kinds[RealTimeCheck::KindCount] = {
+        "allocations", "deallocations", "locks", "waits", "thread controls"
+    };
+    for (int k = 0; k < RealTimeCheck::KindCount; ++k) {
+        int n = RealTimeCheck::getViolationCount(RealTimeCheck::Kind(k));
+        if (n > 0) {
+            BOOST_TEST_MESSAGE(name << ": " << n << " " << kinds[k]);
+        }
+    }
+    if (RealTimeCheck::getViolationCount() > 0) {
+        BOOST_TEST_MESSAGE(name << ": most recent was in "
+                           << RealTimeCheck::getLastViolation());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(harness)
+{
+    if (!RealTimeCheck::isEnabled()) {
+        BOOST_TEST_MESSAGE("Real-time checks not compiled in, skipping");
+        return;
+    }
+
+    RealTimeCheck::resetViolations();
+
+    // Nothing is counted outside a section, or in an inactive one
+    int *p = new int(1);
+    delete p;
+    {
+        RealTimeCheck::Section section(false);
+        BOOST_TEST(!RealTimeCheck::inSection());
+        p = new int(2);
+        delete p;
+    }
+    BOOST_TEST(RealTimeCheck::getViolationCount() == 0);
+
+    {
+        RealTimeCheck::Section section;
+        BOOST_TEST(RealTimeCheck::inSection());
+        p = new int(3);
+        float *f = allocate<float>(16);
+        deallocate(f);
+        Mutex mutex;
+        mutex.lock();
+        mutex.unlock();
+        delete p;
+    }
+
+    BOOST_TEST(!RealTimeCheck::inSection());
+    BOOST_TEST(RealTimeCheck::getViolationCount
+               (RealTimeCheck::Allocation) == 2);
+    BOOST_TEST(RealTimeCheck::getViolationCount
+               (RealTimeCheck::Deallocation) == 2);
+    BOOST_TEST(RealTimeCheck::getViolationCount
+               (RealTimeCheck::Lock) == 1);
+    BOOST_TEST(RealTimeCheck::getViolationCount() == 5);
+
+    RealTimeCheck::resetViolations();
+    BOOST_TEST(RealTimeCheck::getViolationCount() == 0);
+}
+
+// Logger that counts the messages it receives, and how many of those
+// arrived within a real-time section (always none in builds without
+// the checks compiled in)
+struct CountingLogger : public RubberBandStretcher::Logger {
+    int count = 0;
+    int inSection = 0;
+    void log(const char *) override { note(); }
+    void log(const char *, double) override { note(); }
+    void log(const char *, double, double) override { note(); }
+    void note() {
+        ++count;
+        if (RealTimeCheck::inSection()) ++inSection;
+    }
+};
+
+// Run a stretcher in real-time mode through a sequence of ratio,
+// pitch and formant changes, with everything the caller needs
+// allocated up front, and check that no process, available or
+// retrieve call allocated or blocked. If a logger is given, the
+// stretcher logs to it at the given debug level, and must have been
+// asked to defer its logging: we check that nothing reaches the
+// logger until the log is drained
+
+static void
+changes_realtime(RubberBandStretcher::Options options, const char *name,
+                 std::shared_ptr<CountingLogger> logger = nullptr,
+                 int debugLevel = 0)
+{
+    int rate = 44100;
+    int channels = 2;
+    int bs = 512;
+    int blocks = 600;
+    int changeEvery = 50;
+
+    bool finer = (options & RubberBandStretcher::OptionEngineFiner);
+
+    RubberBandStretcher stretcher
+        (rate, channels, logger,
+         options | RubberBandStretcher::OptionProcessRealTime);
+
+    stretcher.setMaxProcessSize(bs);
+
+    if (logger) {
+        stretcher.setDebugLevel(debugLevel);
+        stretcher.drainLog();
+        logger->count = 0;
+    }
+
+    struct Change {
+        double ratio;
+        double pitch;
+        double formant;
+        bool preserveFormant;
+    };
+
+    vector<Change> changes = {
+        { 1.0, 1.0, 1.0, false },
+        { 1.5, 1.0, 1.0, false },
+        { 0.75, 1.0, 1.0, false },
+        { 1.0, 1.25, 1.0, false },
+        { 1.2, 0.8, 1.0, true },
+        { 0.9, 1.5, 1.0, true },
+        { 1.0, 1.0, 1.3, false },
+        { 2.0, 0.7, 0.8, false },
+        { 0.5, 1.1, 1.0, true },
+        { 1.1, 2.0, 1.0, false },
+        { 1.0, 1.0, 1.0, false }
+    };
+
+    vector<vector<float>> in(channels, vector<float>(bs, 0.f));
+    vector<vector<float>> out(channels, vector<float>(bs * 8, 0.f));
+    vector<float *> inptrs(channels), outptrs(channels);
+    for (int c = 0; c < channels; ++c) {
+        inptrs[c] = in[c].data();
+        outptrs[c] = out[c].data();
+    }
+
+    RealTimeCheck::resetViolations();
+
+    int produced = 0;
+    int outcap = int(out[0].size());
+
+    for (int b = 0; b < blocks; ++b) {
+
+        if (b % changeEvery == 0) {
+            const Change &ch = changes[(b / changeEvery) % changes.size()];
+            stretcher.setTimeRatio(ch.ratio);
+            stretcher.setPitchScale(ch.pitch);
+            if (finer) {
+                stretcher.setFormantScale(ch.formant);
+            }
+            stretcher.setFormantOption
+                (ch.preserveFormant ?
+                 RubberBandStretcher::OptionFormantPreserved :
+                 RubberBandStretcher::OptionFormantShifted);
+        }
+
+        for (int i = 0; i < bs; ++i) {
+            double t = double(b * bs + i) / rate;
+            in[0][i] = float(0.3 * sin(2.0 * M_PI * 220.0 * t) +
+                             0.1 * sin(2.0 * M_PI * 1650.0 * t));
+            in[1][i] = float(0.3 * sin(2.0 * M_PI * 330.0 * t) +
+                             ((b % 20 == 0 && i < 20) ? 0.5 : 0.0));
+        }
+
+        stretcher.process(inptrs.data(), bs, b + 1 == blocks);
+
+        int avail = 0;
+        while ((avail = stretcher.available()) > 0) {
+            int got = int(stretcher.retrieve
+                          (outptrs.data(), std::min(avail, outcap)));
+            produced += got;
+        }
+    }
+
+    BOOST_TEST(produced > 0);
+
+    report_violations(name);
+    BOOST_TEST(RealTimeCheck::getViolationCount() == 0);
+
+    if (logger) {
+        BOOST_TEST(logger->count == 0);
+        int drained = int(stretcher.drainLog());
+        BOOST_TEST(drained > 0);
+        BOOST_TEST(logger->count >= drained);
+        BOOST_TEST(logger->inSection == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(changes_realtime_faster)
+{
+    changes_realtime(RubberBandStretcher::OptionEngineFaster,
+                     "faster");
+}
+
+BOOST_AUTO_TEST_CASE(changes_realtime_faster_consistent)
+{
+    changes_realtime(RubberBandStretcher::OptionEngineFaster |
+                     RubberBandStretcher::OptionPitchHighConsistency,
+                     "faster, pitch high consistency");
+}
+
+// R3 redesigns its resampler filter on each pitch change unless
+// OptionPitchHighConsistency is set, which is the documented option
+// for time-varying pitch shifts
+
+BOOST_AUTO_TEST_CASE(changes_realtime_finer)
+{
+    changes_realtime(RubberBandStretcher::OptionEngineFiner |
+                     RubberBandStretcher::OptionPitchHighConsistency,
+                     "finer");
+}
+
+BOOST_AUTO_TEST_CASE(changes_realtime_finer_short)
+{
+    changes_realtime(RubberBandStretcher::OptionEngineFiner |
+                     RubberBandStretcher::OptionPitchHighConsistency |
+                     RubberBandStretcher::OptionWindowShort,
+                     "finer, short window");
+}
+
+// With OptionThreadingRealTime, R2 shares the per-channel work with
+// worker threads and R3 analyses the next hop on a separate thread.
+// Only the calling thread is checked, and it must neither lock nor
+// wait in handing work to them
+
+BOOST_AUTO_TEST_CASE(changes_realtime_faster_workers)
+{
+    changes_realtime(RubberBandStretcher::OptionEngineFaster |
+                     RubberBandStretcher::OptionThreadingRealTime |
+                     RubberBandStretcher::OptionThreadingAlways,
+                     "faster, channel workers");
+}
+
+BOOST_AUTO_TEST_CASE(changes_realtime_finer_pipelined)
+{
+    changes_realtime(RubberBandStretcher::OptionEngineFiner |
+                     RubberBandStretcher::OptionPitchHighConsistency |
+                     RubberBandStretcher::OptionThreadingRealTime |
+                     RubberBandStretcher::OptionThreadingAlways,
+                     "finer, pipelined analysis");
+}
+
+BOOST_AUTO_TEST_CASE(changes_realtime_faster_deferred_log)
+{
+    changes_realtime(RubberBandStretcher::OptionEngineFaster |
+                     RubberBandStretcher::OptionLogDeferred,
+                     "faster, deferred log at debug level 2",
+                     std::make_shared<CountingLogger>(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(changes_realtime_finer_deferred_log)
+{
+    changes_realtime(RubberBandStretcher::OptionEngineFiner |
+                     RubberBandStretcher::OptionPitchHighConsistency |
+                     RubberBandStretcher::OptionLogDeferred,
+                     "finer, deferred log at debug level 2",
+                     std::make_shared<CountingLogger>(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(changes_realtime_finer_traced)
+{
+    // Trace recording claims only memory that startTrace allocated
+
+    RubberBandStretcher::startTrace();
+    changes_realtime(RubberBandStretcher::OptionEngineFiner |
+                     RubberBandStretcher::OptionPitchHighConsistency,
+                     "finer, traced");
+    RubberBandStretcher::stopTrace("");
+}
+
+BOOST_AUTO_TEST_CASE(deferred_log_overflow)
+{
+    // Messages beyond the queue capacity are dropped, and reported
+    // after the rest at the next drain
+
+    int count0 = 0, count1 = 0, count2 = 0;
+    double lastArg = 0.0;
+    Log log([&](const char *) { ++count0; },
+            [&](const char *, double arg) { ++count1; lastArg = arg; },
+            [&](const char *, double, double) { ++count2; });
+    log.setDebugLevel(1);
+
+    Log deferred = log.deferred(8);
+    BOOST_TEST(deferred.isDeferred());
+    BOOST_TEST(!log.isDeferred());
+
+    Log copy(deferred);
+    for (int i = 0; i < 10; ++i) {
+        deferred.log(1, "message");
+        copy.log(1, "message");
+    }
+    deferred.log(2, "above debug level");
+    BOOST_TEST(count0 == 0);
+
+    BOOST_TEST(deferred.drain() == 8);
+    BOOST_TEST(count0 == 8);
+    BOOST_TEST(count1 == 1);
+    BOOST_TEST(lastArg == 12.0);
+
+    BOOST_TEST(copy.drain() == 0);
+    BOOST_TEST(count1 == 1);
+
+    deferred.log(1, "number", 3.0);
+    BOOST_TEST(copy.drain() == 1);
+    BOOST_TEST(lastArg == 3.0);
+    BOOST_TEST(count2 == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
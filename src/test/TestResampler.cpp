@@ -30,6 +30,8 @@
 
 #include <stdexcept>
 #include <vector>
+#include <set>
+#include <string>
 #include <cmath>
 #include <iostream>
 
@@ -216,5 +218,58 @@ BOOST_AUTO_TEST_CASE(overrun_interleaved)
     }
 }
 
+BOOST_AUTO_TEST_CASE(implementation_selection)
+{
+    set<string> impls = Resampler::getImplementations();
+    BOOST_TEST(!impls.empty());
+
+    for (auto impl : impls) {
+        Resampler r(Resampler::Parameters(), 1, impl);
+        BOOST_TEST(r.getImplementation() == impl);
+
+        Resampler::setDefaultImplementation(impl);
+        BOOST_TEST(Resampler::getDefaultImplementation() == impl);
+        Resampler rd(Resampler::Parameters(), 1);
+        BOOST_TEST(rd.getImplementation() == impl);
+
+        // An unknown name leaves the default alone
+        Resampler::setDefaultImplementation("no-such-resampler");
+        BOOST_TEST(Resampler::getDefaultImplementation() == impl);
+    }
+
+    Resampler::setDefaultImplementation("");
+    BOOST_TEST(Resampler::getDefaultImplementation() == "");
+
+    Resampler r(Resampler::Parameters(), 1, "no-such-resampler");
+    BOOST_TEST(impls.count(r.getImplementation()) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(implementation_measurement)
+{
+    Resampler::Parameters params;
+    params.quality = Resampler::Best;
+    vector<double> ratios { 0.5, 1.5 };
+    vector<int> blockSizes { 512 };
+    
+    vector<Resampler::Measurement> mm =
+        Resampler::measureImplementations(params, ratios, blockSizes);
+
+    set<string> impls = Resampler::getImplementations();
+    BOOST_TEST(mm.size() == impls.size() * ratios.size() * blockSizes.size());
+
+    for (const auto &m : mm) {
+        BOOST_TEST_MESSAGE(m.implementation << " at ratio " << m.ratio
+                           << ": " << m.framesPerSecond << " frames/sec, "
+                           << m.aliasing << " dB");
+        BOOST_TEST(impls.count(m.implementation) == 1);
+        BOOST_TEST(m.framesPerSecond > 0.0);
+        BOOST_TEST(m.aliasing < -40.0);
+    }
+
+    string chosen = Resampler::chooseImplementation(mm, -40.0);
+    BOOST_TEST(impls.count(chosen) == 1);
+    BOOST_TEST(Resampler::chooseImplementation(mm, -200.0) == "");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -29,6 +29,8 @@
 #include "../common/StretchCalculator.h"
 
 #include <iostream>
+#include <chrono>
+#include <cstdlib>
 
 using namespace RubberBand;
 using namespace std;
@@ -46,6 +48,48 @@ static Log cerrLog(
     }
     );
 
+// Detection function with decaying onsets of random strength at
+// random intervals, over a low noise floor
+static vector<float> onset_df(size_t n)
+{
+    vector<float> df(n, 0.f);
+    unsigned int seed = 1;
+    auto rnd = [&]() {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) & 0x7fff;
+    };
+    float level = 0.05f;
+    for (size_t i = 0; i < n; ++i) {
+        if (rnd() % 40 == 0) level = float(rnd() % 1000) / 1000.f;
+        level *= 0.9f;
+        df[i] = level + float(rnd() % 100) / 2000.f;
+    }
+    return df;
+}
+
+static map<size_t, size_t> key_frames(size_t inputDuration, size_t spacing,
+                                      double ratio)
+{
+    map<size_t, size_t> mapping;
+    for (size_t i = 1; i * spacing < inputDuration; ++i) {
+        mapping[i * spacing + (i * 37) % 100] = size_t(i * spacing * ratio);
+    }
+    return mapping;
+}
+
+// Calculator that divides the detection function into segments much
+// shorter than the default, so that the segment boundaries can be
+// tested with modest inputs
+class SegmentedStretchCalculator : public StretchCalculator
+{
+public:
+    SegmentedStretchCalculator(size_t sampleRate, size_t inputIncrement,
+                               bool useHardPeaks, size_t segmentLength) :
+        StretchCalculator(sampleRate, inputIncrement, useHardPeaks, cerrLog) {
+        m_segmentLength = segmentLength;
+    }
+};
+
 BOOST_AUTO_TEST_SUITE(TestStretchCalculator)
 
 BOOST_AUTO_TEST_CASE(offline_linear_hp)
@@ -124,5 +168,91 @@ BOOST_AUTO_TEST_CASE(offline_onep_nohp)
     BOOST_TEST(out == expected, tt::per_element());
 }
 
+BOOST_AUTO_TEST_CASE(offline_segmented)
+{
+    // Splitting the analysis into segments must not change the
+    // peaks or the increments in any way, with either an odd or an
+    // even median window length (44100 and 48000 at increment 256)
+    // and with or without key frames
+
+    size_t n = 20000, increment = 256;
+    vector<float> df = onset_df(n);
+    double ratio = 1.5;
+    
+    for (size_t rate : { 44100, 48000 }) {
+        for (bool hp : { true, false }) {
+            for (bool kf : { false, true }) {
+                StretchCalculator sc(rate, increment, hp, cerrLog);
+                if (kf) {
+                    sc.setKeyFrameMap(key_frames(n * increment, 3000, ratio));
+                }
+                vector<int> expected = sc.calculate(ratio, n * increment, df);
+                auto expectedPeaks = sc.getLastCalculatedPeaks();
+                BOOST_TEST(expectedPeaks.size() > 100);
+                
+                for (size_t segment : { 1000, 3333, 7 }) {
+                    SegmentedStretchCalculator ssc(rate, increment, hp, segment);
+                    if (kf) {
+                        ssc.setKeyFrameMap(key_frames(n * increment, 3000, ratio));
+                    }
+                    vector<int> out = ssc.calculate(ratio, n * increment, df);
+                    BOOST_TEST(out == expected, tt::per_element());
+                    auto peaks = ssc.getLastCalculatedPeaks();
+                    BOOST_TEST(peaks.size() == expectedPeaks.size());
+                    for (size_t i = 0;
+                         i < peaks.size() && i < expectedPeaks.size(); ++i) {
+                        BOOST_TEST(peaks[i].chunk == expectedPeaks[i].chunk);
+                        BOOST_TEST(peaks[i].hard == expectedPeaks[i].hard);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Disabled by default: its purpose is to report how the calculation
+// cost grows with input length, and its one check relies on
+// wall-clock times staying in proportion across several input sizes,
+// which is more than a shared build machine can promise. Run it with
+// --run_test=TestStretchCalculator/offline_scaling
+
+BOOST_AUTO_TEST_CASE(offline_scaling, *boost::unit_test::disabled())
+{
+    // Benchmark the offline calculation with a key frame every half
+    // second, from about six minutes up to about an hour and a half
+    // of input at 44.1kHz, and check that the time taken grows no
+    // faster than the input length
+
+    size_t rate = 44100, increment = 256;
+    double ratio = 1.5;
+    vector<size_t> sizes { 1 << 16, 1 << 18, 1 << 20 };
+    vector<double> times;
+    
+    for (size_t n : sizes) {
+        vector<float> df = onset_df(n);
+        double best = 0.0;
+        for (int i = 0; i < 3; ++i) {
+            StretchCalculator sc(rate, increment, true, cerrLog);
+            sc.setKeyFrameMap(key_frames(n * increment, rate / 2, ratio));
+            auto start = std::chrono::steady_clock::now();
+            vector<int> out = sc.calculate(ratio, n * increment, df);
+            auto end = std::chrono::steady_clock::now();
+            BOOST_TEST(out.size() == n);
+            double t = std::chrono::duration<double>(end - start).count();
+            if (i == 0 || t < best) best = t;
+        }
+        BOOST_TEST_MESSAGE("offline calculation for " << n << " chunks: "
+                           << best << " sec, "
+                           << best * 1.0e9 / double(n) << " ns per chunk");
+        times.push_back(best);
+    }
+
+    // Per-chunk time at the largest size should be close to that at
+    // the smallest; allow plenty for timing noise and cache effects
+    double perChunkSmall = times[0] / double(sizes[0]);
+    double perChunkLarge = times[times.size()-1] / double(sizes[sizes.size()-1]);
+    BOOST_TEST(perChunkLarge < perChunkSmall * 3.0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
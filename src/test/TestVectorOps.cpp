@@ -27,9 +27,11 @@
 #include <boost/test/unit_test.hpp>
 
 #include "../common/VectorOps.h"
+#include "../common/FloatGuards.h"
 
 #include <stdexcept>
 #include <vector>
+#include <limits>
 
 using namespace RubberBand;
 
@@ -247,5 +249,55 @@ BOOST_AUTO_TEST_CASE(fftshift)
     COMPARE_N(a, e, 4);
 }
 
+BOOST_AUTO_TEST_CASE(multiply_and_fftshift)
+{
+    float a[] = { 0.125f, 2.0f, -0.25f, 4.0f };
+    float w[] = { 1.0f, 0.5f, 2.0f, -1.0f };
+    double o[4];
+    double e[] = { -0.5, -4.0, 0.125, 1.0 };
+    v_multiply_and_fftshift(o, a, w, 4);
+    COMPARE_N(o, e, 4);
+    v_multiply_and_fftshift(a, w, 4);
+    COMPARE_N(a, e, 4);
+}
+
+BOOST_AUTO_TEST_CASE(fftshift_multiply_and_add)
+{
+    double a[] = { 0.125, 2.0, -0.25, 4.0 };
+    float w[] = { 1.0f, 0.5f, 2.0f, -1.0f };
+    float o[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float s[] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float eo[] = { 0.75f, 3.0f, 1.25f, -1.0f };
+    float es[] = { 2.0f, 2.0f, 6.0f, 1.0f };
+    v_fftshift_multiply_and_add(o, s, a, w, 2.0f, 4);
+    for (int i = 0; i < 4; ++i) {
+        BOOST_TEST(o[i] == eo[i]);
+        BOOST_TEST(s[i] == es[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(finite_check)
+{
+    std::vector<float> v(37, 0.25f);
+    BOOST_TEST(v_all_finite(v.data(), 37));
+    BOOST_TEST(v_all_finite(v.data(), 0));
+
+    std::vector<float> w(37, 1.f);
+    for (int i : { 0, 5, 33, 36 }) {
+        std::vector<float> u(v);
+        u[i] = std::numeric_limits<float>::quiet_NaN();
+        BOOST_TEST(!v_all_finite(u.data(), 37));
+        u[i] = -std::numeric_limits<float>::infinity();
+        BOOST_TEST(!v_all_finite(u.data(), 37));
+        u[i] = std::numeric_limits<float>::denorm_min();
+        BOOST_TEST(v_all_finite(u.data(), 37));
+        u[i] = std::numeric_limits<float>::infinity();
+        v_copy_finite(w.data(), u.data(), 37);
+        BOOST_TEST(w[i] == 0.f);
+        BOOST_TEST(v_all_finite(w.data(), 37));
+        BOOST_TEST(w[(i + 1) % 37] == 0.25f);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 